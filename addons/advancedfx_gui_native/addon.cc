@@ -1,120 +1,641 @@
 #include <napi.h>
 
-#include <queue>
-#include <atomic>
+#include "pipe_core.h"
+#include "json_rpc.h"
+#include "json_rpc_multiplexer.h"
+#include "msgpack.h"
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+Napi::Value JsonToNapi(Napi::Env env, const CJsonValue & value) {
+  switch(value.type) {
+  case CJsonValue::Type_False:
+    return Napi::Boolean::New(env, false);
+  case CJsonValue::Type_True:
+    return Napi::Boolean::New(env, true);
+  case CJsonValue::Type_Number:
+    return Napi::Number::New(env, value.number);
+  case CJsonValue::Type_String:
+    return Napi::String::New(env, value.string);
+  case CJsonValue::Type_Array: {
+      Napi::Array array = Napi::Array::New(env, value.values.size());
+      for(size_t i = 0; i < value.values.size(); i++) {
+        array.Set((uint32_t)i, JsonToNapi(env, value.values[i]));
+      }
+      return array;
+    }
+  case CJsonValue::Type_Object: {
+      Napi::Object object = Napi::Object::New(env);
+      for(size_t i = 0; i < value.values.size(); i++) {
+        object.Set(value.keys[i], JsonToNapi(env, value.values[i]));
+      }
+      return object;
+    }
+  default:
+    return env.Null();
+  }
+}
 
-#include <windows.h>
+// Serializes like JSON.stringify, except that toJSON is not supported.
+// Returns false if value is not serializable (undefined, Function, Symbol)
+// and nothing was appended.
+bool AppendNapiJson(Napi::Env env, std::string & out, Napi::Value value, int depth = 0) {
+  switch(value.Type()) {
+  case napi_null:
+    out += "null";
+    return true;
+  case napi_boolean:
+    out += value.As<Napi::Boolean>().Value() ? "true" : "false";
+    return true;
+  case napi_number:
+    AppendJsonNumber(out, value.As<Napi::Number>().DoubleValue());
+    return true;
+  case napi_string: {
+      std::string str = value.As<Napi::String>().Utf8Value();
+      AppendJsonString(out, str.data(), str.size());
+    }
+    return true;
+  case napi_object:
+    break;
+  default:
+    return false;
+  }
 
-class CThreadedQueue {
-  typedef std::function<void(void)> fp_t;
+  if(256 <= depth) {
+    Napi::Error::New(env, "Value nested too deep (cyclic?)").ThrowAsJavaScriptException();
+    return false;
+  }
 
- public:
-  CThreadedQueue();
-  ~CThreadedQueue();
+  if(value.IsArray()) {
+    Napi::Array array = value.As<Napi::Array>();
+    uint32_t length = array.Length();
+    out += '[';
+    for(uint32_t i = 0; i < length; i++) {
+      if(i) out += ',';
+      if(!AppendNapiJson(env, out, array.Get(i), depth + 1)) {
+        if(env.IsExceptionPending()) return false;
+        out += "null";
+      }
+    }
+    out += ']';
+    return true;
+  }
+
+  Napi::Object object = value.As<Napi::Object>();
+  napi_value keysValue;
+  if(napi_ok != napi_get_all_property_names(env, object, napi_key_own_only,
+      static_cast<napi_key_filter>(napi_key_enumerable | napi_key_skip_symbols), napi_key_numbers_to_strings, &keysValue)) {
+    return false;
+  }
+  Napi::Array keys(env, keysValue);
+  uint32_t length = keys.Length();
+  out += '{';
+  bool bFirst = true;
+  for(uint32_t i = 0; i < length; i++) {
+    Napi::Value key = keys.Get(i);
+    size_t memberStart = out.size();
+    if(!bFirst) out += ',';
+    std::string keyStr = key.As<Napi::String>().Utf8Value();
+    AppendJsonString(out, keyStr.data(), keyStr.size());
+    out += ':';
+    if(AppendNapiJson(env, out, object.Get(key), depth + 1)) {
+      bFirst = false;
+    } else {
+      if(env.IsExceptionPending()) return false;
+      out.resize(memberStart);
+    }
+  }
+  out += '}';
+  return true;
+}
+
+// Same rules as AppendNapiJson, but builds a DOM (for non JSON encodings).
+bool NapiToJsonValue(Napi::Env env, CJsonValue & outValue, Napi::Value value, int depth = 0) {
+  switch(value.Type()) {
+  case napi_null:
+    outValue.type = CJsonValue::Type_Null;
+    return true;
+  case napi_boolean:
+    outValue.type = value.As<Napi::Boolean>().Value() ? CJsonValue::Type_True : CJsonValue::Type_False;
+    return true;
+  case napi_number:
+    outValue.type = CJsonValue::Type_Number;
+    outValue.number = value.As<Napi::Number>().DoubleValue();
+    return true;
+  case napi_string:
+    outValue.type = CJsonValue::Type_String;
+    outValue.string = value.As<Napi::String>().Utf8Value();
+    return true;
+  case napi_object:
+    break;
+  default:
+    return false;
+  }
+
+  if(256 <= depth) {
+    Napi::Error::New(env, "Value nested too deep (cyclic?)").ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if(value.IsArray()) {
+    Napi::Array array = value.As<Napi::Array>();
+    uint32_t length = array.Length();
+    outValue.type = CJsonValue::Type_Array;
+    outValue.values.resize(length);
+    for(uint32_t i = 0; i < length; i++) {
+      if(!NapiToJsonValue(env, outValue.values[i], array.Get(i), depth + 1)) {
+        if(env.IsExceptionPending()) return false;
+        outValue.values[i].type = CJsonValue::Type_Null;
+      }
+    }
+    return true;
+  }
+
+  Napi::Object object = value.As<Napi::Object>();
+  napi_value keysValue;
+  if(napi_ok != napi_get_all_property_names(env, object, napi_key_own_only,
+      static_cast<napi_key_filter>(napi_key_enumerable | napi_key_skip_symbols), napi_key_numbers_to_strings, &keysValue)) {
+    return false;
+  }
+  Napi::Array keys(env, keysValue);
+  uint32_t length = keys.Length();
+  outValue.type = CJsonValue::Type_Object;
+  for(uint32_t i = 0; i < length; i++) {
+    Napi::Value key = keys.Get(i);
+    CJsonValue member;
+    if(NapiToJsonValue(env, member, object.Get(key), depth + 1)) {
+      outValue.keys.push_back(key.As<Napi::String>().Utf8Value());
+      outValue.values.push_back(std::move(member));
+    } else if(env.IsExceptionPending()) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  void SignalQuit();
-  bool HasQuit();
-  void Join();
+struct PipeCompletion {
+  PipeCompletion(const Napi::Promise::Deferred& deferred, Napi::ObjectReference * keepAlive = nullptr)
+  : deferred(deferred), keepAlive(keepAlive) {
+  }
 
-  void Queue(const fp_t& op);
-  void Queue(fp_t&& op);
+  // For operations issued natively: onComplete(env, ok) is called instead of
+  // settling a promise.
+  PipeCompletion(Napi::Env env, std::function<void(Napi::Env, bool)> && onComplete)
+  : deferred(Napi::Promise::Deferred::New(env)), keepAlive(nullptr), onComplete(std::move(onComplete)) {
+  }
 
-  void SetFinalizer(const fp_t& finalizer);
-  void SetFinalizer(fp_t&& finalizer);
+  Napi::Promise::Deferred deferred;
+  Napi::ObjectReference * keepAlive;
+  std::function<void(Napi::Env, bool)> onComplete;
+  bool ok = false;
+  bool hasString = false;
+  std::string str;
+  bool hasBuffer = false;
+  bool bBufferAsString = false; // Resolve with a String instead of a Buffer.
+  unsigned char * bufferData = nullptr; // From CPipeBuffer::Detach, owned until delivered.
+  size_t bufferSize = 0;
+};
 
-  CThreadedQueue(const CThreadedQueue& rhs) = delete;
-  CThreadedQueue& operator=(const CThreadedQueue& rhs) = delete;
-  CThreadedQueue(CThreadedQueue&& rhs) = delete;
-  CThreadedQueue& operator=(CThreadedQueue&& rhs) = delete;
+// Takes ownership of pData (from CPipeBuffer::Detach). Buffers are handed to
+// JS without a copy, unless the runtime does not allow external buffers (V8
+// sandbox, e.g. Electron 21+).
+Napi::Value PipeBufferToNapi(Napi::Env env, unsigned char * pData, size_t size, bool bAsString) {
+  if(bAsString) {
+    Napi::String str = Napi::String::New(env, reinterpret_cast<const char *>(pData), size);
+    CPipeBufferPool::ReleaseData(pData);
+    return str;
+  }
 
-  std::thread::native_handle_type GetNativeThreadHandle(){
-    return m_Thread.native_handle();
+  napi_value value;
+  if(napi_ok == napi_create_external_buffer(env, size, pData, [](napi_env env, void * data, void * hint){
+      CPipeBufferPool::ReleaseData(static_cast<unsigned char *>(data));
+    }, nullptr, &value)) {
+    return Napi::Value(env, value);
   }
 
+  Napi::Buffer<unsigned char> buffer = Napi::Buffer<unsigned char>::Copy(env, pData, size);
+  CPipeBufferPool::ReleaseData(pData);
+  return buffer;
+}
+
+// One long-lived ThreadSafeFunction per pipe. The worker posts completion
+// records and only signals the JS thread when the list was empty, so a burst
+// of completions is delivered in one call.
+// The channel is owned by its ThreadSafeFunction and deletes itself once that
+// is released and drained.
+class CPipeCompletionChannel {
+ public:
+  CPipeCompletionChannel(Napi::Env env, const char * name);
+
+  // JS thread: keeps the event loop alive while operations are outstanding.
+  void AddPending(Napi::Env env);
+
+  // Any thread.
+  void Post(PipeCompletion&& completion, bool ok);
+  void Post(PipeCompletion&& completion, bool ok, std::string&& str);
+  void Post(PipeCompletion&& completion, bool ok, CPipeBuffer&& buffer);
+  void PostFrames(std::vector<std::string>&& frames);
+
+  // JS thread: frames from PostFrames are passed to onFrame one by one, then
+  // onDelivered is called with the number of frames delivered.
+  // With parseJsonRpc frames are parsed as JSON-RPC requests by the posting
+  // thread and onFrame is called with (error, method, params, id).
+  void SetFrameHandler(Napi::Function onFrame, std::function<void(size_t)> && onDelivered, bool parseJsonRpc);
+
+  // JS thread: like SetFrameHandler, but frames are parsed as JSON-RPC
+  // responses by the posting thread and passed to onResponse.
+  void SetResponseHandler(std::function<void(Napi::Env, CJsonRpcResponse &&)> && onResponse, std::function<void(size_t)> && onDelivered);
+
+  // JS thread, before frames are posted: frames not delivered yet are kept
+  // in a queue with policy and limit. onDelivered is then also called, on
+  // the posting thread, for frames dropped or merged away.
+  // With Coalesce, consecutive JSON-RPC requests with the same key (method,
+  // or method.type for requests whose first parameter has a string member
+  // type, e.g. SendMouseInputEvent.mouseMove) that is in coalesceKeys are
+  // merged into the latest one. Requests with an id that are dropped or
+  // merged are delivered as errors, so they can be answered.
+  // With maxInFlight (0 for no limit) at most that many frames are passed to
+  // onFrame until they are acknowledged with AckDelivered.
+  void SetQueue(BoundedQueuePolicy_e policy, size_t limit, std::vector<std::string> && coalesceKeys, size_t maxInFlight, CPipeStats * pStats);
+
+  // JS thread.
+  void AckDelivered(size_t count);
+
+  // JS thread.
+  void Drain(Napi::Env env);
+
+  // JS thread: delivers what is left and releases the channel.
+  void Release(Napi::Env env);
+
  private:
+  Napi::ThreadSafeFunction m_Tsfn;
   std::mutex m_Lock;
-  std::thread m_Thread;
-  std::queue<fp_t> m_Queue;
-  std::condition_variable m_Cv;
-  bool m_Quit = false;
-  std::atomic_bool m_HasQuit = false;
-
-  void Init(void);
-  void QueueThreadHandler(void);
+  std::vector<PipeCompletion> m_Completions;
+  std::vector<PipeCompletion> m_Delivering; // Only used by JS thread.
+  CBoundedQueue<std::string> m_Frames;
+  std::vector<std::string> m_DeliveringFrames; // Only used by JS thread.
+  bool m_ParseJsonRpc = false;
+  CBoundedQueue<CJsonRpcRequest> m_Requests;
+  std::vector<CJsonRpcRequest> m_Rejected; // Dropped or merged requests to answer.
+  std::vector<CJsonRpcRequest> m_DeliveringRequests; // Only used by JS thread.
+  std::vector<std::string> m_CoalesceKeys;
+  size_t m_MaxInFlight = 0;
+  size_t m_InFlight = 0;
+  bool m_ParseJsonRpcResponses = false;
+  std::vector<CJsonRpcResponse> m_Responses;
+  std::vector<CJsonRpcResponse> m_DeliveringResponses; // Only used by JS thread.
+  Napi::FunctionReference m_OnFrame; // Only used by JS thread.
+  std::function<void(Napi::Env, CJsonRpcResponse &&)> m_OnResponse; // Only used by JS thread.
+  std::function<void(size_t)> m_OnDelivered;
+  size_t m_Outstanding = 0; // Only used by JS thread.
+
+  void Post(PipeCompletion&& completion);
+  void Signal();
+  uint64_t GetCoalesceKey(const CJsonRpcRequest & request);
+
+  // Requires m_Lock.
+  bool IsEmpty() {
+    bool bWindowFull = 0 != m_MaxInFlight && m_MaxInFlight <= m_InFlight;
+    return m_Completions.empty() && m_Responses.empty()
+      && (bWindowFull || (m_Frames.IsEmpty() && m_Requests.IsEmpty() && m_Rejected.empty()));
+  }
 };
 
+CPipeCompletionChannel::CPipeCompletionChannel(Napi::Env env, const char * name) {
+  m_Tsfn = Napi::ThreadSafeFunction::New(
+      env,
+      Napi::Function::Function(), // JavaScript function called asynchronously
+      name, // Name
+      0, // Unlimited queue, but Signal keeps at most one call in it
+      1, // 1 thread initially
+      this,
+      [](Napi::Env env, CPipeCompletionChannel* context) {
+        delete context;
+      }
+  );
+  m_Tsfn.Unref(env);
+}
 
-CThreadedQueue::CThreadedQueue() {
-  m_Thread = std::thread(&CThreadedQueue::QueueThreadHandler, this);
+void CPipeCompletionChannel::AddPending(Napi::Env env) {
+  if(0 == m_Outstanding++) m_Tsfn.Ref(env);
 }
 
-CThreadedQueue::~CThreadedQueue() {
-  Join();
+void CPipeCompletionChannel::Post(PipeCompletion&& completion, bool ok) {
+  completion.ok = ok;
+  Post(std::move(completion));
 }
 
-void CThreadedQueue::SignalQuit() {
-  m_Quit = true;
-  m_Cv.notify_one();
+void CPipeCompletionChannel::Post(PipeCompletion&& completion, bool ok, std::string&& str) {
+  completion.ok = ok;
+  completion.hasString = true;
+  completion.str = std::move(str);
+  Post(std::move(completion));
 }
 
-bool CThreadedQueue::HasQuit() {
-  return m_HasQuit;
+void CPipeCompletionChannel::Post(PipeCompletion&& completion, bool ok, CPipeBuffer&& buffer) {
+  completion.ok = ok;
+  completion.hasBuffer = true;
+  completion.bufferSize = buffer.GetSize();
+  completion.bufferData = buffer.Detach();
+  Post(std::move(completion));
 }
 
-void CThreadedQueue::Join() {
-  if (m_Thread.joinable()) {
-    m_Thread.join();
-  }  
+void CPipeCompletionChannel::Post(PipeCompletion&& completion) {
+  bool bSignal;
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    bSignal = IsEmpty();
+    m_Completions.push_back(std::move(completion));
+  }
+  if(bSignal) Signal();
 }
 
-void CThreadedQueue::Queue(const fp_t& op) {
+void CPipeCompletionChannel::PostFrames(std::vector<std::string>&& frames) {
+  if(m_ParseJsonRpc) {
+    std::vector<CJsonRpcRequest> requests(frames.size());
+    for(size_t i = 0; i < frames.size(); i++) {
+      ParseJsonRpcRequest(frames[i].data(), frames[i].size(), requests[i]);
+    }
 
-  std::unique_lock<std::mutex> lock(m_Lock);
-  m_Queue.push(op);
+    bool bSignal;
+    size_t removed = 0;
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      bSignal = IsEmpty();
+      for(auto & request : requests) {
+        uint64_t key = GetCoalesceKey(request);
+        m_Requests.Push(std::move(request), key, [this,&removed](CJsonRpcRequest && request, bool bMerged){
+          ++removed;
+          if(!request.hasId) return;
+          request.valid = false;
+          request.errorCode = bMerged ? JsonRpcError_Merged : JsonRpcError_Dropped;
+          request.errorMessage = bMerged ? "Merged into a later request" : "Dropped by queue policy";
+          m_Rejected.push_back(std::move(request));
+        });
+      }
+      bSignal = bSignal && !IsEmpty();
+    }
+    if(0 < removed && m_OnDelivered) m_OnDelivered(removed);
+    if(bSignal) Signal();
+    return;
+  }
+
+  if(m_ParseJsonRpcResponses) {
+    std::vector<CJsonRpcResponse> responses(frames.size());
+    for(size_t i = 0; i < frames.size(); i++) {
+      ParseJsonRpcResponse(frames[i].data(), frames[i].size(), responses[i]);
+    }
+
+    bool bSignal;
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      bSignal = IsEmpty();
+      for(auto & response : responses) m_Responses.push_back(std::move(response));
+    }
+    if(bSignal) Signal();
+    return;
+  }
 
-  m_Cv.notify_one();
+  bool bSignal;
+  size_t removed = 0;
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    bSignal = IsEmpty();
+    for(auto & frame : frames) {
+      m_Frames.Push(std::move(frame), 0, [&removed](std::string && frame, bool bMerged){
+        ++removed;
+      });
+    }
+    bSignal = bSignal && !IsEmpty();
+  }
+  if(0 < removed && m_OnDelivered) m_OnDelivered(removed);
+  if(bSignal) Signal();
 }
 
-void CThreadedQueue::Queue(fp_t&& op) {
+void CPipeCompletionChannel::Signal() {
+  m_Tsfn.NonBlockingCall([this](Napi::Env env, Napi::Function jsCallback) {
+    if(nullptr == (napi_env)env) return;
+    Drain(env);
+  });
+}
 
-  std::unique_lock<std::mutex> lock(m_Lock);
-  m_Queue.push(std::move(op));
+void CPipeCompletionChannel::SetFrameHandler(Napi::Function onFrame, std::function<void(size_t)> && onDelivered, bool parseJsonRpc) {
+  m_OnFrame = Napi::Persistent(onFrame);
+  m_OnDelivered = std::move(onDelivered);
+  m_ParseJsonRpc = parseJsonRpc;
+}
 
-  m_Cv.notify_one();
+void CPipeCompletionChannel::SetResponseHandler(std::function<void(Napi::Env, CJsonRpcResponse &&)> && onResponse, std::function<void(size_t)> && onDelivered) {
+  m_OnResponse = std::move(onResponse);
+  m_OnDelivered = std::move(onDelivered);
+  m_ParseJsonRpcResponses = true;
 }
 
-void CThreadedQueue::QueueThreadHandler(void) {
+void CPipeCompletionChannel::SetQueue(BoundedQueuePolicy_e policy, size_t limit, std::vector<std::string> && coalesceKeys, size_t maxInFlight, CPipeStats * pStats) {
   std::unique_lock<std::mutex> lock(m_Lock);
+  m_Frames.Configure(policy, limit, &pStats->dropped, &pStats->merged);
+  m_Requests.Configure(policy, limit, &pStats->dropped, &pStats->merged);
+  m_CoalesceKeys = std::move(coalesceKeys);
+  m_MaxInFlight = maxInFlight;
+}
+
+uint64_t CPipeCompletionChannel::GetCoalesceKey(const CJsonRpcRequest & request) {
+  if(!request.valid || m_CoalesceKeys.empty()) return 0;
+
+  std::string key = request.method;
+  if(CJsonValue::Type_Array == request.params.type && !request.params.values.empty()) {
+    const CJsonValue & first = request.params.values[0];
+    if(CJsonValue::Type_Object == first.type) {
+      for(size_t i = 0; i < first.keys.size(); i++) {
+        if("type" == first.keys[i] && CJsonValue::Type_String == first.values[i].type) {
+          key += "." + first.values[i].string;
+          break;
+        }
+      }
+    }
+  }
+
+  for(size_t i = 0; i < m_CoalesceKeys.size(); i++) {
+    if(key == m_CoalesceKeys[i]) return i + 1;
+  }
+  return 0;
+}
+
+void CPipeCompletionChannel::AckDelivered(size_t count) {
+  bool bSignal;
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    bSignal = IsEmpty();
+    m_InFlight -= count < m_InFlight ? count : m_InFlight;
+    bSignal = bSignal && !IsEmpty();
+  }
+  if(bSignal) Signal();
+}
 
-  do {
-    m_Cv.wait(lock, [this] { return (m_Queue.size() || m_Quit); });
+void CPipeCompletionChannel::Drain(Napi::Env env) {
+  size_t rejected; // Acknowledged when they were removed already.
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Delivering.swap(m_Completions);
+    m_DeliveringResponses.swap(m_Responses);
+
+    size_t budget = SIZE_MAX;
+    if(0 != m_MaxInFlight) budget = m_InFlight < m_MaxInFlight ? m_MaxInFlight - m_InFlight : 0;
+    rejected = std::min(budget, m_Rejected.size());
+    m_DeliveringRequests.insert(m_DeliveringRequests.end(), std::make_move_iterator(m_Rejected.begin()), std::make_move_iterator(m_Rejected.begin() + rejected));
+    m_Rejected.erase(m_Rejected.begin(), m_Rejected.begin() + rejected);
+    budget -= rejected;
+    while(0 < budget && !m_Requests.IsEmpty()) {
+      m_DeliveringRequests.push_back(m_Requests.PopFront());
+      --budget;
+    }
+    while(0 < budget && !m_Frames.IsEmpty()) {
+      m_DeliveringFrames.push_back(m_Frames.PopFront());
+      --budget;
+    }
+    if(0 != m_MaxInFlight) m_InFlight += m_DeliveringRequests.size() + m_DeliveringFrames.size();
+  }
 
-    if (m_Queue.size()) {
-      auto op = std::move(m_Queue.front());
-      m_Queue.pop();
+  Napi::HandleScope scope(env);
+
+  if(!m_DeliveringRequests.empty()) {
+    if(!m_OnFrame.IsEmpty()) {
+      for(auto & request : m_DeliveringRequests) {
+        Napi::Value error = env.Undefined();
+        if(!request.valid) {
+          Napi::Object errorObject = Napi::Object::New(env);
+          errorObject["code"] = Napi::Number::New(env, request.errorCode);
+          errorObject["message"] = Napi::String::New(env, request.errorMessage);
+          error = errorObject;
+        }
+        m_OnFrame.Call({
+          error,
+          Napi::String::New(env, request.method),
+          JsonToNapi(env, request.params),
+          request.hasId ? JsonToNapi(env, request.id) : env.Undefined()
+        });
+        if(env.IsExceptionPending()) {
+          Napi::Error exception = env.GetAndClearPendingException();
+          napi_fatal_exception(env, exception.Value());
+        }
+      }
+    }
+    if(m_OnDelivered && rejected < m_DeliveringRequests.size()) m_OnDelivered(m_DeliveringRequests.size() - rejected);
+    m_DeliveringRequests.clear();
+  }
 
-      lock.unlock();
+  if(!m_DeliveringResponses.empty()) {
+    if(m_OnResponse) {
+      for(auto & response : m_DeliveringResponses) {
+        m_OnResponse(env, std::move(response));
+        if(env.IsExceptionPending()) {
+          Napi::Error exception = env.GetAndClearPendingException();
+          napi_fatal_exception(env, exception.Value());
+        }
+      }
+    }
+    if(m_OnDelivered) m_OnDelivered(m_DeliveringResponses.size());
+    m_DeliveringResponses.clear();
+  }
 
-      op();
+  if(!m_DeliveringFrames.empty()) {
+    if(!m_OnFrame.IsEmpty()) {
+      for(auto & frame : m_DeliveringFrames) {
+        m_OnFrame.Call({Napi::String::New(env, frame)});
+        if(env.IsExceptionPending()) {
+          Napi::Error error = env.GetAndClearPendingException();
+          napi_fatal_exception(env, error.Value());
+        }
+      }
+    }
+    if(m_OnDelivered) m_OnDelivered(m_DeliveringFrames.size());
+    m_DeliveringFrames.clear();
+  }
 
-      lock.lock();
+  for(auto & completion : m_Delivering) {
+    if(completion.keepAlive) {
+      delete completion.keepAlive;
     }
-  } while (!m_Quit || m_Queue.size());
+    if(completion.onComplete) {
+      completion.onComplete(env, completion.ok);
+      if(env.IsExceptionPending()) {
+        Napi::Error exception = env.GetAndClearPendingException();
+        napi_fatal_exception(env, exception.Value());
+      }
+    } else if(!completion.ok) {
+      completion.deferred.Reject(env.Undefined());
+    } else if(completion.hasString) {
+      completion.deferred.Resolve(Napi::String::New(env, completion.str));
+    } else if(completion.hasBuffer) {
+      completion.deferred.Resolve(PipeBufferToNapi(env, completion.bufferData, completion.bufferSize, completion.bBufferAsString));
+      completion.bufferData = nullptr;
+    } else {
+      completion.deferred.Resolve(env.Undefined());
+    }
+    if(completion.bufferData) CPipeBufferPool::ReleaseData(completion.bufferData);
+    if(0 < m_Outstanding && 0 == --m_Outstanding) m_Tsfn.Unref(env);
+  }
 
-  m_HasQuit = true;
+  m_Delivering.clear();
 }
 
-struct TsfnContext {
-  Napi::ThreadSafeFunction tsfn;
-  Napi::Value value;
+void CPipeCompletionChannel::Release(Napi::Env env) {
+  m_OnDelivered = nullptr; // The pipe is gone, nothing to acknowledge to.
+  Drain(env);
+  m_OnFrame.Reset();
+  m_OnResponse = nullptr;
+  if(0 < m_Outstanding) {
+    m_Outstanding = 0;
+    m_Tsfn.Unref(env);
+  }
+  m_Tsfn.Release();
+}
+
+class AnonymousPipe;
+class SharedTexture;
+
+// State of the addon per environment (the main thread and each worker load
+// it on their own), set by InitAll.
+struct AddonData {
+  Napi::FunctionReference pipeConstructor;
+  Napi::FunctionReference textureConstructor;
+  CPipeCompletionChannel * textureCreations = nullptr; // Deleted by its own thread safe function.
+  std::vector<AnonymousPipe *> openPipes;
+  std::vector<SharedTexture *> openTextures;
 };
 
+AddonData & GetAddonData(Napi::Env env) {
+  return *env.GetInstanceData<AddonData>();
+}
+
+// {count, mean, p50, p99, max} with nanoseconds converted to microseconds.
+Napi::Value StatHistogramToNapi(Napi::Env env, const CStatHistogram & histogram) {
+  StatHistogramSnapshot snapshot = histogram.GetSnapshot();
+  auto dict = Napi::Object::New(env);
+  dict["count"] = Napi::Number::New(env, (double)snapshot.count);
+  dict["mean"] = Napi::Number::New(env, snapshot.mean / 1000);
+  dict["p50"] = Napi::Number::New(env, snapshot.p50 / 1000.0);
+  dict["p99"] = Napi::Number::New(env, snapshot.p99 / 1000.0);
+  dict["max"] = Napi::Number::New(env, snapshot.max / 1000.0);
+  return dict;
+}
+
 class AnonymousPipe : public Napi::ObjectWrap<AnonymousPipe> {
+  friend class JsonRpcClient;
+
  public:
   static Napi::Object Init(Napi::Env env, Napi::Object exports);
   AnonymousPipe(const Napi::CallbackInfo& info);
   virtual void Finalize(Napi::Env env) override;
 
+  // Of all open pipes of env.
+  static Napi::Value GetAllStats(Napi::Env env);
+  static void ResetAllStats(Napi::Env env);
+
  private:
   Napi::Value Close(const Napi::CallbackInfo& info);
   Napi::Value NativeReadHandle(const Napi::CallbackInfo& info);
@@ -124,15 +645,33 @@ class AnonymousPipe : public Napi::ObjectWrap<AnonymousPipe> {
   Napi::Value ReadArrayBuffer(const Napi::CallbackInfo& info);
   Napi::Value WriteArrayBuffer(const Napi::CallbackInfo& info);
   Napi::Value ReadString(const Napi::CallbackInfo& info);
+  Napi::Value ReadBuffer(const Napi::CallbackInfo& info);
+  Napi::Value WriteBuffer(const Napi::CallbackInfo& info);
   Napi::Value WriteString(const Napi::CallbackInfo& info);
-
-  HANDLE m_ReadHandle = INVALID_HANDLE_VALUE;
-  HANDLE m_WriteHandle = INVALID_HANDLE_VALUE;
-
-  bool ReadBytes(void * pData, DWORD size);
-  bool WriteBytes(const void * pData, DWORD size);
-
-  CThreadedQueue * m_ThreadedQueue;
+  Napi::Value WriteStrings(const Napi::CallbackInfo& info);
+  Napi::Value StartReading(const Napi::CallbackInfo& info);
+  Napi::Value AckFrames(const Napi::CallbackInfo& info);
+  Napi::Value WriteJsonRpcResponse(const Napi::CallbackInfo& info);
+  Napi::Value WriteJsonRpcError(const Napi::CallbackInfo& info);
+  Napi::Value SetEncoding(const Napi::CallbackInfo& info);
+
+  template<class AppendFn> Napi::Value QueueWrite(Napi::Env env, AppendFn appendFn, bool bFramed = true);
+  Napi::Value QueueExternalWrite(Napi::Env env, Napi::Object owner, const void * pData, size_t size, bool bFramed);
+  Napi::Value QueueRead(Napi::Env env, bool bAsString);
+
+  static bool AppendStringFrame(Napi::Env env, std::vector<unsigned char> & buffer, Napi::Value value);
+  static Napi::Value NativeHandleToObject(Napi::Env env, int64_t handle);
+  static bool IsInstance(Napi::Value value);
+
+  typedef CPipeCore<PipeCompletion, CPipeCompletionChannel> PipeCore_t;
+
+  std::string m_Name;
+  PipeCore_t * m_PipeCore = nullptr;
+  CPipeCompletionChannel * m_Completions = nullptr;
+  int64_t m_NativeReadHandle = -1;
+  int64_t m_NativeWriteHandle = -1;
+  bool m_Reading = false;
+  JsonRpcEncoding_e m_Encoding = JsonRpcEncoding_Json;
 };
 
 Napi::Object AnonymousPipe::Init(Napi::Env env, Napi::Object exports) {
@@ -146,46 +685,107 @@ Napi::Object AnonymousPipe::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod("readArrayBuffer", &AnonymousPipe::ReadArrayBuffer),
         InstanceMethod("writeArrayBuffer", &AnonymousPipe::WriteArrayBuffer),
         InstanceMethod("readString", &AnonymousPipe::ReadString),
+        InstanceMethod("readBuffer", &AnonymousPipe::ReadBuffer),
+        InstanceMethod("writeBuffer", &AnonymousPipe::WriteBuffer),
         InstanceMethod("writeString", &AnonymousPipe::WriteString),
+        InstanceMethod("writeStrings", &AnonymousPipe::WriteStrings),
+        InstanceMethod("startReading", &AnonymousPipe::StartReading),
+        InstanceMethod("ackFrames", &AnonymousPipe::AckFrames),
+        InstanceMethod("writeJsonRpcResponse", &AnonymousPipe::WriteJsonRpcResponse),
+        InstanceMethod("writeJsonRpcError", &AnonymousPipe::WriteJsonRpcError),
+        InstanceMethod("setEncoding", &AnonymousPipe::SetEncoding),
     });
 
-  Napi::FunctionReference* constructor = new Napi::FunctionReference();
-  *constructor = Napi::Persistent(func);
-  env.SetInstanceData(constructor);
+  GetAddonData(env).pipeConstructor = Napi::Persistent(func);
 
   exports.Set("AnonymousPipe", func);
   return exports;
 }
 
+// new AnonymousPipe() or new AnonymousPipe({sharedMemory: true, capacity})
+// for a shared memory ring of capacity (power of two, default 1 MiB) bytes,
+// where both native handles are the section to attach to.
+// Option name labels the pipe in getStats().
+// Option localEnd 'read' or 'write' is the end this process uses, the other
+// one is opened for plain blocking I/O of another process (Windows), without
+// it both are opened for this process.
+// Option capture is a file path to record all messages read and written to
+// (see pipe_capture.h).
 AnonymousPipe::AnonymousPipe(const Napi::CallbackInfo& info)
     : Napi::ObjectWrap<AnonymousPipe>(info) {
 
+  bool bSharedMemory = false;
+  uint32_t capacity = 1024 * 1024;
+  PipeLocalEnd_e localEnd = PipeLocalEnd_Both;
+  std::string capturePath;
+
+  if(1 == info.Length() && info[0].IsObject()) {
+    Napi::Object options = info[0].As<Napi::Object>();
+    Napi::Value valSharedMemory = options.Get("sharedMemory");
+    Napi::Value valCapacity = options.Get("capacity");
+    Napi::Value valName = options.Get("name");
+    Napi::Value valCapture = options.Get("capture");
+    Napi::Value valLocalEnd = options.Get("localEnd");
+    if(valSharedMemory.IsBoolean()) bSharedMemory = valSharedMemory.As<Napi::Boolean>().Value();
+    if(valName.IsString()) m_Name = valName.As<Napi::String>().Utf8Value();
+    if(valCapacity.IsNumber()) capacity = valCapacity.As<Napi::Number>().Uint32Value();
+    if(valCapture.IsString()) capturePath = valCapture.As<Napi::String>().Utf8Value();
+    if(valLocalEnd.IsString()) {
+      std::string strLocalEnd = valLocalEnd.As<Napi::String>().Utf8Value();
+      if("read" == strLocalEnd) localEnd = PipeLocalEnd_Read;
+      else if("write" == strLocalEnd) localEnd = PipeLocalEnd_Write;
+      else {
+        Napi::Error::New(info.Env(), "localEnd must be 'read' or 'write'")
+            .ThrowAsJavaScriptException();
+        return;
+      }
+    }
+  }
+
+  CPipeCaptureWriter * capture = nullptr;
+  if(!capturePath.empty()) {
+    capture = CPipeCaptureWriter::Create(capturePath.c_str());
+    if(nullptr == capture) {
+      Napi::Error::New(info.Env(), "Creating capture failed: " + capturePath)
+          .ThrowAsJavaScriptException();
+      return;
+    }
+  }
 
-  SECURITY_ATTRIBUTES securityAttributes {
-    sizeof(SECURITY_ATTRIBUTES),
-    NULL,
-    TRUE
-  };
+  CPipeTransport * transport = bSharedMemory ? CPipeTransport::CreateSharedMemory(capacity) : CPipeTransport::Create(localEnd);
+  if(nullptr == transport) {
+    delete capture;
+    Napi::Error::New(info.Env(), "Creating pipe failed")
+        .ThrowAsJavaScriptException();
+    return;
+  }
 
-  CreatePipe(&m_ReadHandle, &m_WriteHandle, &securityAttributes, 0);
-  m_ThreadedQueue = new CThreadedQueue();
+  m_NativeReadHandle = transport->GetNativeReadHandle();
+  m_NativeWriteHandle = transport->GetNativeWriteHandle();
+
+  m_Completions = new CPipeCompletionChannel(info.Env(), "AnonymousPipe");
+  m_PipeCore = new PipeCore_t(transport, *m_Completions);
+  if(capture) m_PipeCore->SetCapture(capture);
+  GetAddonData(info.Env()).openPipes.push_back(this);
 }
 
 void AnonymousPipe::Finalize(Napi::Env env)
 {
-  if(m_ThreadedQueue) {
-    m_ThreadedQueue->SignalQuit();
-    while(!m_ThreadedQueue->HasQuit()) CancelSynchronousIo(m_ThreadedQueue->GetNativeThreadHandle());
-    delete m_ThreadedQueue;
-    m_ThreadedQueue = nullptr;
+  if(m_PipeCore) {
+    std::vector<AnonymousPipe *> & openPipes = GetAddonData(env).openPipes;
+    openPipes.erase(std::find(openPipes.begin(), openPipes.end(), this));
+    delete m_PipeCore;
+    m_PipeCore = nullptr;
+  }
+  if(m_Completions) {
+    m_Completions->Release(env);
+    m_Completions = nullptr;
   }
-  if(INVALID_HANDLE_VALUE != m_WriteHandle) { CloseHandle(m_WriteHandle); m_WriteHandle = INVALID_HANDLE_VALUE; }
-  if(INVALID_HANDLE_VALUE != m_ReadHandle) { CloseHandle(m_ReadHandle); m_ReadHandle = INVALID_HANDLE_VALUE; }
 }
 
 Napi::Value AnonymousPipe::Close(const Napi::CallbackInfo& info) {
 
-  if(!m_ThreadedQueue) {
+  if(!m_PipeCore) {
     Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
@@ -193,67 +793,91 @@ Napi::Value AnonymousPipe::Close(const Napi::CallbackInfo& info) {
 
   Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-  auto tsfnContext = new TsfnContext();
-
-  tsfnContext->tsfn = Napi::ThreadSafeFunction::New(
-      info.Env(),
-      Napi::Function::Function(), // JavaScript function called asynchronously
-      "AnonymousPipe::Close", // Name
-      0, // Unlimited queue
-      1, // 1 thread initially
-      tsfnContext,
-      [](Napi::Env env, TsfnContext* context) {
-        delete context;
-      }
-  );
-
-  m_ThreadedQueue->Queue([this,tsfnContext,deferred]{
-    tsfnContext->tsfn.BlockingCall([deferred](Napi::Env env, Napi::Function jsCallback) {
-      deferred.Resolve(env.Undefined());
-    });
+  m_Completions->AddPending(info.Env());
 
-    tsfnContext->tsfn.Release();
-  });
+  m_PipeCore->Close(PipeCompletion(deferred));
 
   Finalize(info.Env());
   
   return deferred.Promise();
 }
 
-Napi::Value AnonymousPipe::NativeReadHandle(const Napi::CallbackInfo& info) {
-  void* __ptr64 ptr = HandleToHandle64(this->m_ReadHandle);
-  auto dict = Napi::Object::New(info.Env());
-  dict["lo"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr & 0xFFFFFFFF));
-  dict["hi"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr >> 32));
+Napi::Value AnonymousPipe::GetAllStats(Napi::Env env) {
+  std::vector<AnonymousPipe *> & openPipes = GetAddonData(env).openPipes;
+  Napi::Array array = Napi::Array::New(env, openPipes.size());
+  for(size_t i = 0; i < openPipes.size(); i++) {
+    CPipeStats & stats = openPipes[i]->m_PipeCore->GetStats();
+    auto dict = Napi::Object::New(env);
+    dict["name"] = Napi::String::New(env, openPipes[i]->m_Name);
+    dict["queueDepth"] = Napi::Number::New(env, (double)stats.queueDepth.Get());
+    dict["bytesIn"] = Napi::Number::New(env, (double)stats.bytesIn.Get());
+    dict["bytesOut"] = Napi::Number::New(env, (double)stats.bytesOut.Get());
+    dict["bytesCopied"] = Napi::Number::New(env, (double)stats.bytesCopied.Get());
+    dict["messagesIn"] = Napi::Number::New(env, (double)stats.messagesIn.Get());
+    dict["messagesOut"] = Napi::Number::New(env, (double)stats.messagesOut.Get());
+    dict["dropped"] = Napi::Number::New(env, (double)stats.dropped.Get());
+    dict["merged"] = Napi::Number::New(env, (double)stats.merged.Get());
+    dict["readTime"] = StatHistogramToNapi(env, stats.readTime);
+    dict["writeTime"] = StatHistogramToNapi(env, stats.writeTime);
+    CPipeBufferPoolStats & bufferStats = openPipes[i]->m_PipeCore->GetBufferPoolStats();
+    auto buffers = Napi::Object::New(env);
+    buffers["acquired"] = Napi::Number::New(env, (double)bufferStats.acquired.Get());
+    buffers["reused"] = Napi::Number::New(env, (double)bufferStats.reused.Get());
+    buffers["allocations"] = Napi::Number::New(env, (double)bufferStats.allocations.Get());
+    buffers["allocatedBytes"] = Napi::Number::New(env, (double)bufferStats.allocatedBytes.Get());
+    buffers["inUse"] = Napi::Number::New(env, (double)bufferStats.inUse.Get());
+    dict["buffers"] = buffers;
+    array.Set((uint32_t)i, dict);
+  }
+  return array;
+}
+
+void AnonymousPipe::ResetAllStats(Napi::Env env) {
+  for(AnonymousPipe * pipe : GetAddonData(env).openPipes) {
+    pipe->m_PipeCore->GetStats().Reset();
+    pipe->m_PipeCore->GetBufferPoolStats().Reset();
+  }
+}
+
+Napi::Value AnonymousPipe::NativeHandleToObject(Napi::Env env, int64_t handle) {
+  auto dict = Napi::Object::New(env);
+  dict["lo"] = Napi::Number::New(env,(int)((uint64_t)handle & 0xFFFFFFFF));
+  dict["hi"] = Napi::Number::New(env,(int)((uint64_t)handle >> 32));
   return dict;
 }
 
+Napi::Value AnonymousPipe::NativeReadHandle(const Napi::CallbackInfo& info) {
+  return NativeHandleToObject(info.Env(), m_NativeReadHandle);
+}
+
 Napi::Value AnonymousPipe::NativeWriteHandle(const Napi::CallbackInfo& info) {
-  void* __ptr64 ptr = HandleToHandle64(this->m_WriteHandle);
-  auto dict = Napi::Object::New(info.Env());
-  dict["lo"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr & 0xFFFFFFFF));
-  dict["hi"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr >> 32));
-  return dict;
+  return NativeHandleToObject(info.Env(), m_NativeWriteHandle);
 }
 
 Napi::Value AnonymousPipe::NativeReadHandleToLong(const Napi::CallbackInfo& info) {
-  long value = HandleToLong(this->m_ReadHandle);
+  long value = (long)m_NativeReadHandle;
   return Napi::Number::New(info.Env(),value);
 }
 
 Napi::Value AnonymousPipe::NativeWriteHandleToLong(const Napi::CallbackInfo& info) {
-  long value = HandleToLong(this->m_WriteHandle);
+  long value = (long)m_NativeWriteHandle;
   return Napi::Number::New(info.Env(),value);
 }
 
 Napi::Value AnonymousPipe::ReadArrayBuffer(const Napi::CallbackInfo& info) {
 
-  if(!m_ThreadedQueue) {
+  if(!m_PipeCore) {
     Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
   }
 
+  if(m_Reading) {
+    Napi::Error::New(info.Env(), "Pipe is in streaming mode (startReading)")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
   if (info.Length() != 1) {
     Napi::Error::New(info.Env(), "Expected exactly one argument")
         .ThrowAsJavaScriptException();
@@ -267,45 +891,21 @@ Napi::Value AnonymousPipe::ReadArrayBuffer(const Napi::CallbackInfo& info) {
 
   Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
 
-  auto tsfnContext = new TsfnContext();
-
-  tsfnContext->value = info[0];
-
-  tsfnContext->tsfn = Napi::ThreadSafeFunction::New(
-      info.Env(),
-      Napi::Function::Function(), // JavaScript function called asynchronously
-      "AnonymousPipe::ReadArrayBuffer", // Name
-      0, // Unlimited queue
-      1, // 1 thread initially
-      tsfnContext,
-      [](Napi::Env env, TsfnContext* context) {
-        delete context;
-      }
-  );
-
-  m_ThreadedQueue->Queue([this,tsfnContext,deferred]{
+  auto buf = info[0].As<Napi::ArrayBuffer>();
 
-    auto buf = tsfnContext->value.As<Napi::ArrayBuffer>();
+  // Keeps the ArrayBuffer alive until the read completes.
+  Napi::ObjectReference * keepAlive = new Napi::ObjectReference(Napi::Persistent(buf.As<Napi::Object>()));
 
-    if(!ReadBytes(reinterpret_cast<unsigned char *>(buf.Data()), buf.ByteLength())) {
-      tsfnContext->tsfn.BlockingCall( [deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Reject(env.Undefined());
-      });
-    } else {
-      tsfnContext->tsfn.BlockingCall( [deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Resolve(env.Undefined());
-      });
-    }
+  m_Completions->AddPending(info.Env());
 
-    tsfnContext->tsfn.Release();
-  });
+  m_PipeCore->ReadBytes(PipeCompletion(deferred, keepAlive), buf.Data(), buf.ByteLength());
   
   return deferred.Promise();  
 }
 
 Napi::Value AnonymousPipe::WriteArrayBuffer(const Napi::CallbackInfo& info) {
 
-  if(!m_ThreadedQueue) {
+  if(!m_PipeCore) {
     Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
@@ -322,112 +922,78 @@ Napi::Value AnonymousPipe::WriteArrayBuffer(const Napi::CallbackInfo& info) {
     return info.Env().Undefined();
   }
 
-  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
-
-  auto tsfnContext = new TsfnContext();
-
-  tsfnContext->value = info[0];
-
-  tsfnContext->tsfn = Napi::ThreadSafeFunction::New(
-      info.Env(),
-      Napi::Function::Function(), // JavaScript function called asynchronously
-      "AnonymousPipe::WriteArrayBuffer", // Name
-      0, // Unlimited queue
-      1, // 1 thread initially
-      tsfnContext,
-      [](Napi::Env env, TsfnContext* context) {
-        delete context;
-      }
-  );
-
-  m_ThreadedQueue->Queue([this,tsfnContext,deferred]{
-
-    auto buf = tsfnContext->value.As<Napi::ArrayBuffer>();
-
-    if(!WriteBytes(reinterpret_cast<unsigned char *>(buf.Data()), buf.ByteLength())) {
-      tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Reject(env.Undefined());
-      });
-    } else {
-      tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Resolve(env.Undefined());
-      });
-    }
+  auto buf = info[0].As<Napi::ArrayBuffer>();
 
-    tsfnContext->tsfn.Release();
-  });
-  
-  return deferred.Promise();  
+  return QueueExternalWrite(info.Env(), buf, buf.Data(), buf.ByteLength(), false);
 }
 
 Napi::Value AnonymousPipe::ReadString(const Napi::CallbackInfo& info) {
   
-  if(!m_ThreadedQueue) {
+  if(!m_PipeCore) {
     Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
   }
 
-  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
-
-  auto tsfnContext = new TsfnContext();
+  if(m_Reading) {
+    Napi::Error::New(info.Env(), "Pipe is in streaming mode (startReading)")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
 
-  tsfnContext->tsfn = Napi::ThreadSafeFunction::New(
-      info.Env(),
-      Napi::Function::Function(), // JavaScript function called asynchronously
-      "AnonymousPipe::ReadString", // Name
-      0, // Unlimited queue
-      1, // 1 thread initially
-      tsfnContext,
-      [](Napi::Env env, TsfnContext* context) {
-        delete context;
-      }
-  );
+  return QueueRead(info.Env(), true);
+}
 
-  m_ThreadedQueue->Queue([this,tsfnContext,deferred]{
-    DWORD strLen = 0;
-    if(!ReadBytes(&strLen, sizeof(strLen))) {
-      tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Reject(env.Undefined());
-      });
-      tsfnContext->tsfn.Release();
-      return;
-    }
+Napi::Value AnonymousPipe::ReadBuffer(const Napi::CallbackInfo& info) {
 
-    std::string inStr;
-    std::vector<unsigned char> readBuffer(256);
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
 
-    while(inStr.length() < strLen)
-    {
-      DWORD bytesRead = 0;
-      DWORD chunkSize = min(readBuffer.size(), strLen - inStr.length());
-      do {
-        DWORD curBytesRead;
-        if (!ReadFile(m_ReadHandle, (unsigned char*)(&readBuffer[0]) + bytesRead, chunkSize, &curBytesRead, NULL))  {
-          tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-            deferred.Reject(env.Undefined());
-          });          
-          tsfnContext->tsfn.Release();
-          return;
-        }
-        bytesRead += curBytesRead;
-      } while (bytesRead < chunkSize);
-      inStr.append(readBuffer.begin(), readBuffer.begin() + bytesRead);
-    }
+  if(m_Reading) {
+    Napi::Error::New(info.Env(), "Pipe is in streaming mode (startReading)")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
 
-    tsfnContext->tsfn.BlockingCall( [deferred,inStr]( Napi::Env env, Napi::Function jsCallback) {
-      deferred.Resolve( Napi::String::New(env, inStr) );
-    });
-    tsfnContext->tsfn.Release();
-  });
-  
-  return deferred.Promise();   
+  return QueueRead(info.Env(), false);
 }
 
+Napi::Value AnonymousPipe::WriteBuffer(const Napi::CallbackInfo& info) {
+
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  if (info.Length() != 1) {
+    Napi::Error::New(info.Env(), "Expected exactly one argument")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  if(info[0].IsArrayBuffer()) {
+    auto buf = info[0].As<Napi::ArrayBuffer>();
+    return QueueExternalWrite(info.Env(), buf, buf.Data(), buf.ByteLength(), true);
+  }
+
+  if(info[0].IsTypedArray()) {
+    auto array = info[0].As<Napi::TypedArray>();
+    const unsigned char * pData = reinterpret_cast<const unsigned char *>(array.ArrayBuffer().Data()) + array.ByteOffset();
+    return QueueExternalWrite(info.Env(), array, pData, array.ByteLength(), true);
+  }
+
+  Napi::Error::New(info.Env(), "Expected an ArrayBuffer or TypedArray")
+      .ThrowAsJavaScriptException();
+  return info.Env().Undefined();
+}
 
 Napi::Value AnonymousPipe::WriteString(const Napi::CallbackInfo& info) {
     
-  if(!m_ThreadedQueue) {
+  if(!m_PipeCore) {
     Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
@@ -444,91 +1010,720 @@ Napi::Value AnonymousPipe::WriteString(const Napi::CallbackInfo& info) {
     return info.Env().Undefined();
   }
 
-  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
-
-  auto tsfnContext = new TsfnContext();
-
-  tsfnContext->tsfn = Napi::ThreadSafeFunction::New(
-      info.Env(),
-      Napi::Function::Function(), // JavaScript function called asynchronously
-      "AnonymousPipe::WriteString", // Name
-      0, // Unlimited queue
-      1, // 1 thread initially
-      tsfnContext,
-      [](Napi::Env env, TsfnContext* context) {
-        delete context;
-      }
-  );
+  Napi::Value value = info[0];
 
-  m_ThreadedQueue->Queue([this,tsfnContext,deferred,stdString = std::string(info[0].As<Napi::String>())]{  
-
-    DWORD strLen = stdString.size();
-    if(
-      !WriteBytes(&strLen, sizeof(strLen))
-      || !WriteBytes(reinterpret_cast<const unsigned char *>(stdString.c_str()), stdString.size())
-    ) {
-      tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Reject(env.Undefined());
-      });            
-    } else  {
-      tsfnContext->tsfn.BlockingCall([deferred]( Napi::Env env, Napi::Function jsCallback) {
-        deferred.Resolve(env.Undefined());
-      });
-    }
-    tsfnContext->tsfn.Release();
+  return QueueWrite(info.Env(), [&value](std::vector<unsigned char> & buffer){
+    AppendStringFrame(value.Env(), buffer, value);
   });
-  
-  return deferred.Promise();
 }
 
-bool AnonymousPipe::ReadBytes(void * pData, DWORD bytesToRead) {
-  do {
-    DWORD bytesRead = 0;
-    if(!ReadFile(m_ReadHandle, pData, bytesToRead, &bytesRead, NULL)) {
-      return false;      
-    }
-    bytesToRead -= bytesRead;
-    pData = (unsigned char *)pData + bytesRead;
-  } while(0 < bytesToRead);
-
-  return true;
-}
-
-bool AnonymousPipe::WriteBytes(const void * pData, DWORD bytesToWrite) {
-  do {
-    DWORD bytesWritten = 0;
-    if(!WriteFile(m_WriteHandle, pData, bytesToWrite, &bytesWritten, NULL)) {
-      return false;      
-    }
-    bytesToWrite -= bytesWritten;
-    pData = (const unsigned char *)pData + bytesWritten;
-  } while(0 < bytesToWrite);
-
-  return true;
+Napi::Value AnonymousPipe::WriteStrings(const Napi::CallbackInfo& info) {
+    
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();    
+  }
+  
+  if (info.Length() != 1) {
+    Napi::Error::New(info.Env(), "Expected exactly one argument")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+  if (!info[0].IsArray()) {
+    Napi::Error::New(info.Env(), "Expected an Array")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  Napi::Array array = info[0].As<Napi::Array>();
+  uint32_t length = array.Length();
+
+  for(uint32_t i = 0; i < length; i++) {
+    Napi::Value value = array.Get(i);
+    if(!(value.IsString() || value.IsArrayBuffer())) {
+      Napi::Error::New(info.Env(), "Expected only String or ArrayBuffer elements")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+  }
+
+  return QueueWrite(info.Env(), [&array,length](std::vector<unsigned char> & buffer){
+    for(uint32_t i = 0; i < length; i++) {
+      Napi::Value value = array.Get(i);
+      if(value.IsString()) {
+        AppendStringFrame(value.Env(), buffer, value);
+      } else {
+        auto buf = value.As<Napi::ArrayBuffer>();
+        AppendPipeFrame(buffer, buf.Data(), (PipeFrameLength_t)buf.ByteLength());
+      }
+    }
+  });
+}
+
+// startReading(callback, {jsonRpc, highWatermark, lowWatermark, queueLimit,
+// queuePolicy, coalesce, maxInFlight}): with queueLimit at most that many
+// received messages wait for callback, queuePolicy 'block' (default) stops
+// reading, 'dropOldest' drops the oldest and 'coalesce' merges consecutive
+// requests whose key is in the coalesce Array (see
+// CPipeCompletionChannel::SetQueue) and blocks otherwise. The watermarks are
+// derived from queueLimit then.
+// With maxInFlight callback has at most that many messages that were not
+// acknowledged with ackFrames() yet, so the rest stays in the queue.
+Napi::Value AnonymousPipe::StartReading(const Napi::CallbackInfo& info) {
+
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();    
+  }
+
+  if(m_Reading) {
+    Napi::Error::New(info.Env(), "Pipe is already in streaming mode")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  if (!(1 <= info.Length() && info.Length() <= 2 && info[0].IsFunction() && (info.Length() < 2 || info[1].IsObject()))) {
+    Napi::Error::New(info.Env(), "Expected callback Function and optional options Object")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  uint32_t highWatermark = 64;
+  uint32_t lowWatermark = 16;
+  bool bJsonRpc = false;
+  uint32_t queueLimit = 0;
+  BoundedQueuePolicy_e queuePolicy = BoundedQueuePolicy_Block;
+  std::vector<std::string> coalesceKeys;
+  uint32_t maxInFlight = 0;
+
+  if(2 == info.Length()) {
+    Napi::Object options = info[1].As<Napi::Object>();
+    Napi::Value valJsonRpc = options.Get("jsonRpc");
+    if(valJsonRpc.IsBoolean()) bJsonRpc = valJsonRpc.As<Napi::Boolean>().Value();
+    Napi::Value valHigh = options.Get("highWatermark");
+    Napi::Value valLow = options.Get("lowWatermark");
+    if(valHigh.IsNumber()) highWatermark = valHigh.As<Napi::Number>().Uint32Value();
+    if(valLow.IsNumber()) lowWatermark = valLow.As<Napi::Number>().Uint32Value();
+    if(highWatermark < 1 || highWatermark <= lowWatermark) {
+      Napi::Error::New(info.Env(), "Expected 1 <= highWatermark and lowWatermark < highWatermark")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+
+    Napi::Value valPolicy = options.Get("queuePolicy");
+    if(valPolicy.IsString()) {
+      std::string policy = valPolicy.As<Napi::String>().Utf8Value();
+      if("block" == policy) queuePolicy = BoundedQueuePolicy_Block;
+      else if("dropOldest" == policy) queuePolicy = BoundedQueuePolicy_DropOldest;
+      else if("coalesce" == policy) queuePolicy = BoundedQueuePolicy_Coalesce;
+      else {
+        Napi::Error::New(info.Env(), "Expected queuePolicy 'block', 'dropOldest' or 'coalesce'")
+            .ThrowAsJavaScriptException();
+        return info.Env().Undefined();
+      }
+    }
+    Napi::Value valCoalesce = options.Get("coalesce");
+    if(valCoalesce.IsArray()) {
+      Napi::Array array = valCoalesce.As<Napi::Array>();
+      for(uint32_t i = 0; i < array.Length(); i++) {
+        Napi::Value key = array.Get(i);
+        if(key.IsString()) coalesceKeys.push_back(key.As<Napi::String>().Utf8Value());
+      }
+    }
+    Napi::Value valLimit = options.Get("queueLimit");
+    if(valLimit.IsNumber()) queueLimit = valLimit.As<Napi::Number>().Uint32Value();
+    Napi::Value valMaxInFlight = options.Get("maxInFlight");
+    if(valMaxInFlight.IsNumber()) maxInFlight = valMaxInFlight.As<Napi::Number>().Uint32Value();
+  }
+
+  if(0 < queueLimit) {
+    // Frames count as in flight for the pipe until they left the queue, so
+    // it stops reading when the queue is full, unless it may drop.
+    highWatermark = BoundedQueuePolicy_DropOldest == queuePolicy ? queueLimit + 1 : queueLimit;
+    lowWatermark = highWatermark - 1;
+  } else if(BoundedQueuePolicy_Block != queuePolicy) {
+    Napi::Error::New(info.Env(), "Expected queueLimit with queuePolicy")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+
+  m_Reading = true;
+
+  PipeCore_t * pipeCore = m_PipeCore;
+  m_Completions->SetFrameHandler(info[0].As<Napi::Function>(), [pipeCore](size_t count){
+    pipeCore->AckFrames(count);
+  }, bJsonRpc);
+  m_Completions->SetQueue(queuePolicy, queueLimit, std::move(coalesceKeys), maxInFlight, &m_PipeCore->GetStats());
+
+  m_Completions->AddPending(info.Env());
+
+  m_PipeCore->StartReading(PipeCompletion(deferred), highWatermark, lowWatermark);
+
+  return deferred.Promise();
+}
+
+// ackFrames(count = 1): count messages passed to the startReading callback
+// are done with, see maxInFlight.
+Napi::Value AnonymousPipe::AckFrames(const Napi::CallbackInfo& info) {
+  if(!m_PipeCore) {
+    return info.Env().Undefined(); // Handlers may finish after close.
+  }
+
+  if (!(info.Length() < 1 || info[0].IsNumber())) {
+    Napi::Error::New(info.Env(), "Expected optional count Number")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  m_Completions->AckDelivered(info.Length() < 1 ? 1 : info[0].As<Napi::Number>().Uint32Value());
+
+  return info.Env().Undefined();
+}
+
+// Writes {"jsonrpc":"2.0","result":result,"id":id} in the pipe's encoding,
+// or an empty frame if result is undefined, serializing result without going
+// through a JS string.
+Napi::Value AnonymousPipe::WriteJsonRpcResponse(const Napi::CallbackInfo& info) {
+
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();    
+  }
+
+  if (info.Length() != 2) {
+    Napi::Error::New(info.Env(), "Expected exactly 2 arguments: id, result")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  std::string response;
+
+  if(!info[1].IsUndefined() && JsonRpcEncoding_Json != m_Encoding) {
+    CJsonValue result;
+    CJsonValue id;
+    if(!NapiToJsonValue(info.Env(), result, info[1])) {
+      if(info.Env().IsExceptionPending()) return info.Env().Undefined();
+    }
+    bool bHasId = !info[0].IsUndefined();
+    if(bHasId && !NapiToJsonValue(info.Env(), id, info[0])) {
+      if(info.Env().IsExceptionPending()) return info.Env().Undefined();
+    }
+    AppendJsonRpcResult(response, m_Encoding, result, bHasId ? &id : nullptr);
+  } else if(!info[1].IsUndefined()) {
+    AppendJsonRpcResultHead(response);
+    if(!AppendNapiJson(info.Env(), response, info[1])) {
+      if(info.Env().IsExceptionPending()) return info.Env().Undefined();
+      response += "null";
+    }
+    if(info[0].IsUndefined()) {
+      AppendJsonRpcResultTail(response, nullptr);
+    } else {
+      response += ",\"id\":";
+      if(!AppendNapiJson(info.Env(), response, info[0])) {
+        if(info.Env().IsExceptionPending()) return info.Env().Undefined();
+        response += "null";
+      }
+      response += '}';
+    }
+  }
+
+  return QueueWrite(info.Env(), [&response](std::vector<unsigned char> & buffer){
+    AppendPipeFrame(buffer, response.data(), (PipeFrameLength_t)response.size());
+  });
+}
+
+Napi::Value AnonymousPipe::WriteJsonRpcError(const Napi::CallbackInfo& info) {
+
+  if(!m_PipeCore) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();    
+  }
+
+  if (!(info.Length() == 3 && info[1].IsNumber() && info[2].IsString())) {
+    Napi::Error::New(info.Env(), "Expected exactly 3 arguments: id, code Number, message String")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  CJsonValue id;
+  switch(info[0].Type()) {
+  case napi_number:
+    id.type = CJsonValue::Type_Number;
+    id.number = info[0].As<Napi::Number>().DoubleValue();
+    break;
+  case napi_string:
+    id.type = CJsonValue::Type_String;
+    id.string = info[0].As<Napi::String>().Utf8Value();
+    break;
+  default:
+    break;
+  }
+
+  std::string message = info[2].As<Napi::String>().Utf8Value();
+  std::string response;
+  AppendJsonRpcError(response, m_Encoding, &id, info[1].As<Napi::Number>().Int32Value(), message.c_str());
+
+  return QueueWrite(info.Env(), [&response](std::vector<unsigned char> & buffer){
+    AppendPipeFrame(buffer, response.data(), (PipeFrameLength_t)response.size());
+  });
+}
+
+// Selects the encoding of messages written by writeJsonRpcResponse and
+// writeJsonRpcError: "json" (default) or "msgpack". Incoming messages are
+// detected per frame, so only the writing side needs to be told.
+Napi::Value AnonymousPipe::SetEncoding(const Napi::CallbackInfo& info) {
+  if (!(info.Length() == 1 && info[0].IsString())) {
+    Napi::Error::New(info.Env(), "Expected exactly one String argument")
+        .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  std::string encoding = info[0].As<Napi::String>().Utf8Value();
+  if("json" == encoding) {
+    m_Encoding = JsonRpcEncoding_Json;
+  } else if("msgpack" == encoding) {
+    m_Encoding = JsonRpcEncoding_MsgPack;
+  } else {
+    Napi::Error::New(info.Env(), "Unsupported encoding: " + encoding)
+        .ThrowAsJavaScriptException();
+  }
+
+  return info.Env().Undefined();
+}
+
+template<class AppendFn> Napi::Value AnonymousPipe::QueueWrite(Napi::Env env, AppendFn appendFn, bool bFramed) {
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+
+  m_Completions->AddPending(env);
+
+  m_PipeCore->Write(PipeCompletion(deferred), appendFn, bFramed);
+
+  return deferred.Promise();
+}
+
+// The bytes are written from where they are, the owner is kept alive until
+// the write completed and must not be modified before.
+Napi::Value AnonymousPipe::QueueExternalWrite(Napi::Env env, Napi::Object owner, const void * pData, size_t size, bool bFramed) {
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+
+  Napi::ObjectReference * keepAlive = new Napi::ObjectReference(Napi::Persistent(owner));
+
+  m_Completions->AddPending(env);
+
+  m_PipeCore->WriteExternal(PipeCompletion(deferred, keepAlive), pData, size, bFramed);
+
+  return deferred.Promise();
+}
+
+// Frames are read into buffers from the pipe's pool, resolved as a Buffer
+// or with bAsString as a String.
+Napi::Value AnonymousPipe::QueueRead(Napi::Env env, bool bAsString) {
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+
+  m_Completions->AddPending(env);
+
+  PipeCompletion completion(deferred);
+  completion.bBufferAsString = bAsString;
+  m_PipeCore->ReadBuffer(std::move(completion));
+
+  return deferred.Promise();
+}
+
+bool AnonymousPipe::AppendStringFrame(Napi::Env env, std::vector<unsigned char> & buffer, Napi::Value value) {
+  // Encode the UTF-8 directly into the write buffer instead of going through
+  // an intermediate std::string.
+  size_t strLen = 0;
+  if(napi_ok != napi_get_value_string_utf8(env, value, nullptr, 0, &strLen)) return false;
+
+  size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(PipeFrameLength_t) + strLen + 1);
+
+  size_t written = 0;
+  napi_get_value_string_utf8(env, value, reinterpret_cast<char *>(&buffer[offset + sizeof(PipeFrameLength_t)]), strLen + 1, &written);
+  buffer.resize(offset + sizeof(PipeFrameLength_t) + written);
+
+  PipeFrameLength_t frameLen = (PipeFrameLength_t)written;
+  memcpy(&buffer[offset], &frameLen, sizeof(frameLen));
+  return true;
+}
+
+bool AnonymousPipe::IsInstance(Napi::Value value) {
+  return value.IsObject() && value.As<Napi::Object>().InstanceOf(GetAddonData(value.Env()).pipeConstructor.Value());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#include <d3d11.h>
+// Pipelined JSON-RPC calls over a pair of AnonymousPipes: many calls can be in
+// flight at once and responses are matched to them by id, so a slow call does
+// not hold up the ones behind it.
+class JsonRpcClient : public Napi::ObjectWrap<JsonRpcClient> {
+ public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports);
+  JsonRpcClient(const Napi::CallbackInfo& info);
+
+ private:
+  Napi::Value Call(const Napi::CallbackInfo& info);
+  Napi::Value Notify(const Napi::CallbackInfo& info);
+  Napi::Value Close(const Napi::CallbackInfo& info);
+
+  bool GetRequestArgs(const Napi::CallbackInfo& info, std::string & outMethod, CJsonValue & outParams);
+  void Send(Napi::Env env);
+  void OnResponse(Napi::Env env, CJsonRpcResponse && response);
+  void FailAll(Napi::Env env, const char * message);
+  void AddPending();
+  void ReleasePending();
+
+  Napi::ObjectReference m_WritePipeRef;
+  Napi::ObjectReference m_ReadPipeRef;
+  AnonymousPipe * m_WritePipe = nullptr;
+  AnonymousPipe * m_ReadPipe = nullptr;
+  CJsonRpcMultiplexer<Napi::Promise::Deferred> m_Multiplexer;
+  Napi::FunctionReference m_OnNotification;
+  bool m_Closed = false;
+  size_t m_Pending = 0; // Native operations that call back into this.
+};
+
+Napi::Object JsonRpcClient::Init(Napi::Env env, Napi::Object exports) {
+  Napi::Function func =
+    DefineClass(env, "JsonRpcClient", {
+        InstanceMethod("call", &JsonRpcClient::Call),
+        InstanceMethod("notify", &JsonRpcClient::Notify),
+        InstanceMethod("close", &JsonRpcClient::Close),
+    });
+
+  exports.Set("JsonRpcClient", func);
+  return exports;
+}
+
+// new JsonRpcClient(writePipe, readPipe, {maxInFlight = 16, onNotification})
+// Takes over reading from readPipe. onNotification(method, params) is called
+// for notifications the peer sends on readPipe.
+JsonRpcClient::JsonRpcClient(const Napi::CallbackInfo& info)
+: Napi::ObjectWrap<JsonRpcClient>(info), m_Multiplexer(16) {
+
+  if (!(2 <= info.Length() && info.Length() <= 3 && AnonymousPipe::IsInstance(info[0]) && AnonymousPipe::IsInstance(info[1]) && (info.Length() < 3 || info[2].IsObject()))) {
+    Napi::Error::New(info.Env(), "Expected write AnonymousPipe, read AnonymousPipe and optional options Object")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  if(3 == info.Length()) {
+    Napi::Object options = info[2].As<Napi::Object>();
+    Napi::Value valMaxInFlight = options.Get("maxInFlight");
+    Napi::Value valOnNotification = options.Get("onNotification");
+    if(valMaxInFlight.IsNumber()) m_Multiplexer.SetMaxInFlight(valMaxInFlight.As<Napi::Number>().Uint32Value());
+    if(valOnNotification.IsFunction()) m_OnNotification = Napi::Persistent(valOnNotification.As<Napi::Function>());
+  }
+
+  m_WritePipe = AnonymousPipe::Unwrap(info[0].As<Napi::Object>());
+  m_ReadPipe = AnonymousPipe::Unwrap(info[1].As<Napi::Object>());
+
+  if(!(m_WritePipe->m_PipeCore && m_ReadPipe->m_PipeCore)) {
+    Napi::Error::New(info.Env(), "Pipe threaded queue already closed")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  if(m_ReadPipe->m_Reading) {
+    Napi::Error::New(info.Env(), "Pipe is already in streaming mode")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  m_WritePipeRef = Napi::Persistent(info[0].As<Napi::Object>());
+  m_ReadPipeRef = Napi::Persistent(info[1].As<Napi::Object>());
+
+  m_ReadPipe->m_Reading = true;
+
+  AnonymousPipe::PipeCore_t * pipeCore = m_ReadPipe->m_PipeCore;
+  m_ReadPipe->m_Completions->SetResponseHandler([this](Napi::Env env, CJsonRpcResponse && response){
+    OnResponse(env, std::move(response));
+  }, [pipeCore](size_t count){
+    pipeCore->AckFrames(count);
+  });
+
+  m_ReadPipe->m_Completions->AddPending(info.Env());
+  AddPending();
+
+  m_ReadPipe->m_PipeCore->StartReading(PipeCompletion(info.Env(), [this](Napi::Env env, bool ok){
+    m_Closed = true;
+    FailAll(env, ok ? "Pipe closed" : "Reading from pipe failed");
+    ReleasePending();
+  }), 64, 16);
+}
+
+// call(method, params) resolves with the result, or rejects with an Error
+// that has the code (and data) of an error response.
+Napi::Value JsonRpcClient::Call(const Napi::CallbackInfo& info) {
+
+  std::string method;
+  CJsonValue params;
+  if(!GetRequestArgs(info, method, params)) return info.Env().Undefined();
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+
+  if(m_Closed) {
+    deferred.Reject(Napi::Error::New(info.Env(), "JsonRpcClient closed").Value());
+    return deferred.Promise();
+  }
+
+  uint64_t id = m_Multiplexer.NextId();
+  CJsonValue idValue;
+  idValue.type = CJsonValue::Type_Number;
+  idValue.number = (double)id;
+
+  std::string frame;
+  AppendJsonRpcRequest(frame, m_WritePipe->m_Encoding, method.c_str(), params, &idValue);
+
+  m_Multiplexer.Call(id, deferred, std::move(frame));
+  Send(info.Env());
+
+  return deferred.Promise();
+}
+
+// notify(method, params) resolves once written. It is not held back by the
+// call limit, but stays behind calls that are.
+Napi::Value JsonRpcClient::Notify(const Napi::CallbackInfo& info) {
+
+  std::string method;
+  CJsonValue params;
+  if(!GetRequestArgs(info, method, params)) return info.Env().Undefined();
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+
+  if(m_Closed) {
+    deferred.Reject(Napi::Error::New(info.Env(), "JsonRpcClient closed").Value());
+    return deferred.Promise();
+  }
+
+  std::string frame;
+  AppendJsonRpcRequest(frame, m_WritePipe->m_Encoding, method.c_str(), params, nullptr);
+
+  m_Multiplexer.Notify(deferred, std::move(frame));
+  Send(info.Env());
+
+  return deferred.Promise();
+}
+
+// Rejects what is outstanding, the pipes stay open.
+Napi::Value JsonRpcClient::Close(const Napi::CallbackInfo& info) {
+  m_Closed = true;
+  FailAll(info.Env(), "JsonRpcClient closed");
+  return info.Env().Undefined();
+}
+
+bool JsonRpcClient::GetRequestArgs(const Napi::CallbackInfo& info, std::string & outMethod, CJsonValue & outParams) {
+  if (!(1 <= info.Length() && info.Length() <= 2 && info[0].IsString()
+    && (info.Length() < 2 || info[1].IsUndefined() || info[1].IsArray() || (info[1].IsObject() && !info[1].IsFunction())))) {
+    Napi::Error::New(info.Env(), "Expected method String and optional params Array or Object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  outMethod = info[0].As<Napi::String>().Utf8Value();
+  if(2 == info.Length() && !info[1].IsUndefined()) {
+    NapiToJsonValue(info.Env(), outParams, info[1]);
+    if(info.Env().IsExceptionPending()) return false;
+  }
+  return true;
+}
+
+// Writes what the call limit allows in one batch.
+void JsonRpcClient::Send(Napi::Env env) {
+  std::vector<std::string> frames;
+  std::vector<Napi::Promise::Deferred> written;
+  m_Multiplexer.TakeSendable(frames, written);
+  if(frames.empty()) return;
+
+  if(!m_WritePipe->m_PipeCore) {
+    for(auto & deferred : written) deferred.Reject(Napi::Error::New(env, "Pipe threaded queue already closed").Value());
+    FailAll(env, "Pipe threaded queue already closed");
+    return;
+  }
+
+  m_WritePipe->m_Completions->AddPending(env);
+  AddPending();
+
+  m_WritePipe->m_PipeCore->Write(PipeCompletion(env, [this,written](Napi::Env env, bool ok){
+    for(auto & deferred : written) {
+      if(ok) deferred.Resolve(env.Undefined());
+      else deferred.Reject(Napi::Error::New(env, "Writing to pipe failed").Value());
+    }
+    if(!ok) {
+      m_Closed = true;
+      FailAll(env, "Writing to pipe failed");
+    }
+    ReleasePending();
+  }), [&frames](std::vector<unsigned char> & buffer){
+    for(auto & frame : frames) AppendPipeFrame(buffer, frame.data(), (PipeFrameLength_t)frame.size());
+  });
+}
+
+void JsonRpcClient::OnResponse(Napi::Env env, CJsonRpcResponse && response) {
+  // Frames that can not be matched (e.g. the empty ones JsonRpc_2_0_Server
+  // answers notifications with) are dropped.
+  if(!response.valid) return;
+
+  if(response.isNotification) {
+    if(!m_OnNotification.IsEmpty()) {
+      m_OnNotification.Call({Napi::String::New(env, response.method), JsonToNapi(env, response.params)});
+    }
+    return;
+  }
+
+  if(!(CJsonValue::Type_Number == response.id.type && 0 < response.id.number)) return;
+
+  m_Multiplexer.Complete((uint64_t)response.id.number, [env,&response](Napi::Promise::Deferred && deferred){
+    if(response.isError) {
+      Napi::Error error = Napi::Error::New(env, response.errorMessage);
+      error.Set("code", Napi::Number::New(env, response.errorCode));
+      if(CJsonValue::Type_Null != response.errorData.type) error.Set("data", JsonToNapi(env, response.errorData));
+      deferred.Reject(error.Value());
+    } else {
+      deferred.Resolve(JsonToNapi(env, response.result));
+    }
+  });
+
+  Send(env);
+}
+
+void JsonRpcClient::FailAll(Napi::Env env, const char * message) {
+  m_Multiplexer.FailAll([env,message](Napi::Promise::Deferred && deferred){
+    deferred.Reject(Napi::Error::New(env, message).Value());
+  });
+}
+
+// Keeps this alive while native operations can still call back into it.
+void JsonRpcClient::AddPending() {
+  if(0 == m_Pending++) Ref();
+}
+
+void JsonRpcClient::ReleasePending() {
+  if(0 < m_Pending && 0 == --m_Pending) Unref();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "texture_upload_queue.h"
+#include "texture_trace.h"
+#include "texture_pool.h"
+#include "texture_frames.h"
+#include "threaded_queue.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Devices and textures are kept for the process' lifetime: windows get
+// recreated on map changes and resizes. Never deleted, textures can be
+// finalized after static destructors ran.
+CTexturePool & GetTexturePool() {
+  static CTexturePool * s_Pool = new CTexturePool(
+#ifdef _WIN32
+    &CreateTextureAdapterD3d11
+#else
+    [](int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError) { return CreateTextureAdapterCpu(); }
+#endif
+  );
+  return *s_Pool;
+}
+
+// Runs SharedTexture.createAsync and prewarm one after the other, so a
+// texture prewarmed before is found in the pool.
+CThreadedQueue & GetTextureCreationQueue() {
+  static CThreadedQueue * s_Queue = new CThreadedQueue(0);
+  return *s_Queue;
+}
+
+// Arguments of new SharedTexture.
+struct SharedTextureParams {
+  int32_t luidLo = 0;
+  int32_t luidHi = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t stagingCount = 3;
+  uint32_t bufferCount = 1;
+  bool bDamageTracking = false;
+  int32_t tileSize = 64;
+  TexturePixelFormat_e format = TextureFormat_Bgra8;
+  TexturePixelFormat_e sourceFormat = TextureFormat_Bgra8;
+  bool bPremultiply = false;
+  std::string name;
+  std::string tracePath;
+  bool bTraceCompress = false;
+};
+
+// What SharedTexture::CreateResources made of params, deleted with what the
+// SharedTexture did not take over.
+struct SharedTextureResources {
+  SharedTextureParams params;
+  CTextureUploader * uploader = nullptr;
+  CTextureFrameSection * frames = nullptr;
+  CTextureTraceWriter * trace = nullptr;
+  std::string error;
+
+  ~SharedTextureResources() {
+    delete uploader;
+    delete frames;
+    delete trace;
+  }
+};
 
 class SharedTexture : public Napi::ObjectWrap<SharedTexture> {
  public:
   static Napi::Object Init(Napi::Env env, Napi::Object exports);  
   SharedTexture(const Napi::CallbackInfo& info);
   virtual void Finalize(Napi::Env env) override;  
+
+  // Of all textures of env not deleted yet.
+  static Napi::Value GetAllStats(Napi::Env env);
+  static void ResetAllStats(Napi::Env env);
+
  private:
-  ID3D11Texture2D * m_StagingTexture = nullptr;
-  ID3D11Texture2D * m_SharedTexture = nullptr;
-  ID3D11DeviceContext* m_Ctx = nullptr;
-  HANDLE m_SharedHandle = INVALID_HANDLE_VALUE;
+  typedef CTextureUploadQueue<PipeCompletion, CPipeCompletionChannel> UploadQueue_t;
+
+  std::string m_Name;
+  CTextureUploader * m_Uploader = nullptr;
+  CTextureFrameSection * m_Frames = nullptr;
+  UploadQueue_t * m_UploadQueue = nullptr;
+  CPipeCompletionChannel * m_Completions = nullptr;
+  CTextureTraceWriter * m_Trace = nullptr;
   int m_Width = 0;
   int m_Height = 0;
 
   Napi::Value Delete(const Napi::CallbackInfo& info);
-  Napi::Value SharedTexture::GetSharedHandle(const Napi::CallbackInfo& info);
-  Napi::Value SharedTexture::Update(const Napi::CallbackInfo& info);
+  Napi::Value GetSharedHandle(const Napi::CallbackInfo& info);
+  Napi::Value GetFrameSection(const Napi::CallbackInfo& info);
+  Napi::Value Update(const Napi::CallbackInfo& info);
+  Napi::Value UpdateAsync(const Napi::CallbackInfo& info);
+  Napi::Value GetDamageStats(const Napi::CallbackInfo& info);
+
+  static Napi::Value CreateAsync(const Napi::CallbackInfo& info);
+  static Napi::Value Prewarm(const Napi::CallbackInfo& info);
+
+  bool GetUpdateArgs(const Napi::CallbackInfo& info, TextureRect & outRect, const unsigned char * & outData, size_t & outRowPitch, bool & outSubImage);
+
+  // Throw if the arguments are not usable.
+  static bool ParseArgs(const Napi::CallbackInfo& info, SharedTextureParams & outParams);
+  static bool ParseLuid(Napi::Value value, int32_t & outLo, int32_t & outHi);
+  static bool ParsePixelFormat(Napi::Value value, TexturePixelFormat_e & outFormat);
+
+  // Any thread, returns false and sets resources.error on failure.
+  static bool CreateResources(SharedTextureResources & resources);
 
-  void DoClose();
+  // Takes over what resources hold.
+  void Open(Napi::Env env, SharedTextureResources & resources);
+
+  void DoClose(Napi::Env env);
 };
 
 Napi::Object SharedTexture::Init(Napi::Env env, Napi::Object exports) {
@@ -536,221 +1731,449 @@ Napi::Object SharedTexture::Init(Napi::Env env, Napi::Object exports) {
     DefineClass(env, "SharedTexture", {
         InstanceMethod("delete", &SharedTexture::Delete),
         InstanceMethod("getSharedHandle", &SharedTexture::GetSharedHandle),
+        InstanceMethod("getFrameSection", &SharedTexture::GetFrameSection),
         InstanceMethod("update", &SharedTexture::Update),
+        InstanceMethod("updateAsync", &SharedTexture::UpdateAsync),
+        InstanceMethod("getDamageStats", &SharedTexture::GetDamageStats),
+        StaticMethod("createAsync", &SharedTexture::CreateAsync),
+        StaticMethod("prewarm", &SharedTexture::Prewarm),
     });
 
-  Napi::FunctionReference* constructor = new Napi::FunctionReference();
-  *constructor = Napi::Persistent(func);
-  env.SetInstanceData(constructor);
+  AddonData & data = GetAddonData(env);
+  data.textureConstructor = Napi::Persistent(func);
+  data.textureCreations = new CPipeCompletionChannel(env, "SharedTexture.createAsync");
 
   exports.Set("SharedTexture", func);
   return exports;
 }
 
+// new SharedTexture(adapterLuid, width, height, {stagingCount = 3,
+//   buffers = 1, damageTracking = false, tileSize = 64, format = "bgra8",
+//   sourceFormat = "bgra8", premultiply = false, name, trace,
+//   traceCompress = false})
+// Updates are uploaded round-robin through stagingCount staging textures.
+// With buffers 2 to 8 there are that many shared textures and updates never
+// write the one the game reads: each goes to a free one that is published
+// once the GPU finished it, through the shared memory section named by
+// getFrameSection() (see texture_frames.h). With 1 updates are written in
+// place to the texture of getSharedHandle().
+// Option name labels the texture in getStats().
+// Option trace is a file path to record every update to (see
+// texture_trace.h), with traceCompress run-length encoded.
+// With damageTracking only tileSize x tileSize tiles of the dirty rect that
+// changed since they were last uploaded are uploaded.
+// The texture has format "bgra8", "rgba8", "rgb10a2" or "rgba16", images
+// passed to update are sourceFormat "bgra8" or "rgba8" and converted while
+// uploading, with premultiply their straight alpha is premultiplied.
+// Where there is no D3D11 the texture lives in system memory and has no
+// shared handle.
+// Textures come from a per process pool and go back to it on delete(), so
+// recreating one of the same size, format, stagingCount and buffers is
+// cheap.
 SharedTexture::SharedTexture(const Napi::CallbackInfo& info)
 : Napi::ObjectWrap<SharedTexture>(info) {
 
-  if (info.Length() != 3) {
-    Napi::Error::New(info.Env(), "Expected exactly 3 arguments")
+  // From createAsync, with everything created already.
+  if(1 == info.Length() && info[0].IsExternal()) {
+    Open(info.Env(), *info[0].As<Napi::External<SharedTextureResources>>().Data());
+    return;
+  }
+
+  SharedTextureResources resources;
+  if(!ParseArgs(info, resources.params)) return;
+
+  if(!CreateResources(resources)) {
+    Napi::Error::New(info.Env(), resources.error)
         .ThrowAsJavaScriptException();
     return;
   }
 
-  LUID targetLUID {};
-  bool bOkay = info[0].IsObject();
-  if(bOkay){
-    Napi::Object obj = info[0].As<Napi::Object>();
-    bOkay = obj.Has("lo") && obj.Has("hi");
-    if(bOkay) {
-      Napi::Value lo = obj.Get("lo");
-      Napi::Value hi = obj.Get("hi");
-      bOkay = lo.IsNumber() && hi.IsNumber();
-      if(bOkay) {
-        Napi::Number numLo = lo.As<Napi::Number>();
-        Napi::Number numHi = hi.As<Napi::Number>();
-        targetLUID.LowPart = (LONG)numLo.Int32Value();
-        targetLUID.HighPart = (LONG)numHi.Int32Value();
-      }
-    }
+  Open(info.Env(), resources);
+}
+
+bool SharedTexture::ParseArgs(const Napi::CallbackInfo& info, SharedTextureParams & outParams) {
+  if (!(3 <= info.Length() && info.Length() <= 4 && (info.Length() < 4 || info[3].IsObject()))) {
+    Napi::Error::New(info.Env(), "Expected 3 arguments and optional options Object")
+        .ThrowAsJavaScriptException();
+    return false;
   }
 
-  if(!bOkay) {
+  if(!ParseLuid(info[0], outParams.luidLo, outParams.luidHi)) {
     Napi::Error::New(info.Env(), "Expected adapter LUID Handle object as argument 0")
       .ThrowAsJavaScriptException();
-    return;
+    return false;
   }
 
-  if (!info[1].IsNumber() && info[2].IsNumber()) {
+  if (!(info[1].IsNumber() && info[2].IsNumber())) {
     Napi::Error::New(info.Env(), "Expected width and height Number for arguments 1 and 2")
         .ThrowAsJavaScriptException();
-    return;
+    return false;
   }
 
-  int32_t width = info[1].As<Napi::Number>().Int32Value();
-  int32_t height = info[2].As<Napi::Number>().Int32Value();
+  outParams.width = info[1].As<Napi::Number>().Int32Value();
+  outParams.height = info[2].As<Napi::Number>().Int32Value();
 
-  if(width < 1 || height < 1) {
+  if(outParams.width < 1 || outParams.height < 1) {
     Napi::Error::New(info.Env(), "Arguments width and height must be at least 1")
         .ThrowAsJavaScriptException();
-    return;
+    return false;
   }
 
-  
-  IDXGIFactory * pFactory;
-  if(SUCCEEDED(CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)(&pFactory) ))) {
-
-    IDXGIAdapter * pActualAdapter = nullptr;
-    {
-      UINT i = 0; 
-      IDXGIAdapter * pAdapter;
-      while(pFactory->EnumAdapters(i, &pAdapter) != DXGI_ERROR_NOT_FOUND) 
-      { 
-        DXGI_ADAPTER_DESC desc;
-        if(SUCCEEDED(pAdapter->GetDesc(&desc))) {
-          if(desc.AdapterLuid.HighPart == targetLUID.HighPart && desc.AdapterLuid.LowPart == targetLUID.LowPart) {
-            pAdapter->AddRef();
-            pActualAdapter = pAdapter; 
-          }
-        }
-        pAdapter->Release();
-        ++i; 
-      } 
-    }
-
-    if(pActualAdapter) {
-      ID3D11Device * pDevice;
-      ID3D11DeviceContext * pCtx;
-      if(SUCCEEDED(D3D11CreateDevice(pActualAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0, D3D11_SDK_VERSION, &pDevice, NULL, &pCtx))) {
-
-        D3D11_TEXTURE2D_DESC desc {
-          (UINT)width,
-          (UINT)height,
-          1,
-          1,
-          DXGI_FORMAT_B8G8R8A8_UNORM,
-          {1, 0},
-          D3D11_USAGE_DYNAMIC,
-          D3D11_BIND_SHADER_RESOURCE,
-          D3D11_CPU_ACCESS_WRITE,
-          0
-        };
-
-        if(SUCCEEDED(pDevice->CreateTexture2D(&desc,NULL,&m_StagingTexture))) {
-
-          desc.Usage = D3D11_USAGE_DEFAULT;
-          desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-          desc.CPUAccessFlags = 0;
-          desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
-
-          if(SUCCEEDED(pDevice->CreateTexture2D(&desc,NULL,&m_SharedTexture))) {
-
-            m_SharedHandle = INVALID_HANDLE_VALUE;
-
-            IDXGIResource* dxgiResource;
-
-            if (SUCCEEDED(m_SharedTexture->QueryInterface(__uuidof(IDXGIResource),
-                                                  (void**)&dxgiResource))) {
-              if (FAILED(dxgiResource->GetSharedHandle(&m_SharedHandle))) {
-                m_SharedHandle = INVALID_HANDLE_VALUE;
-              }
-              dxgiResource->Release();
-            }
-
-            if(INVALID_HANDLE_VALUE == m_SharedHandle) {
-              Napi::Error::New(info.Env(), "Getting shared Handle failed")
-                .ThrowAsJavaScriptException();
-            }
-
-            if(m_SharedTexture && INVALID_HANDLE_VALUE != m_SharedHandle) {
-              pCtx->AddRef();
-              m_Ctx = pCtx;
-              m_Width = width;
-              m_Height = height;
-            } else {
-              if(m_SharedTexture) {
-                m_SharedTexture->Release();
-                m_SharedTexture = nullptr;
-              }
-              if(m_StagingTexture) {
-                m_StagingTexture->Release();
-                m_StagingTexture = nullptr;
-              }
-            }
-            
-          } else {
-            Napi::Error::New(info.Env(), "CreateTexture2D failed for shared texture")
-            .ThrowAsJavaScriptException();
-          }
-        } else {
-          Napi::Error::New(info.Env(), "CreateTexture2D failed for staging texture")
+  if(4 == info.Length()) {
+    Napi::Object options = info[3].As<Napi::Object>();
+    Napi::Value valStagingCount = options.Get("stagingCount");
+    Napi::Value valBuffers = options.Get("buffers");
+    Napi::Value valDamageTracking = options.Get("damageTracking");
+    Napi::Value valTileSize = options.Get("tileSize");
+    Napi::Value valFormat = options.Get("format");
+    Napi::Value valSourceFormat = options.Get("sourceFormat");
+    Napi::Value valPremultiply = options.Get("premultiply");
+    Napi::Value valName = options.Get("name");
+    Napi::Value valTrace = options.Get("trace");
+    Napi::Value valTraceCompress = options.Get("traceCompress");
+    if(valName.IsString()) outParams.name = valName.As<Napi::String>().Utf8Value();
+    if(valTrace.IsString()) outParams.tracePath = valTrace.As<Napi::String>().Utf8Value();
+    if(valTraceCompress.IsBoolean()) outParams.bTraceCompress = valTraceCompress.As<Napi::Boolean>().Value();
+    if(valStagingCount.IsNumber()) outParams.stagingCount = valStagingCount.As<Napi::Number>().Uint32Value();
+    if(valBuffers.IsNumber()) outParams.bufferCount = valBuffers.As<Napi::Number>().Uint32Value();
+    if(valDamageTracking.IsBoolean()) outParams.bDamageTracking = valDamageTracking.As<Napi::Boolean>().Value();
+    if(valTileSize.IsNumber()) outParams.tileSize = valTileSize.As<Napi::Number>().Int32Value();
+    if(valPremultiply.IsBoolean()) outParams.bPremultiply = valPremultiply.As<Napi::Boolean>().Value();
+    if(!(valFormat.IsUndefined() || ParsePixelFormat(valFormat, outParams.format))) {
+      Napi::Error::New(info.Env(), "format must be \"bgra8\", \"rgba8\", \"rgb10a2\" or \"rgba16\"")
           .ThrowAsJavaScriptException();
-        }
+      return false;
+    }
+    if(!(valSourceFormat.IsUndefined() || ParsePixelFormat(valSourceFormat, outParams.sourceFormat)) || !(TextureFormat_Bgra8 == outParams.sourceFormat || TextureFormat_Rgba8 == outParams.sourceFormat)) {
+      Napi::Error::New(info.Env(), "sourceFormat must be \"bgra8\" or \"rgba8\"")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if(outParams.stagingCount < 1) {
+      Napi::Error::New(info.Env(), "stagingCount must be at least 1")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if(outParams.bufferCount < 1 || CTextureFrameHeader::MaxBuffers < outParams.bufferCount) {
+      Napi::Error::New(info.Env(), "buffers must be 1 to 8")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if(outParams.tileSize < 1) {
+      Napi::Error::New(info.Env(), "tileSize must be at least 1")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
 
-        pDevice->Release();
-        pCtx->Release();
-      } else {
-        Napi::Error::New(info.Env(), "D3D11CreateDevice failed")
-        .ThrowAsJavaScriptException();
-      }
+  return true;
+}
+
+bool SharedTexture::ParseLuid(Napi::Value value, int32_t & outLo, int32_t & outHi) {
+  if(!value.IsObject()) return false;
+  Napi::Object obj = value.As<Napi::Object>();
+  if(!(obj.Has("lo") && obj.Has("hi"))) return false;
+  Napi::Value lo = obj.Get("lo");
+  Napi::Value hi = obj.Get("hi");
+  if(!(lo.IsNumber() && hi.IsNumber())) return false;
+  outLo = lo.As<Napi::Number>().Int32Value();
+  outHi = hi.As<Napi::Number>().Int32Value();
+  return true;
+}
+
+bool SharedTexture::CreateResources(SharedTextureResources & resources) {
+  const SharedTextureParams & params = resources.params;
+
+  if(!params.tracePath.empty()) {
+    resources.trace = CTextureTraceWriter::Create(params.tracePath.c_str(), params.width, params.height, params.bTraceCompress);
+    if(nullptr == resources.trace) {
+      resources.error = "Creating trace failed: " + params.tracePath;
+      return false;
+    }
+  }
+
+  CTextureDevice * device = GetTexturePool().Acquire(params.luidLo, params.luidHi, params.width, params.height, params.stagingCount, params.bufferCount, params.format, resources.error);
+  if(nullptr == device) return false;
+
+  resources.uploader = new CTextureUploader(device);
+  if(1 < params.bufferCount) {
+    resources.frames = CTextureFrameSection::Create();
+    if(nullptr == resources.frames) {
+      resources.error = "Creating frame section failed";
+      return false;
+    }
+    InitTextureFrameHeader(resources.frames->GetHeader(), device);
+    resources.uploader->SetFrameSync(resources.frames->GetHeader());
+  }
+  if(params.bDamageTracking) resources.uploader->SetDamageTracking(params.tileSize);
+  resources.uploader->SetConversion(params.sourceFormat, params.bPremultiply);
+  return true;
+}
+
+void SharedTexture::Open(Napi::Env env, SharedTextureResources & resources) {
+  m_Name = resources.params.name;
+  m_Width = resources.params.width;
+  m_Height = resources.params.height;
+  m_Uploader = resources.uploader;
+  resources.uploader = nullptr;
+  m_Frames = resources.frames;
+  resources.frames = nullptr;
+  m_Trace = resources.trace;
+  resources.trace = nullptr;
+  m_Completions = new CPipeCompletionChannel(env, "SharedTexture");
+  m_UploadQueue = new UploadQueue_t(*m_Uploader, *m_Completions);
+  m_UploadQueue->SetTrace(m_Trace);
+  GetAddonData(env).openTextures.push_back(this);
+}
+
+// SharedTexture.createAsync(adapterLuid, width, height[, options]) takes the
+// arguments of new SharedTexture, but creates the texture on a worker thread
+// and returns a promise for it.
+Napi::Value SharedTexture::CreateAsync(const Napi::CallbackInfo& info) {
+  SharedTextureResources * resources = new SharedTextureResources();
+  if(!ParseArgs(info, resources->params)) {
+    delete resources;
+    return info.Env().Undefined();
+  }
 
-      pActualAdapter->Release();
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+  PipeCompletion completion(info.Env(), [deferred, resources](Napi::Env env, bool ok) {
+    if(ok) {
+      Napi::Object texture = GetAddonData(env).textureConstructor.New({Napi::External<SharedTextureResources>::New(env, resources)});
+      if(env.IsExceptionPending()) deferred.Reject(env.GetAndClearPendingException().Value());
+      else deferred.Resolve(texture);
     } else {
-      Napi::Error::New(info.Env(), "Could not find adapater for given LUID")
-        .ThrowAsJavaScriptException();
+      deferred.Reject(Napi::Error::New(env, resources->error).Value());
     }
+    delete resources;
+  });
 
-    pFactory->Release();
-  } else {
-    Napi::Error::New(info.Env(), "Could not create IDXGIFactory")
+  CPipeCompletionChannel * creations = GetAddonData(info.Env()).textureCreations;
+  creations->AddPending(info.Env());
+  GetTextureCreationQueue().Queue([resources, creations, completion = std::move(completion)]() mutable {
+    bool ok = CreateResources(*resources);
+    creations->Post(std::move(completion), ok);
+  });
+
+  return deferred.Promise();
+}
+
+// SharedTexture.prewarm(adapterLuid, sizes[, {stagingCount = 3, buffers = 1,
+// format = "bgra8"}]) creates textures for each {width, height} of sizes on
+// createAsync's worker thread and keeps them in the pool, so a texture of
+// that size with those options is created right away. Returns a promise
+// that settles once they are ready. The pool keeps at most 4 unused.
+Napi::Value SharedTexture::Prewarm(const Napi::CallbackInfo& info) {
+  if(!((2 == info.Length() || (3 == info.Length() && info[2].IsObject())) && info[1].IsArray())) {
+    Napi::Error::New(info.Env(), "Expected adapter LUID, sizes Array and optional options Object")
         .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  struct PrewarmJob {
+    int32_t luidLo = 0;
+    int32_t luidHi = 0;
+    std::vector<std::pair<int32_t, int32_t>> sizes;
+    uint32_t stagingCount = 3;
+    uint32_t bufferCount = 1;
+    TexturePixelFormat_e format = TextureFormat_Bgra8;
+    std::string error;
+  };
+  PrewarmJob * prewarm = new PrewarmJob();
+
+  if(!ParseLuid(info[0], prewarm->luidLo, prewarm->luidHi)) {
+    delete prewarm;
+    Napi::Error::New(info.Env(), "Expected adapter LUID Handle object as argument 0")
+      .ThrowAsJavaScriptException();
+    return info.Env().Undefined();
+  }
+
+  Napi::Array sizes = info[1].As<Napi::Array>();
+  for(uint32_t i = 0; i < sizes.Length(); i++) {
+    Napi::Value size = sizes.Get(i);
+    Napi::Value valWidth = size.IsObject() ? size.As<Napi::Object>().Get("width") : info.Env().Undefined();
+    Napi::Value valHeight = size.IsObject() ? size.As<Napi::Object>().Get("height") : info.Env().Undefined();
+    int32_t width = valWidth.IsNumber() ? valWidth.As<Napi::Number>().Int32Value() : 0;
+    int32_t height = valHeight.IsNumber() ? valHeight.As<Napi::Number>().Int32Value() : 0;
+    if(width < 1 || height < 1) {
+      delete prewarm;
+      Napi::Error::New(info.Env(), "sizes must be {width, height} Objects with width and height at least 1")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+    prewarm->sizes.emplace_back(width, height);
+  }
+
+  if(3 == info.Length()) {
+    Napi::Object options = info[2].As<Napi::Object>();
+    Napi::Value valStagingCount = options.Get("stagingCount");
+    Napi::Value valBuffers = options.Get("buffers");
+    Napi::Value valFormat = options.Get("format");
+    if(valStagingCount.IsNumber()) prewarm->stagingCount = valStagingCount.As<Napi::Number>().Uint32Value();
+    if(valBuffers.IsNumber()) prewarm->bufferCount = valBuffers.As<Napi::Number>().Uint32Value();
+    if(!(valFormat.IsUndefined() || ParsePixelFormat(valFormat, prewarm->format))) {
+      delete prewarm;
+      Napi::Error::New(info.Env(), "format must be \"bgra8\", \"rgba8\", \"rgb10a2\" or \"rgba16\"")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+    if(prewarm->stagingCount < 1) {
+      delete prewarm;
+      Napi::Error::New(info.Env(), "stagingCount must be at least 1")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+    if(prewarm->bufferCount < 1 || CTextureFrameHeader::MaxBuffers < prewarm->bufferCount) {
+      delete prewarm;
+      Napi::Error::New(info.Env(), "buffers must be 1 to 8")
+          .ThrowAsJavaScriptException();
+      return info.Env().Undefined();
+    }
+  }
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+  PipeCompletion completion(info.Env(), [deferred, prewarm](Napi::Env env, bool ok) {
+    if(ok) deferred.Resolve(env.Undefined());
+    else deferred.Reject(Napi::Error::New(env, prewarm->error).Value());
+    delete prewarm;
+  });
+
+  CPipeCompletionChannel * creations = GetAddonData(info.Env()).textureCreations;
+  creations->AddPending(info.Env());
+  GetTextureCreationQueue().Queue([prewarm, creations, completion = std::move(completion)]() mutable {
+    bool ok = true;
+    for(auto & size : prewarm->sizes) {
+      ok = GetTexturePool().Prewarm(prewarm->luidLo, prewarm->luidHi, size.first, size.second, prewarm->stagingCount, prewarm->bufferCount, prewarm->format, prewarm->error);
+      if(!ok) break;
+    }
+    creations->Post(std::move(completion), ok);
+  });
+
+  return deferred.Promise();
+}
+
+Napi::Value SharedTexture::GetAllStats(Napi::Env env) {
+  std::vector<SharedTexture *> & openTextures = GetAddonData(env).openTextures;
+  Napi::Array array = Napi::Array::New(env, openTextures.size());
+  for(size_t i = 0; i < openTextures.size(); i++) {
+    CTextureStats & stats = openTextures[i]->m_Uploader->GetStats();
+    auto dict = Napi::Object::New(env);
+    dict["name"] = Napi::String::New(env, openTextures[i]->m_Name);
+    dict["uploads"] = Napi::Number::New(env, (double)stats.uploads.Get());
+    dict["waited"] = Napi::Number::New(env, (double)stats.waited.Get());
+    dict["unchanged"] = Napi::Number::New(env, (double)stats.unchanged.Get());
+    dict["coalesced"] = Napi::Number::New(env, (double)stats.coalesced.Get());
+    dict["frames"] = Napi::Number::New(env, (double)stats.frames.Get());
+    dict["frameWaits"] = Napi::Number::New(env, (double)stats.frameWaits.Get());
+    dict["frameForced"] = Napi::Number::New(env, (double)stats.frameForced.Get());
+    dict["dirtyBytes"] = Napi::Number::New(env, (double)stats.dirtyBytes.Get());
+    dict["uploadedBytes"] = Napi::Number::New(env, (double)stats.uploadedBytes.Get());
+    dict["mapTime"] = StatHistogramToNapi(env, stats.mapTime);
+    dict["uploadTime"] = StatHistogramToNapi(env, stats.uploadTime);
+    dict["latency"] = StatHistogramToNapi(env, stats.latency);
+    dict["finishTime"] = StatHistogramToNapi(env, stats.finishTime);
+    array.Set((uint32_t)i, dict);
   }
+  return array;
+}
+
+void SharedTexture::ResetAllStats(Napi::Env env) {
+  for(SharedTexture * texture : GetAddonData(env).openTextures) texture->m_Uploader->GetStats().Reset();
+}
+
+bool SharedTexture::ParsePixelFormat(Napi::Value value, TexturePixelFormat_e & outFormat) {
+  if(!value.IsString()) return false;
+  std::string name = value.As<Napi::String>().Utf8Value();
+  if("bgra8" == name) outFormat = TextureFormat_Bgra8;
+  else if("rgba8" == name) outFormat = TextureFormat_Rgba8;
+  else if("rgb10a2" == name) outFormat = TextureFormat_Rgb10A2;
+  else if("rgba16" == name) outFormat = TextureFormat_Rgba16;
+  else return false;
+  return true;
 }
 
 void SharedTexture::Finalize(Napi::Env env) {
-  DoClose();
+  DoClose(env);
 }
 
 Napi::Value SharedTexture::Delete(const Napi::CallbackInfo& info) {
-  DoClose();
+  DoClose(info.Env());
    return info.Env().Undefined();
 }
 
-void SharedTexture::DoClose() {
-  if(m_StagingTexture) {
-    m_StagingTexture->Release();
-    m_StagingTexture = nullptr;
+void SharedTexture::DoClose(Napi::Env env) {
+  if(m_UploadQueue) {
+    delete m_UploadQueue; // Uploads what is still pending.
+    m_UploadQueue = nullptr;
   }
-  if(m_SharedTexture) {
-    m_SharedTexture->Release();
-    m_SharedTexture = nullptr;
+  bool bClaimed = false;
+  if(m_Frames) {
+    // Tells the game to let go of the textures, before the uploader hands
+    // them back to the pool where another SharedTexture may get them.
+    m_Frames->GetHeader()->closed.store(1);
+    bClaimed = 0 != m_Frames->GetHeader()->claimed.load();
   }
-  if(m_Ctx) {
-    m_Ctx->Release();
-    m_Ctx = nullptr;
+  if(m_Uploader) {
+    std::vector<SharedTexture *> & openTextures = GetAddonData(env).openTextures;
+    openTextures.erase(std::find(openTextures.begin(), openTextures.end(), this));
+    // The game claimed a buffer before it saw closed and may still read it,
+    // so the textures must not be written by a new SharedTexture.
+    if(bClaimed) GetTexturePool().Drop(m_Uploader->DetachDevice());
+    delete m_Uploader;
+    m_Uploader = nullptr;
+  }
+  if(m_Frames) {
+    delete m_Frames;
+    m_Frames = nullptr;
+  }
+  if(m_Trace) {
+    delete m_Trace;
+    m_Trace = nullptr;
+  }
+  if(m_Completions) {
+    m_Completions->Release(env);
+    m_Completions = nullptr;
   }
-  m_SharedHandle = INVALID_HANDLE_VALUE;
 }
 
 Napi::Value SharedTexture::GetSharedHandle(const Napi::CallbackInfo& info) {
-  void* __ptr64 ptr = HandleToHandle64(this->m_SharedHandle);
+  int64_t handle = m_Uploader ? m_Uploader->GetDevice()->GetSharedHandle(0) : -1;
   auto dict = Napi::Object::New(info.Env());
-  dict["lo"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr & 0xFFFFFFFF));
-  dict["hi"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr >> 32));
+  dict["lo"] = Napi::Number::New(info.Env(),(int)((uint64_t)handle & 0xFFFFFFFF));
+  dict["hi"] = Napi::Number::New(info.Env(),(int)((uint64_t)handle >> 32));
   return dict;
 }
 
-Napi::Value SharedTexture::Update(const Napi::CallbackInfo& info) {
-  if(!(info.Length() == 2 && info[0].IsObject() && info[1].IsBuffer())) {
-    Napi::Error::New(info.Env(), "Expected exactly 2 parameters: dirty Rectangle, Buffer")
+// Name of the frame section to pass to the game, undefined without buffers
+// 2 or more.
+Napi::Value SharedTexture::GetFrameSection(const Napi::CallbackInfo& info) {
+  if(nullptr == m_Frames) return info.Env().Undefined();
+  return Napi::String::New(info.Env(), m_Frames->GetName());
+}
+
+// Validates (dirty, image[, {stride, offset}]) and throws if they are not
+// usable. image is either the full frame or, if it has the dirty rect's size
+// or options are given, only the dirty rect's pixels: the top left one at
+// byte offset (default 0) and stride (default 4 * dirty.width) bytes per row.
+// Buffer views are used in place.
+bool SharedTexture::GetUpdateArgs(const Napi::CallbackInfo& info, TextureRect & outRect, const unsigned char * & outData, size_t & outRowPitch, bool & outSubImage) {
+  if(!((info.Length() == 2 || (info.Length() == 3 && info[2].IsObject())) && info[0].IsObject() && info[1].IsBuffer())) {
+    Napi::Error::New(info.Env(), "Expected 2 parameters: dirty Rectangle, Buffer and optional options Object")
         .ThrowAsJavaScriptException();
-    return info.Env().Undefined();    
+    return false;
+  }
+
+  if(!m_Uploader) {
+    Napi::Error::New(info.Env(), "SharedTexture already deleted")
+        .ThrowAsJavaScriptException();
+    return false;
   }
 
   Napi::Object obj = info[0].As<Napi::Object>();
   if(!(obj.Has("x") && obj.Has("y") && obj.Has("width")&& obj.Has("height"))) {
     Napi::Error::New(info.Env(), "Parameter 0 not a rectangle")
         .ThrowAsJavaScriptException();
-    return info.Env().Undefined();    
+    return false;    
   }
 
   Napi::Value valX = obj["x"];
@@ -761,7 +2184,7 @@ Napi::Value SharedTexture::Update(const Napi::CallbackInfo& info) {
   if(!(valX.IsNumber() && valY.IsNumber() && valWidth.IsNumber() && valHeight.IsNumber())) {
     Napi::Error::New(info.Env(), "Parameter 0 not a Rectangle")
         .ThrowAsJavaScriptException();
-    return info.Env().Undefined();    
+    return false;    
   }
 
   int x = valX.As<Napi::Number>().Int32Value();
@@ -772,69 +2195,201 @@ Napi::Value SharedTexture::Update(const Napi::CallbackInfo& info) {
   if(x < 0 || y < 0 || width > m_Width || height > m_Height || x + width > m_Width || y + height > m_Height) {
     Napi::Error::New(info.Env(), "Parameter 0 Rectangle is out of allowed bounds")
         .ThrowAsJavaScriptException();
-    return info.Env().Undefined();    
+    return false;    
   }
 
   auto buf = info[1].As<Napi::Buffer<char*>>();
+  size_t frameSize = (size_t)4 * m_Width * m_Height;
 
-  if(buf.ByteLength() != (size_t)4 * m_Width * m_Height) {
-    Napi::Error::New(info.Env(), "Image Buffer size unexpected: "+std::to_string(buf.ByteLength())+" != "+std::to_string((size_t)4 * m_Width * m_Height))
-        .ThrowAsJavaScriptException();
-    return info.Env().Undefined(); 
-  }
+  outRect = {x, y, width, height};
+  outData = reinterpret_cast<const unsigned char *>(buf.Data());
 
-  D3D11_MAPPED_SUBRESOURCE mapped;
+  if(2 == info.Length() && buf.ByteLength() == frameSize) {
+    outRowPitch = (size_t)4 * m_Width;
+    outSubImage = false;
+    return true;
+  }
 
-  if(SUCCEEDED(m_Ctx->Map(m_StagingTexture,0,D3D11_MAP_WRITE_DISCARD,0,&mapped))) {
-    unsigned char *pSrcData = reinterpret_cast<unsigned char *>(buf.Data());
-    size_t srcRowSize = sizeof(unsigned char) * 4 * m_Width;
-    if(mapped.pData != nullptr && pSrcData != nullptr) {
-      for(size_t i = 0; i < (size_t)height; i++) {
-        memcpy((unsigned char *)mapped.pData + ((size_t)y +i) * mapped.RowPitch  + (size_t)x * 4 * sizeof(unsigned char), pSrcData + ((size_t)y +i) * srcRowSize + (size_t)x * 4 * sizeof(unsigned char), sizeof(unsigned char) * 4 * width);
-      }
+  size_t stride = (size_t)4 * width;
+  size_t offset = 0;
+  if(3 == info.Length()) {
+    Napi::Object options = info[2].As<Napi::Object>();
+    Napi::Value valStride = options.Get("stride");
+    Napi::Value valOffset = options.Get("offset");
+    if(valStride.IsNumber()) stride = (size_t)valStride.As<Napi::Number>().Int64Value();
+    if(valOffset.IsNumber()) offset = (size_t)valOffset.As<Napi::Number>().Int64Value();
+    if(stride < (size_t)4 * width) {
+      Napi::Error::New(info.Env(), "stride must be at least 4 * dirty.width")
+          .ThrowAsJavaScriptException();
+      return false;
     }
+  }
 
-    m_Ctx->Unmap(m_StagingTexture,0);
+  // Without options the size must match exactly, to catch wrong frames.
+  size_t size = 0 < height ? offset + stride * (height - 1) + (size_t)4 * width : 0;
+  bool bSizeOk = 2 == info.Length()
+    ? buf.ByteLength() == size
+    : offset <= buf.ByteLength() && (height <= 1 || stride <= buf.ByteLength()) && size <= buf.ByteLength();
+  if(!bSizeOk) {
+    Napi::Error::New(info.Env(), "Image Buffer size unexpected: "+std::to_string(buf.ByteLength())+" is neither "+std::to_string(frameSize)+" (full frame) nor "+std::to_string(size)+" (dirty rect)")
+        .ThrowAsJavaScriptException();
+    return false; 
+  }
 
-    D3D11_BOX box = {
-      (size_t)x,(size_t)y,0,
-      (size_t)x+width,(size_t)y+height,1
-    };    
+  outData += offset;
+  outRowPitch = stride;
+  outSubImage = true;
+  return true;
+}
 
-    m_Ctx->CopySubresourceRegion(m_SharedTexture,0,x,y,0,m_StagingTexture,0,&box);
-    m_Ctx->Flush();
-  } else {
-    Napi::Error::New(info.Env(), "ID3D11DeviceContext::Map failed")
+// update(dirty, image[, options]) returns "free" if a staging texture was
+// free right away, "waited" if it had to wait for the GPU to finish with one
+// or "unchanged" if damage tracking found nothing to upload.
+Napi::Value SharedTexture::Update(const Napi::CallbackInfo& info) {
+  TextureRect rect;
+  const unsigned char * pSrcData;
+  size_t rowPitch;
+  bool bSubImage;
+  if(!GetUpdateArgs(info, rect, pSrcData, rowPitch, bSubImage)) return info.Env().Undefined();
+
+  uint64_t start = StatNowNanoseconds();
+
+  // The device and trace are not shared with the upload thread.
+  m_UploadQueue->WaitIdle();
+
+  if(m_Trace) m_Trace->Append(start, rect, pSrcData, rowPitch, bSubImage);
+
+  TextureUploadResult_e result = m_Uploader->Upload(rect, pSrcData, rowPitch, bSubImage);
+  m_Uploader->GetStats().latency.RecordSince(start);
+
+  switch(result) {
+  case TextureUpload_FreeSlot:
+    return Napi::String::New(info.Env(), "free");
+  case TextureUpload_Waited:
+    return Napi::String::New(info.Env(), "waited");
+  case TextureUpload_Unchanged:
+    return Napi::String::New(info.Env(), "unchanged");
+  default:
+    Napi::Error::New(info.Env(), "Mapping staging texture failed")
         .ThrowAsJavaScriptException();
     return info.Env().Undefined();    
-  }  
+  }
+}
 
-  return info.Env().Undefined();
+// updateAsync(dirty, image[, options]) uploads on the upload thread and returns a
+// promise for "free" / "waited" / "unchanged" like update, it rejects if
+// mapping failed. image must not be modified until the promise settled.
+// If a newer update arrives before the upload thread got to this one, this
+// one resolves with "coalesced" and its dirty rect is uploaded with the
+// newer image instead.
+Napi::Value SharedTexture::UpdateAsync(const Napi::CallbackInfo& info) {
+  TextureRect rect;
+  const unsigned char * pSrcData;
+  size_t rowPitch;
+  bool bSubImage;
+  if(!GetUpdateArgs(info, rect, pSrcData, rowPitch, bSubImage)) return info.Env().Undefined();
+
+  Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(info.Env());
+  Napi::ObjectReference * keepAlive = new Napi::ObjectReference(Napi::Persistent(info[1].As<Napi::Object>()));
+
+  m_Completions->AddPending(info.Env());
+
+  m_UploadQueue->Submit(PipeCompletion(deferred, keepAlive), rect, pSrcData, rowPitch, bSubImage);
+
+  return deferred.Promise();
+}
+
+// getDamageStats() returns {dirtyBytes, uploadedBytes, skippedBytes} since
+// creation, skippedBytes are dirty bytes damage tracking found unchanged.
+Napi::Value SharedTexture::GetDamageStats(const Napi::CallbackInfo& info) {
+  // Uploaded first, dirty bytes are counted before an upload starts.
+  uint64_t uploadedBytes = m_Uploader ? (uint64_t)m_Uploader->GetStats().uploadedBytes.Get() : 0;
+  uint64_t dirtyBytes = m_Uploader ? (uint64_t)m_Uploader->GetStats().dirtyBytes.Get() : 0;
+  if(dirtyBytes < uploadedBytes) dirtyBytes = uploadedBytes; // Raced with resetStats.
+  auto dict = Napi::Object::New(info.Env());
+  dict["dirtyBytes"] = Napi::Number::New(info.Env(), (double)dirtyBytes);
+  dict["uploadedBytes"] = Napi::Number::New(info.Env(), (double)uploadedBytes);
+  dict["skippedBytes"] = Napi::Number::New(info.Env(), (double)(dirtyBytes - uploadedBytes));
+  return dict;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 
 Napi::Value GetInvalidHandleValue(const Napi::CallbackInfo& info) {
+#ifdef _WIN32
   void* __ptr64 ptr = HandleToHandle64(INVALID_HANDLE_VALUE);
+#else
+  int64_t ptr = -1;
+#endif
+  auto dict = Napi::Object::New(info.Env());
+  dict["lo"] = Napi::Number::New(info.Env(),(int)((uint64_t)ptr & 0xFFFFFFFF));
+  dict["hi"] = Napi::Number::New(info.Env(),(int)((uint64_t)ptr >> 32));
+  return dict;
+}
+
+Napi::Value GetTexturePoolStats(Napi::Env env) {
+  CTexturePool & pool = GetTexturePool();
+  CTexturePoolStats & stats = pool.GetStats();
+  auto dict = Napi::Object::New(env);
+  dict["hits"] = Napi::Number::New(env, (double)stats.hits.Get());
+  dict["misses"] = Napi::Number::New(env, (double)stats.misses.Get());
+  dict["adapters"] = Napi::Number::New(env, (double)stats.adapters.Get());
+  dict["evicted"] = Napi::Number::New(env, (double)stats.evicted.Get());
+  dict["dropped"] = Napi::Number::New(env, (double)stats.dropped.Get());
+  dict["idle"] = Napi::Number::New(env, (double)pool.GetIdleCount());
+  dict["createTime"] = StatHistogramToNapi(env, stats.createTime);
+  dict["acquireTime"] = StatHistogramToNapi(env, stats.acquireTime);
+  return dict;
+}
+
+// getStats() returns {pipes: [{name, queueDepth, bytesIn, bytesOut,
+// bytesCopied, messagesIn, messagesOut, dropped, merged, readTime, writeTime,
+// buffers: {acquired, reused, allocations, allocatedBytes, inUse}}],
+// textures: [{name, uploads, waited, unchanged, coalesced, frames,
+// frameWaits, frameForced, dirtyBytes, uploadedBytes, mapTime, uploadTime,
+// latency, finishTime}], texturePool: {hits, misses, adapters, evicted,
+// dropped, idle, createTime, acquireTime}} for open pipes and textures, times are
+// {count, mean, p50, p99, max} in microseconds.
+Napi::Value GetStats(const Napi::CallbackInfo& info) {
   auto dict = Napi::Object::New(info.Env());
-  dict["lo"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr & 0xFFFFFFFF));
-  dict["hi"] = Napi::Number::New(info.Env(),(int)((unsigned __int64)ptr >> 32));
+  dict["pipes"] = AnonymousPipe::GetAllStats(info.Env());
+  dict["textures"] = SharedTexture::GetAllStats(info.Env());
+  dict["texturePool"] = GetTexturePoolStats(info.Env());
   return dict;
 }
 
+// resetStats() zeroes what getStats() returns, except queueDepth, idle,
+// allocatedBytes and inUse.
+Napi::Value ResetStats(const Napi::CallbackInfo& info) {
+  AnonymousPipe::ResetAllStats(info.Env());
+  SharedTexture::ResetAllStats(info.Env());
+  GetTexturePool().GetStats().Reset();
+  return info.Env().Undefined();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 using namespace Napi;
 
 Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
+  env.SetInstanceData(new AddonData());
+
   AnonymousPipe::Init(env, exports);
 
+  JsonRpcClient::Init(env, exports);
+
   SharedTexture::Init(env, exports);
 
   exports.Set(Napi::String::New(env, "getInvalidHandleValue"),
               Napi::Function::New(env, GetInvalidHandleValue));
 
+  exports.Set(Napi::String::New(env, "getStats"),
+              Napi::Function::New(env, GetStats));
+
+  exports.Set(Napi::String::New(env, "resetStats"),
+              Napi::Function::New(env, ResetStats));
+
   return exports;
 }
 
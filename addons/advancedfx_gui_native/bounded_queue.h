@@ -0,0 +1,88 @@
+#pragma once
+
+#include "stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+enum BoundedQueuePolicy_e {
+  BoundedQueuePolicy_Block, // Nothing is lost, the producer is told to wait.
+  BoundedQueuePolicy_DropOldest, // The oldest items make room for new ones.
+  BoundedQueuePolicy_Coalesce // Like Block, but an item replaces the one before it if both have the same key.
+};
+
+// FIFO of at most limit items (0 for no limit) for messages that can pile up
+// faster than they are consumed, e.g. input events.
+// Not thread-safe.
+template<class T> class CBoundedQueue {
+ public:
+  // Counters are optional, they count items dropped and merged away.
+  void Configure(BoundedQueuePolicy_e policy, size_t limit, CStatCounter * pDropped = nullptr, CStatCounter * pMerged = nullptr) {
+    m_Policy = policy;
+    m_Limit = limit;
+    m_Dropped = pDropped;
+    m_Merged = pMerged;
+  }
+
+  BoundedQueuePolicy_e GetPolicy() const {
+    return m_Policy;
+  }
+
+  size_t GetLimit() const {
+    return m_Limit;
+  }
+
+  // Key 0 never coalesces. Items dropped or merged away are handed to
+  // onRemoved(T && item, bool bMerged), the caller may still have to answer
+  // them.
+  // Returns false if the queue is over its limit now, which only happens
+  // with Block and Coalesce: the producer should wait until items were
+  // popped.
+  template<class OnRemoved> bool Push(T && item, uint64_t key, OnRemoved onRemoved) {
+    if(BoundedQueuePolicy_Coalesce == m_Policy && 0 != key && !m_Items.empty() && key == m_Items.back().key) {
+      std::swap(m_Items.back().item, item);
+      if(m_Merged) m_Merged->Add(1);
+      onRemoved(std::move(item), true);
+      return true;
+    }
+
+    m_Items.push_back(Entry{std::move(item), key});
+
+    if(0 == m_Limit || m_Items.size() <= m_Limit) return true;
+    if(BoundedQueuePolicy_DropOldest != m_Policy) return false;
+
+    T oldest = std::move(m_Items.front().item);
+    m_Items.pop_front();
+    if(m_Dropped) m_Dropped->Add(1);
+    onRemoved(std::move(oldest), false);
+    return true;
+  }
+
+  bool IsEmpty() const {
+    return m_Items.empty();
+  }
+
+  size_t GetSize() const {
+    return m_Items.size();
+  }
+
+  T PopFront() {
+    T item = std::move(m_Items.front().item);
+    m_Items.pop_front();
+    return item;
+  }
+
+ private:
+  struct Entry {
+    T item;
+    uint64_t key;
+  };
+
+  BoundedQueuePolicy_e m_Policy = BoundedQueuePolicy_Block;
+  size_t m_Limit = 0;
+  CStatCounter * m_Dropped = nullptr;
+  CStatCounter * m_Merged = nullptr;
+  std::deque<Entry> m_Items;
+};
@@ -0,0 +1,72 @@
+#include "file_writer.h"
+
+#include <cstring>
+#include <utility>
+
+CBufferedFileWriter * CBufferedFileWriter::Create(const char * path) {
+  FILE * file = fopen(path, "wb");
+  if(nullptr == file) return nullptr;
+  return new CBufferedFileWriter(file);
+}
+
+// Latency does not matter here, a spinning worker would only take the CPU
+// from the threads that append.
+CBufferedFileWriter::CBufferedFileWriter(FILE * file)
+: m_File(file)
+, m_Queue(0) {
+  m_Buffer.reserve(m_BufferSize);
+}
+
+CBufferedFileWriter::~CBufferedFileWriter() {
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(!m_Buffer.empty()) QueueBuffer();
+  }
+  m_Queue.SignalQuit();
+  m_Queue.Join();
+  fclose(m_File);
+}
+
+void CBufferedFileWriter::Append(const void * pHead, size_t headSize, const void * pData, size_t dataSize) {
+  std::unique_lock<std::mutex> lock(m_Lock);
+  if(m_Failed) return;
+
+  // Hand the buffer over before it would have to grow, appends bigger than
+  // a buffer get one of their own.
+  size_t size = headSize + dataSize;
+  if(!m_Buffer.empty() && m_BufferSize < m_Buffer.size() + size) QueueBuffer();
+
+  size_t offset = m_Buffer.size();
+  m_Buffer.resize(offset + size);
+  if(headSize) memcpy(&m_Buffer[offset], pHead, headSize);
+  if(dataSize) memcpy(&m_Buffer[offset + headSize], pData, dataSize);
+}
+
+bool CBufferedFileWriter::IsOk() {
+  std::unique_lock<std::mutex> lock(m_Lock);
+  return !m_Failed;
+}
+
+void CBufferedFileWriter::QueueBuffer() {
+  std::vector<unsigned char> buffer;
+  buffer.swap(m_Buffer);
+  if(!m_Spare.empty()) {
+    m_Buffer.swap(m_Spare.back());
+    m_Spare.pop_back();
+  } else {
+    m_Buffer.reserve(m_BufferSize);
+  }
+
+  m_Queue.Queue([this, buffer = std::move(buffer)]() mutable {
+    WriteBuffer(buffer);
+  });
+}
+
+void CBufferedFileWriter::WriteBuffer(std::vector<unsigned char> & buffer) {
+  bool bOk = 1 == fwrite(buffer.data(), buffer.size(), 1, m_File) && 0 == fflush(m_File);
+
+  std::unique_lock<std::mutex> lock(m_Lock);
+  if(!bOk) m_Failed = true;
+  buffer.clear();
+  if(m_Spare.size() < 2) m_Spare.push_back(std::move(buffer));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "threaded_queue.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// Append-only file for traces and captures: Append copies into a large
+// buffer and full buffers are written by a worker thread, so the thread
+// that appends only pays for a memcpy.
+class CBufferedFileWriter {
+ public:
+  // Returns nullptr if path can not be created.
+  static CBufferedFileWriter * Create(const char * path);
+
+  // Writes what is buffered and closes the file.
+  ~CBufferedFileWriter();
+
+  CBufferedFileWriter(const CBufferedFileWriter& rhs) = delete;
+  CBufferedFileWriter& operator=(const CBufferedFileWriter& rhs) = delete;
+
+  // Any thread. Head and data end up back to back, appends from other
+  // threads do not go in between.
+  void Append(const void * pHead, size_t headSize, const void * pData = nullptr, size_t dataSize = 0);
+
+  // False once a write to the file failed, appends are dropped from then on.
+  bool IsOk();
+
+ private:
+  static const size_t m_BufferSize = 256 * 1024;
+
+  explicit CBufferedFileWriter(FILE * file);
+
+  FILE * m_File;
+  std::mutex m_Lock;
+  std::vector<unsigned char> m_Buffer;
+  std::vector<std::vector<unsigned char>> m_Spare; // Written buffers for reuse.
+  bool m_Failed = false;
+  CThreadedQueue m_Queue;
+
+  // Requires m_Lock.
+  void QueueBuffer();
+
+  // On m_Queue.
+  void WriteBuffer(std::vector<unsigned char> & buffer);
+};
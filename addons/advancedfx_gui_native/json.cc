@@ -0,0 +1,392 @@
+#include "json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#include <emmintrin.h>
+#define ADVANCEDFX_JSON_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+const CJsonValue * CJsonValue::Find(const char * key) const {
+  if(Type_Object != type) return nullptr;
+  for(size_t i = 0; i < keys.size(); i++) {
+    if(keys[i] == key) return &values[i];
+  }
+  return nullptr;
+}
+
+namespace {
+
+class CJsonParser {
+ public:
+  CJsonParser(const char * pData, size_t size)
+  : m_Cur(pData), m_End(pData + size) {
+  }
+
+  bool Parse(CJsonValue & outValue, std::string & outError) {
+    SkipWhitespace();
+    if(!ParseValue(outValue, 0)) {
+      outError = m_Error;
+      return false;
+    }
+    SkipWhitespace();
+    if(m_Cur != m_End) {
+      outError = "Unexpected trailing characters";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static const int m_MaxDepth = 256;
+
+  const char * m_Cur;
+  const char * m_End;
+  const char * m_Error = nullptr;
+
+  bool Fail(const char * error) {
+    m_Error = error;
+    return false;
+  }
+
+  void SkipWhitespace() {
+    while(m_Cur < m_End && (' ' == *m_Cur || '\n' == *m_Cur || '\r' == *m_Cur || '\t' == *m_Cur)) ++m_Cur;
+  }
+
+  bool Expect(const char * literal, size_t length) {
+    if((size_t)(m_End - m_Cur) < length || 0 != memcmp(m_Cur, literal, length)) return Fail("Invalid literal");
+    m_Cur += length;
+    return true;
+  }
+
+  bool ParseValue(CJsonValue & outValue, int depth) {
+    if(m_Cur == m_End) return Fail("Unexpected end of input");
+
+    switch(*m_Cur) {
+    case 'n':
+      outValue.type = CJsonValue::Type_Null;
+      return Expect("null", 4);
+    case 'f':
+      outValue.type = CJsonValue::Type_False;
+      return Expect("false", 5);
+    case 't':
+      outValue.type = CJsonValue::Type_True;
+      return Expect("true", 4);
+    case '"':
+      outValue.type = CJsonValue::Type_String;
+      return ParseString(outValue.string);
+    case '[':
+      if(m_MaxDepth <= depth) return Fail("Nesting too deep");
+      outValue.type = CJsonValue::Type_Array;
+      return ParseArray(outValue, depth + 1);
+    case '{':
+      if(m_MaxDepth <= depth) return Fail("Nesting too deep");
+      outValue.type = CJsonValue::Type_Object;
+      return ParseObject(outValue, depth + 1);
+    default:
+      outValue.type = CJsonValue::Type_Number;
+      return ParseNumber(outValue.number);
+    }
+  }
+
+  bool ParseArray(CJsonValue & outValue, int depth) {
+    ++m_Cur;
+    SkipWhitespace();
+    if(m_Cur < m_End && ']' == *m_Cur) {
+      ++m_Cur;
+      return true;
+    }
+    while(true) {
+      outValue.values.emplace_back();
+      if(!ParseValue(outValue.values.back(), depth)) return false;
+      SkipWhitespace();
+      if(m_Cur == m_End) return Fail("Unexpected end of input");
+      if(']' == *m_Cur) {
+        ++m_Cur;
+        return true;
+      }
+      if(',' != *m_Cur) return Fail("Expected ',' or ']'");
+      ++m_Cur;
+      SkipWhitespace();
+    }
+  }
+
+  bool ParseObject(CJsonValue & outValue, int depth) {
+    ++m_Cur;
+    SkipWhitespace();
+    if(m_Cur < m_End && '}' == *m_Cur) {
+      ++m_Cur;
+      return true;
+    }
+    while(true) {
+      if(m_Cur == m_End || '"' != *m_Cur) return Fail("Expected member name");
+      outValue.keys.emplace_back();
+      if(!ParseString(outValue.keys.back())) return false;
+      SkipWhitespace();
+      if(m_Cur == m_End || ':' != *m_Cur) return Fail("Expected ':'");
+      ++m_Cur;
+      SkipWhitespace();
+      outValue.values.emplace_back();
+      if(!ParseValue(outValue.values.back(), depth)) return false;
+      SkipWhitespace();
+      if(m_Cur == m_End) return Fail("Unexpected end of input");
+      if('}' == *m_Cur) {
+        ++m_Cur;
+        return true;
+      }
+      if(',' != *m_Cur) return Fail("Expected ',' or '}'");
+      ++m_Cur;
+      SkipWhitespace();
+    }
+  }
+
+  bool ParseNumber(double & outNumber) {
+    const char * start = m_Cur;
+    if(m_Cur < m_End && '-' == *m_Cur) ++m_Cur;
+    if(m_Cur == m_End) return Fail("Invalid number");
+    if('0' == *m_Cur) {
+      ++m_Cur;
+    } else if('1' <= *m_Cur && *m_Cur <= '9') {
+      while(m_Cur < m_End && '0' <= *m_Cur && *m_Cur <= '9') ++m_Cur;
+    } else {
+      return Fail("Unexpected character");
+    }
+    if(m_Cur < m_End && '.' == *m_Cur) {
+      ++m_Cur;
+      if(m_Cur == m_End || !('0' <= *m_Cur && *m_Cur <= '9')) return Fail("Invalid number");
+      while(m_Cur < m_End && '0' <= *m_Cur && *m_Cur <= '9') ++m_Cur;
+    }
+    if(m_Cur < m_End && ('e' == *m_Cur || 'E' == *m_Cur)) {
+      ++m_Cur;
+      if(m_Cur < m_End && ('+' == *m_Cur || '-' == *m_Cur)) ++m_Cur;
+      if(m_Cur == m_End || !('0' <= *m_Cur && *m_Cur <= '9')) return Fail("Invalid number");
+      while(m_Cur < m_End && '0' <= *m_Cur && *m_Cur <= '9') ++m_Cur;
+    }
+
+    // Fast path for small integers, which is most of what we see.
+    size_t length = m_Cur - start;
+    bool bNegative = '-' == *start;
+    if(length - (bNegative ? 1 : 0) <= 15) {
+      const char * p = start + (bNegative ? 1 : 0);
+      long long value = 0;
+      while(p < m_Cur && '0' <= *p && *p <= '9') value = value * 10 + (*p++ - '0');
+      if(p == m_Cur) {
+        outNumber = bNegative ? -(double)value : (double)value;
+        return true;
+      }
+    }
+
+    char buffer[64];
+    std::string longBuffer;
+    const char * text = buffer;
+    if(length < sizeof(buffer)) {
+      memcpy(buffer, start, length);
+      buffer[length] = 0;
+    } else {
+      longBuffer.assign(start, length);
+      text = longBuffer.c_str();
+    }
+    outNumber = strtod(text, nullptr);
+    return true;
+  }
+
+  // Returns the first position at or after p that holds '"', '\\' or a
+  // control character.
+  const char * ScanString(const char * p) {
+#ifdef ADVANCEDFX_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i controlLimit = _mm_set1_epi8(0x1F);
+    while(16 <= m_End - p) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(chunk, controlLimit), chunk)); // chunk <= 0x1F (unsigned)
+      int mask = _mm_movemask_epi8(special);
+      if(mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, (unsigned long)mask);
+        return p + index;
+#else
+        return p + __builtin_ctz((unsigned)mask);
+#endif
+      }
+      p += 16;
+    }
+#endif
+    while(p < m_End && '"' != *p && '\\' != *p && 0x20 <= (unsigned char)*p) ++p;
+    return p;
+  }
+
+  static void AppendUtf8(std::string & out, unsigned long codePoint) {
+    if(codePoint < 0x80) {
+      out += (char)codePoint;
+    } else if(codePoint < 0x800) {
+      out += (char)(0xC0 | (codePoint >> 6));
+      out += (char)(0x80 | (codePoint & 0x3F));
+    } else if(codePoint < 0x10000) {
+      out += (char)(0xE0 | (codePoint >> 12));
+      out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+      out += (char)(0x80 | (codePoint & 0x3F));
+    } else {
+      out += (char)(0xF0 | (codePoint >> 18));
+      out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+      out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+      out += (char)(0x80 | (codePoint & 0x3F));
+    }
+  }
+
+  bool ParseHex4(unsigned long & outValue) {
+    if(m_End - m_Cur < 4) return Fail("Invalid unicode escape");
+    outValue = 0;
+    for(int i = 0; i < 4; i++) {
+      char c = *m_Cur++;
+      outValue <<= 4;
+      if('0' <= c && c <= '9') outValue |= c - '0';
+      else if('a' <= c && c <= 'f') outValue |= c - 'a' + 10;
+      else if('A' <= c && c <= 'F') outValue |= c - 'A' + 10;
+      else return Fail("Invalid unicode escape");
+    }
+    return true;
+  }
+
+  bool ParseString(std::string & outString) {
+    ++m_Cur;
+    while(true) {
+      const char * p = ScanString(m_Cur);
+      outString.append(m_Cur, p);
+      m_Cur = p;
+      if(m_Cur == m_End) return Fail("Unterminated string");
+      if('"' == *m_Cur) {
+        ++m_Cur;
+        return true;
+      }
+      if('\\' != *m_Cur) return Fail("Control character in string");
+      ++m_Cur;
+      if(m_Cur == m_End) return Fail("Unterminated string");
+      switch(*m_Cur++) {
+      case '"': outString += '"'; break;
+      case '\\': outString += '\\'; break;
+      case '/': outString += '/'; break;
+      case 'b': outString += '\b'; break;
+      case 'f': outString += '\f'; break;
+      case 'n': outString += '\n'; break;
+      case 'r': outString += '\r'; break;
+      case 't': outString += '\t'; break;
+      case 'u': {
+          unsigned long codePoint;
+          if(!ParseHex4(codePoint)) return false;
+          if(0xD800 <= codePoint && codePoint <= 0xDBFF && 2 <= m_End - m_Cur && '\\' == m_Cur[0] && 'u' == m_Cur[1]) {
+            const char * restore = m_Cur;
+            m_Cur += 2;
+            unsigned long low;
+            if(!ParseHex4(low)) return false;
+            if(0xDC00 <= low && low <= 0xDFFF) {
+              codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            } else {
+              m_Cur = restore;
+            }
+          }
+          // A lone surrogate has no UTF-8 encoding, like V8 does when
+          // converting to UTF-8.
+          if(0xD800 <= codePoint && codePoint <= 0xDFFF) codePoint = 0xFFFD;
+          AppendUtf8(outString, codePoint);
+        }
+        break;
+      default:
+        return Fail("Invalid escape");
+      }
+    }
+  }
+};
+
+} // namespace
+
+bool ParseJson(const char * pData, size_t size, CJsonValue & outValue, std::string & outError) {
+  CJsonParser parser(pData, size);
+  return parser.Parse(outValue, outError);
+}
+
+void AppendJsonString(std::string & out, const char * pData, size_t size) {
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  const char * runStart = pData;
+  const char * end = pData + size;
+  for(const char * p = pData; p < end; ++p) {
+    unsigned char c = (unsigned char)*p;
+    if('"' != c && '\\' != c && 0x20 <= c) continue;
+    out.append(runStart, p);
+    runStart = p + 1;
+    switch(c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\b': out += "\\b"; break;
+    case '\f': out += "\\f"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      out += "\\u00";
+      out += hex[c >> 4];
+      out += hex[c & 0xF];
+      break;
+    }
+  }
+  out.append(runStart, end);
+  out += '"';
+}
+
+void AppendJsonNumber(std::string & out, double number) {
+  // Like JSON.stringify: non-finite numbers become null.
+  if(!std::isfinite(number)) {
+    out += "null";
+    return;
+  }
+
+  char buffer[32];
+  if(std::fabs(number) < 9007199254740992.0 && number == (double)(long long)number) {
+    snprintf(buffer, sizeof(buffer), "%lld", (long long)number);
+  } else {
+    // Shortest representation that round-trips.
+    for(int precision = 15; precision <= 17; precision++) {
+      snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+      if(strtod(buffer, nullptr) == number) break;
+    }
+  }
+  out += buffer;
+}
+
+void AppendJson(std::string & out, const CJsonValue & value) {
+  switch(value.type) {
+  case CJsonValue::Type_Null: out += "null"; break;
+  case CJsonValue::Type_False: out += "false"; break;
+  case CJsonValue::Type_True: out += "true"; break;
+  case CJsonValue::Type_Number: AppendJsonNumber(out, value.number); break;
+  case CJsonValue::Type_String: AppendJsonString(out, value.string.data(), value.string.size()); break;
+  case CJsonValue::Type_Array:
+    out += '[';
+    for(size_t i = 0; i < value.values.size(); i++) {
+      if(i) out += ',';
+      AppendJson(out, value.values[i]);
+    }
+    out += ']';
+    break;
+  case CJsonValue::Type_Object:
+    out += '{';
+    for(size_t i = 0; i < value.values.size(); i++) {
+      if(i) out += ',';
+      AppendJsonString(out, value.keys[i].data(), value.keys[i].size());
+      out += ':';
+      AppendJson(out, value.values[i]);
+    }
+    out += '}';
+    break;
+  }
+}
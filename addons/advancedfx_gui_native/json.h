@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Minimal JSON DOM, parser and writer for use off the JS thread.
+class CJsonValue {
+ public:
+  enum Type_e {
+    Type_Null,
+    Type_False,
+    Type_True,
+    Type_Number,
+    Type_String,
+    Type_Array,
+    Type_Object
+  };
+
+  Type_e type = Type_Null;
+  double number = 0;
+  std::string string;
+  std::vector<CJsonValue> values; // Array elements or object member values.
+  std::vector<std::string> keys; // Object member names, parallel to values.
+
+  // Returns nullptr if not an object or no such member.
+  const CJsonValue * Find(const char * key) const;
+};
+
+// Parses the complete text, returns false and sets outError on failure.
+bool ParseJson(const char * pData, size_t size, CJsonValue & outValue, std::string & outError);
+
+void AppendJson(std::string & out, const CJsonValue & value);
+void AppendJsonString(std::string & out, const char * pData, size_t size);
+void AppendJsonNumber(std::string & out, double number);
@@ -0,0 +1,228 @@
+#include "json_rpc.h"
+#include "msgpack.h"
+
+#include <cstring>
+
+static void SetError(CJsonRpcRequest & outRequest, int code, const char * message) {
+  outRequest.valid = false;
+  outRequest.errorCode = code;
+  outRequest.errorMessage = message;
+}
+
+static bool ParseJsonRpcRoot(const char * pData, size_t size, CJsonValue & outRoot, std::string & outError) {
+  return IsMsgPackPayload(pData, size)
+    ? ParseMsgPack(pData, size, outRoot, outError)
+    : ParseJson(pData, size, outRoot, outError);
+}
+
+static bool TakeMember(CJsonValue & object, const char * key, CJsonValue & outValue) {
+  for(size_t i = 0; i < object.keys.size(); i++) {
+    if(key == object.keys[i]) {
+      outValue = std::move(object.values[i]);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParseJsonRpcRequest(const char * pData, size_t size, CJsonRpcRequest & outRequest) {
+  CJsonValue root;
+  std::string error;
+  outRequest.encoding = IsMsgPackPayload(pData, size) ? JsonRpcEncoding_MsgPack : JsonRpcEncoding_Json;
+  if(!ParseJsonRpcRoot(pData, size, root, error)) {
+    SetError(outRequest, JsonRpcError_ParseError, ("Parse error: " + error).c_str());
+    return;
+  }
+
+  if(CJsonValue::Type_Array == root.type) {
+    SetError(outRequest, JsonRpcError_InvalidRequest, "Batch requests are not supported");
+    return;
+  }
+  if(CJsonValue::Type_Object != root.type) {
+    SetError(outRequest, JsonRpcError_InvalidRequest, "Not a JSON-RPC 2.0 request");
+    return;
+  }
+
+  for(size_t i = 0; i < root.keys.size(); i++) {
+    const std::string & key = root.keys[i];
+    CJsonValue & value = root.values[i];
+    if("id" == key) {
+      if(!(CJsonValue::Type_Number == value.type || CJsonValue::Type_String == value.type || CJsonValue::Type_Null == value.type)) {
+        SetError(outRequest, JsonRpcError_InvalidRequest, "Invalid id");
+        return;
+      }
+      outRequest.id = std::move(value);
+      outRequest.hasId = true;
+    }
+  }
+
+  const CJsonValue * pVersion = root.Find("jsonrpc");
+  if(!(pVersion && CJsonValue::Type_String == pVersion->type && "2.0" == pVersion->string)) {
+    SetError(outRequest, JsonRpcError_InvalidRequest, "Not a JSON-RPC 2.0 request");
+    return;
+  }
+
+  const CJsonValue * pMethod = root.Find("method");
+  if(!(pMethod && CJsonValue::Type_String == pMethod->type)) {
+    SetError(outRequest, JsonRpcError_InvalidRequest, "Missing method");
+    return;
+  }
+  outRequest.method = pMethod->string;
+
+  for(size_t i = 0; i < root.keys.size(); i++) {
+    if("params" == root.keys[i]) {
+      CJsonValue & value = root.values[i];
+      if(!(CJsonValue::Type_Array == value.type || CJsonValue::Type_Object == value.type)) {
+        SetError(outRequest, JsonRpcError_InvalidParams, "params must be an Array or Object");
+        return;
+      }
+      outRequest.params = std::move(value);
+    }
+  }
+
+  outRequest.valid = true;
+}
+
+void ParseJsonRpcResponse(const char * pData, size_t size, CJsonRpcResponse & outResponse) {
+  CJsonValue root;
+  std::string error;
+  if(!ParseJsonRpcRoot(pData, size, root, error)) {
+    outResponse.invalidReason = "Parse error: " + error;
+    return;
+  }
+
+  const CJsonValue * pVersion = root.Find("jsonrpc");
+  if(!(pVersion && CJsonValue::Type_String == pVersion->type && "2.0" == pVersion->string)) {
+    outResponse.invalidReason = "Not a JSON-RPC 2.0 response";
+    return;
+  }
+
+  const CJsonValue * pMethod = root.Find("method");
+  if(pMethod) {
+    if(CJsonValue::Type_String != pMethod->type || root.Find("id")) {
+      outResponse.invalidReason = "Requests to the calling side are not supported";
+      return;
+    }
+    outResponse.isNotification = true;
+    outResponse.method = pMethod->string;
+    TakeMember(root, "params", outResponse.params);
+    outResponse.valid = true;
+    return;
+  }
+
+  if(!TakeMember(root, "id", outResponse.id)
+    || !(CJsonValue::Type_Number == outResponse.id.type || CJsonValue::Type_String == outResponse.id.type || CJsonValue::Type_Null == outResponse.id.type)) {
+    outResponse.invalidReason = "Missing or invalid id";
+    return;
+  }
+
+  CJsonValue errorObject;
+  if(TakeMember(root, "error", errorObject)) {
+    const CJsonValue * pCode = errorObject.Find("code");
+    const CJsonValue * pMessage = errorObject.Find("message");
+    if(!(pCode && CJsonValue::Type_Number == pCode->type && pMessage && CJsonValue::Type_String == pMessage->type)) {
+      outResponse.invalidReason = "Invalid error object";
+      return;
+    }
+    outResponse.isError = true;
+    outResponse.errorCode = (int)pCode->number;
+    outResponse.errorMessage = pMessage->string;
+    TakeMember(errorObject, "data", outResponse.errorData);
+  } else if(!TakeMember(root, "result", outResponse.result)) {
+    outResponse.invalidReason = "Missing result or error";
+    return;
+  }
+
+  outResponse.valid = true;
+}
+
+void AppendJsonRpcRequest(std::string & out, JsonRpcEncoding_e encoding, const char * method, const CJsonValue & params, const CJsonValue * pId) {
+  bool bHasParams = CJsonValue::Type_Null != params.type;
+
+  if(JsonRpcEncoding_MsgPack == encoding) {
+    AppendMsgPackMapHeader(out, 2 + (bHasParams ? 1 : 0) + (pId ? 1 : 0));
+    AppendMsgPackString(out, "jsonrpc", 7);
+    AppendMsgPackString(out, "2.0", 3);
+    AppendMsgPackString(out, "method", 6);
+    AppendMsgPackString(out, method, strlen(method));
+    if(bHasParams) {
+      AppendMsgPackString(out, "params", 6);
+      AppendMsgPack(out, params);
+    }
+    if(pId) {
+      AppendMsgPackString(out, "id", 2);
+      AppendMsgPack(out, *pId);
+    }
+    return;
+  }
+
+  out += "{\"jsonrpc\":\"2.0\",\"method\":";
+  AppendJsonString(out, method, strlen(method));
+  if(bHasParams) {
+    out += ",\"params\":";
+    AppendJson(out, params);
+  }
+  if(pId) {
+    out += ",\"id\":";
+    AppendJson(out, *pId);
+  }
+  out += '}';
+}
+
+void AppendJsonRpcResultHead(std::string & out) {
+  out += "{\"jsonrpc\":\"2.0\",\"result\":";
+}
+
+void AppendJsonRpcResultTail(std::string & out, const CJsonValue * pId) {
+  if(pId) {
+    out += ",\"id\":";
+    AppendJson(out, *pId);
+  }
+  out += '}';
+}
+
+void AppendJsonRpcResult(std::string & out, JsonRpcEncoding_e encoding, const CJsonValue & result, const CJsonValue * pId) {
+  if(JsonRpcEncoding_MsgPack == encoding) {
+    AppendMsgPackMapHeader(out, pId ? 3 : 2);
+    AppendMsgPackString(out, "jsonrpc", 7);
+    AppendMsgPackString(out, "2.0", 3);
+    AppendMsgPackString(out, "result", 6);
+    AppendMsgPack(out, result);
+    if(pId) {
+      AppendMsgPackString(out, "id", 2);
+      AppendMsgPack(out, *pId);
+    }
+    return;
+  }
+
+  AppendJsonRpcResultHead(out);
+  AppendJson(out, result);
+  AppendJsonRpcResultTail(out, pId);
+}
+
+void AppendJsonRpcError(std::string & out, JsonRpcEncoding_e encoding, const CJsonValue * pId, int code, const char * message) {
+  if(JsonRpcEncoding_MsgPack == encoding) {
+    AppendMsgPackMapHeader(out, 3);
+    AppendMsgPackString(out, "jsonrpc", 7);
+    AppendMsgPackString(out, "2.0", 3);
+    AppendMsgPackString(out, "error", 5);
+    AppendMsgPackMapHeader(out, 2);
+    AppendMsgPackString(out, "code", 4);
+    AppendMsgPackNumber(out, code);
+    AppendMsgPackString(out, "message", 7);
+    AppendMsgPackString(out, message, strlen(message));
+    AppendMsgPackString(out, "id", 2);
+    if(pId) AppendMsgPack(out, *pId);
+    else AppendMsgPackNil(out);
+    return;
+  }
+
+  out += "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":";
+  AppendJsonNumber(out, code);
+  out += ",\"message\":";
+  AppendJsonString(out, message, strlen(message));
+  out += "},\"id\":";
+  if(pId) AppendJson(out, *pId);
+  else out += "null";
+  out += '}';
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "json.h"
+
+// JSON-RPC 2.0 error codes.
+enum JsonRpcError_e {
+  JsonRpcError_ParseError = -32700,
+  JsonRpcError_InvalidRequest = -32600,
+  JsonRpcError_MethodNotFound = -32601,
+  JsonRpcError_InvalidParams = -32602,
+  JsonRpcError_InternalError = -32603,
+
+  // Server defined: the request was not handled because of a queue limit.
+  JsonRpcError_Dropped = -32000,
+  JsonRpcError_Merged = -32001
+};
+
+enum JsonRpcEncoding_e {
+  JsonRpcEncoding_Json,
+  JsonRpcEncoding_MsgPack
+};
+
+// A request with its envelope already validated.
+struct CJsonRpcRequest {
+  JsonRpcEncoding_e encoding = JsonRpcEncoding_Json;
+  bool valid = false;
+  int errorCode = 0;
+  std::string errorMessage;
+
+  std::string method;
+  CJsonValue params; // Array, Object or Null if absent.
+  CJsonValue id; // Number, String or Null.
+  bool hasId = false; // false for notifications.
+};
+
+// A message read by the calling side: a response to one of its requests, or
+// a notification (request without id) sent by the peer.
+struct CJsonRpcResponse {
+  bool valid = false;
+  std::string invalidReason;
+
+  bool isNotification = false;
+  std::string method; // Notification only.
+  CJsonValue params; // Notification only.
+
+  CJsonValue id; // Number, String or Null.
+  bool isError = false;
+  CJsonValue result;
+  int errorCode = 0;
+  std::string errorMessage;
+  CJsonValue errorData;
+};
+
+// Parses and validates a single (non-batch) request, JSON text or
+// MessagePack as detected by IsMsgPackPayload.
+void ParseJsonRpcRequest(const char * pData, size_t size, CJsonRpcRequest & outRequest);
+
+// Same, but for the calling side. An empty frame (what JsonRpc_2_0_Server
+// answers notifications with) is not valid.
+void ParseJsonRpcResponse(const char * pData, size_t size, CJsonRpcResponse & outResponse);
+
+// A nullptr pId makes a notification, params of type Null are omitted.
+void AppendJsonRpcRequest(std::string & out, JsonRpcEncoding_e encoding, const char * method, const CJsonValue & params, const CJsonValue * pId);
+
+// Responses use the member order JsonRpc_2_0_Server used: jsonrpc, result /
+// error, id. A nullptr pId omits the id of a result and is null for an error.
+void AppendJsonRpcResultHead(std::string & out);
+void AppendJsonRpcResultTail(std::string & out, const CJsonValue * pId);
+void AppendJsonRpcResult(std::string & out, JsonRpcEncoding_e encoding, const CJsonValue & result, const CJsonValue * pId);
+void AppendJsonRpcError(std::string & out, JsonRpcEncoding_e encoding, const CJsonValue * pId, int code, const char * message);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Calling side of a pipelined JSON-RPC connection: hands out request ids,
+// matches responses to calls by id and limits how many calls are in flight.
+// Calls beyond the limit wait, and so do notifications queued after them, so
+// the peer still sees messages in the order they were issued.
+// Not thread safe.
+template<class TToken> class CJsonRpcMultiplexer {
+ public:
+  explicit CJsonRpcMultiplexer(size_t maxInFlight)
+  : m_MaxInFlight(maxInFlight < 1 ? 1 : maxInFlight) {
+  }
+
+  void SetMaxInFlight(size_t maxInFlight) {
+    m_MaxInFlight = maxInFlight < 1 ? 1 : maxInFlight;
+    Promote();
+  }
+
+  size_t GetInFlight() const {
+    return m_InFlight.size();
+  }
+
+  size_t GetWaiting() const {
+    return m_Waiting.size();
+  }
+
+  uint64_t NextId() {
+    return ++m_LastId;
+  }
+
+  // frame must carry id (from NextId), token completes with the response.
+  void Call(uint64_t id, TToken token, std::string && frame) {
+    m_Waiting.push_back(Entry{true, id, std::move(token), std::move(frame)});
+    Promote();
+  }
+
+  // token completes once frame is written.
+  void Notify(TToken token, std::string && frame) {
+    m_Waiting.push_back(Entry{false, 0, std::move(token), std::move(frame)});
+    Promote();
+  }
+
+  // Moves the frames that may be written now to outFrames and the tokens of
+  // notifications among them to outWritten.
+  void TakeSendable(std::vector<std::string> & outFrames, std::vector<TToken> & outWritten) {
+    for(auto & frame : m_Sendable) outFrames.push_back(std::move(frame));
+    for(auto & token : m_SendableNotifications) outWritten.push_back(std::move(token));
+    m_Sendable.clear();
+    m_SendableNotifications.clear();
+  }
+
+  // Calls fn(TToken && token) for the call with id, returns false if there
+  // is no such call in flight.
+  template<class Fn> bool Complete(uint64_t id, Fn fn) {
+    auto it = m_InFlight.find(id);
+    if(it == m_InFlight.end()) return false;
+    TToken token = std::move(it->second);
+    m_InFlight.erase(it);
+    Promote();
+    fn(std::move(token));
+    return true;
+  }
+
+  // Calls fn(TToken && token) for every call not completed yet and every
+  // notification not taken by TakeSendable yet.
+  template<class Fn> void FailAll(Fn fn) {
+    std::unordered_map<uint64_t, TToken> inFlight;
+    inFlight.swap(m_InFlight);
+    std::deque<Entry> waiting;
+    waiting.swap(m_Waiting);
+    std::vector<TToken> notifications;
+    notifications.swap(m_SendableNotifications);
+    m_Sendable.clear();
+
+    for(auto & it : inFlight) fn(std::move(it.second));
+    for(auto & entry : waiting) fn(std::move(entry.token));
+    for(auto & token : notifications) fn(std::move(token));
+  }
+
+ private:
+  struct Entry {
+    bool isCall;
+    uint64_t id;
+    TToken token;
+    std::string frame;
+  };
+
+  size_t m_MaxInFlight;
+  uint64_t m_LastId = 0;
+  std::unordered_map<uint64_t, TToken> m_InFlight;
+  std::deque<Entry> m_Waiting;
+  std::vector<std::string> m_Sendable;
+  std::vector<TToken> m_SendableNotifications;
+
+  void Promote() {
+    while(!m_Waiting.empty()) {
+      Entry & entry = m_Waiting.front();
+      if(entry.isCall) {
+        if(m_MaxInFlight <= m_InFlight.size()) break;
+        m_InFlight.emplace(entry.id, std::move(entry.token));
+      } else {
+        m_SendableNotifications.push_back(std::move(entry.token));
+      }
+      m_Sendable.push_back(std::move(entry.frame));
+      m_Waiting.pop_front();
+    }
+  }
+};
@@ -0,0 +1,301 @@
+#include "msgpack.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+void AppendBigEndian(std::string & out, uint64_t value, int bytes) {
+  for(int i = bytes - 1; 0 <= i; i--) out += (char)((value >> (8 * i)) & 0xFF);
+}
+
+class CMsgPackParser {
+ public:
+  CMsgPackParser(const char * pData, size_t size)
+  : m_Cur((const unsigned char *)pData), m_End((const unsigned char *)pData + size) {
+  }
+
+  bool Parse(CJsonValue & outValue, std::string & outError) {
+    if(!ParseValue(outValue, 0)) {
+      outError = m_Error;
+      return false;
+    }
+    if(m_Cur != m_End) {
+      outError = "Unexpected trailing bytes";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static const int m_MaxDepth = 256;
+
+  const unsigned char * m_Cur;
+  const unsigned char * m_End;
+  const char * m_Error = nullptr;
+
+  bool Fail(const char * error) {
+    m_Error = error;
+    return false;
+  }
+
+  bool ReadBigEndian(int bytes, uint64_t & outValue) {
+    if(m_End - m_Cur < bytes) return Fail("Unexpected end of input");
+    outValue = 0;
+    for(int i = 0; i < bytes; i++) outValue = (outValue << 8) | *m_Cur++;
+    return true;
+  }
+
+  bool ParseString(size_t length, std::string & outString) {
+    if((size_t)(m_End - m_Cur) < length) return Fail("Unexpected end of input");
+    outString.assign((const char *)m_Cur, length);
+    m_Cur += length;
+    return true;
+  }
+
+  bool ParseArray(size_t count, CJsonValue & outValue, int depth) {
+    if(m_MaxDepth <= depth) return Fail("Nesting too deep");
+    if((size_t)(m_End - m_Cur) < count) return Fail("Unexpected end of input");
+    outValue.type = CJsonValue::Type_Array;
+    outValue.values.resize(count);
+    for(size_t i = 0; i < count; i++) {
+      if(!ParseValue(outValue.values[i], depth + 1)) return false;
+    }
+    return true;
+  }
+
+  bool ParseMap(size_t count, CJsonValue & outValue, int depth) {
+    if(m_MaxDepth <= depth) return Fail("Nesting too deep");
+    if((size_t)(m_End - m_Cur) < 2 * count) return Fail("Unexpected end of input");
+    outValue.type = CJsonValue::Type_Object;
+    outValue.keys.resize(count);
+    outValue.values.resize(count);
+    for(size_t i = 0; i < count; i++) {
+      CJsonValue key;
+      if(!ParseValue(key, depth + 1)) return false;
+      if(CJsonValue::Type_String != key.type) return Fail("Map key is not a string");
+      outValue.keys[i] = std::move(key.string);
+      if(!ParseValue(outValue.values[i], depth + 1)) return false;
+    }
+    return true;
+  }
+
+  bool ParseValue(CJsonValue & outValue, int depth) {
+    if(m_Cur == m_End) return Fail("Unexpected end of input");
+
+    unsigned char c = *m_Cur++;
+    uint64_t value;
+
+    if(c <= 0x7f) {
+      outValue.type = CJsonValue::Type_Number;
+      outValue.number = c;
+      return true;
+    }
+    if(0xe0 <= c) {
+      outValue.type = CJsonValue::Type_Number;
+      outValue.number = (int8_t)c;
+      return true;
+    }
+    if(0x80 <= c && c <= 0x8f) return ParseMap(c & 0x0f, outValue, depth);
+    if(0x90 <= c && c <= 0x9f) return ParseArray(c & 0x0f, outValue, depth);
+    if(0xa0 <= c && c <= 0xbf) {
+      outValue.type = CJsonValue::Type_String;
+      return ParseString(c & 0x1f, outValue.string);
+    }
+
+    switch(c) {
+    case 0xc0:
+      outValue.type = CJsonValue::Type_Null;
+      return true;
+    case 0xc2:
+      outValue.type = CJsonValue::Type_False;
+      return true;
+    case 0xc3:
+      outValue.type = CJsonValue::Type_True;
+      return true;
+    case 0xc4: case 0xd9:
+      if(!ReadBigEndian(1, value)) return false;
+      outValue.type = CJsonValue::Type_String;
+      return ParseString((size_t)value, outValue.string);
+    case 0xc5: case 0xda:
+      if(!ReadBigEndian(2, value)) return false;
+      outValue.type = CJsonValue::Type_String;
+      return ParseString((size_t)value, outValue.string);
+    case 0xc6: case 0xdb:
+      if(!ReadBigEndian(4, value)) return false;
+      outValue.type = CJsonValue::Type_String;
+      return ParseString((size_t)value, outValue.string);
+    case 0xca: {
+        if(!ReadBigEndian(4, value)) return false;
+        uint32_t bits = (uint32_t)value;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        outValue.type = CJsonValue::Type_Number;
+        outValue.number = f;
+      }
+      return true;
+    case 0xcb: {
+        if(!ReadBigEndian(8, value)) return false;
+        double d;
+        memcpy(&d, &value, sizeof(d));
+        outValue.type = CJsonValue::Type_Number;
+        outValue.number = d;
+      }
+      return true;
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+      if(!ReadBigEndian(1 << (c - 0xcc), value)) return false;
+      outValue.type = CJsonValue::Type_Number;
+      outValue.number = (double)value;
+      return true;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int bytes = 1 << (c - 0xd0);
+        if(!ReadBigEndian(bytes, value)) return false;
+        // Sign extend.
+        if(bytes < 8 && (value >> (8 * bytes - 1))) value |= ~(uint64_t)0 << (8 * bytes);
+        outValue.type = CJsonValue::Type_Number;
+        outValue.number = (double)(int64_t)value;
+      }
+      return true;
+    case 0xdc:
+      if(!ReadBigEndian(2, value)) return false;
+      return ParseArray((size_t)value, outValue, depth);
+    case 0xdd:
+      if(!ReadBigEndian(4, value)) return false;
+      return ParseArray((size_t)value, outValue, depth);
+    case 0xde:
+      if(!ReadBigEndian(2, value)) return false;
+      return ParseMap((size_t)value, outValue, depth);
+    case 0xdf:
+      if(!ReadBigEndian(4, value)) return false;
+      return ParseMap((size_t)value, outValue, depth);
+    default:
+      return Fail("Unsupported MessagePack type");
+    }
+  }
+};
+
+} // namespace
+
+bool ParseMsgPack(const char * pData, size_t size, CJsonValue & outValue, std::string & outError) {
+  CMsgPackParser parser(pData, size);
+  return parser.Parse(outValue, outError);
+}
+
+void AppendMsgPackNil(std::string & out) {
+  out += (char)0xc0;
+}
+
+void AppendMsgPackString(std::string & out, const char * pData, size_t size) {
+  if(size < 32) {
+    out += (char)(0xa0 | size);
+  } else if(size <= 0xff) {
+    out += (char)0xd9;
+    AppendBigEndian(out, size, 1);
+  } else if(size <= 0xffff) {
+    out += (char)0xda;
+    AppendBigEndian(out, size, 2);
+  } else {
+    out += (char)0xdb;
+    AppendBigEndian(out, size, 4);
+  }
+  out.append(pData, size);
+}
+
+void AppendMsgPackNumber(std::string & out, double number) {
+  if(std::fabs(number) < 9223372036854775808.0 && number == std::floor(number)) {
+    int64_t value = (int64_t)number;
+    if(0 <= value) {
+      if(value <= 0x7f) {
+        out += (char)value;
+      } else if(value <= 0xff) {
+        out += (char)0xcc;
+        AppendBigEndian(out, (uint64_t)value, 1);
+      } else if(value <= 0xffff) {
+        out += (char)0xcd;
+        AppendBigEndian(out, (uint64_t)value, 2);
+      } else if(value <= 0xffffffffLL) {
+        out += (char)0xce;
+        AppendBigEndian(out, (uint64_t)value, 4);
+      } else {
+        out += (char)0xcf;
+        AppendBigEndian(out, (uint64_t)value, 8);
+      }
+    } else {
+      if(-32 <= value) {
+        out += (char)(int8_t)value;
+      } else if(-128 <= value) {
+        out += (char)0xd0;
+        AppendBigEndian(out, (uint64_t)value, 1);
+      } else if(-32768 <= value) {
+        out += (char)0xd1;
+        AppendBigEndian(out, (uint64_t)value, 2);
+      } else if(-2147483648LL <= value) {
+        out += (char)0xd2;
+        AppendBigEndian(out, (uint64_t)value, 4);
+      } else {
+        out += (char)0xd3;
+        AppendBigEndian(out, (uint64_t)value, 8);
+      }
+    }
+    return;
+  }
+
+  float f = (float)number;
+  if((double)f == number) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    out += (char)0xca;
+    AppendBigEndian(out, bits, 4);
+  } else {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    out += (char)0xcb;
+    AppendBigEndian(out, bits, 8);
+  }
+}
+
+void AppendMsgPackArrayHeader(std::string & out, size_t count) {
+  if(count < 16) {
+    out += (char)(0x90 | count);
+  } else if(count <= 0xffff) {
+    out += (char)0xdc;
+    AppendBigEndian(out, count, 2);
+  } else {
+    out += (char)0xdd;
+    AppendBigEndian(out, count, 4);
+  }
+}
+
+void AppendMsgPackMapHeader(std::string & out, size_t count) {
+  if(count < 16) {
+    out += (char)(0x80 | count);
+  } else if(count <= 0xffff) {
+    out += (char)0xde;
+    AppendBigEndian(out, count, 2);
+  } else {
+    out += (char)0xdf;
+    AppendBigEndian(out, count, 4);
+  }
+}
+
+void AppendMsgPack(std::string & out, const CJsonValue & value) {
+  switch(value.type) {
+  case CJsonValue::Type_Null: AppendMsgPackNil(out); break;
+  case CJsonValue::Type_False: out += (char)0xc2; break;
+  case CJsonValue::Type_True: out += (char)0xc3; break;
+  case CJsonValue::Type_Number: AppendMsgPackNumber(out, value.number); break;
+  case CJsonValue::Type_String: AppendMsgPackString(out, value.string.data(), value.string.size()); break;
+  case CJsonValue::Type_Array:
+    AppendMsgPackArrayHeader(out, value.values.size());
+    for(auto & element : value.values) AppendMsgPack(out, element);
+    break;
+  case CJsonValue::Type_Object:
+    AppendMsgPackMapHeader(out, value.values.size());
+    for(size_t i = 0; i < value.values.size(); i++) {
+      AppendMsgPackString(out, value.keys[i].data(), value.keys[i].size());
+      AppendMsgPack(out, value.values[i]);
+    }
+    break;
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "json.h"
+
+// MessagePack encoding of the JSON DOM, used as compact alternative to JSON
+// text on the pipe. Integral numbers are encoded as integers, bin is decoded
+// as string, map keys must be strings.
+
+bool ParseMsgPack(const char * pData, size_t size, CJsonValue & outValue, std::string & outError);
+
+void AppendMsgPack(std::string & out, const CJsonValue & value);
+void AppendMsgPackNil(std::string & out);
+void AppendMsgPackString(std::string & out, const char * pData, size_t size);
+void AppendMsgPackNumber(std::string & out, double number);
+void AppendMsgPackArrayHeader(std::string & out, size_t count);
+void AppendMsgPackMapHeader(std::string & out, size_t count);
+
+// JSON text starts with '{', '[' or whitespace for everything we exchange,
+// which no MessagePack map or array header does.
+inline bool IsMsgPackPayload(const char * pData, size_t size) {
+  if(0 == size) return false;
+  switch(pData[0]) {
+  case '{': case '[': case ' ': case '\t': case '\r': case '\n':
+    return false;
+  default:
+    return true;
+  }
+}
@@ -0,0 +1,132 @@
+#include "pipe_buffer_pool.h"
+
+#include <new>
+
+CPipeBuffer & CPipeBuffer::operator=(CPipeBuffer && other) {
+  if(this != &other) {
+    Reset();
+    m_Data = other.m_Data;
+    m_Size = other.m_Size;
+    other.m_Data = nullptr;
+    other.m_Size = 0;
+  }
+  return *this;
+}
+
+void CPipeBuffer::Reset() {
+  if(m_Data) CPipeBufferPool::ReleaseData(Detach());
+}
+
+CPipeBufferPool::CPipeBufferPool(size_t maxIdleBytes)
+: m_MaxIdleBytes(maxIdleBytes) {
+}
+
+CPipeBufferPool::~CPipeBufferPool() {
+  for(uint32_t sizeClass = 0; sizeClass < m_SizeClasses; sizeClass++) {
+    for(Block * block = m_Free[sizeClass]; block; ) {
+      Block * next = block->nextFree;
+      if(!block->bSlab) operator delete(block, std::align_val_t(alignof(Block)));
+      block = next;
+    }
+  }
+  for(unsigned char * pSlab : m_Slabs) operator delete(pSlab, std::align_val_t(alignof(Block)));
+}
+
+CPipeBuffer CPipeBufferPool::Acquire(size_t size) {
+  uint32_t sizeClass = 0;
+  while(sizeClass < m_SizeClasses && GetClassSize(sizeClass) < size) ++sizeClass;
+  if(m_SizeClasses == sizeClass) sizeClass = m_Unpooled;
+
+  Block * block = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(m_Unpooled != sizeClass && m_Free[sizeClass]) {
+      block = m_Free[sizeClass];
+      m_Free[sizeClass] = block->nextFree;
+      if(!block->bSlab) m_IdleBytes -= block->capacity;
+      m_Stats.reused.Add(1);
+    } else if(m_Unpooled != sizeClass && GetClassSize(sizeClass) <= m_MaxSlabBlockSize) {
+      block = AllocateBlock(sizeClass);
+    }
+    ++m_Outstanding;
+  }
+
+  // Big blocks are allocated outside the lock.
+  if(nullptr == block) {
+    size_t capacity = m_Unpooled == sizeClass ? size : GetClassSize(sizeClass);
+    block = static_cast<Block *>(operator new(sizeof(Block) + capacity, std::align_val_t(alignof(Block))));
+    block->pool = this;
+    block->capacity = capacity;
+    block->sizeClass = sizeClass;
+    block->bSlab = false;
+    m_Stats.allocations.Add(1);
+    m_Stats.allocatedBytes.Add((int64_t)capacity);
+  }
+
+  m_Stats.acquired.Add(1);
+  m_Stats.inUse.Add(1);
+
+  CPipeBuffer buffer;
+  buffer.m_Data = reinterpret_cast<unsigned char *>(block + 1);
+  buffer.m_Size = size;
+  return buffer;
+}
+
+CPipeBufferPool::Block * CPipeBufferPool::AllocateBlock(uint32_t sizeClass) {
+  // Carves a whole slab into blocks of the class, all but one go to the
+  // free list.
+  size_t stride = sizeof(Block) + GetClassSize(sizeClass);
+  size_t count = m_SlabSize / stride;
+  unsigned char * pSlab = static_cast<unsigned char *>(operator new(count * stride, std::align_val_t(alignof(Block))));
+  m_Slabs.push_back(pSlab);
+  m_Stats.allocations.Add(1);
+  m_Stats.allocatedBytes.Add((int64_t)(count * stride));
+
+  for(size_t i = 0; i < count; i++) {
+    Block * block = reinterpret_cast<Block *>(pSlab + i * stride);
+    block->pool = this;
+    block->capacity = GetClassSize(sizeClass);
+    block->sizeClass = sizeClass;
+    block->bSlab = true;
+    block->nextFree = 0 < i ? m_Free[sizeClass] : nullptr;
+    if(0 < i) m_Free[sizeClass] = block;
+  }
+  return reinterpret_cast<Block *>(pSlab);
+}
+
+void CPipeBufferPool::ReleaseData(unsigned char * pData) {
+  Block * block = reinterpret_cast<Block *>(pData) - 1;
+  block->pool->ReleaseBlock(block);
+}
+
+void CPipeBufferPool::ReleaseBlock(Block * block) {
+  bool bFree = false;
+  bool bDelete = false;
+  {
+    // Once m_Lock is released the pool may be gone.
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Stats.inUse.Add(-1);
+    if(m_Unpooled == block->sizeClass || (!block->bSlab && m_MaxIdleBytes < m_IdleBytes + block->capacity)) {
+      bFree = true;
+      m_Stats.allocatedBytes.Add(-(int64_t)block->capacity);
+    } else {
+      block->nextFree = m_Free[block->sizeClass];
+      m_Free[block->sizeClass] = block;
+      if(!block->bSlab) m_IdleBytes += block->capacity;
+    }
+    bDelete = 0 == --m_Outstanding && m_Released;
+  }
+
+  if(bFree) operator delete(block, std::align_val_t(alignof(Block)));
+  if(bDelete) delete this;
+}
+
+void CPipeBufferPool::Release() {
+  bool bDelete;
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Released = true;
+    bDelete = 0 == m_Outstanding;
+  }
+  if(bDelete) delete this;
+}
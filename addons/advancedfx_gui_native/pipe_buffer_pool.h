@@ -0,0 +1,143 @@
+#pragma once
+
+#include "stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct CPipeBufferPoolStats {
+  CStatCounter acquired;
+  CStatCounter reused; // Acquired from a free list.
+  CStatCounter allocations; // Slabs and big blocks allocated from the heap.
+  CStatCounter allocatedBytes; // Level, of the allocations not freed yet.
+  CStatCounter inUse; // Level, buffers acquired and not released yet.
+
+  void Reset() {
+    acquired.Reset();
+    reused.Reset();
+    allocations.Reset();
+  }
+};
+
+class CPipeBufferPool;
+
+// Buffer from a CPipeBufferPool, goes back to it on destruction. Movable.
+class CPipeBuffer {
+ public:
+  CPipeBuffer() {}
+
+  CPipeBuffer(CPipeBuffer && other)
+  : m_Data(other.m_Data), m_Size(other.m_Size) {
+    other.m_Data = nullptr;
+    other.m_Size = 0;
+  }
+
+  CPipeBuffer & operator=(CPipeBuffer && other);
+
+  ~CPipeBuffer() {
+    Reset();
+  }
+
+  CPipeBuffer(const CPipeBuffer& rhs) = delete;
+  CPipeBuffer& operator=(const CPipeBuffer& rhs) = delete;
+
+  bool IsEmpty() {
+    return nullptr == m_Data;
+  }
+
+  unsigned char * GetData() {
+    return m_Data;
+  }
+
+  size_t GetSize() {
+    return m_Size;
+  }
+
+  // Returns the buffer to its pool.
+  void Reset();
+
+  // Gives up ownership of the data, hand it to CPipeBufferPool::ReleaseData
+  // when done. Lets owners that only keep a pointer (external ArrayBuffers)
+  // return it without allocating a CPipeBuffer to hold.
+  unsigned char * Detach() {
+    unsigned char * pData = m_Data;
+    m_Data = nullptr;
+    m_Size = 0;
+    return pData;
+  }
+
+ private:
+  friend class CPipeBufferPool;
+
+  unsigned char * m_Data = nullptr;
+  size_t m_Size = 0;
+};
+
+// Per pipe allocator for received messages: blocks in power of two size
+// classes are reused through free lists instead of going back to the heap,
+// small ones are carved from shared slabs. Frames bigger than the biggest
+// class are allocated exactly and freed on release.
+// The owner calls Release instead of deleting the pool, it deletes itself
+// once all buffers it handed out are returned.
+// Thread-safe.
+class CPipeBufferPool {
+ public:
+  // Keeps at most maxIdleBytes of blocks not carved from slabs in the free
+  // lists, freeing the rest.
+  explicit CPipeBufferPool(size_t maxIdleBytes = 32 * 1024 * 1024);
+
+  CPipeBufferPool(const CPipeBufferPool& rhs) = delete;
+  CPipeBufferPool& operator=(const CPipeBufferPool& rhs) = delete;
+
+  // Returns a buffer of size bytes, its content undefined.
+  CPipeBuffer Acquire(size_t size);
+
+  // Any thread: returns data from CPipeBuffer::Detach to its pool.
+  static void ReleaseData(unsigned char * pData);
+
+  void Release();
+
+  CPipeBufferPoolStats & GetStats() {
+    return m_Stats;
+  }
+
+ private:
+  friend class CPipeBuffer;
+
+  // In front of every block's data, keeps the data 64 byte aligned.
+  struct alignas(64) Block {
+    CPipeBufferPool * pool;
+    Block * nextFree;
+    size_t capacity;
+    uint32_t sizeClass;
+    bool bSlab;
+  };
+
+  static const size_t m_MinBlockSize = 256;
+  static const size_t m_SizeClasses = 17; // 256 B to 16 MiB.
+  static const size_t m_MaxSlabBlockSize = 64 * 1024;
+  static const size_t m_SlabSize = 256 * 1024;
+  static const uint32_t m_Unpooled = UINT32_MAX;
+
+  std::mutex m_Lock;
+  Block * m_Free[m_SizeClasses] = {};
+  std::vector<unsigned char *> m_Slabs;
+  size_t m_IdleBytes = 0; // Of blocks not from slabs in m_Free.
+  size_t m_MaxIdleBytes;
+  size_t m_Outstanding = 0;
+  bool m_Released = false;
+  CPipeBufferPoolStats m_Stats;
+
+  ~CPipeBufferPool();
+
+  static size_t GetClassSize(uint32_t sizeClass) {
+    return m_MinBlockSize << sizeClass;
+  }
+
+  // Requires m_Lock.
+  Block * AllocateBlock(uint32_t sizeClass);
+
+  void ReleaseBlock(Block * block);
+};
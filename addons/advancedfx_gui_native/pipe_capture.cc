@@ -0,0 +1,129 @@
+#include "pipe_capture.h"
+#include "pipe_framing.h"
+#include "stats.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+static const char g_PipeCaptureMagic[8] = {'A', 'F', 'X', 'P', 'C', 'A', 'P', '1'};
+
+static const size_t g_PipeCaptureRecordHeaderSize = sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint32_t);
+
+CPipeCaptureWriter * CPipeCaptureWriter::Create(const char * path) {
+  CBufferedFileWriter * file = CBufferedFileWriter::Create(path);
+  if(nullptr == file) return nullptr;
+
+  uint64_t start = StatNowNanoseconds();
+  file->Append(g_PipeCaptureMagic, sizeof(g_PipeCaptureMagic), &start, sizeof(start));
+
+  return new CPipeCaptureWriter(file, start);
+}
+
+CPipeCaptureWriter::CPipeCaptureWriter(CBufferedFileWriter * file, uint64_t startNanoseconds)
+: m_File(file)
+, m_Start(startNanoseconds) {
+}
+
+CPipeCaptureWriter::~CPipeCaptureWriter() {
+  delete m_File;
+}
+
+void CPipeCaptureWriter::Append(uint8_t flags, uint64_t timeNanoseconds, const void * pData, size_t size) {
+  uint64_t time = m_Start < timeNanoseconds ? timeNanoseconds - m_Start : 0;
+  uint32_t size32 = (uint32_t)size;
+
+  unsigned char header[g_PipeCaptureRecordHeaderSize];
+  memcpy(header, &flags, sizeof(flags));
+  memcpy(header + sizeof(flags), &time, sizeof(time));
+  memcpy(header + sizeof(flags) + sizeof(time), &size32, sizeof(size32));
+
+  m_File->Append(header, sizeof(header), pData, size);
+}
+
+bool CPipeCaptureWriter::IsOk() {
+  return m_File->IsOk();
+}
+
+CPipeCaptureReader::~CPipeCaptureReader() {
+  if(m_File) fclose(m_File);
+}
+
+bool CPipeCaptureReader::Open(const char * path) {
+  if(m_File) fclose(m_File);
+  m_Truncated = false;
+
+  m_File = fopen(path, "rb");
+  if(nullptr == m_File) return false;
+
+  char magic[sizeof(g_PipeCaptureMagic)];
+  if(1 != fread(magic, sizeof(magic), 1, m_File)
+    || 0 != memcmp(magic, g_PipeCaptureMagic, sizeof(magic))
+    || 1 != fread(&m_Start, sizeof(m_Start), 1, m_File)) {
+    fclose(m_File);
+    m_File = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+bool CPipeCaptureReader::Next(PipeCaptureRecord & outRecord) {
+  if(nullptr == m_File) return false;
+
+  unsigned char header[g_PipeCaptureRecordHeaderSize];
+  size_t headerRead = fread(header, 1, sizeof(header), m_File);
+  if(headerRead < sizeof(header)) {
+    m_Truncated = 0 != headerRead;
+    return false;
+  }
+
+  uint32_t size;
+  memcpy(&outRecord.flags, header, sizeof(outRecord.flags));
+  memcpy(&outRecord.time, header + sizeof(outRecord.flags), sizeof(outRecord.time));
+  memcpy(&size, header + sizeof(outRecord.flags) + sizeof(outRecord.time), sizeof(size));
+
+  outRecord.data.resize(size);
+  if(size && 1 != fread(&outRecord.data[0], size, 1, m_File)) {
+    m_Truncated = true;
+    return false;
+  }
+
+  return true;
+}
+
+bool ReplayPipeCapture(CPipeCaptureReader & reader, CPipeTransport & transport, uint8_t direction, double speed, uint64_t startNanoseconds) {
+  const size_t batchSize = 64 * 1024;
+
+  std::vector<unsigned char> batch;
+  PipeCaptureRecord record;
+  bool bFirst = true;
+  uint64_t firstTime = 0;
+
+  while(reader.Next(record)) {
+    if(direction != (record.flags & PipeCaptureFlag_Out)) continue;
+
+    if(0 < speed) {
+      if(bFirst) firstTime = record.time;
+      uint64_t due = startNanoseconds + (uint64_t)((record.time - firstTime) / speed);
+      uint64_t now = StatNowNanoseconds();
+      if(now < due) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+    }
+    bFirst = false;
+
+    if(record.flags & PipeCaptureFlag_Raw) {
+      batch.insert(batch.end(), record.data.begin(), record.data.end());
+    } else {
+      AppendPipeFrame(batch, record.data.data(), (PipeFrameLength_t)record.data.size());
+    }
+
+    if(batchSize <= batch.size() || 0 < speed) {
+      if(!transport.WriteBytes(batch.data(), batch.size())) return false;
+      batch.clear();
+    }
+  }
+
+  if(!batch.empty() && !transport.WriteBytes(batch.data(), batch.size())) return false;
+
+  return !reader.IsTruncated();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "file_writer.h"
+#include "pipe_transport.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Append-only log of the messages that went through a pipe, so production
+// traffic can be replayed (ReplayPipeCapture) and benchmarked.
+//
+// File layout, integers in host byte order like the frames on the pipe:
+//   header: char magic[8] = "AFXPCAP1", uint64 start time (ns, steady clock)
+//   records: uint8 flags, uint64 time (ns since start), uint32 size, payload
+// Times are monotonic per direction, records of the two directions may be
+// slightly out of order with each other.
+
+enum PipeCaptureFlags_e {
+  PipeCaptureFlag_Out = 1 << 0, // Written by us, else read.
+  PipeCaptureFlag_Raw = 1 << 1 // Payload is raw bytes, else the body of a frame.
+};
+
+struct PipeCaptureRecord {
+  uint8_t flags = 0;
+  uint64_t time = 0;
+  std::string data;
+};
+
+// Capturing only costs a memcpy on the I/O path (CBufferedFileWriter).
+class CPipeCaptureWriter {
+ public:
+  // Returns nullptr if path can not be created.
+  static CPipeCaptureWriter * Create(const char * path);
+
+  // Writes what is buffered and closes the file.
+  ~CPipeCaptureWriter();
+
+  CPipeCaptureWriter(const CPipeCaptureWriter& rhs) = delete;
+  CPipeCaptureWriter& operator=(const CPipeCaptureWriter& rhs) = delete;
+
+  // Any thread. timeNanoseconds is from StatNowNanoseconds.
+  void Append(uint8_t flags, uint64_t timeNanoseconds, const void * pData, size_t size);
+
+  // False once a write to the file failed, records are dropped from then on.
+  bool IsOk();
+
+ private:
+  CPipeCaptureWriter(CBufferedFileWriter * file, uint64_t startNanoseconds);
+
+  CBufferedFileWriter * m_File;
+  uint64_t m_Start;
+};
+
+class CPipeCaptureReader {
+ public:
+  CPipeCaptureReader() {}
+  ~CPipeCaptureReader();
+
+  CPipeCaptureReader(const CPipeCaptureReader& rhs) = delete;
+  CPipeCaptureReader& operator=(const CPipeCaptureReader& rhs) = delete;
+
+  // Returns false if path can not be opened or is not a capture.
+  bool Open(const char * path);
+
+  uint64_t GetStartTime() {
+    return m_Start;
+  }
+
+  // Returns false at the end, IsTruncated tells if the last record was cut
+  // short.
+  bool Next(PipeCaptureRecord & outRecord);
+
+  bool IsTruncated() {
+    return m_Truncated;
+  }
+
+ private:
+  FILE * m_File = nullptr;
+  uint64_t m_Start = 0;
+  bool m_Truncated = false;
+};
+
+// Writes the records of one direction (0 for what was read, PipeCaptureFlag_Out
+// for what was written) to transport the way the other end sent them: frame
+// bodies are framed again, raw records go as they are.
+// speed 0 writes as fast as possible, batching records, otherwise each
+// record is written once its time since the first replayed record, divided
+// by speed, passed since startNanoseconds (StatNowNanoseconds).
+// Returns false if writing failed or the capture is truncated.
+bool ReplayPipeCapture(CPipeCaptureReader & reader, CPipeTransport & transport, uint8_t direction, double speed, uint64_t startNanoseconds);
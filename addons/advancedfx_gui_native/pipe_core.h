@@ -0,0 +1,534 @@
+#pragma once
+
+#include "pipe_buffer_pool.h"
+#include "pipe_capture.h"
+#include "pipe_reactor.h"
+#include "pipe_transport.h"
+#include "pipe_framing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Platform neutral part of AnonymousPipe: owns the transport, frames
+// messages and merges back-to-back writes.
+// The transport does asynchronous I/O on the process wide CPipeReactor, so a
+// pipe costs no thread of its own while it waits.
+//
+// TToken identifies an operation and is handed back to TSink when the
+// operation completed, on a reactor thread or on the thread that issued an
+// operation that could complete right away:
+//   void TSink::Post(TToken && token, bool ok);
+//   void TSink::Post(TToken && token, bool ok, std::string && str);
+//   void TSink::Post(TToken && token, bool ok, CPipeBuffer && buffer);
+// In streaming mode (StartReading) frames are handed over in batches:
+//   void TSink::PostFrames(std::vector<std::string> && frames);
+// Reads complete in the order they were issued, so do writes.
+template<class TToken, class TSink> class CPipeCore : private CPipeIoHandler {
+ public:
+  CPipeCore(CPipeTransport * transport, TSink & sink)
+  : m_Transport(transport), m_Sink(sink), m_FrameReader(*transport, &m_Stats) {
+    m_BufferPool = new CPipeBufferPool();
+    m_Reactor = CPipeReactor::Acquire();
+    m_Transport->StartAsync(m_Reactor, *this);
+  }
+
+  ~CPipeCore() {
+    Shutdown();
+    m_BufferPool->Release(); // Goes once buffers handed out are returned.
+  }
+
+  CPipeCore(const CPipeCore& rhs) = delete;
+  CPipeCore& operator=(const CPipeCore& rhs) = delete;
+
+  bool IsOpen() {
+    return nullptr != m_Transport;
+  }
+
+  CPipeTransport * GetTransport() {
+    return m_Transport;
+  }
+
+  // Any thread.
+  CPipeStats & GetStats() {
+    return m_Stats;
+  }
+
+  // Any thread, of the buffers ReadBuffer hands out.
+  CPipeBufferPoolStats & GetBufferPoolStats() {
+    return m_BufferPool->GetStats();
+  }
+
+  // Takes ownership of capture, which records every message read and
+  // written from now on. Call before issuing I/O.
+  void SetCapture(CPipeCaptureWriter * capture) {
+    m_Capture = capture;
+  }
+
+  // Shuts down, then completes token.
+  void Close(TToken token) {
+    Shutdown();
+    m_Sink.Post(std::move(token), true);
+  }
+
+  // Gives writes issued before a chance to finish, cancels everything else
+  // and releases the transport. Not to be called from sink callbacks.
+  void Shutdown() {
+    if(nullptr == m_Transport) return;
+
+    {
+      std::unique_lock<std::mutex> lock(m_ReadLock);
+      m_ReadShutdown = true;
+    }
+    {
+      // Like the blocking writes before: writes that make progress finish,
+      // an other end that stopped reading can not hold up closing.
+      std::unique_lock<std::mutex> lock(m_WriteLock);
+      uint64_t written = m_BytesWritten + 1;
+      while(m_Flushing && written != m_BytesWritten) {
+        written = m_BytesWritten;
+        m_WriteCv.wait_for(lock, std::chrono::milliseconds(100), [this]{ return !m_Flushing; });
+      }
+      m_WriteShutdown = true;
+    }
+
+    m_Transport->CancelAsync();
+
+    std::deque<ReadOp> readOps;
+    {
+      std::unique_lock<std::mutex> lock(m_ReadLock);
+      m_ReadCv.wait(lock, [this]{ return !m_Pumping; });
+      readOps.swap(m_ReadOps);
+    }
+    std::vector<TToken> writes;
+    {
+      std::unique_lock<std::mutex> lock(m_WriteLock);
+      m_WriteCv.wait(lock, [this]{ return !m_Flushing; });
+      writes.swap(m_PendingWrites);
+      m_WriteBuffer.clear();
+      m_WriteExternals.clear();
+    }
+
+    m_Stats.queueDepth.Add(-(int64_t)(readOps.size() + writes.size()));
+    for(auto & op : readOps) {
+      switch(op.kind) {
+      case ReadKind::Frame:
+        m_Sink.Post(std::move(op.token), false, std::string());
+        break;
+      case ReadKind::Buffer:
+        m_Sink.Post(std::move(op.token), false, CPipeBuffer());
+        break;
+      case ReadKind::Bytes:
+        m_Sink.Post(std::move(op.token), false);
+        break;
+      case ReadKind::Stream:
+        m_Stats.queueDepth.Add(1); // Not counted as pending.
+        m_Sink.Post(std::move(op.token), true); // Ended by us, not failed.
+        break;
+      }
+    }
+    for(auto & token : writes) {
+      m_Sink.Post(std::move(token), false);
+    }
+
+    delete m_Transport;
+    m_Transport = nullptr;
+    CPipeReactor::Release(m_Reactor);
+    m_Reactor = nullptr;
+    delete m_Capture;
+    m_Capture = nullptr;
+  }
+
+  // appendFn(std::vector<unsigned char> & buffer) appends the bytes to write,
+  // it is called on the calling thread. bFramed tells a capture that the
+  // bytes are frames (AppendPipeFrame).
+  // Writes issued while one is in flight are merged into the next.
+  template<class AppendFn> void Write(TToken token, AppendFn appendFn, bool bFramed = true) {
+    m_Stats.queueDepth.Add(1);
+    std::unique_lock<std::mutex> lock(m_WriteLock);
+    size_t offset = m_WriteBuffer.size();
+    appendFn(m_WriteBuffer);
+    if(m_Capture) CaptureWrite(offset, bFramed);
+    m_PendingWrites.push_back(std::move(token));
+    if(!m_Flushing) {
+      m_Flushing = true;
+      Flush(lock);
+    }
+  }
+
+  // Writes size bytes at pData, as a frame with bFramed, without copying
+  // them: pData must stay valid until token completed. Small writes are
+  // copied anyway, a transport write of their own would cost more.
+  void WriteExternal(TToken token, const void * pData, size_t size, bool bFramed) {
+    if(size < m_MinExternalWrite) {
+      Write(std::move(token), [pData,size,bFramed](std::vector<unsigned char> & buffer){
+        if(bFramed) {
+          AppendPipeFrame(buffer, pData, (PipeFrameLength_t)size);
+        } else {
+          const unsigned char * pBytes = reinterpret_cast<const unsigned char *>(pData);
+          buffer.insert(buffer.end(), pBytes, pBytes + size);
+        }
+      }, bFramed);
+      return;
+    }
+
+    m_Stats.queueDepth.Add(1);
+    std::unique_lock<std::mutex> lock(m_WriteLock);
+    if(bFramed) {
+      PipeFrameLength_t length = (PipeFrameLength_t)size;
+      const unsigned char * pLength = reinterpret_cast<const unsigned char *>(&length);
+      m_WriteBuffer.insert(m_WriteBuffer.end(), pLength, pLength + sizeof(length));
+    }
+    m_WriteExternals.push_back(ExternalWrite{m_WriteBuffer.size(), reinterpret_cast<const unsigned char *>(pData), size});
+    if(m_Capture) m_Capture->Append(bFramed ? PipeCaptureFlag_Out : PipeCaptureFlag_Out | PipeCaptureFlag_Raw, StatNowNanoseconds(), pData, size);
+    m_PendingWrites.push_back(std::move(token));
+    if(!m_Flushing) {
+      m_Flushing = true;
+      Flush(lock);
+    }
+  }
+
+  void WriteString(TToken token, const std::string & str) {
+    Write(std::move(token), [&str](std::vector<unsigned char> & buffer){
+      AppendPipeFrame(buffer, str.data(), (PipeFrameLength_t)str.size());
+    });
+  }
+
+  // pData must stay valid until token completed.
+  void ReadBytes(TToken token, void * pData, size_t size) {
+    QueueRead(ReadOp{ReadKind::Bytes, std::move(token), (unsigned char *)pData, size});
+  }
+
+  void ReadString(TToken token) {
+    QueueRead(ReadOp{ReadKind::Frame, std::move(token)});
+  }
+
+  // Like ReadString, but the frame comes in a buffer from the pipe's pool,
+  // saving the allocation and, for frames too big for the read-ahead
+  // buffer, the copy.
+  void ReadBuffer(TToken token) {
+    QueueRead(ReadOp{ReadKind::Buffer, std::move(token)});
+  }
+
+  // Switches to streaming mode once the reads queued before completed: all
+  // frames that are available are posted in one batch, reading goes on as
+  // long as less than highWatermark frames are posted but not acknowledged
+  // (AckFrames) and resumes at lowWatermark.
+  // token completes when streaming ends, not ok if a read failed.
+  // No other reads may be issued afterwards.
+  void StartReading(TToken token, size_t highWatermark, size_t lowWatermark) {
+    std::unique_lock<std::mutex> lock(m_ReadLock);
+    m_HighWatermark = highWatermark < 1 ? 1 : highWatermark;
+    m_LowWatermark = lowWatermark < m_HighWatermark ? lowWatermark : m_HighWatermark - 1;
+    m_ReadOps.push_back(ReadOp{ReadKind::Stream, std::move(token)});
+    PumpReads(lock);
+  }
+
+  // Any thread.
+  void AckFrames(size_t count) {
+    std::unique_lock<std::mutex> lock(m_ReadLock);
+    size_t acked = count < m_FramesInFlight ? count : m_FramesInFlight;
+    m_FramesInFlight -= acked;
+    m_Stats.queueDepth.Add(-(int64_t)acked);
+    if(m_StreamPaused && m_FramesInFlight <= m_LowWatermark) {
+      m_StreamPaused = false;
+      PumpReads(lock);
+    }
+  }
+
+ private:
+  enum class ReadKind {
+    Frame,
+    Buffer,
+    Bytes,
+    Stream
+  };
+
+  struct ReadOp {
+    ReadKind kind;
+    TToken token;
+    unsigned char * pData = nullptr;
+    size_t size = 0;
+    size_t done = 0;
+  };
+
+  CPipeTransport * m_Transport;
+  CPipeReactor * m_Reactor = nullptr;
+  TSink & m_Sink;
+  CPipeStats m_Stats;
+  CPipeBufferPool * m_BufferPool;
+  CPipeCaptureWriter * m_Capture = nullptr;
+
+  std::mutex m_ReadLock;
+  std::condition_variable m_ReadCv;
+  CPipeFrameReader m_FrameReader;
+  std::deque<ReadOp> m_ReadOps;
+  bool m_ReadInFlight = false;
+  bool m_ReadIntoReader = false; // Else into the front Bytes operation.
+  bool m_ReadFailed = false;
+  bool m_ReadShutdown = false;
+  bool m_Pumping = false;
+  bool m_PumpAgain = false;
+  uint64_t m_ReadStart = 0;
+  uint64_t m_FillTime = 0; // When the last transport read completed, for m_Capture.
+  size_t m_HighWatermark = 0;
+  size_t m_LowWatermark = 0;
+  size_t m_FramesInFlight = 0;
+  bool m_StreamPaused = false;
+
+  // Bytes of a WriteExternal, written before m_WriteBuffer[offset].
+  struct ExternalWrite {
+    size_t offset;
+    const unsigned char * pData;
+    size_t size;
+  };
+
+  // Part of a flush that is written in one go.
+  struct FlushPiece {
+    const unsigned char * pData;
+    size_t size;
+  };
+
+  static const size_t m_MinExternalWrite = 64 * 1024;
+
+  std::mutex m_WriteLock;
+  std::condition_variable m_WriteCv;
+  std::vector<unsigned char> m_WriteBuffer;
+  std::vector<ExternalWrite> m_WriteExternals;
+  std::vector<TToken> m_PendingWrites;
+  bool m_Flushing = false;
+  bool m_WriteShutdown = false;
+  uint64_t m_WriteStart = 0;
+  uint64_t m_BytesWritten = 0;
+  // Owned by the flushing thread:
+  std::vector<unsigned char> m_FlushBuffer;
+  std::vector<ExternalWrite> m_FlushExternals;
+  std::vector<FlushPiece> m_FlushPieces;
+  size_t m_FlushPiece = 0;
+  size_t m_FlushOffset = 0; // Into m_FlushPieces[m_FlushPiece].
+  std::vector<TToken> m_FlushWrites;
+
+  void QueueRead(ReadOp && op) {
+    m_Stats.queueDepth.Add(1);
+    std::unique_lock<std::mutex> lock(m_ReadLock);
+    m_ReadOps.push_back(std::move(op));
+    PumpReads(lock);
+  }
+
+  // Completes what the buffered data allows and starts the next transport
+  // read if needed. Only one thread pumps at a time, so completions are
+  // posted in order even though the lock is released for posting.
+  void PumpReads(std::unique_lock<std::mutex> & lock) {
+    if(m_Pumping) {
+      m_PumpAgain = true;
+      return;
+    }
+    m_Pumping = true;
+
+    do {
+      m_PumpAgain = false;
+      while(!m_ReadOps.empty() && !m_ReadShutdown) {
+        ReadOp & op = m_ReadOps.front();
+
+        if(ReadKind::Frame == op.kind) {
+          std::string str;
+          if(m_FrameReader.TakeFrame(str)) {
+            if(m_Capture) m_Capture->Append(0, m_FillTime, str.data(), str.size());
+            TToken token = std::move(op.token);
+            m_ReadOps.pop_front();
+            m_Stats.queueDepth.Add(-1);
+            lock.unlock();
+            m_Sink.Post(std::move(token), true, std::move(str));
+            lock.lock();
+            continue;
+          }
+        } else if(ReadKind::Buffer == op.kind) {
+          CPipeBuffer buffer;
+          if(m_FrameReader.TakeFrame(*m_BufferPool, buffer)) {
+            if(m_Capture) m_Capture->Append(0, m_FillTime, buffer.GetData(), buffer.GetSize());
+            TToken token = std::move(op.token);
+            m_ReadOps.pop_front();
+            m_Stats.queueDepth.Add(-1);
+            lock.unlock();
+            m_Sink.Post(std::move(token), true, std::move(buffer));
+            lock.lock();
+            continue;
+          }
+        } else if(ReadKind::Bytes == op.kind) {
+          if(!m_ReadInFlight) op.done += m_FrameReader.TakeBytes(op.pData + op.done, op.size - op.done);
+          if(op.done == op.size) {
+            if(m_Capture) m_Capture->Append(PipeCaptureFlag_Raw, m_FillTime, op.pData, op.size);
+            TToken token = std::move(op.token);
+            m_ReadOps.pop_front();
+            m_Stats.messagesIn.Add(1);
+            m_Stats.queueDepth.Add(-1);
+            lock.unlock();
+            m_Sink.Post(std::move(token), true);
+            lock.lock();
+            continue;
+          }
+        } else {
+          if(m_StreamPaused) break;
+          size_t maxFrames = m_HighWatermark - m_FramesInFlight;
+          std::vector<std::string> frames;
+          std::string str;
+          while(frames.size() < maxFrames && m_FrameReader.TakeFrame(str)) {
+            if(m_Capture) m_Capture->Append(0, m_FillTime, str.data(), str.size());
+            frames.push_back(std::move(str));
+          }
+          if(!frames.empty()) {
+            m_FramesInFlight += frames.size();
+            m_Stats.queueDepth.Add((int64_t)frames.size());
+            if(m_HighWatermark <= m_FramesInFlight) m_StreamPaused = true;
+            lock.unlock();
+            m_Sink.PostFrames(std::move(frames));
+            lock.lock();
+            continue;
+          }
+        }
+
+        if(m_ReadInFlight) break;
+
+        if(m_ReadFailed) {
+          TToken token = std::move(op.token);
+          ReadKind kind = op.kind;
+          m_ReadOps.pop_front();
+          if(ReadKind::Stream != kind) m_Stats.queueDepth.Add(-1);
+          lock.unlock();
+          if(ReadKind::Frame == kind) m_Sink.Post(std::move(token), false, std::string());
+          else if(ReadKind::Buffer == kind) m_Sink.Post(std::move(token), false, CPipeBuffer());
+          else m_Sink.Post(std::move(token), false);
+          lock.lock();
+          continue;
+        }
+
+        // Raw bytes go straight to their destination, like ReadBytes did.
+        void * pData;
+        size_t size;
+        m_ReadIntoReader = ReadKind::Bytes != op.kind;
+        if(m_ReadIntoReader) {
+          m_FrameReader.PrepareFill(pData, size);
+        } else {
+          pData = op.pData + op.done;
+          size = op.size - op.done;
+        }
+        m_ReadInFlight = true;
+        m_ReadStart = StatNowNanoseconds();
+        if(!m_Transport->ReadAsync(pData, size)) {
+          m_ReadInFlight = false;
+          m_ReadFailed = true;
+          continue;
+        }
+        break;
+      }
+    } while(m_PumpAgain);
+
+    m_Pumping = false;
+    m_ReadCv.notify_all();
+  }
+
+  virtual void OnReadDone(bool bOk, size_t bytes) override {
+    std::unique_lock<std::mutex> lock(m_ReadLock);
+    m_ReadInFlight = false;
+    m_Stats.readTime.RecordSince(m_ReadStart);
+    if(bOk) {
+      if(m_Capture) m_FillTime = StatNowNanoseconds();
+      m_Stats.bytesIn.Add((int64_t)bytes);
+      if(m_ReadIntoReader) m_FrameReader.CommitFill(bytes);
+      else m_ReadOps.front().done += bytes;
+    } else {
+      m_ReadFailed = true;
+    }
+    PumpReads(lock);
+  }
+
+  // Records what the last Write appended from offset on, requires m_WriteLock.
+  void CaptureWrite(size_t offset, bool bFramed) {
+    uint64_t now = StatNowNanoseconds();
+    size_t end = m_WriteBuffer.size();
+    while(bFramed && offset + sizeof(PipeFrameLength_t) <= end) {
+      PipeFrameLength_t size;
+      memcpy(&size, &m_WriteBuffer[offset], sizeof(size));
+      if(end - offset - sizeof(size) < size) break;
+      m_Capture->Append(PipeCaptureFlag_Out, now, &m_WriteBuffer[offset + sizeof(size)], size);
+      offset += sizeof(size) + size;
+    }
+    if(offset < end) m_Capture->Append(PipeCaptureFlag_Out | PipeCaptureFlag_Raw, now, &m_WriteBuffer[offset], end - offset);
+  }
+
+  // Requires m_Flushing, writes until nothing is pending anymore.
+  void Flush(std::unique_lock<std::mutex> & lock) {
+    while(!m_PendingWrites.empty() && !m_WriteShutdown) {
+      m_FlushBuffer.clear();
+      m_FlushBuffer.swap(m_WriteBuffer);
+      m_FlushExternals.clear();
+      m_FlushExternals.swap(m_WriteExternals);
+      m_FlushWrites.clear();
+      m_FlushWrites.swap(m_PendingWrites);
+      PrepareFlushPieces();
+      m_WriteStart = StatNowNanoseconds();
+
+      if(!m_FlushPieces.empty() && WriteFlushPiece()) return; // Continued in OnWriteDone.
+      FinishFlush(lock, m_FlushPieces.empty());
+    }
+
+    m_Flushing = false;
+    m_WriteCv.notify_all();
+  }
+
+  // Splits the flush into the copied bytes and the external ones between.
+  void PrepareFlushPieces() {
+    m_FlushPieces.clear();
+    m_FlushPiece = 0;
+    m_FlushOffset = 0;
+    size_t offset = 0;
+    for(const ExternalWrite & external : m_FlushExternals) {
+      if(offset < external.offset) m_FlushPieces.push_back(FlushPiece{&m_FlushBuffer[offset], external.offset - offset});
+      if(0 < external.size) m_FlushPieces.push_back(FlushPiece{external.pData, external.size});
+      offset = external.offset;
+    }
+    if(offset < m_FlushBuffer.size()) m_FlushPieces.push_back(FlushPiece{&m_FlushBuffer[offset], m_FlushBuffer.size() - offset});
+  }
+
+  bool WriteFlushPiece() {
+    const FlushPiece & piece = m_FlushPieces[m_FlushPiece];
+    return m_Transport->WriteAsync(piece.pData + m_FlushOffset, piece.size - m_FlushOffset);
+  }
+
+  void FinishFlush(std::unique_lock<std::mutex> & lock, bool bOk) {
+    if(!m_FlushPieces.empty()) m_Stats.writeTime.RecordSince(m_WriteStart);
+    m_Stats.messagesOut.Add((int64_t)m_FlushWrites.size());
+    m_Stats.queueDepth.Add(-(int64_t)m_FlushWrites.size());
+
+    std::vector<TToken> tokens;
+    tokens.swap(m_FlushWrites);
+    lock.unlock();
+    for(auto & token : tokens) {
+      m_Sink.Post(std::move(token), bOk);
+    }
+    lock.lock();
+  }
+
+  virtual void OnWriteDone(bool bOk, size_t bytes) override {
+    std::unique_lock<std::mutex> lock(m_WriteLock);
+    if(bOk) {
+      m_FlushOffset += bytes;
+      m_BytesWritten += bytes;
+      m_Stats.bytesOut.Add((int64_t)bytes);
+      if(m_FlushOffset == m_FlushPieces[m_FlushPiece].size) {
+        ++m_FlushPiece;
+        m_FlushOffset = 0;
+      }
+      if(m_FlushPiece < m_FlushPieces.size()) {
+        if(WriteFlushPiece()) return;
+        bOk = false;
+      }
+    }
+    FinishFlush(lock, bOk);
+    Flush(lock);
+  }
+};
@@ -0,0 +1,215 @@
+#include "pipe_framing.h"
+
+#include <algorithm>
+#include <cstring>
+
+void AppendPipeFrame(std::vector<unsigned char> & buffer, const void * pData, PipeFrameLength_t size) {
+  size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(size) + size);
+  memcpy(&buffer[offset], &size, sizeof(size));
+  if(size) memcpy(&buffer[offset + sizeof(size)], pData, size);
+}
+
+CPipeFrameReader::CPipeFrameReader(CPipeTransport & transport, CPipeStats * pStats)
+: m_Transport(transport)
+, m_Stats(pStats)
+, m_Buffer(m_MinCapacity) {
+}
+
+bool CPipeFrameReader::ReadFrame(std::string & outStr) {
+  while(Buffered() < sizeof(PipeFrameLength_t)) {
+    if(!Fill()) return false;
+  }
+
+  PipeFrameLength_t strLen;
+  memcpy(&strLen, &m_Buffer[m_Begin], sizeof(strLen));
+  m_Begin += sizeof(strLen);
+
+  // Wait for the rest of the frame as long as it will fit the buffer,
+  // otherwise read the remainder straight into outStr.
+  while(Buffered() < strLen && strLen <= m_Buffer.size() / 2) {
+    if(!Fill()) return false;
+  }
+
+  outStr.resize(strLen);
+  size_t taken = Take(&outStr[0], strLen);
+  if(!ReadDirect(&outStr[taken], strLen - taken)) return false;
+  if(m_Stats) m_Stats->messagesIn.Add(1);
+  return true;
+}
+
+bool CPipeFrameReader::ReadBytes(void * pData, size_t size) {
+  size_t taken = Take(pData, size);
+  if(!ReadDirect((unsigned char *)pData + taken, size - taken)) return false;
+  if(m_Stats) m_Stats->messagesIn.Add(1);
+  return true;
+}
+
+bool CPipeFrameReader::HasBufferedFrame() {
+  PipeFrameLength_t strLen;
+  return PeekFrameLength(strLen) && strLen <= Buffered() - sizeof(strLen);
+}
+
+bool CPipeFrameReader::TakeFrame(std::string & outStr) {
+  if(m_HasPartial) {
+    if(m_PartialFilled < GetPartialSize()) return false;
+    if(m_PartialBuffer.IsEmpty()) {
+      outStr.swap(m_Partial);
+      m_Partial.clear();
+    } else {
+      outStr.assign(reinterpret_cast<const char *>(m_PartialBuffer.GetData()), m_PartialBuffer.GetSize());
+      m_PartialBuffer.Reset();
+    }
+    m_HasPartial = false;
+    if(m_Stats) m_Stats->messagesIn.Add(1);
+    return true;
+  }
+
+  PipeFrameLength_t strLen;
+  if(!PeekFrameLength(strLen)) return false;
+
+  if(strLen <= Buffered() - sizeof(strLen)) {
+    m_Begin += sizeof(strLen);
+    outStr.resize(strLen);
+    Take(&outStr[0], strLen);
+    if(m_Stats) m_Stats->messagesIn.Add(1);
+    return true;
+  }
+
+  // Like ReadFrame: what will not fit the buffer is read into the frame.
+  if(m_Buffer.size() / 2 < strLen) {
+    m_Begin += sizeof(strLen);
+    m_Partial.resize(strLen);
+    m_PartialFilled = Take(&m_Partial[0], strLen);
+    m_HasPartial = true;
+  }
+  return false;
+}
+
+bool CPipeFrameReader::TakeFrame(CPipeBufferPool & pool, CPipeBuffer & outBuffer) {
+  if(m_HasPartial) {
+    if(m_PartialFilled < GetPartialSize()) return false;
+    if(m_PartialBuffer.IsEmpty()) {
+      // Started by the other TakeFrame.
+      outBuffer = pool.Acquire(m_Partial.size());
+      if(!m_Partial.empty()) memcpy(outBuffer.GetData(), &m_Partial[0], m_Partial.size());
+      if(m_Stats) m_Stats->bytesCopied.Add((int64_t)m_Partial.size());
+      m_Partial.clear();
+    } else {
+      outBuffer = std::move(m_PartialBuffer);
+    }
+    m_HasPartial = false;
+    if(m_Stats) m_Stats->messagesIn.Add(1);
+    return true;
+  }
+
+  PipeFrameLength_t strLen;
+  if(!PeekFrameLength(strLen)) return false;
+
+  if(strLen <= Buffered() - sizeof(strLen)) {
+    m_Begin += sizeof(strLen);
+    outBuffer = pool.Acquire(strLen);
+    Take(outBuffer.GetData(), strLen);
+    if(m_Stats) m_Stats->messagesIn.Add(1);
+    return true;
+  }
+
+  if(m_Buffer.size() / 2 < strLen) {
+    m_Begin += sizeof(strLen);
+    m_PartialBuffer = pool.Acquire(strLen);
+    m_PartialFilled = Take(m_PartialBuffer.GetData(), strLen);
+    m_HasPartial = true;
+  }
+  return false;
+}
+
+size_t CPipeFrameReader::TakeBytes(void * pData, size_t size) {
+  return Take(pData, size);
+}
+
+void CPipeFrameReader::PrepareFill(void * & outData, size_t & outSize) {
+  if(m_HasPartial) {
+    outData = GetPartialData() + m_PartialFilled;
+    outSize = GetPartialSize() - m_PartialFilled;
+    return;
+  }
+  outSize = PrepareBuffer();
+  outData = &m_Buffer[m_End];
+}
+
+void CPipeFrameReader::CommitFill(size_t bytesRead) {
+  ++m_ReadCalls;
+  if(m_HasPartial) {
+    m_PartialFilled += bytesRead;
+    return;
+  }
+  CommitBuffer(m_Buffer.size() - m_End, bytesRead);
+}
+
+bool CPipeFrameReader::Fill() {
+  size_t freeSize = PrepareBuffer();
+  size_t bytesRead = 0;
+  if(!TransportRead(&m_Buffer[m_End], freeSize, bytesRead)) return false;
+  CommitBuffer(freeSize, bytesRead);
+  return true;
+}
+
+size_t CPipeFrameReader::PrepareBuffer() {
+  if(m_Begin == m_End) {
+    m_Begin = m_End = 0;
+  } else if(m_Buffer.size() / 2 <= m_Begin || m_End == m_Buffer.size()) {
+    memmove(&m_Buffer[0], &m_Buffer[m_Begin], Buffered());
+    m_End -= m_Begin;
+    m_Begin = 0;
+  }
+
+  if(m_End == m_Buffer.size()) {
+    m_Buffer.resize(m_Buffer.size() * 2);
+  }
+
+  return m_Buffer.size() - m_End;
+}
+
+void CPipeFrameReader::CommitBuffer(size_t freeSize, size_t bytesRead) {
+  m_End += bytesRead;
+
+  // A read that filled all free space suggests a backlog, grow for the next.
+  if(bytesRead == freeSize && m_Buffer.size() < m_MaxCapacity) {
+    m_Buffer.resize(std::min(m_MaxCapacity, m_Buffer.size() * 2));
+  }
+}
+
+bool CPipeFrameReader::ReadDirect(void * pData, size_t size) {
+  while(0 < size) {
+    size_t bytesRead = 0;
+    if(!TransportRead(pData, size, bytesRead)) return false;
+    size -= bytesRead;
+    pData = (unsigned char *)pData + bytesRead;
+  }
+  return true;
+}
+
+bool CPipeFrameReader::TransportRead(void * pData, size_t size, size_t & outBytesRead) {
+  ++m_ReadCalls;
+  if(!m_Stats) return m_Transport.Read(pData, size, outBytesRead);
+
+  uint64_t start = StatNowNanoseconds();
+  bool bOk = m_Transport.Read(pData, size, outBytesRead);
+  m_Stats->readTime.RecordSince(start);
+  if(bOk) m_Stats->bytesIn.Add((int64_t)outBytesRead);
+  return bOk;
+}
+
+size_t CPipeFrameReader::Take(void * pData, size_t size) {
+  size_t taken = std::min(size, Buffered());
+  if(taken) memcpy(pData, &m_Buffer[m_Begin], taken);
+  m_Begin += taken;
+  if(m_Stats) m_Stats->bytesCopied.Add((int64_t)taken);
+  return taken;
+}
+
+bool CPipeFrameReader::PeekFrameLength(PipeFrameLength_t & outLength) {
+  if(Buffered() < sizeof(PipeFrameLength_t)) return false;
+  memcpy(&outLength, &m_Buffer[m_Begin], sizeof(outLength));
+  return true;
+}
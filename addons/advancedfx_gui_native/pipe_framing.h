@@ -0,0 +1,129 @@
+#pragma once
+
+#include "pipe_buffer_pool.h"
+#include "pipe_transport.h"
+#include "stats.h"
+
+#include <string>
+#include <vector>
+
+// Messages on the pipe are framed as a 32 bit length in host byte order
+// followed by that many bytes of payload.
+typedef uint32_t PipeFrameLength_t;
+
+void AppendPipeFrame(std::vector<unsigned char> & buffer, const void * pData, PipeFrameLength_t size);
+
+// Counters of one pipe.
+struct CPipeStats {
+  CStatCounter queueDepth; // Operations not completed and streamed frames not acknowledged yet.
+  CStatCounter bytesIn;
+  CStatCounter bytesOut;
+  CStatCounter bytesCopied; // From the read-ahead buffer into messages.
+  CStatCounter messagesIn; // Frames and raw reads.
+  CStatCounter messagesOut; // Write operations.
+  CStatCounter dropped; // Received messages dropped by the queue policy.
+  CStatCounter merged; // Received messages replaced by a later one.
+  CStatHistogram readTime; // Per transport read, including the wait for data.
+  CStatHistogram writeTime; // Per transport write of a merged batch.
+
+  // All but queueDepth, which is a level rather than a total.
+  void Reset() {
+    bytesIn.Reset();
+    bytesOut.Reset();
+    bytesCopied.Reset();
+    messagesIn.Reset();
+    messagesOut.Reset();
+    dropped.Reset();
+    merged.Reset();
+    readTime.Reset();
+    writeTime.Reset();
+  }
+};
+
+// Reads ahead in large chunks and parses as many frames from each read as
+// are available. Bodies that do not fit the read-ahead buffer are read
+// directly into their destination.
+// With asynchronous transports the owner does the reading: TakeFrame /
+// TakeBytes only use what is buffered, PrepareFill tells where the next
+// transport read should go and CommitFill accounts for it.
+// Not thread-safe, meant to be owned by the thread reading the transport.
+class CPipeFrameReader {
+ public:
+  // pStats (optional) receives bytesIn, messagesIn and readTime.
+  CPipeFrameReader(CPipeTransport & transport, CPipeStats * pStats = nullptr);
+
+  bool ReadFrame(std::string & outStr);
+
+  // Reads exactly size raw bytes (no framing).
+  bool ReadBytes(void * pData, size_t size);
+
+  // True if a complete frame is buffered, so ReadFrame will not block.
+  bool HasBufferedFrame();
+
+  // Returns false if the frame is not complete yet.
+  bool TakeFrame(std::string & outStr);
+
+  // Like TakeFrame, but into a buffer from pool. Frames too big for the
+  // read-ahead buffer are read straight into it.
+  bool TakeFrame(CPipeBufferPool & pool, CPipeBuffer & outBuffer);
+
+  // Returns how many bytes were taken, stops short if less are buffered.
+  size_t TakeBytes(void * pData, size_t size);
+
+  void PrepareFill(void * & outData, size_t & outSize);
+  void CommitFill(size_t bytesRead);
+
+  // Number of transport reads issued so far.
+  uint64_t GetReadCalls() {
+    return m_ReadCalls;
+  }
+
+ private:
+  static const size_t m_MinCapacity = 64 * 1024;
+  static const size_t m_MaxCapacity = 1024 * 1024;
+
+  CPipeTransport & m_Transport;
+  CPipeStats * m_Stats;
+  std::vector<unsigned char> m_Buffer;
+  size_t m_Begin = 0;
+  size_t m_End = 0;
+  uint64_t m_ReadCalls = 0;
+
+  // Frame too big for the buffer that TakeFrame is filling directly, in
+  // m_PartialBuffer if the pooled TakeFrame started it.
+  std::string m_Partial;
+  CPipeBuffer m_PartialBuffer;
+  size_t m_PartialFilled = 0;
+  bool m_HasPartial = false;
+
+  size_t Buffered() {
+    return m_End - m_Begin;
+  }
+
+  // Reads at least one more byte into the buffer.
+  bool Fill();
+
+  // Makes room at m_End, returns the free size.
+  size_t PrepareBuffer();
+  void CommitBuffer(size_t freeSize, size_t bytesRead);
+
+  // Reads into pData bypassing the buffer.
+  bool ReadDirect(void * pData, size_t size);
+
+  // Transport read with accounting.
+  bool TransportRead(void * pData, size_t size, size_t & outBytesRead);
+
+  // Takes up to size buffered bytes.
+  size_t Take(void * pData, size_t size);
+
+  // Returns false if not even the length of the next frame is buffered.
+  bool PeekFrameLength(PipeFrameLength_t & outLength);
+
+  unsigned char * GetPartialData() {
+    return m_PartialBuffer.IsEmpty() ? reinterpret_cast<unsigned char *>(&m_Partial[0]) : m_PartialBuffer.GetData();
+  }
+
+  size_t GetPartialSize() {
+    return m_PartialBuffer.IsEmpty() ? m_Partial.size() : m_PartialBuffer.GetSize();
+  }
+};
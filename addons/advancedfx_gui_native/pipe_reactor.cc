@@ -0,0 +1,33 @@
+#include "pipe_reactor.h"
+
+#include <mutex>
+#include <thread>
+
+// Implemented by the platform backend, nullptr if there is none.
+CPipeReactor * CreatePipeReactor(size_t threadCount);
+
+static std::mutex g_ReactorLock;
+static CPipeReactor * g_Reactor = nullptr;
+static size_t g_ReactorUsers = 0;
+
+CPipeReactor * CPipeReactor::Acquire() {
+  std::unique_lock<std::mutex> lock(g_ReactorLock);
+  if(nullptr == g_Reactor) {
+    // Pipes mostly wait, two threads keep one slow callback from stalling
+    // everyone else.
+    size_t threadCount = std::thread::hardware_concurrency() < 2 ? 1 : 2;
+    g_Reactor = CreatePipeReactor(threadCount);
+    if(nullptr == g_Reactor) return nullptr;
+  }
+  ++g_ReactorUsers;
+  return g_Reactor;
+}
+
+void CPipeReactor::Release(CPipeReactor * reactor) {
+  if(nullptr == reactor) return;
+  std::unique_lock<std::mutex> lock(g_ReactorLock);
+  if(0 == --g_ReactorUsers) {
+    delete g_Reactor;
+    g_Reactor = nullptr;
+  }
+}
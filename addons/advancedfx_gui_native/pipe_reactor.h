@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Event loop shared by all pipes of the process: a small fixed pool of
+// threads waits on an epoll instance (Linux) or an I/O completion port
+// (Windows) and runs the callbacks of the transports' asynchronous I/O.
+// Callbacks run on any of the pool threads, but one event is only ever
+// handled by one thread.
+class CPipeReactor {
+ public:
+  // Returns the shared reactor, starting it if needed, or nullptr if the
+  // platform has none. Each Acquire needs a matching Release, the last one
+  // stops the threads. Not to be called from reactor threads.
+  static CPipeReactor * Acquire();
+  static void Release(CPipeReactor * reactor);
+
+  virtual ~CPipeReactor() {}
+
+  virtual size_t GetThreadCount() = 0;
+
+#ifdef _WIN32
+  // Overlapped operation on a handle associated with the reactor, pass it as
+  // the OVERLAPPED of the I/O call to get OnComplete called.
+  struct Operation : public OVERLAPPED {
+    virtual void OnComplete(bool bOk, DWORD bytes) = 0;
+  };
+
+  // Completions of overlapped I/O on handle go to the reactor from now on.
+  virtual bool Associate(HANDLE handle) = 0;
+#else
+  class CWatch {
+   public:
+    // Called once per Arm when fd became ready (or failed).
+    virtual void OnReady(uint32_t events) = 0;
+  };
+
+  // Adds fd without waiting for anything yet, returns 0 on failure.
+  virtual uint64_t Register(int fd, CWatch * watch) = 0;
+
+  // Waits once for events (EPOLLIN, EPOLLOUT) on fd.
+  virtual bool Arm(int fd, uint64_t id, uint32_t events) = 0;
+
+  // Removes fd, once this returns watch is not called anymore and no call is
+  // running. Must not be called from watch's own OnReady.
+  virtual void Unregister(int fd, uint64_t id) = 0;
+#endif
+};
@@ -0,0 +1,137 @@
+#include "pipe_reactor.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Watches are registered one-shot, so an event is handed to one thread and
+// nothing fires again until the watch is armed again.
+// The epoll data is an id rather than the watch itself: a thread may already
+// have an event of a watch in hand when it is unregistered, looking the id
+// up (and counting calls in progress) makes Unregister safe against that.
+class CPipeReactorEpoll : public CPipeReactor {
+ public:
+  CPipeReactorEpoll(int epollFd, int quitFd, size_t threadCount)
+  : m_EpollFd(epollFd), m_QuitFd(quitFd) {
+    for(size_t i = 0; i < threadCount; i++) {
+      m_Threads.emplace_back(&CPipeReactorEpoll::ThreadHandler, this);
+    }
+  }
+
+  virtual ~CPipeReactorEpoll() {
+    uint64_t one = 1;
+    while(write(m_QuitFd, &one, sizeof(one)) < 0 && EINTR == errno);
+    for(std::thread & thread : m_Threads) thread.join();
+    close(m_QuitFd);
+    close(m_EpollFd);
+  }
+
+  virtual size_t GetThreadCount() override {
+    return m_Threads.size();
+  }
+
+  virtual uint64_t Register(int fd, CWatch * watch) override {
+    uint64_t id;
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      id = ++m_NextId;
+      m_Watches[id] = Entry{watch, 0};
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLONESHOT;
+    event.data.u64 = id;
+    if(0 != epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, fd, &event)) {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Watches.erase(id);
+      return 0;
+    }
+    return id;
+  }
+
+  virtual bool Arm(int fd, uint64_t id, uint32_t events) override {
+    epoll_event event = {};
+    event.events = events | EPOLLONESHOT;
+    event.data.u64 = id;
+    return 0 == epoll_ctl(m_EpollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+
+  virtual void Unregister(int fd, uint64_t id) override {
+    epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // Looked up again after every wake: Register may have rehashed the map.
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [this, id]{
+      auto it = m_Watches.find(id);
+      return it == m_Watches.end() || 0 == it->second.calls;
+    });
+    m_Watches.erase(id);
+  }
+
+ private:
+  struct Entry {
+    CWatch * watch;
+    size_t calls; // OnReady calls in progress.
+  };
+
+  int m_EpollFd;
+  int m_QuitFd;
+  std::vector<std::thread> m_Threads;
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::unordered_map<uint64_t, Entry> m_Watches;
+  uint64_t m_NextId = 0;
+
+  void ThreadHandler() {
+    epoll_event events[16];
+    while(true) {
+      int count = epoll_wait(m_EpollFd, events, 16, -1);
+      if(count < 0) {
+        if(EINTR == errno) continue;
+        break;
+      }
+      for(int i = 0; i < count; i++) {
+        if(0 == events[i].data.u64) return; // The quit eventfd, never read so it wakes all threads.
+
+        CWatch * watch = nullptr;
+        {
+          std::unique_lock<std::mutex> lock(m_Lock);
+          auto it = m_Watches.find(events[i].data.u64);
+          if(it == m_Watches.end()) continue;
+          watch = it->second.watch;
+          ++it->second.calls;
+        }
+
+        watch->OnReady(events[i].events);
+
+        std::unique_lock<std::mutex> lock(m_Lock);
+        auto it = m_Watches.find(events[i].data.u64);
+        if(0 == --it->second.calls) m_Cv.notify_all();
+      }
+    }
+  }
+};
+
+CPipeReactor * CreatePipeReactor(size_t threadCount) {
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if(epollFd < 0) return nullptr;
+
+  int quitFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  if(quitFd < 0 || 0 != epoll_ctl(epollFd, EPOLL_CTL_ADD, quitFd, &event)) {
+    if(0 <= quitFd) close(quitFd);
+    close(epollFd);
+    return nullptr;
+  }
+
+  return new CPipeReactorEpoll(epollFd, quitFd, threadCount);
+}
@@ -0,0 +1,56 @@
+#include "pipe_reactor.h"
+
+#include <thread>
+#include <vector>
+
+// Every operation carries its handler in the OVERLAPPED it was issued with,
+// the completion key only tells the quit packets apart.
+class CPipeReactorIocp : public CPipeReactor {
+ public:
+  CPipeReactorIocp(HANDLE port, size_t threadCount)
+  : m_Port(port) {
+    for(size_t i = 0; i < threadCount; i++) {
+      m_Threads.emplace_back(&CPipeReactorIocp::ThreadHandler, this);
+    }
+  }
+
+  virtual ~CPipeReactorIocp() {
+    for(size_t i = 0; i < m_Threads.size(); i++) PostQueuedCompletionStatus(m_Port, 0, QuitKey, NULL);
+    for(std::thread & thread : m_Threads) thread.join();
+    CloseHandle(m_Port);
+  }
+
+  virtual size_t GetThreadCount() override {
+    return m_Threads.size();
+  }
+
+  virtual bool Associate(HANDLE handle) override {
+    return NULL != CreateIoCompletionPort(handle, m_Port, 0, 0);
+  }
+
+ private:
+  static const ULONG_PTR QuitKey = 1;
+
+  HANDLE m_Port;
+  std::vector<std::thread> m_Threads;
+
+  void ThreadHandler() {
+    while(true) {
+      DWORD bytes = 0;
+      ULONG_PTR key = 0;
+      OVERLAPPED * pOverlapped = NULL;
+      BOOL bOk = GetQueuedCompletionStatus(m_Port, &bytes, &key, &pOverlapped, INFINITE);
+      if(NULL == pOverlapped) {
+        if(QuitKey == key || !bOk && ERROR_ABANDONED_WAIT_0 == GetLastError()) break;
+        continue;
+      }
+      static_cast<Operation *>(pOverlapped)->OnComplete(FALSE != bOk, bytes);
+    }
+  }
+};
+
+CPipeReactor * CreatePipeReactor(size_t threadCount) {
+  HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, (DWORD)threadCount);
+  if(NULL == port) return nullptr;
+  return new CPipeReactorIocp(port, threadCount);
+}
@@ -0,0 +1,110 @@
+#include "pipe_transport.h"
+
+#include "threaded_queue.h"
+
+#include <mutex>
+
+// Asynchronous I/O for backends without reactor support: the blocking calls
+// run on one thread per direction, started on first use.
+class CPipeBlockingAsync {
+ public:
+  CPipeBlockingAsync(CPipeTransport & transport, CPipeIoHandler & handler)
+  : m_Transport(transport), m_Handler(handler) {
+  }
+
+  ~CPipeBlockingAsync() {
+    Cancel();
+  }
+
+  bool Read(void * pData, size_t size) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(m_Cancelled) return false;
+    if(nullptr == m_ReadQueue) m_ReadQueue = new CThreadedQueue();
+    m_ReadQueue->Queue([this,pData,size]{
+      size_t bytesRead = 0;
+      bool bOk = m_Transport.Read(pData, size, bytesRead);
+      m_Handler.OnReadDone(bOk, bytesRead);
+    });
+    return true;
+  }
+
+  bool Write(const void * pData, size_t size) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(m_Cancelled) return false;
+    if(nullptr == m_WriteQueue) m_WriteQueue = new CThreadedQueue();
+    m_WriteQueue->Queue([this,pData,size]{
+      size_t bytesWritten = 0;
+      bool bOk = m_Transport.Write(pData, size, bytesWritten);
+      m_Handler.OnWriteDone(bOk, bytesWritten);
+    });
+    return true;
+  }
+
+  void Cancel() {
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Cancelled = true;
+    }
+    for(CThreadedQueue ** ppQueue : {&m_ReadQueue, &m_WriteQueue}) {
+      if(nullptr == *ppQueue) continue;
+      (*ppQueue)->SignalQuit();
+      while(!(*ppQueue)->HasQuit()) m_Transport.CancelIo((*ppQueue)->GetNativeThreadHandle());
+      delete *ppQueue;
+      *ppQueue = nullptr;
+    }
+  }
+
+ private:
+  CPipeTransport & m_Transport;
+  CPipeIoHandler & m_Handler;
+  std::mutex m_Lock;
+  bool m_Cancelled = false;
+  CThreadedQueue * m_ReadQueue = nullptr;
+  CThreadedQueue * m_WriteQueue = nullptr;
+};
+
+CPipeTransport::~CPipeTransport() {
+  delete m_BlockingAsync;
+}
+
+void CPipeTransport::StartAsync(CPipeReactor * reactor, CPipeIoHandler & handler) {
+  m_BlockingAsync = new CPipeBlockingAsync(*this, handler);
+}
+
+bool CPipeTransport::ReadAsync(void * pData, size_t size) {
+  return m_BlockingAsync && m_BlockingAsync->Read(pData, size);
+}
+
+bool CPipeTransport::WriteAsync(const void * pData, size_t size) {
+  return m_BlockingAsync && m_BlockingAsync->Write(pData, size);
+}
+
+void CPipeTransport::CancelAsync() {
+  if(m_BlockingAsync) m_BlockingAsync->Cancel();
+}
+
+bool CPipeTransport::ReadBytes(void * pData, size_t bytesToRead) {
+  while(0 < bytesToRead) {
+    size_t bytesRead = 0;
+    if(!Read(pData, bytesToRead, bytesRead)) {
+      return false;
+    }
+    bytesToRead -= bytesRead;
+    pData = (unsigned char *)pData + bytesRead;
+  }
+
+  return true;
+}
+
+bool CPipeTransport::WriteBytes(const void * pData, size_t bytesToWrite) {
+  while(0 < bytesToWrite) {
+    size_t bytesWritten = 0;
+    if(!Write(pData, bytesToWrite, bytesWritten)) {
+      return false;
+    }
+    bytesToWrite -= bytesWritten;
+    pData = (const unsigned char *)pData + bytesWritten;
+  }
+
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+class CPipeReactor;
+class CPipeBlockingAsync;
+
+// Completions of asynchronous transport I/O (CPipeTransport::StartAsync).
+// bOk means at least one byte was transferred, not ok is an error, EOF or
+// cancellation.
+class CPipeIoHandler {
+ public:
+  virtual void OnReadDone(bool bOk, size_t bytes) = 0;
+  virtual void OnWriteDone(bool bOk, size_t bytes) = 0;
+};
+
+// Which end of a pipe this process does I/O on, the other one is handed to
+// another process.
+enum PipeLocalEnd_e {
+  PipeLocalEnd_Both, // Both are used here, e.g. in benchmarks.
+  PipeLocalEnd_Read,
+  PipeLocalEnd_Write
+};
+
+// OS specific end points of an anonymous pipe. Both ends are owned by the
+// transport, one of them is usually handed to another process.
+class CPipeTransport {
+ public:
+  // Creates the backend for the current platform, returns nullptr on failure.
+  // Only localEnd may be used for I/O by this process.
+  static CPipeTransport * Create(PipeLocalEnd_e localEnd = PipeLocalEnd_Both);
+
+  // Creates a single producer / single consumer ring of capacity (a power of
+  // two) bytes in shared memory instead (see pipe_transport_shm.h). Both
+  // native handles are the section, the other process attaches to it.
+  static CPipeTransport * CreateSharedMemory(size_t capacity);
+
+  // Attaches to a section created by CreateSharedMemory in another process,
+  // takes ownership of sectionHandle. Returns nullptr on failure.
+  static CPipeTransport * AttachSharedMemory(int64_t sectionHandle);
+
+  // Call CancelAsync before if StartAsync was called.
+  virtual ~CPipeTransport();
+
+  // Reads at most size bytes, blocks until at least one byte is available.
+  virtual bool Read(void * pData, size_t size, size_t & outBytesRead) = 0;
+
+  // Writes at most size bytes, blocks until at least one byte is written.
+  virtual bool Write(const void * pData, size_t size, size_t & outBytesWritten) = 0;
+
+  // Aborts blocking I/O on ioThread, may have to be called repeatedly until
+  // that thread stopped issuing I/O.
+  virtual void CancelIo(std::thread::native_handle_type ioThread) = 0;
+
+  // Switches to asynchronous I/O through ReadAsync / WriteAsync, completions
+  // go to handler. Backends that support it use reactor (may be nullptr),
+  // the others run the blocking calls on a helper thread per direction.
+  // Read / Write keep working, e.g. for the other end.
+  virtual void StartAsync(CPipeReactor * reactor, CPipeIoHandler & handler);
+
+  // Transfer at most size bytes, at most one read and one write may be in
+  // flight. Return false if the operation could not be started, otherwise
+  // handler is called exactly once, on another thread.
+  virtual bool ReadAsync(void * pData, size_t size);
+  virtual bool WriteAsync(const void * pData, size_t size);
+
+  // Operations in flight and started later fail. Once this returns no
+  // handler call is running or will be made anymore.
+  virtual void CancelAsync();
+
+  // Handle / file descriptor values as they are passed to other processes.
+  virtual int64_t GetNativeReadHandle() = 0;
+  virtual int64_t GetNativeWriteHandle() = 0;
+
+  // Reads / writes exactly size bytes.
+  bool ReadBytes(void * pData, size_t size);
+  bool WriteBytes(const void * pData, size_t size);
+
+ private:
+  CPipeBlockingAsync * m_BlockingAsync = nullptr;
+};
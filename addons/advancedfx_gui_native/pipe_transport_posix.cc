@@ -0,0 +1,249 @@
+#include "pipe_transport.h"
+#include "pipe_reactor.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Blocking I/O is done through poll() on the pipe and a cancel pipe, so
+// CancelIo can wake up a blocked thread the way CancelSynchronousIo does on
+// Windows.
+// Asynchronous I/O goes through the reactor on private non-blocking opens of
+// the pipe ends (/proc/self/fd), so the file status flags of the ends handed
+// to other processes stay blocking.
+// The pipe is created with O_CLOEXEC, child processes get their end passed
+// explicitly (e.g. through the stdio option of child_process.spawn).
+class CPipeTransportPosix : public CPipeTransport {
+ public:
+  CPipeTransportPosix(int readFd, int writeFd, int cancelReadFd, int cancelWriteFd)
+  : m_ReadFd(readFd), m_WriteFd(writeFd), m_CancelReadFd(cancelReadFd), m_CancelWriteFd(cancelWriteFd)
+  , m_AsyncRead(this, false), m_AsyncWrite(this, true) {
+  }
+
+  virtual ~CPipeTransportPosix() {
+    if(0 <= m_AsyncRead.fd) close(m_AsyncRead.fd);
+    if(0 <= m_AsyncWrite.fd) close(m_AsyncWrite.fd);
+    close(m_WriteFd);
+    close(m_ReadFd);
+    close(m_CancelWriteFd);
+    close(m_CancelReadFd);
+  }
+
+  virtual bool Read(void * pData, size_t size, size_t & outBytesRead) override {
+    if(!WaitFor(m_ReadFd, POLLIN)) return false;
+
+    ssize_t result;
+    do {
+      result = read(m_ReadFd, pData, size);
+    } while(result < 0 && EINTR == errno);
+
+    if(result <= 0) return false; // 0 is EOF, the other end was closed.
+    outBytesRead = (size_t)result;
+    return true;
+  }
+
+  virtual bool Write(const void * pData, size_t size, size_t & outBytesWritten) override {
+    if(!WaitFor(m_WriteFd, POLLOUT)) return false;
+
+    ssize_t result;
+    do {
+      result = write(m_WriteFd, pData, size);
+    } while(result < 0 && EINTR == errno);
+
+    if(result < 0) return false;
+    outBytesWritten = (size_t)result;
+    return true;
+  }
+
+  virtual void CancelIo(std::thread::native_handle_type ioThread) override {
+    if(!m_Cancelled.exchange(true)) {
+      char dummy = 0;
+      while(write(m_CancelWriteFd, &dummy, 1) < 0 && EINTR == errno);
+    }
+  }
+
+  virtual void StartAsync(CPipeReactor * reactor, CPipeIoHandler & handler) override {
+    if(nullptr == reactor) {
+      CPipeTransport::StartAsync(reactor, handler);
+      return;
+    }
+    m_Reactor = reactor;
+    m_Handler = &handler;
+  }
+
+  virtual bool ReadAsync(void * pData, size_t size) override {
+    if(nullptr == m_Reactor) return CPipeTransport::ReadAsync(pData, size);
+    return StartOp(m_AsyncRead, m_ReadFd, (unsigned char *)pData, size);
+  }
+
+  virtual bool WriteAsync(const void * pData, size_t size) override {
+    if(nullptr == m_Reactor) return CPipeTransport::WriteAsync(pData, size);
+    return StartOp(m_AsyncWrite, m_WriteFd, (unsigned char *)pData, size);
+  }
+
+  virtual void CancelAsync() override {
+    if(nullptr == m_Reactor) {
+      CPipeTransport::CancelAsync();
+      return;
+    }
+
+    std::vector<AsyncOp *> failed;
+    {
+      std::unique_lock<std::mutex> lock(m_AsyncLock);
+      m_AsyncCancelled = true;
+      for(AsyncOp * op : {&m_AsyncRead, &m_AsyncWrite}) {
+        if(op->bPending) failed.push_back(op);
+        op->bPending = false;
+      }
+    }
+
+    // Waits for OnReady calls in progress, those found their op taken.
+    for(AsyncOp * op : {&m_AsyncRead, &m_AsyncWrite}) {
+      if(op->id) m_Reactor->Unregister(op->fd, op->id);
+      op->id = 0;
+    }
+
+    for(AsyncOp * op : failed) {
+      if(op->bWrite) m_Handler->OnWriteDone(false, 0);
+      else m_Handler->OnReadDone(false, 0);
+    }
+  }
+
+  virtual int64_t GetNativeReadHandle() override {
+    return m_ReadFd;
+  }
+
+  virtual int64_t GetNativeWriteHandle() override {
+    return m_WriteFd;
+  }
+
+ private:
+  int m_ReadFd;
+  int m_WriteFd;
+  int m_CancelReadFd;
+  int m_CancelWriteFd;
+  std::atomic_bool m_Cancelled = false;
+
+  struct AsyncOp : public CPipeReactor::CWatch {
+    AsyncOp(CPipeTransportPosix * transport, bool bWrite)
+    : transport(transport), bWrite(bWrite) {
+    }
+
+    virtual void OnReady(uint32_t events) override {
+      transport->OnReady(*this);
+    }
+
+    CPipeTransportPosix * transport;
+    bool bWrite;
+    int fd = -1;
+    uint64_t id = 0;
+    unsigned char * pData = nullptr;
+    size_t size = 0;
+    bool bPending = false;
+  };
+
+  CPipeReactor * m_Reactor = nullptr;
+  CPipeIoHandler * m_Handler = nullptr;
+  std::mutex m_AsyncLock;
+  bool m_AsyncCancelled = false;
+  AsyncOp m_AsyncRead;
+  AsyncOp m_AsyncWrite;
+
+  // Opens a new file description of the pipe end fd, so O_NONBLOCK does not
+  // leak to other holders of fd. Where /proc is missing it has to.
+  static int OpenNonBlocking(int fd, bool bWrite) {
+    std::string path = "/proc/self/fd/" + std::to_string(fd);
+    int result = open(path.c_str(), (bWrite ? O_WRONLY : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+    if(0 <= result) return result;
+
+    result = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if(0 <= result && 0 != fcntl(result, F_SETFL, fcntl(result, F_GETFL) | O_NONBLOCK)) {
+      close(result);
+      result = -1;
+    }
+    return result;
+  }
+
+  bool StartOp(AsyncOp & op, int fd, unsigned char * pData, size_t size) {
+    std::unique_lock<std::mutex> lock(m_AsyncLock);
+    if(m_AsyncCancelled) return false;
+
+    if(0 == op.id) {
+      if(op.fd < 0) op.fd = OpenNonBlocking(fd, op.bWrite);
+      if(op.fd < 0) return false;
+      op.id = m_Reactor->Register(op.fd, &op);
+      if(0 == op.id) return false;
+    }
+
+    op.pData = pData;
+    op.size = size;
+    op.bPending = true;
+    if(!m_Reactor->Arm(op.fd, op.id, op.bWrite ? EPOLLOUT : EPOLLIN)) {
+      op.bPending = false;
+      return false;
+    }
+    return true;
+  }
+
+  void OnReady(AsyncOp & op) {
+    ssize_t result;
+    {
+      std::unique_lock<std::mutex> lock(m_AsyncLock);
+      if(!op.bPending) return; // Cancelled.
+
+      do {
+        result = op.bWrite ? write(op.fd, op.pData, op.size) : read(op.fd, op.pData, op.size);
+      } while(result < 0 && EINTR == errno);
+
+      if(result < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+        // Someone else got there first, wait again.
+        if(m_Reactor->Arm(op.fd, op.id, op.bWrite ? EPOLLOUT : EPOLLIN)) return;
+      }
+      op.bPending = false;
+    }
+
+    // 0 is EOF for reads.
+    if(op.bWrite) m_Handler->OnWriteDone(0 < result, 0 < result ? (size_t)result : 0);
+    else m_Handler->OnReadDone(0 < result, 0 < result ? (size_t)result : 0);
+  }
+
+  bool WaitFor(int fd, short events) {
+    if(m_Cancelled) return false;
+
+    pollfd fds[2] = {
+      {fd, events, 0},
+      {m_CancelReadFd, POLLIN, 0}
+    };
+
+    int result;
+    do {
+      result = poll(fds, 2, -1);
+    } while(result < 0 && EINTR == errno);
+
+    if(result < 0 || fds[1].revents) return false;
+    return 0 != fds[0].revents;
+  }
+};
+
+CPipeTransport * CPipeTransport::Create(PipeLocalEnd_e localEnd) {
+  int fds[2];
+  if(0 != pipe2(fds, O_CLOEXEC)) {
+    return nullptr;
+  }
+
+  int cancelFds[2];
+  if(0 != pipe2(cancelFds, O_CLOEXEC | O_NONBLOCK)) {
+    close(fds[0]);
+    close(fds[1]);
+    return nullptr;
+  }
+
+  return new CPipeTransportPosix(fds[0], fds[1], cancelFds[0], cancelFds[1]);
+}
@@ -0,0 +1,106 @@
+#include "pipe_transport_shm.h"
+
+#include <cstring>
+#include <new>
+
+CPipeTransportShm::CPipeTransportShm(CShmRingHeader * pHeader)
+: m_Header(pHeader), m_Data(reinterpret_cast<unsigned char *>(pHeader) + ShmRingDataOffset) {
+}
+
+void CPipeTransportShm::InitSection(void * pSection, uint64_t capacity, int64_t dataEvent, int64_t spaceEvent) {
+  CShmRingHeader * pHeader = new (pSection) CShmRingHeader();
+  pHeader->magic = CShmRingHeader::Magic;
+  pHeader->version = CShmRingHeader::Version;
+  pHeader->capacity = capacity;
+  pHeader->dataEvent = dataEvent;
+  pHeader->spaceEvent = spaceEvent;
+  pHeader->closed = 0;
+  pHeader->writePos = 0;
+  pHeader->readerWaiting = 0;
+  pHeader->readPos = 0;
+  pHeader->writerWaiting = 0;
+}
+
+bool CPipeTransportShm::IsValidSection(const void * pSection, size_t sectionSize) {
+  if(sectionSize < ShmRingDataOffset) return false;
+  const CShmRingHeader * pHeader = reinterpret_cast<const CShmRingHeader *>(pSection);
+  return CShmRingHeader::Magic == pHeader->magic
+    && CShmRingHeader::Version == pHeader->version
+    && 0 < pHeader->capacity && 0 == (pHeader->capacity & (pHeader->capacity - 1))
+    && pHeader->capacity <= sectionSize - ShmRingDataOffset;
+}
+
+bool CPipeTransportShm::Read(void * pData, size_t size, size_t & outBytesRead) {
+  const uint64_t capacity = m_Header->capacity;
+
+  while(true) {
+    uint64_t readPos = m_Header->readPos.load(std::memory_order_relaxed);
+    uint64_t available = m_Header->writePos.load(std::memory_order_acquire) - readPos;
+
+    if(0 < available) {
+      size_t count = (size_t)(available < size ? available : size);
+      size_t offset = (size_t)(readPos & (capacity - 1));
+      size_t first = count < capacity - offset ? count : (size_t)(capacity - offset);
+      memcpy(pData, m_Data + offset, first);
+      memcpy((unsigned char *)pData + first, m_Data, count - first);
+
+      m_Header->readPos.store(readPos + count, std::memory_order_seq_cst);
+      if(m_Header->writerWaiting.load(std::memory_order_seq_cst) && m_Header->writerWaiting.exchange(0)) WakeSpace();
+
+      outBytesRead = count;
+      return true;
+    }
+
+    if(m_Cancelled || m_Header->closed) return false;
+
+    m_Header->readerWaiting.store(1, std::memory_order_seq_cst);
+    if(m_Header->writePos.load(std::memory_order_seq_cst) == readPos && !m_Cancelled && !m_Header->closed) {
+      WaitData();
+    }
+    m_Header->readerWaiting.store(0, std::memory_order_relaxed);
+  }
+}
+
+bool CPipeTransportShm::Write(const void * pData, size_t size, size_t & outBytesWritten) {
+  const uint64_t capacity = m_Header->capacity;
+
+  while(true) {
+    if(m_Cancelled || m_Header->closed) return false;
+
+    uint64_t writePos = m_Header->writePos.load(std::memory_order_relaxed);
+    uint64_t space = capacity - (writePos - m_Header->readPos.load(std::memory_order_acquire));
+
+    if(0 < space) {
+      size_t count = (size_t)(space < size ? space : size);
+      size_t offset = (size_t)(writePos & (capacity - 1));
+      size_t first = count < capacity - offset ? count : (size_t)(capacity - offset);
+      memcpy(m_Data + offset, pData, first);
+      memcpy(m_Data, (const unsigned char *)pData + first, count - first);
+
+      m_Header->writePos.store(writePos + count, std::memory_order_seq_cst);
+      if(m_Header->readerWaiting.load(std::memory_order_seq_cst) && m_Header->readerWaiting.exchange(0)) WakeData();
+
+      outBytesWritten = count;
+      return true;
+    }
+
+    m_Header->writerWaiting.store(1, std::memory_order_seq_cst);
+    if(capacity == writePos - m_Header->readPos.load(std::memory_order_seq_cst) && !m_Cancelled && !m_Header->closed) {
+      WaitSpace();
+    }
+    m_Header->writerWaiting.store(0, std::memory_order_relaxed);
+  }
+}
+
+void CPipeTransportShm::CancelIo(std::thread::native_handle_type ioThread) {
+  m_Cancelled = true;
+  Interrupt();
+}
+
+void CPipeTransportShm::CloseRing() {
+  m_Header->closed = 1;
+  m_Header->readerWaiting = 0;
+  m_Header->writerWaiting = 0;
+  WakeData();
+  WakeSpace();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "pipe_transport.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of a shared memory ring section, this is what the other process
+// attaches to. The ring carries one direction: whoever writes is the single
+// producer, whoever reads the single consumer.
+//
+// A side that finds the ring empty (full) raises readerWaiting
+// (writerWaiting), checks again and sleeps. The other side only wakes it when
+// it sees the flag, so a busy stream needs no syscalls at all.
+// On Linux the flags double as futex words. On Windows dataEvent and
+// spaceEvent hold inheritable auto-reset event handles.
+struct CShmRingHeader {
+  static const uint32_t Magic = 0x52584641; // "AFXR"
+  static const uint32_t Version = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity; // Power of two.
+  int64_t dataEvent;
+  int64_t spaceEvent;
+  std::atomic<uint32_t> closed;
+
+  alignas(64) std::atomic<uint64_t> writePos;
+  std::atomic<uint32_t> readerWaiting;
+
+  alignas(64) std::atomic<uint64_t> readPos;
+  std::atomic<uint32_t> writerWaiting;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory ring needs lock-free 64 bit atomics");
+
+// The ring data starts at this offset into the section.
+const size_t ShmRingDataOffset = 256;
+static_assert(sizeof(CShmRingHeader) <= ShmRingDataOffset, "CShmRingHeader too big");
+
+// Platform neutral part of the shared memory transport, the backends provide
+// the section and the sleeping / waking.
+class CPipeTransportShm : public CPipeTransport {
+ public:
+  CPipeTransportShm(CShmRingHeader * pHeader);
+
+  virtual bool Read(void * pData, size_t size, size_t & outBytesRead) override;
+  virtual bool Write(const void * pData, size_t size, size_t & outBytesWritten) override;
+  virtual void CancelIo(std::thread::native_handle_type ioThread) override;
+
+  // Initializes a fresh section of ShmRingDataOffset + capacity bytes.
+  static void InitSection(void * pSection, uint64_t capacity, int64_t dataEvent, int64_t spaceEvent);
+
+  // Returns false if pSection of sectionSize bytes is not a valid ring.
+  static bool IsValidSection(const void * pSection, size_t sectionSize);
+
+ protected:
+  CShmRingHeader * m_Header;
+  unsigned char * m_Data;
+  std::atomic_bool m_Cancelled = false;
+
+  // Marks the ring closed and wakes both sides, call before unmapping.
+  void CloseRing();
+
+  // Sleep until woken by the matching Wake or Interrupt, may return early.
+  virtual void WaitData() = 0;
+  virtual void WaitSpace() = 0;
+  virtual void WakeData() = 0;
+  virtual void WakeSpace() = 0;
+
+  // Wakes threads of this process sleeping in WaitData / WaitSpace.
+  virtual void Interrupt() = 0;
+};
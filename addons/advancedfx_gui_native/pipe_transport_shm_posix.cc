@@ -0,0 +1,112 @@
+#include "pipe_transport_shm.h"
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The section is a memfd, the waiting flags are used as (process shared)
+// futex words. Like the pipe, the memfd is created with MFD_CLOEXEC and the
+// other process gets it passed explicitly.
+class CPipeTransportShmPosix : public CPipeTransportShm {
+ public:
+  CPipeTransportShmPosix(int fd, void * pSection, size_t sectionSize)
+  : CPipeTransportShm(reinterpret_cast<CShmRingHeader *>(pSection)), m_Fd(fd), m_SectionSize(sectionSize) {
+  }
+
+  virtual ~CPipeTransportShmPosix() {
+    CloseRing();
+    munmap(m_Header, m_SectionSize);
+    close(m_Fd);
+  }
+
+  virtual int64_t GetNativeReadHandle() override {
+    return m_Fd;
+  }
+
+  virtual int64_t GetNativeWriteHandle() override {
+    return m_Fd;
+  }
+
+ protected:
+  virtual void WaitData() override {
+    FutexWait(m_Header->readerWaiting);
+  }
+
+  virtual void WaitSpace() override {
+    FutexWait(m_Header->writerWaiting);
+  }
+
+  virtual void WakeData() override {
+    FutexWake(m_Header->readerWaiting);
+  }
+
+  virtual void WakeSpace() override {
+    FutexWake(m_Header->writerWaiting);
+  }
+
+  virtual void Interrupt() override {
+    m_Header->readerWaiting = 0;
+    m_Header->writerWaiting = 0;
+    FutexWake(m_Header->readerWaiting);
+    FutexWake(m_Header->writerWaiting);
+  }
+
+ private:
+  int m_Fd;
+  size_t m_SectionSize;
+
+  static void FutexWait(std::atomic<uint32_t> & word) {
+    // Returns right away if word is not 1 anymore, EINTR is a wake-up too.
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, 1, nullptr, nullptr, 0);
+  }
+
+  static void FutexWake(std::atomic<uint32_t> & word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+  }
+};
+
+static CPipeTransport * MapSection(int fd, size_t sectionSize, uint64_t initCapacity) {
+  void * pSection = mmap(nullptr, sectionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(MAP_FAILED == pSection) {
+    close(fd);
+    return nullptr;
+  }
+
+  if(initCapacity) {
+    CPipeTransportShm::InitSection(pSection, initCapacity, -1, -1);
+  } else if(!CPipeTransportShm::IsValidSection(pSection, sectionSize)) {
+    munmap(pSection, sectionSize);
+    close(fd);
+    return nullptr;
+  }
+
+  return new CPipeTransportShmPosix(fd, pSection, sectionSize);
+}
+
+CPipeTransport * CPipeTransport::CreateSharedMemory(size_t capacity) {
+  if(0 == capacity || 0 != (capacity & (capacity - 1))) return nullptr;
+
+  int fd = memfd_create("advancedfx_gui_ring", MFD_CLOEXEC);
+  if(fd < 0) return nullptr;
+
+  size_t sectionSize = ShmRingDataOffset + capacity;
+  if(0 != ftruncate(fd, (off_t)sectionSize)) {
+    close(fd);
+    return nullptr;
+  }
+
+  return MapSection(fd, sectionSize, capacity);
+}
+
+CPipeTransport * CPipeTransport::AttachSharedMemory(int64_t sectionHandle) {
+  int fd = (int)sectionHandle;
+  struct stat st;
+  if(0 != fstat(fd, &st)) {
+    close(fd);
+    return nullptr;
+  }
+  return MapSection(fd, (size_t)st.st_size, 0);
+}
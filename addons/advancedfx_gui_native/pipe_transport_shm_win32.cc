@@ -0,0 +1,117 @@
+#include "pipe_transport_shm.h"
+
+#include <windows.h>
+
+// The section is a pagefile backed file mapping, waking is done with two
+// auto-reset events. All three handles are inheritable, so the other process
+// sees the event handles stored in the header with the same values.
+class CPipeTransportShmWin32 : public CPipeTransportShm {
+ public:
+  CPipeTransportShmWin32(HANDLE mapping, void * pSection, bool bOwnEvents)
+  : CPipeTransportShm(reinterpret_cast<CShmRingHeader *>(pSection)), m_Mapping(mapping), m_OwnEvents(bOwnEvents) {
+    m_DataEvent = (HANDLE)(INT_PTR)m_Header->dataEvent;
+    m_SpaceEvent = (HANDLE)(INT_PTR)m_Header->spaceEvent;
+    m_CancelEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  }
+
+  virtual ~CPipeTransportShmWin32() {
+    CloseRing();
+    if(m_OwnEvents) {
+      CloseHandle(m_SpaceEvent);
+      CloseHandle(m_DataEvent);
+    }
+    CloseHandle(m_CancelEvent);
+    UnmapViewOfFile(m_Header);
+    CloseHandle(m_Mapping);
+  }
+
+  virtual int64_t GetNativeReadHandle() override {
+    return (int64_t)(INT_PTR)m_Mapping;
+  }
+
+  virtual int64_t GetNativeWriteHandle() override {
+    return (int64_t)(INT_PTR)m_Mapping;
+  }
+
+ protected:
+  virtual void WaitData() override {
+    Wait(m_DataEvent);
+  }
+
+  virtual void WaitSpace() override {
+    Wait(m_SpaceEvent);
+  }
+
+  virtual void WakeData() override {
+    SetEvent(m_DataEvent);
+  }
+
+  virtual void WakeSpace() override {
+    SetEvent(m_SpaceEvent);
+  }
+
+  virtual void Interrupt() override {
+    SetEvent(m_CancelEvent);
+  }
+
+ private:
+  HANDLE m_Mapping;
+  HANDLE m_DataEvent;
+  HANDLE m_SpaceEvent;
+  HANDLE m_CancelEvent; // Local to this process.
+  bool m_OwnEvents;
+
+  void Wait(HANDLE event) {
+    HANDLE handles[2] = { event, m_CancelEvent };
+    WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+  }
+};
+
+CPipeTransport * CPipeTransport::CreateSharedMemory(size_t capacity) {
+  if(0 == capacity || 0 != (capacity & (capacity - 1))) return nullptr;
+
+  SECURITY_ATTRIBUTES securityAttributes {
+    sizeof(SECURITY_ATTRIBUTES),
+    NULL,
+    TRUE
+  };
+
+  uint64_t sectionSize = ShmRingDataOffset + (uint64_t)capacity;
+  HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &securityAttributes, PAGE_READWRITE, (DWORD)(sectionSize >> 32), (DWORD)sectionSize, NULL);
+  if(NULL == mapping) return nullptr;
+
+  HANDLE dataEvent = CreateEventW(&securityAttributes, FALSE, FALSE, NULL);
+  HANDLE spaceEvent = CreateEventW(&securityAttributes, FALSE, FALSE, NULL);
+  void * pSection = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+  if(NULL == dataEvent || NULL == spaceEvent || NULL == pSection) {
+    if(pSection) UnmapViewOfFile(pSection);
+    if(spaceEvent) CloseHandle(spaceEvent);
+    if(dataEvent) CloseHandle(dataEvent);
+    CloseHandle(mapping);
+    return nullptr;
+  }
+
+  CPipeTransportShm::InitSection(pSection, capacity, (int64_t)(INT_PTR)dataEvent, (int64_t)(INT_PTR)spaceEvent);
+
+  return new CPipeTransportShmWin32(mapping, pSection, true);
+}
+
+CPipeTransport * CPipeTransport::AttachSharedMemory(int64_t sectionHandle) {
+  HANDLE mapping = (HANDLE)(INT_PTR)sectionHandle;
+  void * pSection = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+  if(NULL == pSection) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+
+  MEMORY_BASIC_INFORMATION info;
+  if(0 == VirtualQuery(pSection, &info, sizeof(info)) || !CPipeTransportShm::IsValidSection(pSection, info.RegionSize)) {
+    UnmapViewOfFile(pSection);
+    CloseHandle(mapping);
+    return nullptr;
+  }
+
+  // The event handles are inherited ones, they are closed with the process.
+  return new CPipeTransportShmWin32(mapping, pSection, false);
+}
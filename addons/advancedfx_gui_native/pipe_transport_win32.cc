@@ -0,0 +1,200 @@
+#include "pipe_transport.h"
+#include "pipe_reactor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include <windows.h>
+
+// A named pipe with a unique name instead of CreatePipe, because anonymous
+// pipes can not do overlapped I/O. Only the local end(s) are opened
+// overlapped, the end handed to the other process is not, so plain
+// ReadFile / WriteFile without OVERLAPPED (as in AfxHookSource) work on it.
+// Blocking Read / Write are overlapped operations that are waited for, with
+// the low bit of the event set so they never reach the completion port.
+class CPipeTransportWin32 : public CPipeTransport {
+ public:
+  CPipeTransportWin32(HANDLE readHandle, HANDLE writeHandle)
+  : m_ReadHandle(readHandle), m_WriteHandle(writeHandle)
+  , m_AsyncRead(this, false), m_AsyncWrite(this, true) {
+    m_ReadEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    m_WriteEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  }
+
+  virtual ~CPipeTransportWin32() {
+    CloseHandle(m_WriteHandle);
+    CloseHandle(m_ReadHandle);
+    if(m_WriteEvent) CloseHandle(m_WriteEvent);
+    if(m_ReadEvent) CloseHandle(m_ReadEvent);
+  }
+
+  virtual bool Read(void * pData, size_t size, size_t & outBytesRead) override {
+    return Transfer(m_ReadHandle, m_ReadEvent, false, pData, size, outBytesRead);
+  }
+
+  virtual bool Write(const void * pData, size_t size, size_t & outBytesWritten) override {
+    return Transfer(m_WriteHandle, m_WriteEvent, true, const_cast<void *>(pData), size, outBytesWritten);
+  }
+
+  virtual void CancelIo(std::thread::native_handle_type ioThread) override {
+    m_Cancelled = true;
+    CancelIoEx(m_ReadHandle, NULL);
+    CancelIoEx(m_WriteHandle, NULL);
+  }
+
+  virtual void StartAsync(CPipeReactor * reactor, CPipeIoHandler & handler) override {
+    if(nullptr == reactor) {
+      CPipeTransport::StartAsync(reactor, handler);
+      return;
+    }
+    m_Reactor = reactor;
+    m_Handler = &handler;
+  }
+
+  virtual bool ReadAsync(void * pData, size_t size) override {
+    if(nullptr == m_Reactor) return CPipeTransport::ReadAsync(pData, size);
+    return StartOp(m_AsyncRead, m_ReadHandle, pData, size);
+  }
+
+  virtual bool WriteAsync(const void * pData, size_t size) override {
+    if(nullptr == m_Reactor) return CPipeTransport::WriteAsync(pData, size);
+    return StartOp(m_AsyncWrite, m_WriteHandle, const_cast<void *>(pData), size);
+  }
+
+  virtual void CancelAsync() override {
+    if(nullptr == m_Reactor) {
+      CPipeTransport::CancelAsync();
+      return;
+    }
+
+    // A cancelled operation still completes through the port.
+    std::unique_lock<std::mutex> lock(m_AsyncLock);
+    m_AsyncCancelled = true;
+    if(m_AsyncRead.bPending) CancelIoEx(m_ReadHandle, &m_AsyncRead);
+    if(m_AsyncWrite.bPending) CancelIoEx(m_WriteHandle, &m_AsyncWrite);
+    m_AsyncCv.wait(lock, [this]{ return !m_AsyncRead.bPending && !m_AsyncWrite.bPending && 0 == m_AsyncRunning; });
+  }
+
+  virtual int64_t GetNativeReadHandle() override {
+    return (int64_t)(INT_PTR)m_ReadHandle;
+  }
+
+  virtual int64_t GetNativeWriteHandle() override {
+    return (int64_t)(INT_PTR)m_WriteHandle;
+  }
+
+ private:
+  struct AsyncOp : public CPipeReactor::Operation {
+    AsyncOp(CPipeTransportWin32 * transport, bool bWrite)
+    : transport(transport), bWrite(bWrite) {
+    }
+
+    virtual void OnComplete(bool bOk, DWORD bytes) override {
+      transport->OnComplete(*this, bOk, bytes);
+    }
+
+    CPipeTransportWin32 * transport;
+    bool bWrite;
+    bool bAssociated = false;
+    bool bPending = false;
+  };
+
+  HANDLE m_ReadHandle;
+  HANDLE m_WriteHandle;
+  HANDLE m_ReadEvent;
+  HANDLE m_WriteEvent;
+  std::atomic_bool m_Cancelled = false;
+
+  CPipeReactor * m_Reactor = nullptr;
+  CPipeIoHandler * m_Handler = nullptr;
+  std::mutex m_AsyncLock;
+  std::condition_variable m_AsyncCv;
+  bool m_AsyncCancelled = false;
+  size_t m_AsyncRunning = 0; // Handler calls in progress.
+  AsyncOp m_AsyncRead;
+  AsyncOp m_AsyncWrite;
+
+  bool Transfer(HANDLE handle, HANDLE event, bool bWrite, void * pData, size_t size, size_t & outBytes) {
+    if(m_Cancelled || NULL == event) return false;
+
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = (HANDLE)((ULONG_PTR)event | 1);
+    DWORD count = size < MAXDWORD ? (DWORD)size : MAXDWORD;
+    BOOL bOk = bWrite ? WriteFile(handle, pData, count, NULL, &overlapped) : ReadFile(handle, pData, count, NULL, &overlapped);
+    if(!bOk && ERROR_IO_PENDING != GetLastError()) return false;
+
+    DWORD bytes = 0;
+    if(!GetOverlappedResult(handle, &overlapped, &bytes, TRUE)) return false;
+    outBytes = bytes;
+    return true;
+  }
+
+  // Only the end that is used asynchronously is associated with the reactor:
+  // I/O of the other process on the other end must not reach our port.
+  bool StartOp(AsyncOp & op, HANDLE handle, void * pData, size_t size) {
+    std::unique_lock<std::mutex> lock(m_AsyncLock);
+    if(m_AsyncCancelled) return false;
+
+    if(!op.bAssociated) {
+      if(!m_Reactor->Associate(handle)) return false;
+      op.bAssociated = true;
+    }
+
+    // Issued under the lock, so CancelAsync can not miss it.
+    OVERLAPPED & overlapped = op;
+    overlapped = OVERLAPPED{};
+    DWORD count = size < MAXDWORD ? (DWORD)size : MAXDWORD;
+    BOOL bOk = op.bWrite ? WriteFile(handle, pData, count, NULL, &op) : ReadFile(handle, pData, count, NULL, &op);
+    if(!bOk && ERROR_IO_PENDING != GetLastError()) return false;
+
+    op.bPending = true;
+    return true;
+  }
+
+  void OnComplete(AsyncOp & op, bool bOk, DWORD bytes) {
+    {
+      std::unique_lock<std::mutex> lock(m_AsyncLock);
+      op.bPending = false;
+      ++m_AsyncRunning;
+    }
+
+    bOk = bOk && 0 < bytes;
+    if(op.bWrite) m_Handler->OnWriteDone(bOk, bytes);
+    else m_Handler->OnReadDone(bOk, bytes);
+
+    std::unique_lock<std::mutex> lock(m_AsyncLock);
+    --m_AsyncRunning;
+    m_AsyncCv.notify_all();
+  }
+};
+
+CPipeTransport * CPipeTransport::Create(PipeLocalEnd_e localEnd) {
+  static std::atomic<unsigned long> s_PipeCount{0};
+
+  SECURITY_ATTRIBUTES securityAttributes {
+    sizeof(SECURITY_ATTRIBUTES),
+    NULL,
+    TRUE
+  };
+
+  std::wstring name = L"\\\\.\\pipe\\advancedfx_gui." + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(++s_PipeCount);
+
+  DWORD readFlags = PipeLocalEnd_Write != localEnd ? FILE_FLAG_OVERLAPPED : 0;
+  DWORD writeFlags = PipeLocalEnd_Read != localEnd ? FILE_FLAG_OVERLAPPED : 0;
+
+  HANDLE readHandle = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE | readFlags,
+    PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 0, 64 * 1024, 0, &securityAttributes);
+  if(INVALID_HANDLE_VALUE == readHandle) {
+    return nullptr;
+  }
+
+  HANDLE writeHandle = CreateFileW(name.c_str(), GENERIC_WRITE, 0, &securityAttributes, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | writeFlags, NULL);
+  if(INVALID_HANDLE_VALUE == writeHandle) {
+    CloseHandle(readHandle);
+    return nullptr;
+  }
+
+  return new CPipeTransportWin32(readHandle, writeHandle);
+}
@@ -0,0 +1,98 @@
+#include "stats.h"
+
+#include <algorithm>
+
+size_t GetStatStripe() {
+  static std::atomic<size_t> s_NextStripe{0};
+  thread_local size_t t_Stripe = s_NextStripe.fetch_add(1, std::memory_order_relaxed) % StatStripeCount;
+  return t_Stripe;
+}
+
+int64_t CStatCounter::Get() const {
+  int64_t result = 0;
+  for(const Stripe & stripe : m_Stripes) result += stripe.value.load(std::memory_order_relaxed);
+  return result;
+}
+
+void CStatCounter::Reset() {
+  for(Stripe & stripe : m_Stripes) stripe.value.store(0, std::memory_order_relaxed);
+}
+
+size_t CStatHistogram::BucketOf(uint64_t value) {
+  const uint64_t linearEnd = (uint64_t)2 << m_SubBucketBits;
+  if(value < linearEnd) return (size_t)value;
+  if(((uint64_t)2 << m_MaxExponent) <= value) return m_BucketCount - 1;
+
+  int exponent = 63;
+  while(0 == (value >> exponent)) --exponent;
+  size_t subBucket = (size_t)(value >> (exponent - m_SubBucketBits)) & ((1 << m_SubBucketBits) - 1);
+  return (size_t)linearEnd + (size_t)(exponent - m_SubBucketBits - 1) * (1 << m_SubBucketBits) + subBucket;
+}
+
+uint64_t CStatHistogram::BucketUpperBound(size_t bucket) {
+  const uint64_t linearEnd = (uint64_t)2 << m_SubBucketBits;
+  if(bucket < linearEnd) return bucket;
+
+  size_t offset = bucket - (size_t)linearEnd;
+  int exponent = (int)(offset >> m_SubBucketBits) + m_SubBucketBits + 1;
+  uint64_t subBucket = offset & ((1 << m_SubBucketBits) - 1);
+  uint64_t width = (uint64_t)1 << (exponent - m_SubBucketBits);
+  return ((uint64_t)1 << exponent) + (subBucket + 1) * width - 1;
+}
+
+void CStatHistogram::Record(uint64_t value) {
+  Stripe & stripe = m_Stripes[GetStatStripe() % m_StripeCount];
+  stripe.sum.fetch_add(value, std::memory_order_relaxed);
+  stripe.buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = stripe.max.load(std::memory_order_relaxed);
+  while(max < value && !stripe.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+StatHistogramSnapshot CStatHistogram::GetSnapshot() const {
+  StatHistogramSnapshot result = {0, 0, 0, 0, 0};
+  uint64_t buckets[m_BucketCount] = {};
+  uint64_t sum = 0;
+  uint64_t count = 0;
+
+  for(const Stripe & stripe : m_Stripes) {
+    sum += stripe.sum.load(std::memory_order_relaxed);
+    result.max = std::max(result.max, stripe.max.load(std::memory_order_relaxed));
+    for(size_t i = 0; i < m_BucketCount; i++) {
+      uint64_t value = stripe.buckets[i].load(std::memory_order_relaxed);
+      buckets[i] += value;
+      count += value;
+    }
+  }
+
+  result.count = count;
+  if(0 == count) return result;
+  result.mean = (double)sum / count;
+
+  uint64_t p50Rank = (count + 1) / 2;
+  uint64_t p99Rank = count - count / 100;
+  uint64_t seen = 0;
+  bool bHaveP50 = false;
+  for(size_t i = 0; i < m_BucketCount; i++) {
+    if(0 == buckets[i]) continue;
+    seen += buckets[i];
+    if(!bHaveP50 && p50Rank <= seen) {
+      result.p50 = std::min(BucketUpperBound(i), result.max);
+      bHaveP50 = true;
+    }
+    if(p99Rank <= seen) {
+      result.p99 = std::min(BucketUpperBound(i), result.max);
+      break;
+    }
+  }
+
+  return result;
+}
+
+void CStatHistogram::Reset() {
+  for(Stripe & stripe : m_Stripes) {
+    stripe.sum.store(0, std::memory_order_relaxed);
+    stripe.max.store(0, std::memory_order_relaxed);
+    for(auto & bucket : stripe.buckets) bucket.store(0, std::memory_order_relaxed);
+  }
+}
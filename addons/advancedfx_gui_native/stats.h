@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Always-on instrumentation: every thread writes to its own stripe (picked
+// once per thread) with relaxed atomics, readers sum the stripes up. Reads
+// and Reset racing with writers may miss the writes in flight.
+
+const size_t StatStripeCount = 8;
+
+// Stripe of the calling thread, in [0, StatStripeCount).
+size_t GetStatStripe();
+
+inline uint64_t StatNowNanoseconds() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class CStatCounter {
+ public:
+  void Add(int64_t value) {
+    m_Stripes[GetStatStripe()].value.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  int64_t Get() const;
+  void Reset();
+
+ private:
+  struct alignas(64) Stripe {
+    std::atomic<int64_t> value{0};
+  };
+
+  Stripe m_Stripes[StatStripeCount];
+};
+
+struct StatHistogramSnapshot {
+  uint64_t count;
+  double mean;
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t max;
+};
+
+// HDR style log-linear histogram of durations in nanoseconds: exact below
+// 32, above that 16 buckets per power of two (at most 6.25 % error). Values
+// from 2^41 (about 36 minutes) on share the last bucket.
+class CStatHistogram {
+ public:
+  void Record(uint64_t value);
+
+  // Records the time since startNanoseconds (StatNowNanoseconds).
+  void RecordSince(uint64_t startNanoseconds) {
+    Record(StatNowNanoseconds() - startNanoseconds);
+  }
+
+  StatHistogramSnapshot GetSnapshot() const;
+  void Reset();
+
+ private:
+  static const int m_SubBucketBits = 4;
+  static const int m_MaxExponent = 40;
+  static const size_t m_BucketCount = (2 << m_SubBucketBits) + (m_MaxExponent - m_SubBucketBits) * (1 << m_SubBucketBits);
+  static const size_t m_StripeCount = 4; // Histograms are big, share more.
+
+  struct alignas(64) Stripe {
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+    std::atomic<uint64_t> buckets[m_BucketCount] = {};
+  };
+
+  Stripe m_Stripes[m_StripeCount];
+
+  static size_t BucketOf(uint64_t value);
+  static uint64_t BucketUpperBound(size_t bucket);
+};
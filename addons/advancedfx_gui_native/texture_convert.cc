@@ -0,0 +1,227 @@
+#include "texture_convert_impl.h"
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+
+// 4 pixels per step, widened to 16 bit lanes (2 pixels per register).
+template<TexturePixelFormat_e src, TexturePixelFormat_e dst, bool premultiply>
+struct CTextureConvertSse2 {
+  static __m128i Process(__m128i x) {
+    if(CTextureSwapRb<src, dst>::value) {
+      x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    if(premultiply) {
+      __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      // Alpha itself is multiplied by 255.
+      __m128i factor = _mm_or_si128(_mm_and_si128(alpha, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)), _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, factor), _mm_set1_epi16(128));
+      x = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    return x;
+  }
+
+  // 2 pixels in 16 bit lanes to 2 Rgb10A2 pixels in the low 64 bits.
+  static __m128i Pack10(__m128i x) {
+    __m128i expanded = _mm_or_si128(_mm_slli_epi16(x, 2), _mm_srli_epi16(x, 6));
+    __m128i rgbMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    x = _mm_or_si128(_mm_and_si128(rgbMask, expanded), _mm_andnot_si128(rgbMask, _mm_srli_epi16(x, 6)));
+    // Per pixel dwords r + g << 10 and b + a << 10.
+    __m128i pairs = _mm_madd_epi16(x, _mm_set_epi16(1024, 1, 1024, 1, 1024, 1, 1024, 1));
+    __m128i hi = _mm_and_si128(_mm_srli_epi64(pairs, 12), _mm_set_epi32(0, (int)0xFFF00000, 0, (int)0xFFF00000));
+    __m128i lo = _mm_and_si128(pairs, _mm_set_epi32(0, 0x000FFFFF, 0, 0x000FFFFF));
+    return _mm_shuffle_epi32(_mm_or_si128(hi, lo), _MM_SHUFFLE(3, 1, 2, 0));
+  }
+
+  static void Row(const unsigned char * pSrc, unsigned char * pDst, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 4 <= width; i += 4) {
+      __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + 4 * i));
+      __m128i lo = Process(_mm_unpacklo_epi8(pixels, zero));
+      __m128i hi = Process(_mm_unpackhi_epi8(pixels, zero));
+
+      switch(dst) {
+      case TextureFormat_Bgra8:
+      case TextureFormat_Rgba8:
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 4 * i), _mm_packus_epi16(lo, hi));
+        break;
+      case TextureFormat_Rgb10A2:
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 4 * i), _mm_unpacklo_epi64(Pack10(lo), Pack10(hi)));
+        break;
+      case TextureFormat_Rgba16:
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 8 * i), _mm_or_si128(lo, _mm_slli_epi16(lo, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 8 * i + 16), _mm_or_si128(hi, _mm_slli_epi16(hi, 8)));
+        break;
+      }
+    }
+    CTextureConvertScalar<src, dst, premultiply>::Row(pSrc + 4 * i, pDst + GetTextureBytesPerPixel(dst) * i, width - i);
+  }
+};
+
+bool CpuHasAvx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7) return false;
+  __cpuid(info, 1);
+  bool bOsxsave = 0 != (info[2] & (1 << 27));
+  bool bAvx = 0 != (info[2] & (1 << 28));
+  if(!(bOsxsave && bAvx)) return false;
+  // The OS must save the YMM registers.
+  if(6 != (_xgetbv(0) & 6)) return false;
+  __cpuidex(info, 7, 0);
+  return 0 != (info[1] & (1 << 5));
+#elif defined(__GNUC__)
+  __builtin_cpu_init();
+  return 0 != __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+#endif
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_NEON
+
+// 16 pixels per step, vld4 splits the channels.
+template<TexturePixelFormat_e src, TexturePixelFormat_e dst, bool premultiply>
+struct CTextureConvertNeon {
+  static uint8x16_t MulDiv255(uint8x16_t c, uint8x16_t a) {
+    uint16x8_t lo = vmlal_u8(vdupq_n_u16(128), vget_low_u8(c), vget_low_u8(a));
+    uint16x8_t hi = vmlal_u8(vdupq_n_u16(128), vget_high_u8(c), vget_high_u8(a));
+    return vcombine_u8(vshrn_n_u16(vsraq_n_u16(lo, lo, 8), 8), vshrn_n_u16(vsraq_n_u16(hi, hi, 8), 8));
+  }
+
+  static uint16x8_t Expand10(uint8x8_t c) {
+    uint16x8_t wide = vmovl_u8(c);
+    return vorrq_u16(vshlq_n_u16(wide, 2), vshrq_n_u16(wide, 6));
+  }
+
+  static void Pack10(unsigned char * pDst, uint8x8_t r, uint8x8_t g, uint8x8_t b, uint8x8_t a) {
+    uint16x8_t r10 = Expand10(r);
+    uint16x8_t g10 = Expand10(g);
+    uint16x8_t b10 = Expand10(b);
+    uint16x8_t a2 = vshrq_n_u16(vmovl_u8(a), 6);
+
+    uint32x4_t lo = vorrq_u32(vorrq_u32(vmovl_u16(vget_low_u16(r10)), vshlq_n_u32(vmovl_u16(vget_low_u16(g10)), 10)),
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(b10)), 20), vshlq_n_u32(vmovl_u16(vget_low_u16(a2)), 30)));
+    uint32x4_t hi = vorrq_u32(vorrq_u32(vmovl_u16(vget_high_u16(r10)), vshlq_n_u32(vmovl_u16(vget_high_u16(g10)), 10)),
+      vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(b10)), 20), vshlq_n_u32(vmovl_u16(vget_high_u16(a2)), 30)));
+
+    vst1q_u32(reinterpret_cast<uint32_t *>(pDst), lo);
+    vst1q_u32(reinterpret_cast<uint32_t *>(pDst + 16), hi);
+  }
+
+  static void Row(const unsigned char * pSrc, unsigned char * pDst, int width) {
+    int i = 0;
+    for(; i + 16 <= width; i += 16) {
+      uint8x16x4_t pixels = vld4q_u8(pSrc + 4 * i);
+      uint8x16_t r = TextureFormat_Bgra8 == src ? pixels.val[2] : pixels.val[0];
+      uint8x16_t g = pixels.val[1];
+      uint8x16_t b = TextureFormat_Bgra8 == src ? pixels.val[0] : pixels.val[2];
+      uint8x16_t a = pixels.val[3];
+
+      if(premultiply) {
+        r = MulDiv255(r, a);
+        g = MulDiv255(g, a);
+        b = MulDiv255(b, a);
+      }
+
+      switch(dst) {
+      case TextureFormat_Bgra8:
+      case TextureFormat_Rgba8: {
+          uint8x16x4_t out;
+          out.val[0] = TextureFormat_Bgra8 == dst ? b : r;
+          out.val[1] = g;
+          out.val[2] = TextureFormat_Bgra8 == dst ? r : b;
+          out.val[3] = a;
+          vst4q_u8(pDst + 4 * i, out);
+        }
+        break;
+      case TextureFormat_Rgb10A2:
+        Pack10(pDst + 4 * i, vget_low_u8(r), vget_low_u8(g), vget_low_u8(b), vget_low_u8(a));
+        Pack10(pDst + 4 * i + 32, vget_high_u8(r), vget_high_u8(g), vget_high_u8(b), vget_high_u8(a));
+        break;
+      case TextureFormat_Rgba16: {
+          uint16x8x4_t lo;
+          lo.val[0] = vmulq_n_u16(vmovl_u8(vget_low_u8(r)), 257);
+          lo.val[1] = vmulq_n_u16(vmovl_u8(vget_low_u8(g)), 257);
+          lo.val[2] = vmulq_n_u16(vmovl_u8(vget_low_u8(b)), 257);
+          lo.val[3] = vmulq_n_u16(vmovl_u8(vget_low_u8(a)), 257);
+          vst4q_u16(reinterpret_cast<uint16_t *>(pDst + 8 * i), lo);
+          uint16x8x4_t hi;
+          hi.val[0] = vmulq_n_u16(vmovl_u8(vget_high_u8(r)), 257);
+          hi.val[1] = vmulq_n_u16(vmovl_u8(vget_high_u8(g)), 257);
+          hi.val[2] = vmulq_n_u16(vmovl_u8(vget_high_u8(b)), 257);
+          hi.val[3] = vmulq_n_u16(vmovl_u8(vget_high_u8(a)), 257);
+          vst4q_u16(reinterpret_cast<uint16_t *>(pDst + 8 * i + 64), hi);
+        }
+        break;
+      }
+    }
+    CTextureConvertScalar<src, dst, premultiply>::Row(pSrc + 4 * i, pDst + GetTextureBytesPerPixel(dst) * i, width - i);
+  }
+};
+
+#endif
+
+TextureIsa_e DetectBestTextureIsa() {
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+  return CpuHasAvx2() ? TextureIsa_Avx2 : TextureIsa_Sse2;
+#elif defined(ADVANCEDFX_TEXTURE_CONVERT_NEON)
+  return TextureIsa_Neon;
+#else
+  return TextureIsa_Scalar;
+#endif
+}
+
+} // namespace
+
+const char * GetTextureIsaName(TextureIsa_e isa) {
+  switch(isa) {
+  case TextureIsa_Sse2:
+    return "sse2";
+  case TextureIsa_Avx2:
+    return "avx2";
+  case TextureIsa_Neon:
+    return "neon";
+  default:
+    return "scalar";
+  }
+}
+
+TextureIsa_e GetBestTextureIsa() {
+  static const TextureIsa_e s_Isa = DetectBestTextureIsa();
+  return s_Isa;
+}
+
+TextureConvertRowFn GetTextureConvertRow(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply, TextureIsa_e isa) {
+  switch(isa) {
+  case TextureIsa_Scalar:
+    return SelectTextureConvertRow<CTextureConvertScalar>(srcFormat, dstFormat, bPremultiply);
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+  case TextureIsa_Sse2:
+    return SelectTextureConvertRow<CTextureConvertSse2>(srcFormat, dstFormat, bPremultiply);
+  case TextureIsa_Avx2:
+    return TextureIsa_Avx2 == GetBestTextureIsa() ? GetTextureConvertRowAvx2(srcFormat, dstFormat, bPremultiply) : nullptr;
+#endif
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_NEON
+  case TextureIsa_Neon:
+    return SelectTextureConvertRow<CTextureConvertNeon>(srcFormat, dstFormat, bPremultiply);
+#endif
+  default:
+    return nullptr;
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "texture_device.h"
+
+// Converts width pixels of an 8 bit source format at pSrc to pDst.
+typedef void (*TextureConvertRowFn)(const unsigned char * pSrc, unsigned char * pDst, int width);
+
+enum TextureIsa_e {
+  TextureIsa_Scalar, // Reference implementation.
+  TextureIsa_Sse2,
+  TextureIsa_Avx2,
+  TextureIsa_Neon
+};
+
+const char * GetTextureIsaName(TextureIsa_e isa);
+
+// Best instruction set the CPU supports, detected once.
+TextureIsa_e GetBestTextureIsa();
+
+// Kernel for converting srcFormat (TextureFormat_Bgra8 or TextureFormat_Rgba8)
+// to dstFormat, with bPremultiply straight alpha is premultiplied.
+// Returns nullptr if the pair or isa is not supported.
+TextureConvertRowFn GetTextureConvertRow(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply, TextureIsa_e isa);
+
+inline TextureConvertRowFn GetTextureConvertRow(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply) {
+  return GetTextureConvertRow(srcFormat, dstFormat, bPremultiply, GetBestTextureIsa());
+}
@@ -0,0 +1,98 @@
+#include "texture_convert_impl.h"
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+
+// Only called after runtime detection, so compile for AVX2 without making
+// the rest of the module require it.
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+// 8 pixels per step, widened to 16 bit lanes (4 pixels per register).
+template<TexturePixelFormat_e src, TexturePixelFormat_e dst, bool premultiply>
+struct CTextureConvertAvx2 {
+  static __m256i Process(__m256i x) {
+    if(CTextureSwapRb<src, dst>::value) {
+      x = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    if(premultiply) {
+      __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      // Alpha itself is multiplied by 255.
+      __m256i factor = _mm256_blend_epi16(alpha, _mm256_set1_epi16(255), 0x88);
+      __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, factor), _mm256_set1_epi16(128));
+      x = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+    return x;
+  }
+
+  // 4 pixels in 16 bit lanes to 4 Rgb10A2 pixels.
+  static __m128i Pack10(__m256i x) {
+    __m256i expanded = _mm256_or_si256(_mm256_slli_epi16(x, 2), _mm256_srli_epi16(x, 6));
+    x = _mm256_blend_epi16(expanded, _mm256_srli_epi16(x, 6), 0x88);
+    // Per pixel dwords r + g << 10 and b + a << 10.
+    __m256i pairs = _mm256_madd_epi16(x, _mm256_set1_epi32(1024 << 16 | 1));
+    __m256i packed = _mm256_or_si256(_mm256_and_si256(pairs, _mm256_set1_epi64x(0x000FFFFF)), _mm256_slli_epi64(_mm256_srli_epi64(pairs, 32), 20));
+    // Pixels are in the low dwords of the 64 bit lanes.
+    __m256i gathered = _mm256_permutevar8x32_epi32(packed, _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0));
+    return _mm256_castsi256_si128(gathered);
+  }
+
+  static void Step(const unsigned char * pSrc, unsigned char * pDst) {
+    __m256i lo = Process(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc))));
+    __m256i hi = Process(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + 16))));
+
+    switch(dst) {
+    case TextureFormat_Bgra8:
+    case TextureFormat_Rgba8:
+      // packus works per 128 bit lane, restore the pixel order.
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+      break;
+    case TextureFormat_Rgb10A2:
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst), Pack10(lo));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 16), Pack10(hi));
+      break;
+    case TextureFormat_Rgba16:
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_or_si256(lo, _mm256_slli_epi16(lo, 8)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst + 32), _mm256_or_si256(hi, _mm256_slli_epi16(hi, 8)));
+      break;
+    }
+  }
+
+  static void Row(const unsigned char * pSrc, unsigned char * pDst, int width) {
+    size_t bytesPerPixel = GetTextureBytesPerPixel(dst);
+    int i = 0;
+    for(; i + 8 <= width; i += 8) {
+      Step(pSrc + 4 * i, pDst + bytesPerPixel * i);
+    }
+    // The tail goes through a buffer instead of CTextureConvertScalar, its
+    // instantiation is shared with the TUs that must not use AVX2.
+    if(i < width) {
+      unsigned char srcTail[32] = {};
+      unsigned char dstTail[64];
+      memcpy(srcTail, pSrc + 4 * i, (size_t)4 * (width - i));
+      Step(srcTail, dstTail);
+      memcpy(pDst + bytesPerPixel * i, dstTail, bytesPerPixel * (width - i));
+    }
+  }
+};
+
+} // namespace
+
+TextureConvertRowFn GetTextureConvertRowAvx2(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply) {
+  return SelectTextureConvertRow<CTextureConvertAvx2>(srcFormat, dstFormat, bPremultiply);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+// Shared by the texture_convert*.cc files, every instruction set implements
+// template<TexturePixelFormat_e src, TexturePixelFormat_e dst, bool premultiply>
+// struct with a static Row function matching TextureConvertRowFn.
+
+#include "texture_convert.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#define ADVANCEDFX_TEXTURE_CONVERT_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define ADVANCEDFX_TEXTURE_CONVERT_NEON
+#endif
+
+// Whether src and dst disagree about where R and B are.
+template<TexturePixelFormat_e src, TexturePixelFormat_e dst> struct CTextureSwapRb {
+  static const bool value = (TextureFormat_Bgra8 == src) != (TextureFormat_Bgra8 == dst);
+};
+
+// c * a / 255 rounded, exact for all 8 bit c and a.
+inline unsigned TextureMulDiv255(unsigned c, unsigned a) {
+  unsigned t = c * a + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+// Scalar reference, the SIMD kernels use it for row tails.
+template<TexturePixelFormat_e src, TexturePixelFormat_e dst, bool premultiply>
+struct CTextureConvertScalar {
+  static void Row(const unsigned char * pSrc, unsigned char * pDst, int width) {
+    for(int i = 0; i < width; i++) {
+      const unsigned char * s = pSrc + 4 * i;
+      unsigned r = TextureFormat_Bgra8 == src ? s[2] : s[0];
+      unsigned g = s[1];
+      unsigned b = TextureFormat_Bgra8 == src ? s[0] : s[2];
+      unsigned a = s[3];
+
+      if(premultiply) {
+        r = TextureMulDiv255(r, a);
+        g = TextureMulDiv255(g, a);
+        b = TextureMulDiv255(b, a);
+      }
+
+      switch(dst) {
+      case TextureFormat_Bgra8:
+        pDst[4 * i + 0] = (unsigned char)b;
+        pDst[4 * i + 1] = (unsigned char)g;
+        pDst[4 * i + 2] = (unsigned char)r;
+        pDst[4 * i + 3] = (unsigned char)a;
+        break;
+      case TextureFormat_Rgba8:
+        pDst[4 * i + 0] = (unsigned char)r;
+        pDst[4 * i + 1] = (unsigned char)g;
+        pDst[4 * i + 2] = (unsigned char)b;
+        pDst[4 * i + 3] = (unsigned char)a;
+        break;
+      case TextureFormat_Rgb10A2: {
+          uint32_t value = ((r << 2) | (r >> 6)) | ((g << 2) | (g >> 6)) << 10 | ((b << 2) | (b >> 6)) << 20 | (a >> 6) << 30;
+          memcpy(pDst + 4 * i, &value, 4);
+        }
+        break;
+      case TextureFormat_Rgba16: {
+          uint16_t value[4] = {(uint16_t)(r * 257), (uint16_t)(g * 257), (uint16_t)(b * 257), (uint16_t)(a * 257)};
+          memcpy(pDst + 8 * i, value, 8);
+        }
+        break;
+      }
+    }
+  }
+};
+
+template<template<TexturePixelFormat_e, TexturePixelFormat_e, bool> class TKernel, TexturePixelFormat_e src, TexturePixelFormat_e dst>
+TextureConvertRowFn SelectTextureConvertRow(bool bPremultiply) {
+  return bPremultiply ? &TKernel<src, dst, true>::Row : &TKernel<src, dst, false>::Row;
+}
+
+template<template<TexturePixelFormat_e, TexturePixelFormat_e, bool> class TKernel, TexturePixelFormat_e src>
+TextureConvertRowFn SelectTextureConvertRow(TexturePixelFormat_e dstFormat, bool bPremultiply) {
+  switch(dstFormat) {
+  case TextureFormat_Bgra8:
+    return SelectTextureConvertRow<TKernel, src, TextureFormat_Bgra8>(bPremultiply);
+  case TextureFormat_Rgba8:
+    return SelectTextureConvertRow<TKernel, src, TextureFormat_Rgba8>(bPremultiply);
+  case TextureFormat_Rgb10A2:
+    return SelectTextureConvertRow<TKernel, src, TextureFormat_Rgb10A2>(bPremultiply);
+  case TextureFormat_Rgba16:
+    return SelectTextureConvertRow<TKernel, src, TextureFormat_Rgba16>(bPremultiply);
+  }
+  return nullptr;
+}
+
+// Instantiates TKernel for every supported format pair.
+template<template<TexturePixelFormat_e, TexturePixelFormat_e, bool> class TKernel>
+TextureConvertRowFn SelectTextureConvertRow(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply) {
+  switch(srcFormat) {
+  case TextureFormat_Bgra8:
+    return SelectTextureConvertRow<TKernel, TextureFormat_Bgra8>(dstFormat, bPremultiply);
+  case TextureFormat_Rgba8:
+    return SelectTextureConvertRow<TKernel, TextureFormat_Rgba8>(dstFormat, bPremultiply);
+  default:
+    return nullptr;
+  }
+}
+
+#ifdef ADVANCEDFX_TEXTURE_CONVERT_X86
+// In texture_convert_avx2.cc, only call if the CPU has AVX2.
+TextureConvertRowFn GetTextureConvertRowAvx2(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply);
+#endif
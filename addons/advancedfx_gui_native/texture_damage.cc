@@ -0,0 +1,211 @@
+#include "texture_damage.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)
+#include <emmintrin.h>
+#define ADVANCEDFX_TEXTURE_SSE2
+#endif
+
+namespace {
+
+// Like XXH3: every 16 byte block is mixed with a per column key into two 64
+// bit accumulators, the accumulators are scrambled after every row, so
+// moving blocks or rows around changes the hash.
+const int KeyCount = 16;
+
+const uint64_t Keys[KeyCount][2] = {
+  {0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull}, {0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull},
+  {0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull}, {0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull},
+  {0xcb00c391bb52283cull, 0xa32e531b8b65d088ull}, {0x4ef90da297486471ull, 0xd8acdea946ef1938ull},
+  {0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull}, {0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull},
+  {0xc3ebd33483acc5eaull, 0xeb6313faffa081c5ull}, {0x49daf0b751dd0d17ull, 0x9e68d429265516d3ull},
+  {0xfca1477d58be162bull, 0xce31d07ad1b8f88full}, {0x280416958f3acb45ull, 0x7e404bbbcafbd7afull},
+  {0xb5aa2b2b6a6bdd38ull, 0x4caf11bd8b8a2b39ull}, {0xa8e5e6a1ad26d3d6ull, 0xe40d6fd4ddba6bd9ull},
+  {0x6b93b6e8ea2fb73aull, 0xfd2aa4f6cadb9e3bull}, {0x9b1b6c6bc6e8ec3cull, 0x2bd3e1a7d6c1a4d3ull},
+};
+
+const uint64_t ScrambleKey = 0x9fb21c651e98df25ull;
+const uint32_t Prime32 = 0x9E3779B1u;
+
+uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xC2B2AE3D27D4EB4Full;
+  h ^= h >> 29;
+  h *= 0x165667B19E3779F9ull;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t Finish(uint64_t acc0, uint64_t acc1, int width, int height) {
+  return Avalanche(acc0 ^ ((acc1 << 31) | (acc1 >> 33)) ^ ((uint64_t)(uint32_t)width << 32 | (uint32_t)height));
+}
+
+void AccumulateScalar(uint64_t acc[2], const unsigned char * pBlock, const uint64_t key[2]) {
+  uint64_t data[2];
+  memcpy(data, pBlock, 16);
+  for(int j = 0; j < 2; j++) {
+    uint64_t dataKey = data[j] ^ key[j];
+    acc[j] += data[j ^ 1] + (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+  }
+}
+
+void ScrambleScalar(uint64_t acc[2]) {
+  for(int j = 0; j < 2; j++) {
+    acc[j] = (acc[j] ^ (acc[j] >> 47) ^ ScrambleKey) * Prime32;
+  }
+}
+
+} // namespace
+
+uint64_t HashTexturePixelsScalar(const unsigned char * pSrc, size_t rowPitch, int width, int height) {
+  uint64_t acc[2] = {0, 0};
+  size_t rowSize = (size_t)4 * width;
+  size_t blocks = rowSize / 16;
+  size_t rest = rowSize % 16;
+
+  for(int y = 0; y < height; y++) {
+    const unsigned char * pRow = pSrc + y * rowPitch;
+    for(size_t i = 0; i < blocks; i++) {
+      AccumulateScalar(acc, pRow + 16 * i, Keys[i % KeyCount]);
+    }
+    if(rest) {
+      unsigned char block[16] = {};
+      memcpy(block, pRow + 16 * blocks, rest);
+      AccumulateScalar(acc, block, Keys[blocks % KeyCount]);
+    }
+    ScrambleScalar(acc);
+  }
+
+  return Finish(acc[0], acc[1], width, height);
+}
+
+#ifdef ADVANCEDFX_TEXTURE_SSE2
+
+static inline __m128i AccumulateSse2(__m128i acc, __m128i data, __m128i key) {
+  __m128i dataKey = _mm_xor_si128(data, key);
+  __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+  __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);
+  __m128i dataSwap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_add_epi64(acc, _mm_add_epi64(dataSwap, product));
+}
+
+uint64_t HashTexturePixels(const unsigned char * pSrc, size_t rowPitch, int width, int height) {
+  __m128i acc = _mm_setzero_si128();
+  __m128i scrambleKey = _mm_set1_epi64x((long long)ScrambleKey);
+  __m128i prime = _mm_set1_epi32((int)Prime32);
+  size_t rowSize = (size_t)4 * width;
+  size_t blocks = rowSize / 16;
+  size_t rest = rowSize % 16;
+
+  for(int y = 0; y < height; y++) {
+    const unsigned char * pRow = pSrc + y * rowPitch;
+    for(size_t i = 0; i < blocks; i++) {
+      __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Keys[i % KeyCount]));
+      acc = AccumulateSse2(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(pRow + 16 * i)), key);
+    }
+    if(rest) {
+      unsigned char block[16] = {};
+      memcpy(block, pRow + 16 * blocks, rest);
+      __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Keys[blocks % KeyCount]));
+      acc = AccumulateSse2(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(block)), key);
+    }
+    // acc = (acc ^ acc >> 47 ^ key) * Prime32, 64 bit by 32 bit multiply.
+    acc = _mm_xor_si128(_mm_xor_si128(acc, _mm_srli_epi64(acc, 47)), scrambleKey);
+    __m128i productLo = _mm_mul_epu32(acc, prime);
+    __m128i productHi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+    acc = _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+  }
+
+  uint64_t result[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(result), acc);
+  return Finish(result[0], result[1], width, height);
+}
+
+#else
+
+uint64_t HashTexturePixels(const unsigned char * pSrc, size_t rowPitch, int width, int height) {
+  return HashTexturePixelsScalar(pSrc, rowPitch, width, height);
+}
+
+#endif
+
+CTextureDamageTracker::CTextureDamageTracker(int width, int height, int tileSize)
+: m_Width(width), m_Height(height), m_TileSize(tileSize)
+, m_TilesX((width + tileSize - 1) / tileSize), m_TilesY((height + tileSize - 1) / tileSize)
+, m_Hashes((size_t)m_TilesX * m_TilesY, 0)
+, m_Valid((size_t)m_TilesX * m_TilesY, false) {
+}
+
+void CTextureDamageTracker::FindChanged(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, std::vector<TextureRect> & outRects) {
+  FindChangedTiles(rect, pSrc, srcRowPitch, false, outRects);
+}
+
+void CTextureDamageTracker::FindChangedPart(const TextureRect & rect, const unsigned char * pRectSrc, size_t srcRowPitch, std::vector<TextureRect> & outRects) {
+  FindChangedTiles(rect, pRectSrc, srcRowPitch, true, outRects);
+}
+
+void CTextureDamageTracker::FindChangedTiles(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bPart, std::vector<TextureRect> & outRects) {
+  if(rect.width <= 0 || rect.height <= 0) return;
+
+  int tileX0 = rect.x / m_TileSize;
+  int tileY0 = rect.y / m_TileSize;
+  int tileX1 = (rect.x + rect.width - 1) / m_TileSize;
+  int tileY1 = (rect.y + rect.height - 1) / m_TileSize;
+
+  for(int tileY = tileY0; tileY <= tileY1; tileY++) {
+    int top = std::max(rect.y, tileY * m_TileSize);
+    int bottom = std::min(rect.y + rect.height, (tileY + 1) * m_TileSize);
+    int tileTop = tileY * m_TileSize;
+    int tileHeight = std::min(m_TileSize, m_Height - tileTop);
+    int runStart = -1;
+
+    for(int tileX = tileX0; tileX <= tileX1 + 1; tileX++) {
+      bool bChanged = false;
+      if(tileX <= tileX1) {
+        // Hash the whole tile, so the hash does not depend on rect.
+        int tileLeft = tileX * m_TileSize;
+        int tileWidth = std::min(m_TileSize, m_Width - tileLeft);
+        size_t index = (size_t)tileY * m_TilesX + tileX;
+        if(!bPart) {
+          uint64_t hash = HashTexturePixels(pSrc + (size_t)tileTop * srcRowPitch + (size_t)4 * tileLeft, srcRowPitch, tileWidth, tileHeight);
+          bChanged = !m_Valid[index] || m_Hashes[index] != hash;
+          m_Hashes[index] = hash;
+          m_Valid[index] = true;
+        } else if(rect.x <= tileLeft && tileLeft + tileWidth <= rect.x + rect.width
+          && rect.y <= tileTop && tileTop + tileHeight <= rect.y + rect.height) {
+          uint64_t hash = HashTexturePixels(pSrc + (size_t)(tileTop - rect.y) * srcRowPitch + (size_t)4 * (tileLeft - rect.x), srcRowPitch, tileWidth, tileHeight);
+          bChanged = !m_Valid[index] || m_Hashes[index] != hash;
+          m_Hashes[index] = hash;
+          m_Valid[index] = true;
+        } else {
+          bChanged = true;
+          m_Valid[index] = false;
+        }
+      }
+
+      if(bChanged) {
+        if(runStart < 0) runStart = tileX;
+      } else if(0 <= runStart) {
+        int left = std::max(rect.x, runStart * m_TileSize);
+        int right = std::min(rect.x + rect.width, tileX * m_TileSize);
+        outRects.push_back(TextureRect{left, top, right - left, bottom - top});
+        runStart = -1;
+      }
+    }
+  }
+}
+
+void CTextureDamageTracker::Invalidate() {
+  std::fill(m_Valid.begin(), m_Valid.end(), false);
+}
+
+void CTextureDamageTracker::Invalidate(const TextureRect & rect) {
+  if(rect.width <= 0 || rect.height <= 0) return;
+  for(int tileY = rect.y / m_TileSize; tileY <= (rect.y + rect.height - 1) / m_TileSize; tileY++) {
+    for(int tileX = rect.x / m_TileSize; tileX <= (rect.x + rect.width - 1) / m_TileSize; tileX++) {
+      m_Valid[(size_t)tileY * m_TilesX + tileX] = false;
+    }
+  }
+}
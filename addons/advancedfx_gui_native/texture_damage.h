@@ -0,0 +1,47 @@
+#pragma once
+
+#include "texture_device.h"
+
+#include <cstdint>
+#include <vector>
+
+// Hash of width x height BGRA pixels at pSrc with rowPitch bytes per row.
+// Uses SSE2 where available, HashTexturePixelsScalar computes the same value.
+uint64_t HashTexturePixels(const unsigned char * pSrc, size_t rowPitch, int width, int height);
+uint64_t HashTexturePixelsScalar(const unsigned char * pSrc, size_t rowPitch, int width, int height);
+
+// Remembers a hash per tile of what the shared texture holds, to find out
+// which parts of a dirty rect really changed.
+class CTextureDamageTracker {
+ public:
+  CTextureDamageTracker(int width, int height, int tileSize);
+
+  // Appends the changed parts of rect to outRects (one rect per run of
+  // changed tiles in a tile row, clipped to rect) and assumes they are
+  // uploaded. pSrc is a full sized frame as for CTextureUploader::Upload,
+  // pixels outside of rect must be unchanged.
+  void FindChanged(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, std::vector<TextureRect> & outRects);
+
+  // Like FindChanged, but pRectSrc only holds rect's pixels, starting with
+  // its top left one (a sub-image). Tiles only partly inside rect can not be
+  // hashed, they are forgotten and reported as changed.
+  void FindChangedPart(const TextureRect & rect, const unsigned char * pRectSrc, size_t srcRowPitch, std::vector<TextureRect> & outRects);
+
+  // Forgets all hashes, so the next FindChanged reports everything.
+  void Invalidate();
+
+  // Forgets the hashes of the tiles touched by rect.
+  void Invalidate(const TextureRect & rect);
+
+ private:
+  int m_Width;
+  int m_Height;
+  int m_TileSize;
+  int m_TilesX;
+  int m_TilesY;
+  std::vector<uint64_t> m_Hashes;
+  std::vector<bool> m_Valid;
+
+  // With bPart as FindChangedPart, else as FindChanged.
+  void FindChangedTiles(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bPart, std::vector<TextureRect> & outRects);
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Pixel formats of shared textures, in memory order.
+enum TexturePixelFormat_e {
+  TextureFormat_Bgra8,
+  TextureFormat_Rgba8,
+  TextureFormat_Rgb10A2, // 32 bit little endian, R in the lowest bits.
+  TextureFormat_Rgba16
+};
+
+inline size_t GetTextureBytesPerPixel(TexturePixelFormat_e format) {
+  return TextureFormat_Rgba16 == format ? 8 : 4;
+}
+
+struct TextureRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+// Smallest rect that contains a and b.
+inline TextureRect UnionTextureRect(const TextureRect & a, const TextureRect & b) {
+  int left = a.x < b.x ? a.x : b.x;
+  int top = a.y < b.y ? a.y : b.y;
+  int right = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+  int bottom = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+  return TextureRect{left, top, right - left, bottom - top};
+}
+
+inline bool TextureRectContains(const TextureRect & outer, const TextureRect & inner) {
+  return outer.x <= inner.x && outer.y <= inner.y
+    && inner.x + inner.width <= outer.x + outer.width && inner.y + inner.height <= outer.y + outer.height;
+}
+
+struct TextureMapping {
+  unsigned char * pData;
+  size_t rowPitch;
+};
+
+enum TextureMapResult_e {
+  TextureMap_Ok,
+  TextureMap_Busy, // Only without bWait: the GPU still reads the slot.
+  TextureMap_Failed
+};
+
+// GPU side of SharedTexture: bufferCount shared textures that are written
+// through a ring of CPU writable staging slots of the same size and format.
+// Only used from one thread at a time.
+class CTextureDevice {
+ public:
+  virtual ~CTextureDevice() {}
+
+  virtual int GetWidth() = 0;
+  virtual int GetHeight() = 0;
+  virtual size_t GetStagingCount() = 0;
+  virtual size_t GetBufferCount() = 0;
+  virtual TexturePixelFormat_e GetFormat() = 0;
+
+  // Handle of shared texture buffer as passed to other processes, -1 if
+  // there is none.
+  virtual int64_t GetSharedHandle(size_t buffer) = 0;
+
+  // Maps staging slot for writing. Without bWait fails with TextureMap_Busy
+  // instead of blocking while a copy from the slot is pending.
+  virtual TextureMapResult_e MapStaging(size_t slot, bool bWait, TextureMapping & outMapping) = 0;
+  virtual void UnmapStaging(size_t slot) = 0;
+
+  // Queues copying rect from staging slot to the same place in shared
+  // texture buffer.
+  virtual void CopyToShared(size_t slot, const TextureRect & rect, size_t buffer) = 0;
+
+  // Queues copying rect between shared texture buffers, srcBuffer !=
+  // dstBuffer.
+  virtual void CopyBetweenShared(size_t srcBuffer, size_t dstBuffer, const TextureRect & rect) = 0;
+
+  // Submits what was queued.
+  virtual void Flush() = 0;
+
+  // Submits what was queued and waits until the GPU executed it, so other
+  // devices (processes) see the result.
+  virtual void Finish() = 0;
+};
+
+// Reference implementation in system memory, for benchmarks and machines
+// without a GPU. Copies are executed by a thread that pretends a copy is
+// done latencyMicroseconds after submission at the earliest, and that copies
+// transfer bytesPerMicrosecond one after another.
+class CTextureDeviceCpu : public CTextureDevice {
+ public:
+  static CTextureDeviceCpu * Create(int width, int height, size_t stagingCount, double latencyMicroseconds = 0, double bytesPerMicrosecond = 0, TexturePixelFormat_e format = TextureFormat_Bgra8, size_t bufferCount = 1);
+
+  // Waits until all submitted copies are done and returns shared texture
+  // buffer's pixels (rowPitch GetTextureBytesPerPixel(format) * width).
+  virtual const unsigned char * GetSharedPixels(size_t buffer = 0) = 0;
+
+  // Any thread: buffer's pixels without waiting, for reading a frame that
+  // was published (texture_frames.h) while the device is used on.
+  virtual const unsigned char * GetBufferPixels(size_t buffer) = 0;
+};
+
+// One adapter's device, which creates the staging and shared textures of
+// CTextureDevices. Creating it is the expensive part (adapter enumeration,
+// device creation), CTexturePool keeps one per adapter LUID.
+class CTextureAdapter {
+ public:
+  virtual ~CTextureAdapter() {}
+
+  // Returns nullptr and sets outError on failure. Any thread, the devices
+  // may be used from different threads at the same time.
+  virtual CTextureDevice * CreateDevice(int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError) = 0;
+};
+
+// Creates CTextureDeviceCpu devices with latencyMicroseconds and
+// bytesPerMicrosecond, pretending each creation takes createMicroseconds.
+CTextureAdapter * CreateTextureAdapterCpu(double createMicroseconds = 0, double latencyMicroseconds = 0, double bytesPerMicrosecond = 0);
+
+#ifdef _WIN32
+// adapterLuidLo / adapterLuidHi select the adapter, returns nullptr and sets
+// outError on failure.
+CTextureAdapter * CreateTextureAdapterD3d11(int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError);
+#endif
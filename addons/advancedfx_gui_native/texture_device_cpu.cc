@@ -0,0 +1,206 @@
+#include "texture_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CTextureDeviceCpuImpl : public CTextureDeviceCpu {
+ public:
+  CTextureDeviceCpuImpl(int width, int height, size_t stagingCount, double latencyMicroseconds, double bytesPerMicrosecond, TexturePixelFormat_e format, size_t bufferCount)
+  : m_Width(width), m_Height(height), m_Format(format), m_BytesPerPixel(GetTextureBytesPerPixel(format))
+  , m_LatencyMicroseconds(latencyMicroseconds), m_BytesPerMicrosecond(bytesPerMicrosecond)
+  , m_Staging(stagingCount, std::vector<unsigned char>(m_BytesPerPixel * width * height))
+  , m_SlotPending(stagingCount, 0)
+  , m_Buffers(bufferCount, std::vector<unsigned char>(m_BytesPerPixel * width * height)) {
+    m_GpuThread = std::thread(&CTextureDeviceCpuImpl::GpuThreadHandler, this);
+  }
+
+  virtual ~CTextureDeviceCpuImpl() {
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Quit = true;
+      m_Cv.notify_all();
+    }
+    m_GpuThread.join();
+  }
+
+  virtual int GetWidth() override {
+    return m_Width;
+  }
+
+  virtual int GetHeight() override {
+    return m_Height;
+  }
+
+  virtual size_t GetStagingCount() override {
+    return m_Staging.size();
+  }
+
+  virtual size_t GetBufferCount() override {
+    return m_Buffers.size();
+  }
+
+  virtual TexturePixelFormat_e GetFormat() override {
+    return m_Format;
+  }
+
+  virtual int64_t GetSharedHandle(size_t buffer) override {
+    return -1;
+  }
+
+  virtual TextureMapResult_e MapStaging(size_t slot, bool bWait, TextureMapping & outMapping) override {
+    if(m_Staging.size() <= slot) return TextureMap_Failed;
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(0 < m_SlotPending[slot]) {
+      if(!bWait) return TextureMap_Busy;
+      // Like D3D11, waiting on a slot submits copies still queued.
+      lock.unlock();
+      Flush();
+      lock.lock();
+      m_Cv.wait(lock, [this,slot]{ return 0 == m_SlotPending[slot]; });
+    }
+
+    outMapping.pData = m_Staging[slot].data();
+    outMapping.rowPitch = m_BytesPerPixel * m_Width;
+    return TextureMap_Ok;
+  }
+
+  virtual void UnmapStaging(size_t slot) override {
+  }
+
+  virtual void CopyToShared(size_t slot, const TextureRect & rect, size_t buffer) override {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    ++m_SlotPending[slot];
+    m_Queued.push_back(Copy{slot, SIZE_MAX, buffer, rect, std::chrono::steady_clock::time_point()});
+  }
+
+  virtual void CopyBetweenShared(size_t srcBuffer, size_t dstBuffer, const TextureRect & rect) override {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Queued.push_back(Copy{SIZE_MAX, srcBuffer, dstBuffer, rect, std::chrono::steady_clock::time_point()});
+  }
+
+  virtual void Flush() override {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(m_Queued.empty()) return;
+    // Copies are pipelined: the latency overlaps, the transfers do not.
+    auto now = std::chrono::steady_clock::now();
+    for(auto & copy : m_Queued) {
+      double transferMicroseconds = 0 < m_BytesPerMicrosecond ? (double)m_BytesPerPixel * copy.rect.width * copy.rect.height / m_BytesPerMicrosecond : 0;
+      m_TransferDone = std::max(m_TransferDone, now) + ToDuration(transferMicroseconds);
+      copy.due = std::max(m_TransferDone, now + ToDuration(m_LatencyMicroseconds));
+      m_Submitted.push_back(copy);
+    }
+    m_Queued.clear();
+    m_Cv.notify_all();
+  }
+
+  virtual void Finish() override {
+    Flush();
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [this]{ return m_Submitted.empty() && !m_Copying; });
+  }
+
+  virtual const unsigned char * GetSharedPixels(size_t buffer) override {
+    Finish();
+    return m_Buffers[buffer].data();
+  }
+
+  virtual const unsigned char * GetBufferPixels(size_t buffer) override {
+    return m_Buffers[buffer].data();
+  }
+
+ private:
+  struct Copy {
+    size_t slot; // SIZE_MAX if from srcBuffer.
+    size_t srcBuffer;
+    size_t dstBuffer;
+    TextureRect rect;
+    std::chrono::steady_clock::time_point due;
+  };
+
+  int m_Width;
+  int m_Height;
+  TexturePixelFormat_e m_Format;
+  size_t m_BytesPerPixel;
+  double m_LatencyMicroseconds;
+  double m_BytesPerMicrosecond;
+  std::vector<std::vector<unsigned char>> m_Staging;
+  std::vector<size_t> m_SlotPending; // Queued or submitted copies per slot.
+  std::vector<std::vector<unsigned char>> m_Buffers; // Only written by GPU thread.
+  std::vector<Copy> m_Queued;
+  std::deque<Copy> m_Submitted;
+  bool m_Copying = false;
+  std::chrono::steady_clock::time_point m_TransferDone;
+  bool m_Quit = false;
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::thread m_GpuThread;
+
+  static std::chrono::steady_clock::duration ToDuration(double microseconds) {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(microseconds));
+  }
+
+  void GpuThreadHandler() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    while(true) {
+      m_Cv.wait(lock, [this]{ return m_Quit || !m_Submitted.empty(); });
+      if(m_Quit) break;
+
+      Copy copy = m_Submitted.front();
+      m_Submitted.pop_front();
+      m_Copying = true;
+      lock.unlock();
+
+      size_t rowSize = m_BytesPerPixel * copy.rect.width;
+      const unsigned char * pSrc = SIZE_MAX != copy.slot ? m_Staging[copy.slot].data() : m_Buffers[copy.srcBuffer].data();
+      unsigned char * pDst = m_Buffers[copy.dstBuffer].data();
+      size_t rowPitch = m_BytesPerPixel * m_Width;
+      for(int i = 0; i < copy.rect.height; i++) {
+        size_t offset = ((size_t)copy.rect.y + i) * rowPitch + m_BytesPerPixel * copy.rect.x;
+        memcpy(pDst + offset, pSrc + offset, rowSize);
+      }
+
+      std::this_thread::sleep_until(copy.due);
+
+      lock.lock();
+      if(SIZE_MAX != copy.slot) --m_SlotPending[copy.slot];
+      m_Copying = false;
+      m_Cv.notify_all();
+    }
+  }
+};
+
+CTextureDeviceCpu * CTextureDeviceCpu::Create(int width, int height, size_t stagingCount, double latencyMicroseconds, double bytesPerMicrosecond, TexturePixelFormat_e format, size_t bufferCount) {
+  if(width < 1 || height < 1 || stagingCount < 1 || bufferCount < 1) return nullptr;
+  return new CTextureDeviceCpuImpl(width, height, stagingCount, latencyMicroseconds, bytesPerMicrosecond, format, bufferCount);
+}
+
+class CTextureAdapterCpu : public CTextureAdapter {
+ public:
+  CTextureAdapterCpu(double createMicroseconds, double latencyMicroseconds, double bytesPerMicrosecond)
+  : m_CreateMicroseconds(createMicroseconds), m_LatencyMicroseconds(latencyMicroseconds), m_BytesPerMicrosecond(bytesPerMicrosecond) {
+  }
+
+  virtual CTextureDevice * CreateDevice(int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError) override {
+    if(0 < m_CreateMicroseconds) std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(m_CreateMicroseconds));
+    CTextureDevice * device = CTextureDeviceCpu::Create(width, height, stagingCount, m_LatencyMicroseconds, m_BytesPerMicrosecond, format, bufferCount);
+    if(nullptr == device) outError = "Creating texture device failed";
+    return device;
+  }
+
+ private:
+  double m_CreateMicroseconds;
+  double m_LatencyMicroseconds;
+  double m_BytesPerMicrosecond;
+};
+
+CTextureAdapter * CreateTextureAdapterCpu(double createMicroseconds, double latencyMicroseconds, double bytesPerMicrosecond) {
+  return new CTextureAdapterCpu(createMicroseconds, latencyMicroseconds, bytesPerMicrosecond);
+}
@@ -0,0 +1,260 @@
+#include "texture_device.h"
+
+#include <thread>
+#include <vector>
+
+#include <windows.h>
+#include <d3d10.h>
+#include <d3d11.h>
+
+class CTextureDeviceD3d11 : public CTextureDevice {
+ public:
+  CTextureDeviceD3d11(ID3D11DeviceContext * pCtx, ID3D11Query * pQuery, std::vector<ID3D11Texture2D *> && shared, std::vector<HANDLE> && sharedHandles, std::vector<ID3D11Texture2D *> && staging, int width, int height, TexturePixelFormat_e format)
+  : m_Ctx(pCtx), m_Query(pQuery), m_Shared(std::move(shared)), m_SharedHandles(std::move(sharedHandles)), m_Staging(std::move(staging)), m_Width(width), m_Height(height), m_Format(format) {
+  }
+
+  virtual ~CTextureDeviceD3d11() {
+    for(ID3D11Texture2D * pTexture : m_Staging) pTexture->Release();
+    for(ID3D11Texture2D * pTexture : m_Shared) pTexture->Release();
+    m_Query->Release();
+    m_Ctx->Release();
+  }
+
+  virtual int GetWidth() override {
+    return m_Width;
+  }
+
+  virtual int GetHeight() override {
+    return m_Height;
+  }
+
+  virtual size_t GetStagingCount() override {
+    return m_Staging.size();
+  }
+
+  virtual size_t GetBufferCount() override {
+    return m_Shared.size();
+  }
+
+  virtual TexturePixelFormat_e GetFormat() override {
+    return m_Format;
+  }
+
+  virtual int64_t GetSharedHandle(size_t buffer) override {
+    return (int64_t)(INT_PTR)m_SharedHandles[buffer];
+  }
+
+  virtual TextureMapResult_e MapStaging(size_t slot, bool bWait, TextureMapping & outMapping) override {
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = m_Ctx->Map(m_Staging[slot], 0, D3D11_MAP_WRITE, bWait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+    if(DXGI_ERROR_WAS_STILL_DRAWING == hr) return TextureMap_Busy;
+    if(FAILED(hr) || nullptr == mapped.pData) return TextureMap_Failed;
+
+    outMapping.pData = reinterpret_cast<unsigned char *>(mapped.pData);
+    outMapping.rowPitch = mapped.RowPitch;
+    return TextureMap_Ok;
+  }
+
+  virtual void UnmapStaging(size_t slot) override {
+    m_Ctx->Unmap(m_Staging[slot], 0);
+  }
+
+  virtual void CopyToShared(size_t slot, const TextureRect & rect, size_t buffer) override {
+    D3D11_BOX box = ToBox(rect);
+    m_Ctx->CopySubresourceRegion(m_Shared[buffer], 0, rect.x, rect.y, 0, m_Staging[slot], 0, &box);
+  }
+
+  virtual void CopyBetweenShared(size_t srcBuffer, size_t dstBuffer, const TextureRect & rect) override {
+    D3D11_BOX box = ToBox(rect);
+    m_Ctx->CopySubresourceRegion(m_Shared[dstBuffer], 0, rect.x, rect.y, 0, m_Shared[srcBuffer], 0, &box);
+  }
+
+  virtual void Flush() override {
+    m_Ctx->Flush();
+  }
+
+  virtual void Finish() override {
+    m_Ctx->End(m_Query);
+    m_Ctx->Flush();
+    while(S_FALSE == m_Ctx->GetData(m_Query, NULL, 0, 0)) std::this_thread::yield();
+  }
+
+ private:
+  ID3D11DeviceContext * m_Ctx;
+  ID3D11Query * m_Query; // D3D11_QUERY_EVENT for Finish.
+  std::vector<ID3D11Texture2D *> m_Shared;
+  std::vector<HANDLE> m_SharedHandles;
+  std::vector<ID3D11Texture2D *> m_Staging;
+  int m_Width;
+  int m_Height;
+  TexturePixelFormat_e m_Format;
+
+  static D3D11_BOX ToBox(const TextureRect & rect) {
+    return D3D11_BOX {
+      (UINT)rect.x, (UINT)rect.y, 0,
+      (UINT)(rect.x + rect.width), (UINT)(rect.y + rect.height), 1
+    };
+  }
+};
+
+static DXGI_FORMAT ToDxgiFormat(TexturePixelFormat_e format) {
+  switch(format) {
+  case TextureFormat_Rgba8:
+    return DXGI_FORMAT_R8G8B8A8_UNORM;
+  case TextureFormat_Rgb10A2:
+    return DXGI_FORMAT_R10G10B10A2_UNORM;
+  case TextureFormat_Rgba16:
+    return DXGI_FORMAT_R16G16B16A16_UNORM;
+  default:
+    return DXGI_FORMAT_B8G8R8A8_UNORM;
+  }
+}
+
+static IDXGIAdapter * FindAdapter(int32_t adapterLuidLo, int32_t adapterLuidHi) {
+  IDXGIFactory * pFactory;
+  if(FAILED(CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)(&pFactory)))) return nullptr;
+
+  IDXGIAdapter * pActualAdapter = nullptr;
+  UINT i = 0;
+  IDXGIAdapter * pAdapter;
+  while(pFactory->EnumAdapters(i, &pAdapter) != DXGI_ERROR_NOT_FOUND) {
+    DXGI_ADAPTER_DESC desc;
+    if(SUCCEEDED(pAdapter->GetDesc(&desc))) {
+      if(desc.AdapterLuid.HighPart == (LONG)adapterLuidHi && desc.AdapterLuid.LowPart == (DWORD)adapterLuidLo) {
+        pAdapter->AddRef();
+        pActualAdapter = pAdapter;
+      }
+    }
+    pAdapter->Release();
+    ++i;
+  }
+
+  pFactory->Release();
+  return pActualAdapter;
+}
+
+class CTextureAdapterD3d11 : public CTextureAdapter {
+ public:
+  CTextureAdapterD3d11(ID3D11Device * pDevice, ID3D11DeviceContext * pCtx)
+  : m_Device(pDevice), m_Ctx(pCtx) {
+  }
+
+  virtual ~CTextureAdapterD3d11() {
+    m_Ctx->Release();
+    m_Device->Release();
+  }
+
+  virtual CTextureDevice * CreateDevice(int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError) override {
+    CTextureDevice * result = nullptr;
+    std::vector<ID3D11Texture2D *> staging;
+    std::vector<ID3D11Texture2D *> shared;
+    std::vector<HANDLE> sharedHandles;
+    ID3D11Query * pQuery = nullptr;
+
+    // Staging (not dynamic) textures, so a busy slot can be detected with
+    // D3D11_MAP_FLAG_DO_NOT_WAIT and only the dirty part needs writing.
+    D3D11_TEXTURE2D_DESC desc {
+      (UINT)width,
+      (UINT)height,
+      1,
+      1,
+      ToDxgiFormat(format),
+      {1, 0},
+      D3D11_USAGE_STAGING,
+      0,
+      D3D11_CPU_ACCESS_WRITE,
+      0
+    };
+
+    for(size_t i = 0; i < stagingCount; i++) {
+      ID3D11Texture2D * pTexture;
+      if(FAILED(m_Device->CreateTexture2D(&desc, NULL, &pTexture))) {
+        outError = "CreateTexture2D failed for staging texture";
+        break;
+      }
+      staging.push_back(pTexture);
+    }
+
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
+
+    for(size_t i = 0; i < bufferCount && staging.size() == stagingCount; i++) {
+      ID3D11Texture2D * pSharedTexture;
+      if(FAILED(m_Device->CreateTexture2D(&desc, NULL, &pSharedTexture))) {
+        outError = "CreateTexture2D failed for shared texture";
+        break;
+      }
+      shared.push_back(pSharedTexture);
+
+      HANDLE sharedHandle = INVALID_HANDLE_VALUE;
+      IDXGIResource * dxgiResource;
+      if(SUCCEEDED(pSharedTexture->QueryInterface(__uuidof(IDXGIResource), (void**)&dxgiResource))) {
+        if(FAILED(dxgiResource->GetSharedHandle(&sharedHandle))) {
+          sharedHandle = INVALID_HANDLE_VALUE;
+        }
+        dxgiResource->Release();
+      }
+      if(INVALID_HANDLE_VALUE == sharedHandle) {
+        outError = "Getting shared Handle failed";
+        break;
+      }
+      sharedHandles.push_back(sharedHandle);
+    }
+
+    if(sharedHandles.size() == bufferCount) {
+      D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_EVENT, 0 };
+      if(FAILED(m_Device->CreateQuery(&queryDesc, &pQuery))) {
+        pQuery = nullptr;
+        outError = "CreateQuery failed";
+      }
+    }
+
+    if(pQuery) {
+      m_Ctx->AddRef();
+      result = new CTextureDeviceD3d11(m_Ctx, pQuery, std::move(shared), std::move(sharedHandles), std::move(staging), width, height, format);
+    } else {
+      for(ID3D11Texture2D * pTexture : shared) pTexture->Release();
+      for(ID3D11Texture2D * pTexture : staging) pTexture->Release();
+    }
+
+    return result;
+  }
+
+ private:
+  ID3D11Device * m_Device;
+  ID3D11DeviceContext * m_Ctx;
+};
+
+CTextureAdapter * CreateTextureAdapterD3d11(int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError) {
+  IDXGIAdapter * pAdapter = FindAdapter(adapterLuidLo, adapterLuidHi);
+  if(nullptr == pAdapter) {
+    outError = "Could not find adapater for given LUID";
+    return nullptr;
+  }
+
+  ID3D11Device * pDevice;
+  ID3D11DeviceContext * pCtx;
+  HRESULT hr = D3D11CreateDevice(pAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0, D3D11_SDK_VERSION, &pDevice, NULL, &pCtx);
+  pAdapter->Release();
+  if(FAILED(hr)) {
+    outError = "D3D11CreateDevice failed";
+    return nullptr;
+  }
+
+  // The textures of all SharedTextures on this adapter share the immediate
+  // context, while each has its own upload thread.
+  ID3D10Multithread * pMultithread;
+  if(SUCCEEDED(pDevice->QueryInterface(__uuidof(ID3D10Multithread), (void**)&pMultithread))) {
+    pMultithread->SetMultithreadProtected(TRUE);
+    pMultithread->Release();
+  } else {
+    pCtx->Release();
+    pDevice->Release();
+    outError = "ID3D10Multithread not supported";
+    return nullptr;
+  }
+
+  return new CTextureAdapterD3d11(pDevice, pCtx);
+}
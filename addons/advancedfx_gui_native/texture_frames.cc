@@ -0,0 +1,111 @@
+#include "texture_frames.h"
+#include "stats.h"
+
+#include <chrono>
+#include <new>
+#include <thread>
+
+void InitTextureFrameHeader(void * pSection, CTextureDevice * device) {
+  CTextureFrameHeader * pHeader = new (pSection) CTextureFrameHeader();
+  pHeader->magic = CTextureFrameHeader::Magic;
+  pHeader->version = CTextureFrameHeader::Version;
+  pHeader->bufferCount = (uint32_t)device->GetBufferCount();
+  pHeader->width = (uint32_t)device->GetWidth();
+  pHeader->height = (uint32_t)device->GetHeight();
+  pHeader->format = (uint32_t)device->GetFormat();
+  for(uint32_t i = 0; i < CTextureFrameHeader::MaxBuffers; i++) {
+    pHeader->sharedHandles[i] = i < pHeader->bufferCount ? device->GetSharedHandle(i) : -1;
+  }
+  pHeader->closed = 0;
+  pHeader->latest = 0;
+  pHeader->claimed = 0;
+}
+
+bool IsValidTextureFrameHeader(const void * pSection, size_t sectionSize) {
+  if(sectionSize < TextureFrameSectionSize) return false;
+  const CTextureFrameHeader * pHeader = reinterpret_cast<const CTextureFrameHeader *>(pSection);
+  return CTextureFrameHeader::Magic == pHeader->magic
+    && CTextureFrameHeader::Version == pHeader->version
+    && 2 <= pHeader->bufferCount && pHeader->bufferCount <= CTextureFrameHeader::MaxBuffers;
+}
+
+CTextureFrameProducer::CTextureFrameProducer(CTextureFrameHeader * pHeader)
+: m_Header(pHeader)
+, m_BufferCount(pHeader->bufferCount)
+, m_Stale(pHeader->bufferCount) {
+}
+
+TextureFrameBuffer_e CTextureFrameProducer::BeginFrame(uint64_t maxWaitMicroseconds, size_t & outBuffer) {
+  TextureFrameBuffer_e result = TextureFrameBuffer_Free;
+  uint64_t waitStart = 0;
+
+  while(true) {
+    uint32_t claimed = m_Header->claimed.load(std::memory_order_seq_cst);
+    for(size_t i = 0; i < m_BufferCount; i++) {
+      size_t buffer = (m_Next + i) % m_BufferCount;
+      if(buffer == m_Latest || buffer + 1 == claimed) continue;
+      m_Next = (buffer + 1) % m_BufferCount;
+      outBuffer = buffer;
+      return result;
+    }
+
+    // Only with 2 buffers, the consumer holds the one not the latest.
+    uint64_t now = StatNowNanoseconds();
+    if(0 == waitStart) {
+      waitStart = now;
+      result = TextureFrameBuffer_Waited;
+    } else if(maxWaitMicroseconds * 1000 <= now - waitStart) {
+      outBuffer = claimed - 1;
+      return TextureFrameBuffer_Forced;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+void CTextureFrameProducer::Publish(size_t buffer, const std::vector<TextureRect> & dirty) {
+  m_Stale[buffer].clear();
+  for(size_t i = 0; i < m_BufferCount; i++) {
+    if(i == buffer) continue;
+    std::vector<TextureRect> & stale = m_Stale[i];
+    stale.insert(stale.end(), dirty.begin(), dirty.end());
+    if(m_MaxStaleRects < stale.size()) {
+      TextureRect bounds = stale[0];
+      for(const TextureRect & rect : stale) bounds = UnionTextureRect(bounds, rect);
+      stale.assign(1, bounds);
+    }
+  }
+
+  m_Latest = buffer;
+  ++m_Sequence;
+  m_Header->latest.store(m_Sequence << 8 | buffer, std::memory_order_seq_cst);
+}
+
+CTextureFrameConsumer::CTextureFrameConsumer(CTextureFrameHeader * pHeader)
+: m_Header(pHeader) {
+}
+
+CTextureFrameConsumer::~CTextureFrameConsumer() {
+  Release();
+}
+
+bool CTextureFrameConsumer::AcquireLatest(size_t & outBuffer, uint64_t & outSequence) {
+  uint64_t latest = m_Header->latest.load(std::memory_order_seq_cst);
+  while(0 != latest) {
+    uint32_t buffer = (uint32_t)(latest & 0xff);
+    m_Header->claimed.store(buffer + 1, std::memory_order_seq_cst);
+    if(0 != m_Header->closed.load(std::memory_order_seq_cst)) break;
+    uint64_t check = m_Header->latest.load(std::memory_order_seq_cst);
+    if((uint32_t)(check & 0xff) == buffer) {
+      outBuffer = buffer;
+      outSequence = check >> 8;
+      return true;
+    }
+    latest = check;
+  }
+  Release();
+  return false;
+}
+
+void CTextureFrameConsumer::Release() {
+  m_Header->claimed.store(0, std::memory_order_seq_cst);
+}
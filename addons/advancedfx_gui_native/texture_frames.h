@@ -0,0 +1,151 @@
+#pragma once
+
+#include "texture_device.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Layout of the section a consumer (the game) attaches to, to find out which
+// of bufferCount shared textures holds the latest complete frame, without
+// any round trip:
+//
+// The producer only writes buffers that are neither the latest nor claimed,
+// waits for the GPU to finish and then publishes the buffer by storing
+// latest. The consumer claims the latest buffer by storing it to claimed,
+// then loads latest again and retries if it names another buffer by now.
+// Both sides store before they load, with sequentially consistent atomics,
+// so either the producer sees the claim or the consumer sees the buffer is
+// not the latest anymore.
+// With 3 or more buffers the producer never waits, with 2 it waits while the
+// consumer holds the buffer that is not the latest.
+// Closing the producer stores closed before its textures can be reused, the
+// consumer loads it after claiming and lets go if it is set.
+struct CTextureFrameHeader {
+  static const uint32_t Magic = 0x46584641; // "AFXF"
+  static const uint32_t Version = 1;
+  static const uint32_t MaxBuffers = 8;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t bufferCount;
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // TexturePixelFormat_e
+  int64_t sharedHandles[MaxBuffers];
+  std::atomic<uint32_t> closed; // The producer is gone.
+
+  alignas(64) std::atomic<uint64_t> latest; // sequence << 8 | buffer, 0 before the first frame.
+  alignas(64) std::atomic<uint32_t> claimed; // buffer + 1, 0 for none.
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Texture frame sync needs lock-free 64 bit atomics");
+
+const size_t TextureFrameSectionSize = 256;
+static_assert(sizeof(CTextureFrameHeader) <= TextureFrameSectionSize, "CTextureFrameHeader too big");
+
+// Initializes a fresh header with the handles of the device's buffers, 2 to
+// MaxBuffers of them.
+void InitTextureFrameHeader(void * pSection, CTextureDevice * device);
+
+// Returns false if pSection of sectionSize bytes is not a valid header.
+bool IsValidTextureFrameHeader(const void * pSection, size_t sectionSize);
+
+enum TextureFrameBuffer_e {
+  TextureFrameBuffer_Free,
+  TextureFrameBuffer_Waited, // Waited for the consumer to release one.
+  TextureFrameBuffer_Forced // Gave up waiting and took the claimed one.
+};
+
+// Producer side, remembers what each buffer misses of the latest frame.
+class CTextureFrameProducer {
+ public:
+  explicit CTextureFrameProducer(CTextureFrameHeader * pHeader);
+
+  CTextureFrameProducer(const CTextureFrameProducer& rhs) = delete;
+  CTextureFrameProducer& operator=(const CTextureFrameProducer& rhs) = delete;
+
+  // Picks the buffer to write the next frame to. If all are taken waits up
+  // to maxWaitMicroseconds for the consumer, then takes the claimed one
+  // anyway: a consumer that hangs must not stall uploads for good.
+  TextureFrameBuffer_e BeginFrame(uint64_t maxWaitMicroseconds, size_t & outBuffer);
+
+  // Rects where buffer differs from the latest frame, to be copied from
+  // GetLatest before the new frame's dirty rects.
+  const std::vector<TextureRect> & GetStale(size_t buffer) {
+    return m_Stale[buffer];
+  }
+
+  // SIZE_MAX before the first frame.
+  size_t GetLatest() {
+    return m_Latest;
+  }
+
+  // Publishes buffer, which the GPU finished writing, with dirty the rects
+  // that changed compared to the latest frame.
+  void Publish(size_t buffer, const std::vector<TextureRect> & dirty);
+
+ private:
+  static const size_t m_MaxStaleRects = 16; // More are merged into one.
+
+  CTextureFrameHeader * m_Header;
+  size_t m_BufferCount;
+  size_t m_Latest = SIZE_MAX;
+  size_t m_Next = 0;
+  uint64_t m_Sequence = 0;
+  std::vector<std::vector<TextureRect>> m_Stale;
+};
+
+// Consumer side, what the game does; here for benchmarks and tests.
+class CTextureFrameConsumer {
+ public:
+  explicit CTextureFrameConsumer(CTextureFrameHeader * pHeader);
+  ~CTextureFrameConsumer();
+
+  CTextureFrameConsumer(const CTextureFrameConsumer& rhs) = delete;
+  CTextureFrameConsumer& operator=(const CTextureFrameConsumer& rhs) = delete;
+
+  // Claims the latest buffer instead of the one claimed before, hold it
+  // until done reading it, on the GPU too. Returns false if there is no
+  // frame yet or the producer is closed.
+  bool AcquireLatest(size_t & outBuffer, uint64_t & outSequence);
+
+  void Release();
+
+ private:
+  CTextureFrameHeader * m_Header;
+};
+
+// Named shared memory of TextureFrameSectionSize bytes for a
+// CTextureFrameHeader, consumers open it by name.
+class CTextureFrameSection {
+ public:
+  // Creates a section with a name unique to this process, nullptr on
+  // failure. The section is initialized by the caller.
+  static CTextureFrameSection * Create();
+
+  // Returns nullptr on failure or if the section holds no valid header.
+  static CTextureFrameSection * Open(const char * name);
+
+  virtual ~CTextureFrameSection() {}
+
+  CTextureFrameSection(const CTextureFrameSection& rhs) = delete;
+  CTextureFrameSection& operator=(const CTextureFrameSection& rhs) = delete;
+
+  CTextureFrameHeader * GetHeader() {
+    return m_Header;
+  }
+
+  const std::string & GetName() {
+    return m_Name;
+  }
+
+ protected:
+  CTextureFrameSection(const std::string & name, void * pSection)
+  : m_Name(name), m_Header(reinterpret_cast<CTextureFrameHeader *>(pSection)) {
+  }
+
+  std::string m_Name;
+  CTextureFrameHeader * m_Header;
+};
@@ -0,0 +1,70 @@
+#include "texture_frames.h"
+
+#include <atomic>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// POSIX shared memory object, since the game opens it by name. The creator
+// unlinks it again on destruction, mappings stay valid until unmapped.
+class CTextureFrameSectionPosix : public CTextureFrameSection {
+ public:
+  CTextureFrameSectionPosix(const std::string & name, void * pSection, bool bOwner)
+  : CTextureFrameSection(name, pSection), m_Owner(bOwner) {
+  }
+
+  virtual ~CTextureFrameSectionPosix() {
+    munmap(m_Header, TextureFrameSectionSize);
+    if(m_Owner) shm_unlink(m_Name.c_str());
+  }
+
+ private:
+  bool m_Owner;
+};
+
+static void * MapSection(int fd) {
+  void * pSection = mmap(nullptr, TextureFrameSectionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return MAP_FAILED == pSection ? nullptr : pSection;
+}
+
+CTextureFrameSection * CTextureFrameSection::Create() {
+  static std::atomic<uint32_t> s_NextId(0);
+  std::string name = "/advancedfx_gui_frames_" + std::to_string(getpid()) + "_" + std::to_string(s_NextId++);
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if(-1 == fd) return nullptr;
+  if(0 != ftruncate(fd, TextureFrameSectionSize)) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  void * pSection = MapSection(fd);
+  if(nullptr == pSection) {
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+  return new CTextureFrameSectionPosix(name, pSection, true);
+}
+
+CTextureFrameSection * CTextureFrameSection::Open(const char * name) {
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if(-1 == fd) return nullptr;
+
+  struct stat st;
+  if(0 != fstat(fd, &st) || (size_t)st.st_size < TextureFrameSectionSize) {
+    close(fd);
+    return nullptr;
+  }
+
+  void * pSection = MapSection(fd);
+  if(nullptr == pSection) return nullptr;
+  if(!IsValidTextureFrameHeader(pSection, TextureFrameSectionSize)) {
+    munmap(pSection, TextureFrameSectionSize);
+    return nullptr;
+  }
+  return new CTextureFrameSectionPosix(name, pSection, false);
+}
@@ -0,0 +1,63 @@
+#include "texture_frames.h"
+
+#include <atomic>
+#include <string>
+
+#include <windows.h>
+
+// Pagefile backed named file mapping, it goes away with the last handle.
+class CTextureFrameSectionWin32 : public CTextureFrameSection {
+ public:
+  CTextureFrameSectionWin32(const std::string & name, HANDLE mapping, void * pSection)
+  : CTextureFrameSection(name, pSection), m_Mapping(mapping) {
+  }
+
+  virtual ~CTextureFrameSectionWin32() {
+    UnmapViewOfFile(m_Header);
+    CloseHandle(m_Mapping);
+  }
+
+ private:
+  HANDLE m_Mapping;
+};
+
+static std::wstring ToWide(const std::string & name) {
+  // Names are ASCII.
+  return std::wstring(name.begin(), name.end());
+}
+
+CTextureFrameSection * CTextureFrameSection::Create() {
+  static std::atomic<uint32_t> s_NextId(0);
+  std::string name = "Local\\advancedfx_gui_frames_" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(s_NextId++);
+
+  HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)TextureFrameSectionSize, ToWide(name).c_str());
+  if(NULL == mapping) return nullptr;
+  if(ERROR_ALREADY_EXISTS == GetLastError()) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+
+  void * pSection = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, TextureFrameSectionSize);
+  if(nullptr == pSection) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+  return new CTextureFrameSectionWin32(name, mapping, pSection);
+}
+
+CTextureFrameSection * CTextureFrameSection::Open(const char * name) {
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, ToWide(name).c_str());
+  if(NULL == mapping) return nullptr;
+
+  void * pSection = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, TextureFrameSectionSize);
+  if(nullptr == pSection) {
+    CloseHandle(mapping);
+    return nullptr;
+  }
+  if(!IsValidTextureFrameHeader(pSection, TextureFrameSectionSize)) {
+    UnmapViewOfFile(pSection);
+    CloseHandle(mapping);
+    return nullptr;
+  }
+  return new CTextureFrameSectionWin32(name, mapping, pSection);
+}
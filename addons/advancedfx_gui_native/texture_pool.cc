@@ -0,0 +1,188 @@
+#include "texture_pool.h"
+
+// What CTexturePool::Acquire hands out: forwards to the pooled device and
+// gives it back on destruction.
+class CTexturePool::CPooledDevice : public CTextureDevice {
+ public:
+  CPooledDevice(CTexturePool & pool, CTextureAdapter * adapter, CTextureDevice * device)
+  : m_Pool(pool), m_Adapter(adapter), m_Device(device) {
+  }
+
+  virtual ~CPooledDevice() {
+    if(m_bRecycle) m_Pool.Recycle(m_Adapter, m_Device);
+    else delete m_Device;
+  }
+
+  void SetRecycle(bool bRecycle) {
+    m_bRecycle = bRecycle;
+  }
+
+  virtual int GetWidth() override {
+    return m_Device->GetWidth();
+  }
+
+  virtual int GetHeight() override {
+    return m_Device->GetHeight();
+  }
+
+  virtual size_t GetStagingCount() override {
+    return m_Device->GetStagingCount();
+  }
+
+  virtual size_t GetBufferCount() override {
+    return m_Device->GetBufferCount();
+  }
+
+  virtual TexturePixelFormat_e GetFormat() override {
+    return m_Device->GetFormat();
+  }
+
+  virtual int64_t GetSharedHandle(size_t buffer) override {
+    return m_Device->GetSharedHandle(buffer);
+  }
+
+  virtual TextureMapResult_e MapStaging(size_t slot, bool bWait, TextureMapping & outMapping) override {
+    return m_Device->MapStaging(slot, bWait, outMapping);
+  }
+
+  virtual void UnmapStaging(size_t slot) override {
+    m_Device->UnmapStaging(slot);
+  }
+
+  virtual void CopyToShared(size_t slot, const TextureRect & rect, size_t buffer) override {
+    m_Device->CopyToShared(slot, rect, buffer);
+  }
+
+  virtual void CopyBetweenShared(size_t srcBuffer, size_t dstBuffer, const TextureRect & rect) override {
+    m_Device->CopyBetweenShared(srcBuffer, dstBuffer, rect);
+  }
+
+  virtual void Flush() override {
+    m_Device->Flush();
+  }
+
+  virtual void Finish() override {
+    m_Device->Finish();
+  }
+
+ private:
+  CTexturePool & m_Pool;
+  CTextureAdapter * m_Adapter;
+  CTextureDevice * m_Device;
+  bool m_bRecycle = true;
+};
+
+CTexturePool::CTexturePool(TextureAdapterFactory_t && factory, size_t maxIdle)
+: m_Factory(std::move(factory))
+, m_MaxIdle(maxIdle) {
+}
+
+CTexturePool::~CTexturePool() {
+  for(Idle & idle : m_Idle) delete idle.device;
+  for(Adapter & adapter : m_Adapters) delete adapter.adapter;
+}
+
+CTextureDevice * CTexturePool::Acquire(int32_t adapterLuidLo, int32_t adapterLuidHi, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError) {
+  uint64_t start = StatNowNanoseconds();
+
+  CTextureAdapter * adapter = GetAdapter(adapterLuidLo, adapterLuidHi, outError);
+  if(nullptr == adapter) return nullptr;
+
+  CTextureDevice * device = FindIdle(adapter, width, height, stagingCount, bufferCount, format, true);
+  if(device) {
+    m_Stats.hits.Add(1);
+  } else {
+    device = adapter->CreateDevice(width, height, stagingCount, bufferCount, format, outError);
+    if(nullptr == device) return nullptr;
+    m_Stats.misses.Add(1);
+    m_Stats.createTime.RecordSince(start);
+  }
+
+  m_Stats.acquireTime.RecordSince(start);
+  return new CPooledDevice(*this, adapter, device);
+}
+
+bool CTexturePool::Prewarm(int32_t adapterLuidLo, int32_t adapterLuidHi, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError) {
+  uint64_t start = StatNowNanoseconds();
+
+  CTextureAdapter * adapter = GetAdapter(adapterLuidLo, adapterLuidHi, outError);
+  if(nullptr == adapter) return false;
+
+  if(FindIdle(adapter, width, height, stagingCount, bufferCount, format, false)) return true;
+
+  CTextureDevice * device = adapter->CreateDevice(width, height, stagingCount, bufferCount, format, outError);
+  if(nullptr == device) return false;
+  m_Stats.prewarmed.Add(1);
+  m_Stats.createTime.RecordSince(start);
+
+  Recycle(adapter, device);
+  return true;
+}
+
+void CTexturePool::Drop(CTextureDevice * device) {
+  static_cast<CPooledDevice *>(device)->SetRecycle(false);
+  delete device;
+  m_Stats.dropped.Add(1);
+}
+
+void CTexturePool::SetMaxIdle(size_t maxIdle) {
+  std::vector<CTextureDevice *> evicted;
+  {
+    std::unique_lock<std::mutex> lock(m_IdleLock);
+    m_MaxIdle = maxIdle;
+    Evict(evicted);
+  }
+  for(CTextureDevice * device : evicted) delete device;
+}
+
+size_t CTexturePool::GetIdleCount() {
+  std::unique_lock<std::mutex> lock(m_IdleLock);
+  return m_Idle.size();
+}
+
+CTextureAdapter * CTexturePool::GetAdapter(int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError) {
+  std::unique_lock<std::mutex> lock(m_AdapterLock);
+  for(Adapter & adapter : m_Adapters) {
+    if(adapter.luidLo == adapterLuidLo && adapter.luidHi == adapterLuidHi) return adapter.adapter;
+  }
+
+  CTextureAdapter * adapter = m_Factory(adapterLuidLo, adapterLuidHi, outError);
+  if(nullptr == adapter) return nullptr;
+  m_Adapters.push_back(Adapter{adapterLuidLo, adapterLuidHi, adapter});
+  m_Stats.adapters.Add(1);
+  return adapter;
+}
+
+CTextureDevice * CTexturePool::FindIdle(CTextureAdapter * adapter, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, bool bTake) {
+  std::unique_lock<std::mutex> lock(m_IdleLock);
+  // Most recently deleted first, it is the most likely to be in caches.
+  for(size_t i = m_Idle.size(); 0 < i; i--) {
+    Idle & idle = m_Idle[i - 1];
+    if(idle.adapter == adapter && idle.device->GetWidth() == width && idle.device->GetHeight() == height
+      && idle.device->GetStagingCount() == stagingCount && idle.device->GetBufferCount() == bufferCount && idle.device->GetFormat() == format) {
+      CTextureDevice * device = idle.device;
+      if(bTake) m_Idle.erase(m_Idle.begin() + (i - 1));
+      return device;
+    }
+  }
+  return nullptr;
+}
+
+void CTexturePool::Recycle(CTextureAdapter * adapter, CTextureDevice * device) {
+  std::vector<CTextureDevice *> evicted;
+  {
+    std::unique_lock<std::mutex> lock(m_IdleLock);
+    m_Idle.push_back(Idle{adapter, device});
+    Evict(evicted);
+  }
+  // Outside the lock, releasing can wait for the GPU.
+  for(CTextureDevice * evictedDevice : evicted) delete evictedDevice;
+}
+
+void CTexturePool::Evict(std::vector<CTextureDevice *> & outEvicted) {
+  if(m_Idle.size() <= m_MaxIdle) return;
+  size_t count = m_Idle.size() - m_MaxIdle;
+  for(size_t i = 0; i < count; i++) outEvicted.push_back(m_Idle[i].device);
+  m_Idle.erase(m_Idle.begin(), m_Idle.begin() + count);
+  m_Stats.evicted.Add((int64_t)count);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "stats.h"
+#include "texture_device.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CTexturePoolStats {
+  CStatCounter hits; // Devices handed out recycled.
+  CStatCounter misses; // Devices that had to be created.
+  CStatCounter prewarmed; // Devices created idle by Prewarm.
+  CStatCounter adapters; // Adapters created.
+  CStatCounter evicted; // Idle devices released to stay within maxIdle.
+  CStatCounter dropped; // Devices released by Drop.
+  CStatHistogram createTime; // Of misses and Prewarm, including creating the adapter.
+  CStatHistogram acquireTime;
+
+  void Reset() {
+    hits.Reset();
+    misses.Reset();
+    prewarmed.Reset();
+    adapters.Reset();
+    evicted.Reset();
+    dropped.Reset();
+    createTime.Reset();
+    acquireTime.Reset();
+  }
+};
+
+// Returns nullptr and sets outError if there is no adapter with that LUID.
+typedef std::function<CTextureAdapter * (int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError)> TextureAdapterFactory_t;
+
+// Keeps one CTextureAdapter per adapter LUID and, instead of releasing
+// them, the textures of deleted devices for the next device of the same
+// adapter, size, format, staging and buffer count. Recreating a window of
+// the same size then only takes a lookup.
+// Recycled devices still hold the pixels of their last use.
+// Thread-safe.
+class CTexturePool {
+ public:
+  // Keeps at most maxIdle devices that are not in use, least recently
+  // deleted ones are released first.
+  explicit CTexturePool(TextureAdapterFactory_t && factory, size_t maxIdle = 4);
+
+  // Devices handed out must be deleted before.
+  ~CTexturePool();
+
+  CTexturePool(const CTexturePool& rhs) = delete;
+  CTexturePool& operator=(const CTexturePool& rhs) = delete;
+
+  // Deleting the returned device returns its textures to the pool. Returns
+  // nullptr and sets outError on failure.
+  CTextureDevice * Acquire(int32_t adapterLuidLo, int32_t adapterLuidHi, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError);
+
+  // Creates a device as Acquire would and keeps it idle, unless a matching
+  // one is idle already, so that the next Acquire of it hits. Returns false
+  // and sets outError on failure.
+  bool Prewarm(int32_t adapterLuidLo, int32_t adapterLuidHi, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, std::string & outError);
+
+  // Deletes device, which Acquire returned, releasing its textures instead
+  // of returning them to the pool: for textures another process may still
+  // read.
+  void Drop(CTextureDevice * device);
+
+  void SetMaxIdle(size_t maxIdle);
+
+  size_t GetIdleCount();
+
+  CTexturePoolStats & GetStats() {
+    return m_Stats;
+  }
+
+ private:
+  class CPooledDevice;
+
+  struct Adapter {
+    int32_t luidLo;
+    int32_t luidHi;
+    CTextureAdapter * adapter;
+  };
+
+  struct Idle {
+    CTextureAdapter * adapter;
+    CTextureDevice * device;
+  };
+
+  TextureAdapterFactory_t m_Factory;
+  std::mutex m_AdapterLock; // Held while creating one.
+  std::vector<Adapter> m_Adapters;
+  std::mutex m_IdleLock;
+  std::vector<Idle> m_Idle; // Least recently deleted first.
+  size_t m_MaxIdle;
+  CTexturePoolStats m_Stats;
+
+  CTextureAdapter * GetAdapter(int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError);
+
+  // Returns a matching idle device, nullptr if there is none. With bTake it
+  // is no longer idle.
+  CTextureDevice * FindIdle(CTextureAdapter * adapter, int width, int height, size_t stagingCount, size_t bufferCount, TexturePixelFormat_e format, bool bTake);
+
+  void Recycle(CTextureAdapter * adapter, CTextureDevice * device);
+
+  // Moves idle devices beyond m_MaxIdle to outEvicted, with m_IdleLock held.
+  void Evict(std::vector<CTextureDevice *> & outEvicted);
+};
@@ -0,0 +1,206 @@
+#include "texture_trace.h"
+#include "stats.h"
+
+#include <cstring>
+
+static const char g_TextureTraceMagic[8] = {'A', 'F', 'X', 'T', 'T', 'R', 'C', '1'};
+
+static const size_t g_TextureTraceRecordHeaderSize = sizeof(uint64_t) + 4 * sizeof(int32_t) + 2 * sizeof(uint32_t);
+
+static const size_t g_TexturePixelRunMax = 0x8000;
+
+static inline uint32_t LoadTexturePixel(const unsigned char * pPixels, size_t index) {
+  uint32_t pixel;
+  memcpy(&pixel, pPixels + 4 * index, sizeof(pixel));
+  return pixel;
+}
+
+static inline void AppendTexturePixelPacket(std::vector<unsigned char> & out, bool bRun, size_t count, const unsigned char * pPixels) {
+  uint16_t control = (uint16_t)((bRun ? 0x8000 : 0) | (count - 1));
+  size_t pixelBytes = 4 * (bRun ? 1 : count);
+  size_t offset = out.size();
+  out.resize(offset + sizeof(control) + pixelBytes);
+  memcpy(&out[offset], &control, sizeof(control));
+  memcpy(&out[offset + sizeof(control)], pPixels, pixelBytes);
+}
+
+void EncodeTexturePixelRuns(const unsigned char * pPixels, size_t count, std::vector<unsigned char> & out) {
+  size_t i = 0;
+  while(i < count) {
+    uint32_t pixel = LoadTexturePixel(pPixels, i);
+    size_t run = 1;
+    while(i + run < count && run < g_TexturePixelRunMax && pixel == LoadTexturePixel(pPixels, i + run)) ++run;
+
+    if(2 <= run) {
+      AppendTexturePixelPacket(out, true, run, pPixels + 4 * i);
+      i += run;
+      continue;
+    }
+
+    // Literals up to where the next run starts.
+    size_t end = i + 1;
+    while(end < count && end - i < g_TexturePixelRunMax
+      && !(end + 1 < count && LoadTexturePixel(pPixels, end) == LoadTexturePixel(pPixels, end + 1))) ++end;
+    AppendTexturePixelPacket(out, false, end - i, pPixels + 4 * i);
+    i = end;
+  }
+}
+
+bool DecodeTexturePixelRuns(const unsigned char * pData, size_t size, unsigned char * pOutPixels, size_t count) {
+  size_t offset = 0;
+  size_t done = 0;
+  while(offset < size) {
+    uint16_t control;
+    if(size - offset < sizeof(control)) return false;
+    memcpy(&control, pData + offset, sizeof(control));
+    offset += sizeof(control);
+
+    size_t packetCount = (size_t)(control & 0x7fff) + 1;
+    if(count - done < packetCount) return false;
+
+    if(control & 0x8000) {
+      if(size - offset < 4) return false;
+      for(size_t i = 0; i < packetCount; i++) memcpy(pOutPixels + 4 * (done + i), pData + offset, 4);
+      offset += 4;
+    } else {
+      if(size - offset < 4 * packetCount) return false;
+      memcpy(pOutPixels + 4 * done, pData + offset, 4 * packetCount);
+      offset += 4 * packetCount;
+    }
+    done += packetCount;
+  }
+  return done == count;
+}
+
+CTextureTraceWriter * CTextureTraceWriter::Create(const char * path, int width, int height, bool bRuns) {
+  CBufferedFileWriter * file = CBufferedFileWriter::Create(path);
+  if(nullptr == file) return nullptr;
+
+  uint64_t start = StatNowNanoseconds();
+  unsigned char header[sizeof(g_TextureTraceMagic) + 2 * sizeof(uint32_t) + sizeof(uint64_t)];
+  uint32_t width32 = (uint32_t)width;
+  uint32_t height32 = (uint32_t)height;
+  memcpy(header, g_TextureTraceMagic, sizeof(g_TextureTraceMagic));
+  memcpy(header + sizeof(g_TextureTraceMagic), &width32, sizeof(width32));
+  memcpy(header + sizeof(g_TextureTraceMagic) + sizeof(width32), &height32, sizeof(height32));
+  memcpy(header + sizeof(g_TextureTraceMagic) + sizeof(width32) + sizeof(height32), &start, sizeof(start));
+  file->Append(header, sizeof(header));
+
+  return new CTextureTraceWriter(file, start, bRuns);
+}
+
+CTextureTraceWriter::CTextureTraceWriter(CBufferedFileWriter * file, uint64_t startNanoseconds, bool bRuns)
+: m_File(file)
+, m_Start(startNanoseconds)
+, m_Runs(bRuns) {
+}
+
+CTextureTraceWriter::~CTextureTraceWriter() {
+  delete m_File;
+}
+
+void CTextureTraceWriter::Append(uint64_t timeNanoseconds, const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage) {
+  size_t rowBytes = (size_t)4 * rect.width;
+  m_Pixels.resize(rowBytes * rect.height);
+  for(int i = 0; i < rect.height; i++) {
+    const unsigned char * pSrcRow = bSubImage
+      ? pSrc + (size_t)i * srcRowPitch
+      : pSrc + ((size_t)rect.y + i) * srcRowPitch + (size_t)4 * rect.x;
+    if(rowBytes) memcpy(&m_Pixels[(size_t)i * rowBytes], pSrcRow, rowBytes);
+  }
+
+  uint32_t flags = bSubImage ? 0 : TextureTraceFlag_FullFrame;
+  const std::vector<unsigned char> * pPayload = &m_Pixels;
+  if(m_Runs) {
+    m_Encoded.clear();
+    EncodeTexturePixelRuns(m_Pixels.data(), m_Pixels.size() / 4, m_Encoded);
+    flags |= TextureTraceFlag_Runs;
+    pPayload = &m_Encoded;
+  }
+
+  uint64_t time = m_Start < timeNanoseconds ? timeNanoseconds - m_Start : 0;
+  int32_t rectValues[4] = {rect.x, rect.y, rect.width, rect.height};
+  uint32_t size = (uint32_t)pPayload->size();
+  unsigned char header[g_TextureTraceRecordHeaderSize];
+  memcpy(header, &time, sizeof(time));
+  memcpy(header + sizeof(time), rectValues, sizeof(rectValues));
+  memcpy(header + sizeof(time) + sizeof(rectValues), &flags, sizeof(flags));
+  memcpy(header + sizeof(time) + sizeof(rectValues) + sizeof(flags), &size, sizeof(size));
+
+  m_File->Append(header, sizeof(header), pPayload->data(), pPayload->size());
+}
+
+CTextureTraceReader::~CTextureTraceReader() {
+  if(m_File) fclose(m_File);
+}
+
+bool CTextureTraceReader::Open(const char * path) {
+  if(m_File) fclose(m_File);
+  m_Corrupt = false;
+
+  m_File = fopen(path, "rb");
+  if(nullptr == m_File) return false;
+
+  char magic[sizeof(g_TextureTraceMagic)];
+  uint32_t width;
+  uint32_t height;
+  uint64_t start;
+  if(1 != fread(magic, sizeof(magic), 1, m_File)
+    || 0 != memcmp(magic, g_TextureTraceMagic, sizeof(magic))
+    || 1 != fread(&width, sizeof(width), 1, m_File)
+    || 1 != fread(&height, sizeof(height), 1, m_File)
+    || 1 != fread(&start, sizeof(start), 1, m_File)) {
+    fclose(m_File);
+    m_File = nullptr;
+    return false;
+  }
+
+  m_Width = (int)width;
+  m_Height = (int)height;
+  return true;
+}
+
+bool CTextureTraceReader::Next(TextureTraceRecord & outRecord) {
+  if(nullptr == m_File || m_Corrupt) return false;
+
+  unsigned char header[g_TextureTraceRecordHeaderSize];
+  size_t headerRead = fread(header, 1, sizeof(header), m_File);
+  if(headerRead < sizeof(header)) {
+    m_Corrupt = 0 != headerRead;
+    return false;
+  }
+
+  int32_t rectValues[4];
+  uint32_t flags;
+  uint32_t size;
+  memcpy(&outRecord.time, header, sizeof(outRecord.time));
+  memcpy(rectValues, header + sizeof(outRecord.time), sizeof(rectValues));
+  memcpy(&flags, header + sizeof(outRecord.time) + sizeof(rectValues), sizeof(flags));
+  memcpy(&size, header + sizeof(outRecord.time) + sizeof(rectValues) + sizeof(flags), sizeof(size));
+
+  outRecord.rect = TextureRect{rectValues[0], rectValues[1], rectValues[2], rectValues[3]};
+  outRecord.bFullFrame = 0 != (flags & TextureTraceFlag_FullFrame);
+  outRecord.storedSize = size;
+
+  TextureRect bounds{0, 0, m_Width, m_Height};
+  if(outRecord.rect.width < 0 || outRecord.rect.height < 0 || !TextureRectContains(bounds, outRecord.rect)) {
+    m_Corrupt = true;
+    return false;
+  }
+  size_t pixelCount = (size_t)outRecord.rect.width * outRecord.rect.height;
+  outRecord.pixels.resize(4 * pixelCount);
+
+  if(flags & TextureTraceFlag_Runs) {
+    m_Payload.resize(size);
+    if((size && 1 != fread(m_Payload.data(), size, 1, m_File))
+      || !DecodeTexturePixelRuns(m_Payload.data(), size, outRecord.pixels.data(), pixelCount)) {
+      m_Corrupt = true;
+      return false;
+    }
+  } else if(size != outRecord.pixels.size() || (size && 1 != fread(outRecord.pixels.data(), size, 1, m_File))) {
+    m_Corrupt = true;
+    return false;
+  }
+
+  return true;
+}
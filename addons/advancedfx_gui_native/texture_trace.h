@@ -0,0 +1,108 @@
+#pragma once
+
+#include "file_writer.h"
+#include "texture_device.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Recording of SharedTexture updates, to benchmark the upload path with what
+// an offscreen BrowserWindow really painted.
+//
+// File layout, integers in host byte order:
+//   header: char magic[8] = "AFXTTRC1", uint32 width, uint32 height,
+//           uint64 start time (ns, steady clock)
+//   records: uint64 time (ns since start), int32 x, y, width, height,
+//            uint32 flags, uint32 size, payload of size bytes
+// The payload holds only the dirty rect's 4 byte pixels, row after row
+// without padding, with TextureTraceFlag_Runs run-length encoded
+// (EncodeTexturePixelRuns).
+
+enum TextureTraceFlags_e {
+  TextureTraceFlag_FullFrame = 1 << 0, // update was passed the full frame, else only the dirty rect.
+  TextureTraceFlag_Runs = 1 << 1
+};
+
+// Packets of a uint16 control word: the low 15 bits are count - 1, with the
+// high bit set one pixel follows that repeats count times, otherwise count
+// pixels follow as they are. Overlays are mostly transparent or flat, which
+// this catches at memcpy-like speed.
+void EncodeTexturePixelRuns(const unsigned char * pPixels, size_t count, std::vector<unsigned char> & out);
+
+// Returns false if pData does not decode to exactly count pixels.
+bool DecodeTexturePixelRuns(const unsigned char * pData, size_t size, unsigned char * pOutPixels, size_t count);
+
+class CTextureTraceWriter {
+ public:
+  // With bRuns pixels are run-length encoded. Returns nullptr if path can not
+  // be created.
+  static CTextureTraceWriter * Create(const char * path, int width, int height, bool bRuns);
+
+  // Writes what is buffered and closes the file.
+  ~CTextureTraceWriter();
+
+  CTextureTraceWriter(const CTextureTraceWriter& rhs) = delete;
+  CTextureTraceWriter& operator=(const CTextureTraceWriter& rhs) = delete;
+
+  // Records an update of rect with pSrc, srcRowPitch and bSubImage as for
+  // CTextureUploader::Upload. timeNanoseconds is from StatNowNanoseconds.
+  // Not thread-safe.
+  void Append(uint64_t timeNanoseconds, const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage);
+
+  bool IsOk() {
+    return m_File->IsOk();
+  }
+
+ private:
+  CTextureTraceWriter(CBufferedFileWriter * file, uint64_t startNanoseconds, bool bRuns);
+
+  CBufferedFileWriter * m_File;
+  uint64_t m_Start;
+  bool m_Runs;
+  std::vector<unsigned char> m_Pixels;
+  std::vector<unsigned char> m_Encoded;
+};
+
+struct TextureTraceRecord {
+  uint64_t time = 0; // ns since the start of the trace.
+  TextureRect rect = {0, 0, 0, 0};
+  bool bFullFrame = false;
+  std::vector<unsigned char> pixels; // rect's pixels, 4 * rect.width bytes per row.
+  size_t storedSize = 0; // Of the payload in the file.
+};
+
+class CTextureTraceReader {
+ public:
+  CTextureTraceReader() {}
+  ~CTextureTraceReader();
+
+  CTextureTraceReader(const CTextureTraceReader& rhs) = delete;
+  CTextureTraceReader& operator=(const CTextureTraceReader& rhs) = delete;
+
+  // Returns false if path can not be opened or is not a trace.
+  bool Open(const char * path);
+
+  int GetWidth() {
+    return m_Width;
+  }
+
+  int GetHeight() {
+    return m_Height;
+  }
+
+  // Returns false at the end, IsCorrupt tells if a record was cut short or
+  // did not decode.
+  bool Next(TextureTraceRecord & outRecord);
+
+  bool IsCorrupt() {
+    return m_Corrupt;
+  }
+
+ private:
+  FILE * m_File = nullptr;
+  int m_Width = 0;
+  int m_Height = 0;
+  bool m_Corrupt = false;
+  std::vector<unsigned char> m_Payload;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "texture_trace.h"
+#include "texture_uploader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Uploads frames on a dedicated thread, latest frame wins: frames still
+// waiting for the thread are replaced by a newer full frame, their dirty
+// rects are merged and the replaced frames complete right away as
+// "coalesced". Sub-images lack the pixels around them, a sub-image that
+// finds another one waiting is merged with it into a full sized composite
+// the queue owns. So at most a full frame and a sub-image wait.
+//
+// TToken identifies a frame and is handed back to TSink once the frame is
+// done, str is "free" / "waited" / "unchanged" (see TextureUploadResult_e)
+// or "coalesced":
+//   void TSink::Post(TToken && token, bool ok, std::string && str);
+template<class TToken, class TSink> class CTextureUploadQueue {
+ public:
+  CTextureUploadQueue(CTextureUploader & uploader, TSink & sink)
+  : m_Uploader(uploader), m_Sink(sink) {
+    m_Thread = std::thread(&CTextureUploadQueue::UploadThreadHandler, this);
+  }
+
+  // Uploads frames still pending, then stops the thread.
+  ~CTextureUploadQueue() {
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Quit = true;
+      m_Cv.notify_all();
+    }
+    m_Thread.join();
+  }
+
+  CTextureUploadQueue(const CTextureUploadQueue& rhs) = delete;
+  CTextureUploadQueue& operator=(const CTextureUploadQueue& rhs) = delete;
+
+  // Call before the first Submit, trace (not owned) then records every
+  // submitted frame on the upload thread, in submit order. Replaced frames
+  // are recorded before the frame replacing them and only then complete.
+  void SetTrace(CTextureTraceWriter * trace) {
+    m_Trace = trace;
+  }
+
+  // Parameters as for CTextureUploader::Upload, pSrc must stay valid and
+  // unchanged until token completed.
+  void Submit(TToken token, const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage = false) {
+    std::unique_ptr<Frame> frame(new Frame(std::move(token), rect, pSrc, srcRowPitch, bSubImage));
+    std::vector<std::unique_ptr<Frame>> replaced;
+    size_t coalesced;
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      if(!bSubImage) {
+        for(auto & pending : m_Pending) {
+          frame->rect = UnionTextureRect(pending->rect, frame->rect);
+          replaced.push_back(std::move(pending));
+        }
+        m_Pending.clear();
+      } else if(!m_Pending.empty() && m_Pending.back()->bSubImage) {
+        std::unique_ptr<Frame> & back = m_Pending.back();
+        if(!back->bComposite) {
+          m_Composite.resize(GetCompositeRowPitch() * m_Uploader.GetDevice()->GetHeight());
+          CopyToComposite(back->submittedRect, back->pSrc, back->srcRowPitch);
+          back->parts.assign(1, back->submittedRect);
+          back->bComposite = true;
+        }
+        CopyToComposite(rect, pSrc, srcRowPitch);
+        frame->parts = std::move(back->parts);
+        frame->parts.erase(std::remove_if(frame->parts.begin(), frame->parts.end(), [&rect](const TextureRect & part){
+          return TextureRectContains(rect, part);
+        }), frame->parts.end());
+        frame->parts.push_back(rect);
+        frame->bComposite = true;
+        frame->rect = UnionTextureRect(back->rect, rect);
+        replaced.push_back(std::move(back));
+        m_Pending.pop_back();
+      }
+      coalesced = replaced.size();
+      if(m_Trace) {
+        for(auto & replacedFrame : replaced) {
+          for(auto & earlier : replacedFrame->replaced) frame->replaced.push_back(std::move(earlier));
+          frame->replaced.push_back(std::move(replacedFrame));
+        }
+        replaced.clear();
+      }
+      m_Pending.push_back(std::move(frame));
+      m_Cv.notify_all();
+    }
+    m_Uploader.GetStats().coalesced.Add((int64_t)coalesced);
+    for(auto & replacedFrame : replaced) m_Sink.Post(std::move(replacedFrame->token), true, "coalesced");
+  }
+
+  // Blocks until no frame is pending or uploading, after that the uploader
+  // may be used by the calling thread until the next Submit.
+  void WaitIdle() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [this]{ return m_Pending.empty() && !m_Uploading; });
+  }
+
+ private:
+  struct Frame {
+    Frame(TToken && token, const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage)
+    : token(std::move(token)), rect(rect), submittedRect(rect), pSrc(pSrc), srcRowPitch(srcRowPitch)
+    , bSubImage(bSubImage), submitNanoseconds(StatNowNanoseconds()) {
+    }
+
+    TToken token;
+    TextureRect rect; // Grows with the rects of frames replaced.
+    TextureRect submittedRect;
+    const unsigned char * pSrc;
+    size_t srcRowPitch;
+    bool bSubImage;
+    uint64_t submitNanoseconds;
+    std::vector<std::unique_ptr<Frame>> replaced; // Only with m_Trace, in submit order.
+    bool bComposite = false; // Uploads parts of m_Composite instead of pSrc.
+    std::vector<TextureRect> parts;
+  };
+
+  CTextureUploader & m_Uploader;
+  TSink & m_Sink;
+  CTextureTraceWriter * m_Trace = nullptr;
+  std::thread m_Thread;
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::deque<std::unique_ptr<Frame>> m_Pending;
+  std::vector<unsigned char> m_Composite; // Of the waiting composite frame.
+  std::vector<unsigned char> m_CompositeUploading; // Only used by upload thread.
+  bool m_Uploading = false;
+  bool m_Quit = false;
+
+  void UploadThreadHandler() {
+    while(true) {
+      std::unique_ptr<Frame> frame;
+      {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Cv.wait(lock, [this]{ return m_Quit || !m_Pending.empty(); });
+        if(m_Pending.empty()) break;
+        frame = std::move(m_Pending.front());
+        m_Pending.pop_front();
+        if(frame->bComposite) m_CompositeUploading.swap(m_Composite);
+        m_Uploading = true;
+      }
+
+      TextureUploadResult_e result = frame->bComposite
+        ? m_Uploader.UploadParts(frame->parts, m_CompositeUploading.data(), GetCompositeRowPitch())
+        : m_Uploader.Upload(frame->rect, frame->pSrc, frame->srcRowPitch, frame->bSubImage);
+      m_Uploader.GetStats().latency.RecordSince(frame->submitNanoseconds);
+
+      // Still uploading, so it does not race with appends after WaitIdle.
+      if(m_Trace) {
+        for(auto & replacedFrame : frame->replaced) Trace(*replacedFrame);
+        Trace(*frame);
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Uploading = false;
+        m_Cv.notify_all();
+      }
+
+      for(auto & replacedFrame : frame->replaced) m_Sink.Post(std::move(replacedFrame->token), true, "coalesced");
+
+      switch(result) {
+      case TextureUpload_FreeSlot:
+        m_Sink.Post(std::move(frame->token), true, "free");
+        break;
+      case TextureUpload_Waited:
+        m_Sink.Post(std::move(frame->token), true, "waited");
+        break;
+      case TextureUpload_Unchanged:
+        m_Sink.Post(std::move(frame->token), true, "unchanged");
+        break;
+      default:
+        m_Sink.Post(std::move(frame->token), false, std::string());
+        break;
+      }
+    }
+  }
+
+  size_t GetCompositeRowPitch() {
+    return (size_t)4 * m_Uploader.GetDevice()->GetWidth();
+  }
+
+  // Requires m_Lock, pSrc holds rect's pixels.
+  void CopyToComposite(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch) {
+    size_t rowPitch = GetCompositeRowPitch();
+    for(int i = 0; i < rect.height; i++) {
+      memcpy(&m_Composite[(size_t)(rect.y + i) * rowPitch + (size_t)4 * rect.x], pSrc + (size_t)i * srcRowPitch, (size_t)4 * rect.width);
+    }
+  }
+
+  void Trace(const Frame & frame) {
+    m_Trace->Append(frame.submitNanoseconds, frame.submittedRect, frame.pSrc, frame.srcRowPitch, frame.bSubImage);
+  }
+};
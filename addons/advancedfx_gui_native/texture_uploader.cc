@@ -0,0 +1,142 @@
+#include "texture_uploader.h"
+
+#include <cstring>
+
+CTextureUploader::CTextureUploader(CTextureDevice * device)
+: m_Device(device) {
+  SetConversion(TextureFormat_Bgra8, false);
+}
+
+CTextureUploader::~CTextureUploader() {
+  delete m_FrameProducer;
+  delete m_DamageTracker;
+  delete m_Device;
+}
+
+void CTextureUploader::SetFrameSync(CTextureFrameHeader * pHeader, uint64_t maxWaitMicroseconds) {
+  delete m_FrameProducer;
+  m_FrameProducer = pHeader ? new CTextureFrameProducer(pHeader) : nullptr;
+  m_FrameMaxWaitMicroseconds = maxWaitMicroseconds;
+}
+
+void CTextureUploader::SetDamageTracking(int tileSize) {
+  delete m_DamageTracker;
+  m_DamageTracker = 0 < tileSize ? new CTextureDamageTracker(m_Device->GetWidth(), m_Device->GetHeight(), tileSize) : nullptr;
+}
+
+bool CTextureUploader::SetConversion(TexturePixelFormat_e srcFormat, bool bPremultiply) {
+  if(4 != GetTextureBytesPerPixel(srcFormat)) return false;
+  if(srcFormat == m_Device->GetFormat() && !bPremultiply) {
+    m_ConvertRow = nullptr;
+    return true;
+  }
+  TextureConvertRowFn convertRow = GetTextureConvertRow(srcFormat, m_Device->GetFormat(), bPremultiply);
+  if(nullptr == convertRow) return false;
+  m_ConvertRow = convertRow;
+  return true;
+}
+
+TextureUploadResult_e CTextureUploader::Upload(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage) {
+  uint64_t start = StatNowNanoseconds();
+  if(bSubImage) return Record(UploadRects(&rect, 1, pSrc, srcRowPitch, rect.x, rect.y, false), start);
+  return Record(UploadRects(&rect, 1, pSrc, srcRowPitch, 0, 0, true), start);
+}
+
+TextureUploadResult_e CTextureUploader::UploadParts(const std::vector<TextureRect> & rects, const unsigned char * pSrc, size_t srcRowPitch) {
+  uint64_t start = StatNowNanoseconds();
+  return Record(UploadRects(rects.data(), rects.size(), pSrc, srcRowPitch, 0, 0, false), start);
+}
+
+TextureUploadResult_e CTextureUploader::Record(TextureUploadResult_e result, uint64_t start) {
+  m_Stats.uploadTime.RecordSince(start);
+  m_Stats.uploads.Add(1);
+  if(TextureUpload_Waited == result) m_Stats.waited.Add(1);
+  else if(TextureUpload_Unchanged == result) m_Stats.unchanged.Add(1);
+  return result;
+}
+
+TextureUploadResult_e CTextureUploader::UploadRects(const TextureRect * pRects, size_t rectCount, const unsigned char * pSrc, size_t srcRowPitch, int srcX, int srcY, bool bFullFrame) {
+  m_Rects.clear();
+  for(size_t i = 0; i < rectCount; i++) {
+    const TextureRect & rect = pRects[i];
+    m_Stats.dirtyBytes.Add((int64_t)4 * rect.width * rect.height);
+    if(!m_DamageTracker) {
+      m_Rects.push_back(rect);
+    } else if(bFullFrame) {
+      m_DamageTracker->FindChanged(rect, pSrc, srcRowPitch, m_Rects);
+    } else {
+      const unsigned char * pRectSrc = pSrc + (size_t)(rect.y - srcY) * srcRowPitch + (size_t)4 * (rect.x - srcX);
+      m_DamageTracker->FindChangedPart(rect, pRectSrc, srcRowPitch, m_Rects);
+    }
+  }
+  if(m_Rects.empty()) return TextureUpload_Unchanged;
+
+  size_t count = m_Device->GetStagingCount();
+  size_t slot = m_NextSlot;
+  TextureMapping mapping;
+  TextureMapResult_e result = TextureMap_Busy;
+  uint64_t mapStart = StatNowNanoseconds();
+
+  // Take the first free slot in ring order, only block if there is none.
+  for(size_t i = 0; i < count && TextureMap_Busy == result; i++) {
+    slot = (m_NextSlot + i) % count;
+    result = m_Device->MapStaging(slot, false, mapping);
+  }
+
+  bool bWaited = false;
+  if(TextureMap_Busy == result) {
+    slot = m_NextSlot;
+    result = m_Device->MapStaging(slot, true, mapping);
+    bWaited = true;
+  }
+  m_Stats.mapTime.RecordSince(mapStart);
+
+  if(TextureMap_Ok != result) {
+    // The hashes claim pixels that never made it.
+    if(m_DamageTracker) m_DamageTracker->Invalidate();
+    return TextureUpload_Failed;
+  }
+
+  size_t dstBytesPerPixel = GetTextureBytesPerPixel(m_Device->GetFormat());
+  for(const TextureRect & part : m_Rects) {
+    for(int i = 0; i < part.height; i++) {
+      size_t y = (size_t)part.y + i;
+      unsigned char * pDstRow = mapping.pData + y * mapping.rowPitch + dstBytesPerPixel * part.x;
+      const unsigned char * pSrcRow = pSrc + (size_t)(part.y + i - srcY) * srcRowPitch + (size_t)4 * (part.x - srcX);
+      if(m_ConvertRow) m_ConvertRow(pSrcRow, pDstRow, part.width);
+      else memcpy(pDstRow, pSrcRow, (size_t)4 * part.width);
+    }
+    m_Stats.uploadedBytes.Add((int64_t)4 * part.width * part.height);
+  }
+
+  m_Device->UnmapStaging(slot);
+
+  if(m_FrameProducer) {
+    size_t buffer;
+    TextureFrameBuffer_e frameResult = m_FrameProducer->BeginFrame(m_FrameMaxWaitMicroseconds, buffer);
+    if(TextureFrameBuffer_Waited == frameResult) m_Stats.frameWaits.Add(1);
+    else if(TextureFrameBuffer_Forced == frameResult) m_Stats.frameForced.Add(1);
+
+    // Bring the buffer up to the latest frame where it is behind, then
+    // apply this one's changes on top.
+    size_t latest = m_FrameProducer->GetLatest();
+    if(SIZE_MAX != latest && latest != buffer) {
+      for(const TextureRect & stale : m_FrameProducer->GetStale(buffer)) m_Device->CopyBetweenShared(latest, buffer, stale);
+    }
+    for(const TextureRect & part : m_Rects) m_Device->CopyToShared(slot, part, buffer);
+
+    uint64_t finishStart = StatNowNanoseconds();
+    m_Device->Finish();
+    m_Stats.finishTime.RecordSince(finishStart);
+
+    m_FrameProducer->Publish(buffer, m_Rects);
+    m_Stats.frames.Add(1);
+  } else {
+    for(const TextureRect & part : m_Rects) m_Device->CopyToShared(slot, part, 0);
+    m_Device->Flush();
+  }
+
+  m_NextSlot = (slot + 1) % count;
+
+  return bWaited ? TextureUpload_Waited : TextureUpload_FreeSlot;
+}
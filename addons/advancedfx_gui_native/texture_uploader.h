@@ -0,0 +1,120 @@
+#pragma once
+
+#include "texture_convert.h"
+#include "texture_damage.h"
+#include "texture_frames.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <vector>
+
+enum TextureUploadResult_e {
+  TextureUpload_FreeSlot, // A staging slot was free right away.
+  TextureUpload_Waited, // All slots were busy, waited for the GPU.
+  TextureUpload_Unchanged, // Damage tracking found nothing changed.
+  TextureUpload_Failed
+};
+
+struct CTextureStats {
+  CStatCounter dirtyBytes; // Of dirty rects passed to Upload.
+  CStatCounter uploadedBytes; // Copied to staging slots.
+  CStatCounter uploads;
+  CStatCounter waited;
+  CStatCounter unchanged;
+  CStatCounter coalesced; // By CTextureUploadQueue.
+  CStatCounter frames; // Published with frame sync.
+  CStatCounter frameWaits; // Waited for the consumer to release a buffer.
+  CStatCounter frameForced; // Gave up waiting and wrote the claimed buffer.
+  CStatHistogram mapTime; // Mapping staging slots, including waits for the GPU.
+  CStatHistogram uploadTime; // Of Upload.
+  CStatHistogram latency; // From handing over a frame until it is done.
+  CStatHistogram finishTime; // Waiting for the GPU before publishing a frame.
+
+  void Reset() {
+    dirtyBytes.Reset();
+    uploadedBytes.Reset();
+    uploads.Reset();
+    waited.Reset();
+    unchanged.Reset();
+    coalesced.Reset();
+    frames.Reset();
+    frameWaits.Reset();
+    frameForced.Reset();
+    mapTime.Reset();
+    uploadTime.Reset();
+    latency.Reset();
+    finishTime.Reset();
+  }
+};
+
+// Spreads uploads round-robin over the device's staging slots, so the CPU
+// can fill one slot while the GPU still copies from the others.
+class CTextureUploader {
+ public:
+  // Takes ownership of device.
+  explicit CTextureUploader(CTextureDevice * device);
+  ~CTextureUploader();
+
+  CTextureUploader(const CTextureUploader& rhs) = delete;
+  CTextureUploader& operator=(const CTextureUploader& rhs) = delete;
+
+  CTextureDevice * GetDevice() {
+    return m_Device;
+  }
+
+  // Hands the device over to the caller, the uploader can only be deleted
+  // afterwards.
+  CTextureDevice * DetachDevice() {
+    CTextureDevice * device = m_Device;
+    m_Device = nullptr;
+    return device;
+  }
+
+  // With tileSize > 0 only tiles of the dirty rect whose pixels differ from
+  // the last upload are uploaded, 0 uploads dirty rects as they are.
+  void SetDamageTracking(int tileSize);
+
+  // With pHeader (initialized for the device, 2 or more buffers) every
+  // upload writes a buffer the consumer does not read, waits for the GPU
+  // and publishes it there, see texture_frames.h. Waits at most
+  // maxWaitMicroseconds for the consumer to release a buffer. nullptr
+  // writes buffer 0 in place. pHeader must outlive the uploader.
+  void SetFrameSync(CTextureFrameHeader * pHeader, uint64_t maxWaitMicroseconds = 50000);
+
+  // Frames passed to Upload are in srcFormat (TextureFormat_Bgra8 by
+  // default) and converted to the device's format, with bPremultiply straight
+  // alpha is premultiplied. Returns false if the conversion is not supported.
+  bool SetConversion(TexturePixelFormat_e srcFormat, bool bPremultiply);
+
+  // Uploads rect of pSrc, a full sized frame with 4 byte pixels and
+  // srcRowPitch bytes per row, to the same place in the shared texture.
+  // With bSubImage pSrc only holds rect's pixels instead, starting with its
+  // top left one; damage tracking then only skips tiles that lie fully
+  // inside rect. rect must be in bounds.
+  TextureUploadResult_e Upload(const TextureRect & rect, const unsigned char * pSrc, size_t srcRowPitch, bool bSubImage = false);
+
+  // Uploads rects of pSrc in one go, a full sized frame of which only the
+  // pixels inside rects are valid (sub-images merged by CTextureUploadQueue).
+  TextureUploadResult_e UploadParts(const std::vector<TextureRect> & rects, const unsigned char * pSrc, size_t srcRowPitch);
+
+  // Any thread.
+  CTextureStats & GetStats() {
+    return m_Stats;
+  }
+
+ private:
+  CTextureDevice * m_Device;
+  size_t m_NextSlot = 0;
+  CTextureDamageTracker * m_DamageTracker = nullptr;
+  TextureConvertRowFn m_ConvertRow = nullptr; // nullptr copies as is.
+  CTextureFrameProducer * m_FrameProducer = nullptr;
+  uint64_t m_FrameMaxWaitMicroseconds = 0;
+  std::vector<TextureRect> m_Rects;
+  CTextureStats m_Stats;
+
+  // The pixel at (x, y) is at pSrc + (y - srcY) * srcRowPitch + 4 * (x - srcX),
+  // bFullFrame if pSrc holds all of the frame's pixels.
+  TextureUploadResult_e UploadRects(const TextureRect * pRects, size_t rectCount, const unsigned char * pSrc, size_t srcRowPitch, int srcX, int srcY, bool bFullFrame);
+
+  TextureUploadResult_e Record(TextureUploadResult_e result, uint64_t start);
+};
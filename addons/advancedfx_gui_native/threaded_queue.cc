@@ -0,0 +1,134 @@
+#include "threaded_queue.h"
+
+CThreadedQueue::CThreadedQueue(int spinCount)
+: m_SpinCount(spinCount) {
+  for(size_t i = 0; i < m_Capacity; i++) m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+  m_Thread = std::thread(&CThreadedQueue::QueueThreadHandler, this);
+}
+
+CThreadedQueue::~CThreadedQueue() {
+  Join();
+}
+
+void CThreadedQueue::SignalQuit() {
+  m_Quit.store(true, std::memory_order_release);
+  std::unique_lock<std::mutex> lock(m_Lock);
+  m_Sleeping.store(false, std::memory_order_relaxed);
+  m_Cv.notify_one();
+}
+
+bool CThreadedQueue::HasQuit() {
+  return m_HasQuit;
+}
+
+void CThreadedQueue::Join() {
+  if (m_Thread.joinable()) {
+    m_Thread.join();
+  }
+}
+
+void CThreadedQueue::Queue(CThreadedTask && task) {
+  if(m_Overflowing.load(std::memory_order_acquire) || !TryPush(task)) {
+    std::unique_lock<std::mutex> lock(m_OverflowLock);
+    m_Overflow.push_back(std::move(task));
+    m_Overflowing.store(true, std::memory_order_release);
+  }
+  Wake();
+}
+
+bool CThreadedQueue::TryPush(CThreadedTask & task) {
+  size_t pos = m_Tail.load(std::memory_order_relaxed);
+  while(true) {
+    Slot & slot = m_Slots[pos & (m_Capacity - 1)];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if(sequence == pos) {
+      if(m_Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        slot.task = std::move(task);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if(sequence < pos) {
+      return false; // Full, the worker did not free the slot yet.
+    } else {
+      pos = m_Tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool CThreadedQueue::RunNext() {
+  Slot & slot = m_Slots[m_Head & (m_Capacity - 1)];
+  if(slot.sequence.load(std::memory_order_acquire) != m_Head + 1) return false;
+
+  // Free the slot before running, the task may block for long.
+  CThreadedTask task(std::move(slot.task));
+  slot.sequence.store(m_Head + m_Capacity, std::memory_order_release);
+  ++m_Head;
+
+  task();
+  return true;
+}
+
+bool CThreadedQueue::HasWork() {
+  return m_Overflowing.load(std::memory_order_acquire)
+    || m_Slots[m_Head & (m_Capacity - 1)].sequence.load(std::memory_order_acquire) == m_Head + 1;
+}
+
+void CThreadedQueue::Wake() {
+  // Pairs with the fence in QueueThreadHandler: either the worker sees the
+  // task or we see it sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(m_Sleeping.load(std::memory_order_relaxed)) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Sleeping.store(false, std::memory_order_relaxed);
+    m_Cv.notify_one();
+  }
+}
+
+void CThreadedQueue::QueueThreadHandler(void) {
+  std::deque<CThreadedTask> overflow;
+
+  while(true) {
+    if(m_Overflowing.load(std::memory_order_acquire)) {
+      size_t end;
+      {
+        std::unique_lock<std::mutex> lock(m_OverflowLock);
+        overflow.swap(m_Overflow);
+        end = m_Tail.load(std::memory_order_relaxed);
+        m_Overflowing.store(false, std::memory_order_release);
+      }
+      // Tickets claimed before the overflow was taken are older than (or
+      // concurrent with) it, run them first. They may still be publishing.
+      while(m_Head != end) {
+        if(!RunNext()) std::this_thread::yield();
+      }
+      for(CThreadedTask & task : overflow) task();
+      overflow.clear();
+      continue;
+    }
+
+    size_t count = 0;
+    while(count < m_BatchSize && RunNext()) ++count;
+    if(0 < count) continue;
+
+    for(int i = 0; i < m_SpinCount && !HasWork(); i++) std::this_thread::yield();
+    if(HasWork()) continue;
+
+    if(m_Quit.load(std::memory_order_acquire)) {
+      if(HasWork()) continue;
+      break;
+    }
+
+    m_Sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(HasWork() || m_Quit.load(std::memory_order_relaxed)) {
+      m_Sleeping.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [this] { return !m_Sleeping.load(std::memory_order_relaxed) || m_Quit.load(std::memory_order_relaxed); });
+    m_Sleeping.store(false, std::memory_order_relaxed);
+  }
+
+  m_HasQuit = true;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable. Callables of up to InlineSize bytes are stored
+// in place, only bigger ones are allocated.
+class CThreadedTask {
+ public:
+  static const size_t InlineSize = 112;
+
+  CThreadedTask() {}
+
+  template<class Fn, class = typename std::enable_if<!std::is_same<typename std::decay<Fn>::type, CThreadedTask>::value>::type>
+  CThreadedTask(Fn && fn) {
+    typedef typename std::decay<Fn>::type Fn_t;
+    Init<Fn_t>(std::forward<Fn>(fn), std::integral_constant<bool,
+      sizeof(Fn_t) <= InlineSize && alignof(Fn_t) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<Fn_t>::value>());
+  }
+
+  CThreadedTask(CThreadedTask && rhs) noexcept {
+    MoveFrom(rhs);
+  }
+
+  CThreadedTask& operator=(CThreadedTask && rhs) noexcept {
+    if(this != &rhs) {
+      Reset();
+      MoveFrom(rhs);
+    }
+    return *this;
+  }
+
+  ~CThreadedTask() {
+    Reset();
+  }
+
+  CThreadedTask(const CThreadedTask& rhs) = delete;
+  CThreadedTask& operator=(const CThreadedTask& rhs) = delete;
+
+  explicit operator bool() const {
+    return nullptr != m_Ops;
+  }
+
+  void operator()() {
+    m_Ops->invoke(m_Storage);
+  }
+
+  void Reset() {
+    if(m_Ops) {
+      m_Ops->destroy(m_Storage);
+      m_Ops = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void * pStorage);
+    void (*move)(void * pDst, void * pSrc); // Also destroys pSrc.
+    void (*destroy)(void * pStorage);
+  };
+
+  template<class Fn_t> struct InlineOps {
+    static void Invoke(void * pStorage) {
+      (*static_cast<Fn_t *>(pStorage))();
+    }
+    static void Move(void * pDst, void * pSrc) {
+      new (pDst) Fn_t(std::move(*static_cast<Fn_t *>(pSrc)));
+      static_cast<Fn_t *>(pSrc)->~Fn_t();
+    }
+    static void Destroy(void * pStorage) {
+      static_cast<Fn_t *>(pStorage)->~Fn_t();
+    }
+    static const Ops ops;
+  };
+
+  template<class Fn_t> struct HeapOps {
+    static void Invoke(void * pStorage) {
+      (**static_cast<Fn_t **>(pStorage))();
+    }
+    static void Move(void * pDst, void * pSrc) {
+      *static_cast<Fn_t **>(pDst) = *static_cast<Fn_t **>(pSrc);
+    }
+    static void Destroy(void * pStorage) {
+      delete *static_cast<Fn_t **>(pStorage);
+    }
+    static const Ops ops;
+  };
+
+  alignas(std::max_align_t) unsigned char m_Storage[InlineSize];
+  const Ops * m_Ops = nullptr;
+
+  template<class Fn_t, class Fn> void Init(Fn && fn, std::true_type) {
+    new (m_Storage) Fn_t(std::forward<Fn>(fn));
+    m_Ops = &InlineOps<Fn_t>::ops;
+  }
+
+  template<class Fn_t, class Fn> void Init(Fn && fn, std::false_type) {
+    *reinterpret_cast<Fn_t **>(m_Storage) = new Fn_t(std::forward<Fn>(fn));
+    m_Ops = &HeapOps<Fn_t>::ops;
+  }
+
+  void MoveFrom(CThreadedTask & rhs) {
+    if(rhs.m_Ops) {
+      rhs.m_Ops->move(m_Storage, rhs.m_Storage);
+      m_Ops = rhs.m_Ops;
+      rhs.m_Ops = nullptr;
+    }
+  }
+};
+
+template<class Fn_t> const CThreadedTask::Ops CThreadedTask::InlineOps<Fn_t>::ops = {&Invoke, &Move, &Destroy};
+template<class Fn_t> const CThreadedTask::Ops CThreadedTask::HeapOps<Fn_t>::ops = {&Invoke, &Move, &Destroy};
+
+// Runs queued tasks on a worker thread. Producers claim slots of a bounded
+// ring with a ticket (compare and swap on the tail) and only take a lock
+// when the ring is full, then tasks go to an overflow list until the worker
+// caught up. The worker runs whatever is ready back-to-back, spins a little
+// when it runs dry and only then parks; producers only touch the lock to
+// wake a parked worker.
+class CThreadedQueue {
+ public:
+  static const int DefaultSpinCount = 64;
+
+  // spinCount 0 parks right away, for background work where latency does
+  // not matter and spinning would only take the CPU from other threads.
+  explicit CThreadedQueue(int spinCount = DefaultSpinCount);
+  ~CThreadedQueue();
+
+  // Tasks queued before still run.
+  void SignalQuit();
+  bool HasQuit();
+  void Join();
+
+  // Any thread, tasks queued by one thread run in order.
+  void Queue(CThreadedTask && task);
+
+  CThreadedQueue(const CThreadedQueue& rhs) = delete;
+  CThreadedQueue& operator=(const CThreadedQueue& rhs) = delete;
+  CThreadedQueue(CThreadedQueue&& rhs) = delete;
+  CThreadedQueue& operator=(CThreadedQueue&& rhs) = delete;
+
+  std::thread::native_handle_type GetNativeThreadHandle(){
+    return m_Thread.native_handle();
+  }
+
+ private:
+  static const size_t m_Capacity = 256; // Power of two.
+  static const size_t m_BatchSize = 64; // Tasks between overflow checks.
+  const int m_SpinCount;
+
+  // sequence is the ticket that may claim the slot next, ticket + 1 once
+  // that published its task.
+  struct alignas(64) Slot {
+    std::atomic<size_t> sequence;
+    CThreadedTask task;
+  };
+
+  Slot m_Slots[m_Capacity];
+  alignas(64) std::atomic<size_t> m_Tail{0};
+  alignas(64) size_t m_Head = 0; // Only used by the worker.
+
+  std::mutex m_OverflowLock;
+  std::deque<CThreadedTask> m_Overflow;
+  std::atomic_bool m_Overflowing{false};
+
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::atomic_bool m_Sleeping{false};
+  std::atomic_bool m_Quit{false};
+  std::atomic_bool m_HasQuit{false};
+  std::thread m_Thread;
+
+  bool TryPush(CThreadedTask & task);
+  bool RunNext();
+  bool HasWork();
+  void Wake();
+
+  void QueueThreadHandler(void);
+};
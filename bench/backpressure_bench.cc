@@ -0,0 +1,77 @@
+#include "bench.h"
+
+#include "bounded_queue.h"
+
+#include <cstdint>
+
+namespace {
+
+struct InputEvent {
+  uint64_t time; // Microseconds.
+  bool isMove;
+};
+
+// Simulated time: input arrives every intervalUs, every 50th event is a
+// click, the rest are mouse moves. Handling one takes serviceUs, so the
+// consumer falls behind and the policy decides what waits.
+void Flood(const char * name, BoundedQueuePolicy_e policy, size_t limit) {
+  const size_t count = 200000;
+  const uint64_t intervalUs = 125; // 8 kHz mouse.
+  const uint64_t serviceUs = 500;
+
+  CStatCounter dropped;
+  CStatCounter merged;
+  CBoundedQueue<InputEvent> queue;
+  queue.Configure(policy, limit, &dropped, &merged);
+
+  std::vector<double> latencies;
+  size_t clicksSent = 0;
+  size_t clicksDelivered = 0;
+  size_t maxSize = 0;
+  uint64_t stalledUs = 0;
+  uint64_t producerTime = 0;
+  uint64_t consumerFree = 0;
+  size_t sent = 0;
+  bool bBlocked = false;
+
+  while(sent < count || !queue.IsEmpty()) {
+    if(sent < count && !bBlocked && (queue.IsEmpty() || producerTime <= consumerFree)) {
+      bool bMove = 0 != sent % 50;
+      if(!bMove) ++clicksSent;
+      bBlocked = !queue.Push(InputEvent{producerTime, bMove}, bMove ? 1 : 0, [](InputEvent && event, bool bMerged){});
+      maxSize = std::max(maxSize, queue.GetSize());
+      ++sent;
+      producerTime += intervalUs;
+    } else {
+      InputEvent event = queue.PopFront();
+      uint64_t start = std::max(consumerFree, event.time);
+      latencies.push_back((double)(start - event.time));
+      if(!event.isMove) ++clicksDelivered;
+      consumerFree = start + serviceUs;
+      if(bBlocked && queue.GetSize() <= limit) {
+        // The producer waited for this one to be taken.
+        bBlocked = false;
+        if(producerTime < start) {
+          stalledUs += start - producerTime;
+          producerTime = start;
+        }
+      }
+    }
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50) / 1000;
+  double p99 = BenchPercentile(latencies, 0.99) / 1000;
+
+  printf("  %-12s limit %3zu: %7zu handled %7lld dropped %7lld merged %4zu clicks lost  max queue %6zu  p50 %8.1f ms  p99 %8.1f ms  producer stalled %8.1f ms\n",
+    name, limit, latencies.size(), (long long)dropped.Get(), (long long)merged.Get(), clicksSent - clicksDelivered,
+    maxSize, p50, p99, stalledUs / 1000.0);
+}
+
+} // namespace
+
+void RunBackpressureBench(void) {
+  Flood("unbounded", BoundedQueuePolicy_Block, 0);
+  Flood("block", BoundedQueuePolicy_Block, 64);
+  Flood("dropOldest", BoundedQueuePolicy_DropOldest, 64);
+  Flood("coalesce", BoundedQueuePolicy_Coalesce, 64);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock_t;
+
+inline double BenchSeconds(BenchClock_t::time_point start, BenchClock_t::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Latencies are in microseconds, p is in [0,1].
+inline double BenchPercentile(std::vector<double> & samples, double p) {
+  if(samples.empty()) return 0;
+  size_t index = std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+inline std::string BenchFormatSize(size_t size) {
+  if(size >= 1024 * 1024) return std::to_string(size / (1024 * 1024)) + " MiB";
+  if(size >= 1024) return std::to_string(size / 1024) + " KiB";
+  return std::to_string(size) + " B";
+}
+
+// Picks an iteration count so a run moves about budgetBytes.
+inline size_t BenchIterations(size_t messageSize, size_t budgetBytes, size_t minIterations, size_t maxIterations) {
+  return std::max(minIterations, std::min(maxIterations, budgetBytes / std::max((size_t)1, messageSize)));
+}
+
+struct BenchSuite {
+  const char * name;
+  void (*run)(void);
+};
+
+void RunPipeBench(void);
+void RunJsonRpcBench(void);
+void RunRpcBench(void);
+void RunShmBench(void);
+void RunTextureBench(void);
+void RunDamageBench(void);
+void RunConvertBench(void);
+void RunQueueBench(void);
+void RunReactorBench(void);
+void RunBackpressureBench(void);
+void RunReplayBench(void);
+void RunTraceBench(void);
+void RunPoolBench(void);
+void RunFramesBench(void);
+void RunBuffersBench(void);
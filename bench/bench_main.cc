@@ -0,0 +1,56 @@
+// Native benchmarks for the platform neutral parts of advancedfx_gui_native.
+// Usage: advancedfx_gui_bench [suite ...]
+
+#include "bench.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+static const BenchSuite g_Suites[] = {
+  {"pipe", &RunPipeBench},
+  {"jsonrpc", &RunJsonRpcBench},
+  {"rpc", &RunRpcBench},
+  {"shm", &RunShmBench},
+  {"texture", &RunTextureBench},
+  {"damage", &RunDamageBench},
+  {"convert", &RunConvertBench},
+  {"queue", &RunQueueBench},
+  {"reactor", &RunReactorBench},
+  {"backpressure", &RunBackpressureBench},
+  {"replay", &RunReplayBench},
+  {"trace", &RunTraceBench},
+  {"pool", &RunPoolBench},
+  {"frames", &RunFramesBench},
+  {"buffers", &RunBuffersBench},
+};
+
+int main(int argc, char ** argv) {
+#ifndef _WIN32
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  bool bRanAny = false;
+  for(const BenchSuite & suite : g_Suites) {
+    bool bSelected = argc < 2;
+    for(int i = 1; i < argc; i++) {
+      if(0 == strcmp(argv[i], suite.name)) bSelected = true;
+    }
+    if(!bSelected) continue;
+
+    printf("== %s ==\n", suite.name);
+    suite.run();
+    bRanAny = true;
+  }
+
+  if(!bRanAny) {
+    fprintf(stderr, "Unknown suite. Available:");
+    for(const BenchSuite & suite : g_Suites) fprintf(stderr, " %s", suite.name);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include "bench.h"
+
+#include "pipe_core.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+
+// Counts heap allocations of the whole bench, so a pass can tell how many
+// the pipe made per message.
+static std::atomic<uint64_t> g_Allocations{0};
+
+void * operator new(size_t size) {
+  g_Allocations.fetch_add(1, std::memory_order_relaxed);
+  if(void * p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+  free(p);
+}
+
+void operator delete(void * p, size_t size) noexcept {
+  free(p);
+}
+
+namespace {
+
+struct BenchToken {
+  bool isRead;
+};
+
+// Stands in for the addon's completion channel: strings are copied once
+// more like Napi::String::New does, buffers are handed over like external
+// Buffers and returned to the pool right away, as if collected.
+class CBufferSink {
+ public:
+  void Post(BenchToken && token, bool ok) {
+    Complete(token, ok);
+  }
+
+  void Post(BenchToken && token, bool ok, std::string && str) {
+    m_JsHeap.assign(str.begin(), str.end());
+    m_JsCopied += str.size();
+    Complete(token, ok);
+  }
+
+  void Post(BenchToken && token, bool ok, CPipeBuffer && buffer) {
+    if(ok && m_bBufferAsString) {
+      m_JsHeap.assign(buffer.GetData(), buffer.GetData() + buffer.GetSize());
+      m_JsCopied += buffer.GetSize();
+    }
+    buffer.Reset();
+    Complete(token, ok);
+  }
+
+  void PostFrames(std::vector<std::string> && frames) {
+  }
+
+  bool Wait(size_t reads, size_t writes) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [&]{ return m_Failed || (reads <= m_Reads && writes <= m_Writes); });
+    return !m_Failed;
+  }
+
+  // Resolve buffers as String, like readString.
+  bool m_bBufferAsString = false;
+
+  // Only touched by the completing thread.
+  uint64_t m_JsCopied = 0;
+
+ private:
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::vector<unsigned char> m_JsHeap;
+  size_t m_Reads = 0;
+  size_t m_Writes = 0;
+  bool m_Failed = false;
+
+  void Complete(const BenchToken & token, bool ok) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(!ok) m_Failed = true;
+    if(token.isRead) ++m_Reads;
+    else ++m_Writes;
+    m_Cv.notify_all();
+  }
+};
+
+typedef CPipeCore<BenchToken, CBufferSink> BenchPipe_t;
+
+enum ReadPath_e {
+  ReadPath_String, // readString before: std::string, then the JS string.
+  ReadPath_BufferAsString, // readString now: pooled buffer, then the JS string.
+  ReadPath_Buffer // readBuffer: pooled buffer handed to JS.
+};
+
+const char * ReadPathName(ReadPath_e path) {
+  switch(path) {
+  case ReadPath_String:
+    return "std::string   ";
+  case ReadPath_BufferAsString:
+    return "pool->String  ";
+  case ReadPath_Buffer:
+    return "pool->Buffer  ";
+  }
+  return "";
+}
+
+// Another thread writes frames of messageSize into the pipe, the pipe reads
+// them with up to window reads outstanding.
+void Receive(size_t messageSize, ReadPath_e path) {
+  size_t iterations = BenchIterations(messageSize, 256 * 1024 * 1024, 16, 100000);
+  const size_t window = 64;
+
+  CBufferSink sink;
+  sink.m_bBufferAsString = ReadPath_BufferAsString == path;
+  BenchPipe_t pipe(CPipeTransport::Create(), sink);
+  CPipeTransport * transport = pipe.GetTransport();
+
+  std::vector<unsigned char> frame;
+  std::string message(messageSize, 'x');
+  AppendPipeFrame(frame, message.data(), (PipeFrameLength_t)message.size());
+
+  uint64_t allocationsStart = g_Allocations.load();
+  auto start = BenchClock_t::now();
+
+  std::thread writer([&]{
+    for(size_t i = 0; i < iterations; i++) {
+      if(!transport->WriteBytes(frame.data(), frame.size())) return;
+    }
+  });
+
+  bool bOk = true;
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    if(window <= i) bOk = sink.Wait(i - window + 1, 0);
+    if(ReadPath_String == path) pipe.ReadString({true});
+    else pipe.ReadBuffer({true});
+  }
+  bOk = bOk && sink.Wait(iterations, 0);
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+  writer.join();
+
+  if(!bOk) {
+    printf("  receive %s %8s: FAILED\n", ReadPathName(path), BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  CPipeBufferPoolStats & poolStats = pipe.GetBufferPoolStats();
+  uint64_t allocations = g_Allocations.load() - allocationsStart + (uint64_t)poolStats.allocations.Get();
+  uint64_t copied = (uint64_t)pipe.GetStats().bytesCopied.Get() + sink.m_JsCopied;
+
+  printf("  receive %s %8s: %10.0f msg/s %8.1f MB/s %8.3f allocs/msg %6.2f copies/msg  pool %8s\n", ReadPathName(path),
+    BenchFormatSize(messageSize).c_str(), iterations / seconds, (double)iterations * messageSize / seconds / 1e6,
+    (double)allocations / iterations, (double)copied / ((double)iterations * messageSize),
+    BenchFormatSize((size_t)poolStats.allocatedBytes.Get()).c_str());
+}
+
+// The pipe writes frames of messageSize, copied into its write buffer like
+// writeString or from where they are like writeBuffer.
+void Send(size_t messageSize, bool bExternal) {
+  size_t iterations = BenchIterations(messageSize, 256 * 1024 * 1024, 16, 100000);
+  const size_t window = 64;
+
+  CBufferSink sink;
+  BenchPipe_t pipe(CPipeTransport::Create(), sink);
+  CPipeTransport * transport = pipe.GetTransport();
+
+  std::string message(messageSize, 'x');
+  bool bReaderOk = true;
+
+  std::thread reader([&]{
+    CPipeFrameReader frameReader(*transport);
+    std::string inStr(messageSize, '\0');
+    for(size_t i = 0; i < iterations && bReaderOk; i++) {
+      bReaderOk = frameReader.ReadFrame(inStr) && inStr.size() == messageSize;
+    }
+  });
+
+  uint64_t allocationsStart = g_Allocations.load();
+  auto start = BenchClock_t::now();
+
+  bool bOk = true;
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    if(window <= i) bOk = sink.Wait(0, i - window + 1);
+    if(bExternal) pipe.WriteExternal({false}, message.data(), message.size(), true);
+    else pipe.WriteString({false}, message);
+  }
+  bOk = bOk && sink.Wait(0, iterations);
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+  uint64_t allocations = g_Allocations.load() - allocationsStart;
+  reader.join();
+
+  if(!bOk || !bReaderOk) {
+    printf("  send    %s %8s: FAILED\n", bExternal ? "external      " : "copied        ", BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  printf("  send    %s %8s: %10.0f msg/s %8.1f MB/s %8.3f allocs/msg\n", bExternal ? "external      " : "copied        ",
+    BenchFormatSize(messageSize).c_str(), iterations / seconds, (double)iterations * messageSize / seconds / 1e6,
+    (double)allocations / iterations);
+}
+
+} // namespace
+
+void RunBuffersBench(void) {
+  const size_t sizes[] = {1024, 64 * 1024, 4 * 1024 * 1024};
+  for(size_t size : sizes) {
+    Receive(size, ReadPath_String);
+    Receive(size, ReadPath_BufferAsString);
+    Receive(size, ReadPath_Buffer);
+  }
+  for(size_t size : sizes) {
+    Send(size, false);
+    Send(size, true);
+  }
+}
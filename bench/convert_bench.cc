@@ -0,0 +1,87 @@
+#include "bench.h"
+
+#include "texture_convert.h"
+
+#include <cstring>
+
+namespace {
+
+const int FrameWidth = 1920;
+const int FrameHeight = 1080;
+
+const char * FormatName(TexturePixelFormat_e format) {
+  switch(format) {
+  case TextureFormat_Bgra8:
+    return "bgra8";
+  case TextureFormat_Rgba8:
+    return "rgba8";
+  case TextureFormat_Rgb10A2:
+    return "rgb10a2";
+  default:
+    return "rgba16";
+  }
+}
+
+void Convert(TextureConvertRowFn convertRow, const std::vector<unsigned char> & src, std::vector<unsigned char> & dst, int width, size_t dstBytesPerPixel) {
+  for(int y = 0; y < FrameHeight; y++) {
+    convertRow(&src[(size_t)4 * width * y], &dst[dstBytesPerPixel * width * y], width);
+  }
+}
+
+// Source GB/s of one kernel, negative if its output differs from the scalar
+// reference (checked with an odd width, so the row tails are covered).
+double Kernel(TexturePixelFormat_e srcFormat, TexturePixelFormat_e dstFormat, bool bPremultiply, TextureIsa_e isa, const std::vector<unsigned char> & src) {
+  TextureConvertRowFn convertRow = GetTextureConvertRow(srcFormat, dstFormat, bPremultiply, isa);
+  TextureConvertRowFn referenceRow = GetTextureConvertRow(srcFormat, dstFormat, bPremultiply, TextureIsa_Scalar);
+  size_t dstBytesPerPixel = GetTextureBytesPerPixel(dstFormat);
+
+  std::vector<unsigned char> dst(dstBytesPerPixel * FrameWidth * FrameHeight);
+  std::vector<unsigned char> reference(dst.size());
+  Convert(convertRow, src, dst, FrameWidth - 3, dstBytesPerPixel);
+  Convert(referenceRow, src, reference, FrameWidth - 3, dstBytesPerPixel);
+  if(0 != memcmp(dst.data(), reference.data(), dst.size())) return -1;
+
+  const size_t iterations = 20;
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations; i++) {
+    Convert(convertRow, src, dst, FrameWidth, dstBytesPerPixel);
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  return iterations * src.size() / seconds / 1e9;
+}
+
+} // namespace
+
+void RunConvertBench(void) {
+  std::vector<unsigned char> src((size_t)4 * FrameWidth * FrameHeight);
+  uint32_t seed = 3;
+  for(size_t i = 0; i < src.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    src[i] = (unsigned char)(seed >> 24);
+  }
+
+  std::vector<TextureIsa_e> isas;
+  for(TextureIsa_e isa : {TextureIsa_Scalar, TextureIsa_Sse2, TextureIsa_Avx2, TextureIsa_Neon}) {
+    if(GetTextureConvertRow(TextureFormat_Bgra8, TextureFormat_Rgba8, false, isa)) isas.push_back(isa);
+  }
+
+  printf("  best: %s, source GB/s:\n  %-30s", GetTextureIsaName(GetBestTextureIsa()), "");
+  for(TextureIsa_e isa : isas) printf(" %8s", GetTextureIsaName(isa));
+  printf("\n");
+
+  for(TexturePixelFormat_e srcFormat : {TextureFormat_Bgra8, TextureFormat_Rgba8}) {
+    for(TexturePixelFormat_e dstFormat : {TextureFormat_Bgra8, TextureFormat_Rgba8, TextureFormat_Rgb10A2, TextureFormat_Rgba16}) {
+      for(bool bPremultiply : {false, true}) {
+        std::string name = std::string(FormatName(srcFormat)) + " -> " + FormatName(dstFormat) + (bPremultiply ? " premul" : "");
+        printf("  %-30s", name.c_str());
+        for(TextureIsa_e isa : isas) {
+          double gbs = Kernel(srcFormat, dstFormat, bPremultiply, isa, src);
+          if(gbs < 0) printf(" MISMATCH");
+          else printf(" %8.2f", gbs);
+        }
+        printf("\n");
+      }
+    }
+  }
+}
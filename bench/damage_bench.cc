@@ -0,0 +1,107 @@
+#include "bench.h"
+
+#include "texture_uploader.h"
+
+#include <cstring>
+
+namespace {
+
+const int FrameWidth = 1920;
+const int FrameHeight = 1080;
+
+void FillNoise(std::vector<unsigned char> & pixels, uint32_t seed) {
+  for(size_t i = 0; i < pixels.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    pixels[i] = (unsigned char)(seed >> 24);
+  }
+}
+
+void Paint(std::vector<unsigned char> & frame, const TextureRect & rect, unsigned char value) {
+  for(int y = rect.y; y < rect.y + rect.height; y++) {
+    memset(&frame[((size_t)y * FrameWidth + rect.x) * 4], value, (size_t)4 * rect.width);
+  }
+}
+
+void HashKernel(const char * name, uint64_t (*hash)(const unsigned char *, size_t, int, int), const std::vector<unsigned char> & frame, uint64_t & outHash) {
+  const size_t iterations = 50;
+  const int tileSize = 64;
+
+  uint64_t sum = 0;
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations; i++) {
+    for(int y = 0; y < FrameHeight; y += tileSize) {
+      for(int x = 0; x < FrameWidth; x += tileSize) {
+        sum += hash(&frame[((size_t)y * FrameWidth + x) * 4], (size_t)4 * FrameWidth,
+          std::min(tileSize, FrameWidth - x), std::min(tileSize, FrameHeight - y));
+      }
+    }
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  printf("  hash %-6s: %6.2f GB/s\n", name, iterations * frame.size() / seconds / 1e9);
+  outHash = sum;
+}
+
+// A mostly static HUD: Chromium reports the whole frame dirty, but only a
+// clock changes every frame and a panel every 30th frame. tileSize 0 is
+// without damage tracking.
+void Hud(int tileSize) {
+  const size_t iterations = 300;
+
+  CTextureUploader uploader(CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 3, 300, 4000));
+  uploader.SetDamageTracking(tileSize);
+
+  std::vector<unsigned char> frame((size_t)4 * FrameWidth * FrameHeight);
+  FillNoise(frame, 1);
+
+  TextureRect full{0, 0, FrameWidth, FrameHeight};
+  TextureRect clock{1700, 40, 160, 32};
+  TextureRect panel{100, 600, 400, 300};
+  size_t unchanged = 0;
+  size_t failed = 0;
+
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations; i++) {
+    Paint(frame, clock, (unsigned char)i);
+    if(0 == i % 30) Paint(frame, panel, (unsigned char)(i / 30));
+
+    switch(uploader.Upload(full, frame.data(), (size_t)4 * FrameWidth)) {
+    case TextureUpload_Unchanged:
+      ++unchanged;
+      break;
+    case TextureUpload_Failed:
+      ++failed;
+      break;
+    default:
+      break;
+    }
+  }
+  const unsigned char * pShared = static_cast<CTextureDeviceCpu *>(uploader.GetDevice())->GetSharedPixels();
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(failed || 0 != memcmp(pShared, frame.data(), frame.size())) {
+    printf("  hud tiles %3d: FAILED\n", tileSize);
+    return;
+  }
+
+  double dirty = (double)uploader.GetStats().dirtyBytes.Get();
+  double uploaded = (double)uploader.GetStats().uploadedBytes.Get();
+  printf("  hud tiles %3d: %8.3f MiB/frame uploaded  %6.1fx less than dirty  %6.0f us/frame\n", tileSize,
+    uploaded / iterations / (1024 * 1024), 0 < uploaded ? dirty / uploaded : 0, seconds * 1e6 / iterations);
+}
+
+} // namespace
+
+void RunDamageBench(void) {
+  std::vector<unsigned char> frame((size_t)4 * FrameWidth * FrameHeight);
+  FillNoise(frame, 2);
+
+  uint64_t scalarHash, hash;
+  HashKernel("scalar", &HashTexturePixelsScalar, frame, scalarHash);
+  HashKernel("best", &HashTexturePixels, frame, hash);
+  if(scalarHash != hash) printf("  hash MISMATCH between scalar and best kernel\n");
+
+  for(int tileSize : {0, 32, 64, 128}) {
+    Hud(tileSize);
+  }
+}
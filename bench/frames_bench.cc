@@ -0,0 +1,128 @@
+#include "bench.h"
+
+#include "texture_frames.h"
+#include "texture_uploader.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int FrameWidth = 1280;
+const int FrameHeight = 720;
+const int TileSize = 64;
+
+// Pretends the GPU needs 300 us per copy plus 4 GB/s.
+const double GpuLatencyMicroseconds = 300;
+const double GpuBytesPerMicrosecond = 4000;
+
+// Paints a frame every frameMicroseconds in which only the top left and the
+// bottom right tile change, both to the frame's value. A consumer thread
+// like the game reads the top left pixel, holds the texture for
+// holdMicroseconds (drawing it) and then reads the bottom right one: if they
+// differ it saw a torn frame. With bufferCount 1 it reads the texture that
+// is written in place, otherwise it goes through the frame section.
+void Frames(size_t bufferCount, double frameMicroseconds, double holdMicroseconds) {
+  const size_t iterations = 300;
+
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 3, GpuLatencyMicroseconds, GpuBytesPerMicrosecond, TextureFormat_Bgra8, bufferCount);
+  CTextureUploader uploader(device);
+  uploader.SetDamageTracking(TileSize);
+
+  CTextureFrameSection * section = nullptr;
+  CTextureFrameSection * consumerSection = nullptr;
+  if(1 < bufferCount) {
+    section = CTextureFrameSection::Create();
+    if(section) {
+      InitTextureFrameHeader(section->GetHeader(), device);
+      uploader.SetFrameSync(section->GetHeader());
+      consumerSection = CTextureFrameSection::Open(section->GetName().c_str());
+    }
+    if(nullptr == consumerSection) {
+      printf("  buffers %zu: FAILED to create frame section\n", bufferCount);
+      delete section;
+      return;
+    }
+  }
+
+  std::atomic<bool> quit(false);
+  size_t reads = 0;
+  size_t torn = 0;
+  size_t backwards = 0;
+  size_t distinct = 0;
+
+  std::thread consumer([&]() {
+    const size_t rowPitch = (size_t)4 * FrameWidth;
+    const size_t bottomRight = (size_t)(FrameHeight - 1) * rowPitch + (size_t)4 * (FrameWidth - 1);
+    CTextureFrameConsumer * frames = consumerSection ? new CTextureFrameConsumer(consumerSection->GetHeader()) : nullptr;
+    unsigned char lastValue = 0;
+
+    while(!quit) {
+      size_t buffer = 0;
+      uint64_t sequence = 0;
+      if(frames && !frames->AcquireLatest(buffer, sequence)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+
+      const unsigned char * pPixels = device->GetBufferPixels(buffer);
+      unsigned char topLeft = reinterpret_cast<const volatile unsigned char *>(pPixels)[0];
+      std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(holdMicroseconds));
+      unsigned char bottomRightValue = reinterpret_cast<const volatile unsigned char *>(pPixels)[bottomRight];
+      if(frames) frames->Release();
+
+      ++reads;
+      if(topLeft != bottomRightValue) ++torn;
+      else if(topLeft != lastValue) {
+        // Values wrap around at 255.
+        if((unsigned char)(topLeft - lastValue) > 128) ++backwards;
+        ++distinct;
+        lastValue = topLeft;
+      }
+
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    delete frames;
+  });
+
+  std::vector<unsigned char> frame((size_t)4 * FrameWidth * FrameHeight, 0);
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations; i++) {
+    auto due = start + std::chrono::duration_cast<BenchClock_t::duration>(std::chrono::duration<double, std::micro>(i * frameMicroseconds));
+    std::this_thread::sleep_until(due);
+
+    unsigned char value = (unsigned char)(1 + i % 255);
+    for(int y = 0; y < TileSize; y++) {
+      memset(frame.data() + (size_t)y * 4 * FrameWidth, value, (size_t)4 * TileSize);
+      memset(frame.data() + (size_t)(FrameHeight - 1 - y) * 4 * FrameWidth + (size_t)4 * (FrameWidth - TileSize), value, (size_t)4 * TileSize);
+    }
+    uploader.Upload(TextureRect{0, 0, FrameWidth, FrameHeight}, frame.data(), (size_t)4 * FrameWidth);
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  quit = true;
+  consumer.join();
+
+  CTextureStats & stats = uploader.GetStats();
+  StatHistogramSnapshot uploadTime = stats.uploadTime.GetSnapshot();
+  StatHistogramSnapshot finishTime = stats.finishTime.GetSnapshot();
+  printf("  buffers %zu, hold %5.0f us: %6.1f frames/s  upload p50 %7.1f us  p99 %7.1f us  finish p50 %7.1f us  reads %4zu  frames seen %4zu  torn %4zu  backwards %zu  waits %lld  forced %lld\n",
+    bufferCount, holdMicroseconds, iterations / seconds,
+    uploadTime.p50 / 1000.0, uploadTime.p99 / 1000.0, finishTime.p50 / 1000.0,
+    reads, distinct, torn, backwards, (long long)stats.frameWaits.Get(), (long long)stats.frameForced.Get());
+
+  uploader.SetFrameSync(nullptr);
+  delete consumerSection;
+  delete section;
+}
+
+} // namespace
+
+void RunFramesBench(void) {
+  for(double hold : {500.0, 3000.0}) {
+    Frames(1, 2000, hold);
+    Frames(2, 2000, hold);
+    Frames(3, 2000, hold);
+  }
+}
@@ -0,0 +1,84 @@
+// Compares per frame input latency of one SendMouseInputEvent call per event
+// with one SendInputEvents call per frame, through the same pipes, native
+// codec and JSON-RPC server as main.js. A JsonRpcClient stands in for the
+// game, the overlay renderer is simulated with one event loop turn per IPC
+// hop.
+// Usage: node bench/input_batch.js [frames]
+
+const advancedfx_gui_native = require('bindings')('advancedfx_gui_native')
+const jsonrpc = require('../modules/jsonrpc.js');
+const input = require('../modules/input.js');
+
+const frames = parseInt(process.argv[2] || '2000');
+
+// Like overlay_preload.js: clicks are captured, moves are not.
+function createOverlay() {
+  let captured = false;
+  let mask = 0;
+  return {
+    sendInputEvent: (ev) => setImmediate(() => { captured = ev.type !== 'mouseMove'; }),
+    send: (channel, index) => setImmediate(() => { if(captured) mask |= 1 << index; }),
+    invoke: (channel) => new Promise((resolve) => setImmediate(() => {
+      let value = channel === 'afxEndInputBatch' ? mask >>> 0 : captured;
+      mask = 0;
+      setImmediate(() => resolve(value));
+    }))
+  };
+}
+
+function percentile(samples, p) {
+  samples.sort((a, b) => a - b);
+  return samples[Math.min(samples.length - 1, Math.round(p * (samples.length - 1)))];
+}
+
+async function run(eventsPerFrame) {
+  const requestPipe = new advancedfx_gui_native.AnonymousPipe();
+  const replyPipe = new advancedfx_gui_native.AnonymousPipe();
+  const overlay = createOverlay();
+
+  const server = new jsonrpc.JsonRpc_2_0_Server();
+  server.on('SendMouseInputEvent', async (ev) => await input.dispatchInputEvent(overlay, ev));
+  server.on('SendInputEvents', async (events) => await input.dispatchInputBatch(overlay, events));
+  server.setConcurrency(8);
+  const pump = server.streamParsed(
+    (onRequest) => requestPipe.startReading(onRequest, {jsonRpc: true, queueLimit: 64, maxInFlight: 8}),
+    (id, result) => replyPipe.writeJsonRpcResponse(id, result),
+    (id, code, message) => replyPipe.writeJsonRpcError(id, code, message),
+    undefined,
+    (count) => requestPipe.ackFrames(count));
+
+  const game = new advancedfx_gui_native.JsonRpcClient(requestPipe, replyPipe, {maxInFlight: 64});
+
+  let events = [];
+  for(let i = 0; i < eventsPerFrame; i++) {
+    events.push({'type': i % 8 == 7 ? 'mouseDown' : 'mouseMove', 'x': 100 + i, 'y': 200, 'button': 'left', 'clickCount': 1, 'modifiers': []});
+  }
+
+  async function measure(name, frame) {
+    let latencies = [];
+    for(let i = 0; i < frames; i++) {
+      const start = process.hrtime.bigint();
+      await frame();
+      latencies.push(Number(process.hrtime.bigint() - start) / 1000);
+    }
+    console.log(`  ${name} ${String(eventsPerFrame).padStart(2)} events/frame: p50 ${percentile(latencies, 0.5).toFixed(1).padStart(8)} us  p99 ${percentile(latencies, 0.99).toFixed(1).padStart(8)} us`);
+  }
+
+  await measure('per event', async () => {
+    await Promise.all(events.map((ev) => game.call('SendMouseInputEvent', [ev])));
+  });
+  await measure('batched  ', async () => {
+    await game.call('SendInputEvents', [events]);
+  });
+
+  await game.close();
+  await requestPipe.close();
+  await replyPipe.close();
+  await pump.catch(() => {});
+}
+
+async function main() {
+  for(const eventsPerFrame of [1, 4, 16, 32]) await run(eventsPerFrame);
+}
+
+main();
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "jsonrpc_messages.h"
+
+#include "json_rpc.h"
+#include "msgpack.h"
+
+void RunJsonRpcBench(void) {
+  std::vector<std::string> messages = BenchJsonRpcMessageMix();
+
+  size_t totalBytes = 0;
+  for(auto & message : messages) totalBytes += message.size();
+
+  const size_t rounds = 2000;
+  size_t invalid = 0;
+
+  auto start = BenchClock_t::now();
+  for(size_t round = 0; round < rounds; round++) {
+    for(auto & message : messages) {
+      CJsonRpcRequest request;
+      ParseJsonRpcRequest(message.data(), message.size(), request);
+      if(!request.valid) ++invalid;
+    }
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(invalid) {
+    printf("  parse: FAILED (%zu invalid)\n", invalid);
+    return;
+  }
+
+  printf("  parse request mix:     %12.0f msg/s %10.1f MB/s %8.0f ns/msg\n",
+    rounds * messages.size() / seconds, rounds * totalBytes / seconds / 1e6, seconds * 1e9 / (rounds * messages.size()));
+
+  CJsonValue id;
+  id.type = CJsonValue::Type_Number;
+  id.number = 42;
+  CJsonValue result;
+  result.type = CJsonValue::Type_True;
+
+  std::string out;
+  size_t responses = 0;
+  start = BenchClock_t::now();
+  for(size_t i = 0; i < rounds * messages.size(); i++) {
+    out.clear();
+    AppendJsonRpcResultHead(out);
+    AppendJson(out, result);
+    AppendJsonRpcResultTail(out, &id);
+    responses += out.size();
+  }
+  seconds = BenchSeconds(start, BenchClock_t::now());
+
+  printf("  serialize response:    %12.0f msg/s %8.0f ns/msg (%zu bytes)\n",
+    rounds * messages.size() / seconds, seconds * 1e9 / (rounds * messages.size()), responses / (rounds * messages.size()));
+
+  // Same mix in MessagePack, the input events alone are what matters most.
+  std::vector<std::string> packed;
+  size_t inputJsonBytes = 0;
+  size_t inputPackedBytes = 0;
+  for(auto & message : messages) {
+    CJsonValue value;
+    std::string error;
+    ParseJson(message.data(), message.size(), value, error);
+    packed.emplace_back();
+    AppendMsgPack(packed.back(), value);
+    if(message.size() < 1024) {
+      inputJsonBytes += message.size();
+      inputPackedBytes += packed.back().size();
+    }
+  }
+
+  printf("  small messages:        json %8zu bytes, msgpack %8zu bytes (%.0f %%)\n",
+    inputJsonBytes, inputPackedBytes, 100.0 * inputPackedBytes / inputJsonBytes);
+
+  for(int pass = 0; pass < 2; pass++) {
+    bool bMsgPack = 1 == pass;
+    std::vector<std::string> & inputs = bMsgPack ? packed : messages;
+    size_t inputBytes = 0;
+    for(auto & input : inputs) inputBytes += input.size();
+
+    invalid = 0;
+    start = BenchClock_t::now();
+    for(size_t round = 0; round < rounds; round++) {
+      for(auto & input : inputs) {
+        CJsonRpcRequest request;
+        ParseJsonRpcRequest(input.data(), input.size(), request);
+        if(!request.valid) ++invalid;
+      }
+    }
+    seconds = BenchSeconds(start, BenchClock_t::now());
+    double decodeNs = seconds * 1e9 / (rounds * inputs.size());
+
+    CJsonValue value;
+    std::string error;
+    std::vector<CJsonValue> values(inputs.size());
+    for(size_t i = 0; i < inputs.size(); i++) {
+      if(bMsgPack) ParseMsgPack(inputs[i].data(), inputs[i].size(), values[i], error);
+      else ParseJson(inputs[i].data(), inputs[i].size(), values[i], error);
+    }
+
+    start = BenchClock_t::now();
+    for(size_t round = 0; round < rounds; round++) {
+      for(auto & value : values) {
+        out.clear();
+        if(bMsgPack) AppendMsgPack(out, value);
+        else AppendJson(out, value);
+      }
+    }
+    seconds = BenchSeconds(start, BenchClock_t::now());
+    double encodeNs = seconds * 1e9 / (rounds * inputs.size());
+
+    printf("  %-8s decode %8.0f ns/msg  encode %8.0f ns/msg  %8zu bytes/mix%s\n", bMsgPack ? "msgpack" : "json",
+      decodeNs, encodeNs, inputBytes, invalid ? " FAILED" : "");
+  }
+}
@@ -0,0 +1,70 @@
+// Compares JS main thread time spent per JSON-RPC request between parsing
+// with JSON.parse / JSON.stringify and the native codec (startReading with
+// jsonRpc: true, writeJsonRpcResponse).
+// Usage: node bench/jsonrpc_main_thread.js [rounds]
+
+const advancedfx_gui_native = require('bindings')('advancedfx_gui_native')
+
+const rounds = parseInt(process.argv[2] || '200');
+
+function messageMix() {
+  let messages = [];
+  for(let i = 0; i < 80; i++) messages.push(JSON.stringify({"jsonrpc": "2.0", "method": "SendMouseInputEvent", "params": [{"type": "mouseMove", "x": 100 + i, "y": 200 + 2 * i, "globalX": 1100 + i, "globalY": 600 + 2 * i, "modifiers": []}], "id": i}));
+  for(let i = 0; i < 8; i++) messages.push(JSON.stringify({"jsonrpc": "2.0", "method": "SendMouseWheelInputEvent", "params": [{"type": "mouseWheel", "x": 10, "y": 20, "globalX": 1010, "globalY": 420, "deltaX": 0, "deltaY": -120, "canScroll": true, "modifiers": ["shift"]}], "id": 100 + i}));
+  for(let i = 0; i < 10; i++) messages.push(JSON.stringify({"jsonrpc": "2.0", "method": "SendKeyboardInputEvent", "params": [{"type": "keyDown", "keyCode": "A", "modifiers": ["control"]}], "id": 200 + i}));
+  messages.push(JSON.stringify({"jsonrpc": "2.0", "method": "DrawingWindowCreated", "params": [{"lo": 12345, "hi": 0}, 2560, 1440], "id": 300}));
+  messages.push(JSON.stringify({"jsonrpc": "2.0", "method": "SetConfig", "params": [{"name": "hud", "text": "x".repeat(64 * 1024)}], "id": 301}));
+  return messages;
+}
+
+async function run(name, jsonRpc) {
+  const messages = messageMix();
+  const total = rounds * messages.length;
+  const inPipe = new advancedfx_gui_native.AnonymousPipe();
+  const outPipe = new advancedfx_gui_native.AnonymousPipe();
+
+  let received = 0;
+  let mainThreadNs = 0n;
+  let done;
+  let allReceived = new Promise((resolve) => { done = resolve; });
+
+  function handle(method, params, id) {
+    return true;
+  }
+
+  if(jsonRpc) {
+    inPipe.startReading((error, method, params, id) => {
+      const start = process.hrtime.bigint();
+      outPipe.writeJsonRpcResponse(id, handle(method, params, id));
+      mainThreadNs += process.hrtime.bigint() - start;
+      if(++received == total) done();
+    }, {jsonRpc: true});
+  } else {
+    inPipe.startReading((strRequest) => {
+      const start = process.hrtime.bigint();
+      const request = JSON.parse(strRequest);
+      const result = handle(request["method"], request["params"], request["id"]);
+      outPipe.writeString(JSON.stringify({"jsonrpc": "2.0", "result": result, "id": request["id"]}));
+      mainThreadNs += process.hrtime.bigint() - start;
+      if(++received == total) done();
+    });
+  }
+
+  // Drain the responses so the output pipe does not fill up.
+  outPipe.startReading(() => {});
+
+  for(let i = 0; i < rounds; i++) await inPipe.writeStrings(messages);
+  await allReceived;
+
+  console.log(`${name}: ${(Number(mainThreadNs) / total).toFixed(0)} ns main thread per request`);
+
+  await inPipe.close();
+  await outPipe.close();
+}
+
+async function main() {
+  await run('JSON.parse / JSON.stringify', false);
+  await run('native codec', true);
+}
+
+main();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Message mix modelled on what AfxHookSource sends during overlay use:
+// mostly input events, some cursor / window messages and rare large payloads.
+inline std::vector<std::string> BenchJsonRpcMessageMix(void) {
+  std::vector<std::string> messages;
+
+  for(int i = 0; i < 80; i++) {
+    messages.push_back("{\"jsonrpc\":\"2.0\",\"method\":\"SendMouseInputEvent\",\"params\":[{\"type\":\"mouseMove\",\"x\":"
+      + std::to_string(100 + i) + ",\"y\":" + std::to_string(200 + 2 * i) + ",\"globalX\":" + std::to_string(1100 + i)
+      + ",\"globalY\":" + std::to_string(600 + 2 * i) + ",\"modifiers\":[]}],\"id\":" + std::to_string(i) + "}");
+  }
+  for(int i = 0; i < 8; i++) {
+    messages.push_back("{\"jsonrpc\":\"2.0\",\"method\":\"SendMouseWheelInputEvent\",\"params\":[{\"type\":\"mouseWheel\",\"x\":10,\"y\":20,"
+      "\"globalX\":1010,\"globalY\":420,\"deltaX\":0,\"deltaY\":-120,\"canScroll\":true,\"modifiers\":[\"shift\"]}],\"id\":" + std::to_string(100 + i) + "}");
+  }
+  for(int i = 0; i < 10; i++) {
+    messages.push_back("{\"jsonrpc\":\"2.0\",\"method\":\"SendKeyboardInputEvent\",\"params\":[{\"type\":\"keyDown\",\"keyCode\":\"A\",\"modifiers\":[\"control\"]}],\"id\":"
+      + std::to_string(200 + i) + "}");
+  }
+  messages.push_back("{\"jsonrpc\":\"2.0\",\"method\":\"DrawingWindowCreated\",\"params\":[{\"lo\":12345,\"hi\":0},2560,1440],\"id\":300}");
+  messages.push_back("{\"jsonrpc\":\"2.0\",\"method\":\"SetConfig\",\"params\":[{\"name\":\"hud\",\"text\":\""
+    + std::string(64 * 1024, 'x') + "\",\"escaped\":\"line\\nbreak \\u00e4\\ud83d\\ude00\"}],\"id\":301}");
+
+  return messages;
+}
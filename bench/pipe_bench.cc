@@ -0,0 +1,201 @@
+#include "bench.h"
+
+#include "pipe_core.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct BenchToken {
+  bool isRead;
+};
+
+class CBenchSink {
+ public:
+  void Post(BenchToken && token, bool ok) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(!ok) m_Failed = true;
+    if(token.isRead) ++m_Reads;
+    else ++m_Writes;
+    m_Cv.notify_all();
+  }
+
+  void Post(BenchToken && token, bool ok, std::string && str) {
+    Post(std::move(token), ok);
+  }
+
+  void Post(BenchToken && token, bool ok, CPipeBuffer && buffer) {
+    Post(std::move(token), ok);
+  }
+
+  void PostFrames(std::vector<std::string> && frames) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Reads += frames.size();
+    m_Cv.notify_all();
+    if(m_OnFrames) m_OnFrames(frames.size());
+  }
+
+  // Called with the batch size of every PostFrames.
+  void (*m_OnFrames)(size_t) = nullptr;
+
+  // Waits until at least reads read and writes write completions arrived.
+  bool Wait(size_t reads, size_t writes) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [&]{ return m_Failed || (reads <= m_Reads && writes <= m_Writes); });
+    return !m_Failed;
+  }
+
+ private:
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  size_t m_Reads = 0;
+  size_t m_Writes = 0;
+  bool m_Failed = false;
+};
+
+typedef CPipeCore<BenchToken, CBenchSink> BenchPipe_t;
+
+void Throughput(size_t messageSize) {
+  size_t iterations = BenchIterations(messageSize, 256 * 1024 * 1024, 16, 200000);
+  const size_t window = 64;
+
+  CBenchSink sink;
+  BenchPipe_t pipe(CPipeTransport::Create(), sink);
+  CPipeTransport * transport = pipe.GetTransport();
+
+  std::string message(messageSize, 'x');
+  bool bReaderOk = true;
+
+  auto start = BenchClock_t::now();
+
+  CPipeFrameReader frameReader(*transport);
+
+  std::thread reader([&]{
+    std::string inStr;
+    for(size_t i = 0; i < iterations && bReaderOk; i++) {
+      bReaderOk = frameReader.ReadFrame(inStr) && inStr.size() == messageSize;
+    }
+  });
+
+  bool bOk = true;
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    if(window <= i) bOk = sink.Wait(0, i - window + 1);
+    pipe.WriteString({false}, message);
+  }
+  bOk = bOk && sink.Wait(0, iterations);
+
+  reader.join();
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(!bOk || !bReaderOk) {
+    printf("  throughput %10s: FAILED\n", BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  printf("  throughput %10s: %12.0f msg/s %10.1f MB/s %8.3f reads/msg\n", BenchFormatSize(messageSize).c_str(),
+    iterations / seconds, (double)iterations * messageSize / seconds / 1e6, (double)frameReader.GetReadCalls() / iterations);
+}
+
+void RoundTrip(size_t messageSize) {
+  size_t iterations = BenchIterations(messageSize, 64 * 1024 * 1024, 8, 20000);
+
+  CBenchSink sink;
+  BenchPipe_t requestPipe(CPipeTransport::Create(), sink);
+  BenchPipe_t replyPipe(CPipeTransport::Create(), sink);
+  CPipeTransport * requestTransport = requestPipe.GetTransport();
+  CPipeTransport * replyTransport = replyPipe.GetTransport();
+
+  // Stands in for the other process: echoes every message back.
+  std::thread echo([&]{
+    CPipeFrameReader frameReader(*requestTransport);
+    std::string inStr;
+    std::vector<unsigned char> outBuffer;
+    for(size_t i = 0; i < iterations; i++) {
+      if(!frameReader.ReadFrame(inStr)) return;
+      outBuffer.clear();
+      AppendPipeFrame(outBuffer, inStr.data(), (PipeFrameLength_t)inStr.size());
+      if(!replyTransport->WriteBytes(outBuffer.data(), outBuffer.size())) return;
+    }
+  });
+
+  std::string message(messageSize, 'x');
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+
+  bool bOk = true;
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    auto requestStart = BenchClock_t::now();
+    requestPipe.WriteString({false}, message);
+    replyPipe.ReadString({true});
+    bOk = sink.Wait(i + 1, i + 1);
+    latencies.push_back(BenchSeconds(requestStart, BenchClock_t::now()) * 1e6);
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  echo.join();
+
+  if(!bOk) {
+    printf("  round trip %10s: FAILED\n", BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50);
+  double p99 = BenchPercentile(latencies, 0.99);
+
+  printf("  round trip %10s: %12.0f msg/s %10.1f MB/s  p50 %10.1f us  p99 %10.1f us\n", BenchFormatSize(messageSize).c_str(),
+    iterations / seconds, 2.0 * iterations * messageSize / seconds / 1e6, p50, p99);
+}
+
+// Streaming mode, frames are acknowledged as soon as they are posted.
+void StreamingThroughput(size_t messageSize) {
+  size_t iterations = BenchIterations(messageSize, 256 * 1024 * 1024, 16, 200000);
+  const size_t window = 64;
+
+  static BenchPipe_t * s_Pipe;
+
+  CBenchSink sink;
+  BenchPipe_t pipe(CPipeTransport::Create(), sink);
+  s_Pipe = &pipe;
+  sink.m_OnFrames = [](size_t count) { s_Pipe->AckFrames(count); };
+
+  std::string message(messageSize, 'x');
+
+  auto start = BenchClock_t::now();
+
+  pipe.StartReading({true}, 256, 64);
+
+  bool bOk = true;
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    if(window <= i) bOk = sink.Wait(0, i - window + 1);
+    pipe.WriteString({false}, message);
+  }
+  bOk = bOk && sink.Wait(iterations, iterations);
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(!bOk) {
+    printf("  streaming  %10s: FAILED\n", BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  printf("  streaming  %10s: %12.0f msg/s %10.1f MB/s\n", BenchFormatSize(messageSize).c_str(),
+    iterations / seconds, (double)iterations * messageSize / seconds / 1e6);
+}
+
+} // namespace
+
+void RunPipeBench(void) {
+  for(size_t size = 16; size <= 16 * 1024 * 1024; size *= 16) {
+    Throughput(size);
+  }
+  for(size_t size = 16; size <= 16 * 1024 * 1024; size *= 16) {
+    StreamingThroughput(size);
+  }
+  for(size_t size = 16; size <= 16 * 1024 * 1024; size *= 16) {
+    RoundTrip(size);
+  }
+}
@@ -0,0 +1,48 @@
+// Measures AnonymousPipe promise round trips per second.
+// Usage: node bench/pipe_calls.js [iterations]
+
+const advancedfx_gui_native = require('bindings')('advancedfx_gui_native')
+
+const iterations = parseInt(process.argv[2] || '100000');
+
+async function run(name, fn) {
+  const pipe = new advancedfx_gui_native.AnonymousPipe();
+  const start = process.hrtime.bigint();
+  await fn(pipe);
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+  await pipe.close();
+  console.log(`${name}: ${Math.round(iterations / seconds)} calls/sec`);
+}
+
+async function main() {
+  const message = JSON.stringify({"jsonrpc": "2.0", "method": "SetMouseCursor", "params": ["default"]});
+
+  await run('writeString+readString (lockstep)', async (pipe) => {
+    for(let i = 0; i < iterations; i++) {
+      await Promise.all([pipe.writeString(message), pipe.readString()]);
+    }
+  });
+
+  await run('writeString+readString (pipelined x64)', async (pipe) => {
+    for(let i = 0; i < iterations; i += 64) {
+      let promises = [];
+      for(let j = 0; j < 64; j++) promises.push(pipe.writeString(message), pipe.readString());
+      await Promise.all(promises);
+    }
+  });
+
+  await run('writeString+startReading (streaming)', async (pipe) => {
+    let received = 0;
+    let done;
+    let allReceived = new Promise((resolve) => { done = resolve; });
+    pipe.startReading(() => { if(++received == iterations) done(); });
+    for(let i = 0; i < iterations; i += 64) {
+      let promises = [];
+      for(let j = 0; j < 64; j++) promises.push(pipe.writeString(message));
+      await Promise.all(promises);
+    }
+    await allReceived;
+  });
+}
+
+main();
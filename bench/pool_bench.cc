@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include "texture_pool.h"
+#include "texture_uploader.h"
+#include "threaded_queue.h"
+
+#include <future>
+#include <thread>
+
+namespace {
+
+// Pretends finding the adapter and D3D11CreateDevice take 15 ms and
+// creating the shared and staging textures 2 ms, on top of what the CPU
+// device really costs (allocating them, starting its thread).
+const double AdapterCreateMicroseconds = 15000;
+const double DeviceCreateMicroseconds = 2000;
+
+TextureAdapterFactory_t FakeAdapterFactory() {
+  return [](int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError) {
+    std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(AdapterCreateMicroseconds));
+    return CreateTextureAdapterCpu(DeviceCreateMicroseconds);
+  };
+}
+
+struct Size {
+  int width;
+  int height;
+};
+
+// Creates and deletes a texture like main.js on DrawingWindowCreated and
+// DrawingWindowDestroyed, cycling through sizes. With bSharedPool all
+// cycles use one pool, otherwise each its own, like before there was one.
+void Recreate(const char * name, const std::vector<Size> & sizes, size_t cycles, bool bSharedPool, size_t maxIdle) {
+  CTexturePool * pool = bSharedPool ? new CTexturePool(FakeAdapterFactory(), maxIdle) : nullptr;
+  std::vector<double> latencies;
+  latencies.reserve(cycles);
+  size_t hits = 0;
+  size_t failed = 0;
+  std::vector<unsigned char> frame;
+
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < cycles; i++) {
+    CTexturePool * cyclePool = pool ? pool : new CTexturePool(FakeAdapterFactory(), maxIdle);
+    const Size & size = sizes[i % sizes.size()];
+
+    auto createStart = BenchClock_t::now();
+    std::string error;
+    CTextureDevice * device = cyclePool->Acquire(0, 0, size.width, size.height, 3, 1, TextureFormat_Bgra8, error);
+    if(nullptr == device) {
+      ++failed;
+      if(!pool) delete cyclePool;
+      continue;
+    }
+    CTextureUploader * uploader = new CTextureUploader(device);
+    uploader->SetDamageTracking(64);
+    latencies.push_back(BenchSeconds(createStart, BenchClock_t::now()) * 1e6);
+
+    // The first paint, so a recycled device is really used again.
+    frame.resize((size_t)4 * size.width * size.height);
+    if(TextureUpload_Failed == uploader->Upload(TextureRect{0, 0, size.width, size.height}, frame.data(), (size_t)4 * size.width)) ++failed;
+    delete uploader;
+
+    if(pool) hits = (size_t)pool->GetStats().hits.Get();
+    else delete cyclePool;
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+  delete pool;
+
+  if(failed) {
+    printf("  %-26s: FAILED\n", name);
+    return;
+  }
+
+  printf("  %-26s: %6.1f cycles/s  hits %5.1f %%  create p50 %8.1f us  p99 %8.1f us\n", name,
+    cycles / seconds, 100.0 * hits / cycles, BenchPercentile(latencies, 0.50), BenchPercentile(latencies, 0.99));
+}
+
+// First creation on a new adapter, like SharedTexture.createAsync: the
+// calling thread only queues the work to a worker and waits for the
+// result. With bPrewarm SharedTexture.prewarm ran before. Reports how long
+// the calling thread was busy against how long until the texture was ready.
+void CreateOffThread(const char * name, size_t cycles, bool bPrewarm) {
+  const Size size = {1920, 1080};
+  std::vector<double> blocked;
+  std::vector<double> ready;
+  size_t failed = 0;
+  CThreadedQueue worker(0);
+
+  for(size_t i = 0; i < cycles; i++) {
+    CTexturePool pool(FakeAdapterFactory());
+    if(bPrewarm) {
+      std::promise<void> prewarmed;
+      worker.Queue([&pool, &prewarmed, &failed, size]() {
+        std::string error;
+        if(!pool.Prewarm(0, 0, size.width, size.height, 3, 1, TextureFormat_Bgra8, error)) ++failed;
+        prewarmed.set_value();
+      });
+      prewarmed.get_future().wait();
+    }
+
+    std::promise<CTextureDevice *> created;
+    std::future<CTextureDevice *> device = created.get_future();
+    auto createStart = BenchClock_t::now();
+    worker.Queue([&pool, &created, size]() {
+      std::string error;
+      created.set_value(pool.Acquire(0, 0, size.width, size.height, 3, 1, TextureFormat_Bgra8, error));
+    });
+    blocked.push_back(BenchSeconds(createStart, BenchClock_t::now()) * 1e6);
+    CTextureDevice * pDevice = device.get();
+    ready.push_back(BenchSeconds(createStart, BenchClock_t::now()) * 1e6);
+    if(nullptr == pDevice) ++failed;
+    delete pDevice;
+  }
+  worker.SignalQuit();
+  worker.Join();
+
+  if(failed) {
+    printf("  %-26s: FAILED\n", name);
+    return;
+  }
+
+  printf("  %-26s: calling thread busy p50 %8.1f us  p99 %8.1f us  ready p50 %8.1f us  p99 %8.1f us\n", name,
+    BenchPercentile(blocked, 0.50), BenchPercentile(blocked, 0.99), BenchPercentile(ready, 0.50), BenchPercentile(ready, 0.99));
+}
+
+} // namespace
+
+void RunPoolBench(void) {
+  const size_t cycles = 40;
+  std::vector<Size> same = {{1920, 1080}};
+  std::vector<Size> resizes = {{1920, 1080}, {1280, 720}, {2560, 1440}};
+
+  Recreate("same size, no cache", same, cycles, false, 0);
+  Recreate("same size, adapters only", same, cycles, true, 0);
+  Recreate("same size, pooled", same, cycles, true, 4);
+  Recreate("3 sizes, pooled maxIdle 2", resizes, cycles, true, 2);
+  Recreate("3 sizes, pooled maxIdle 4", resizes, cycles, true, 4);
+  CreateOffThread("first, on a worker", 10, false);
+  CreateOffThread("first, prewarmed", 10, true);
+}
@@ -0,0 +1,143 @@
+#include "bench.h"
+
+#include "threaded_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <thread>
+
+namespace {
+
+// The queue CThreadedQueue used to be: std::function tasks in a std::queue
+// behind one mutex and condition variable, kept for comparison.
+class CLockedQueue {
+ public:
+  CLockedQueue() {
+    m_Thread = std::thread(&CLockedQueue::QueueThreadHandler, this);
+  }
+
+  ~CLockedQueue() {
+    m_Thread.join();
+  }
+
+  void SignalQuit() {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Quit = true;
+    m_Cv.notify_one();
+  }
+
+  void Queue(std::function<void(void)> && op) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Queue.push(std::move(op));
+    m_Cv.notify_one();
+  }
+
+ private:
+  std::mutex m_Lock;
+  std::thread m_Thread;
+  std::queue<std::function<void(void)>> m_Queue;
+  std::condition_variable m_Cv;
+  bool m_Quit = false;
+
+  void QueueThreadHandler(void) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    do {
+      m_Cv.wait(lock, [this] { return (m_Queue.size() || m_Quit); });
+      if (m_Queue.size()) {
+        auto op = std::move(m_Queue.front());
+        m_Queue.pop();
+        lock.unlock();
+        op();
+        lock.lock();
+      }
+    } while (!m_Quit || m_Queue.size());
+  }
+};
+
+// About what CPipeCore's tasks capture: the core and a completion token.
+struct Payload {
+  uint64_t words[12];
+};
+
+template<class TQueue> const char * GetQueueName();
+template<> const char * GetQueueName<CLockedQueue>() { return "locked"; }
+template<> const char * GetQueueName<CThreadedQueue>() { return "ticket"; }
+
+// producerCount threads queue tasks as fast as they can, ops/s until the
+// worker ran all of them.
+template<class TQueue> void Throughput(size_t producerCount) {
+  const size_t tasksPerProducer = 200000;
+
+  std::atomic<size_t> done{0};
+  Payload payload = {};
+  auto start = BenchClock_t::now();
+  {
+    TQueue queue;
+    std::vector<std::thread> producers;
+    for(size_t p = 0; p < producerCount; p++) {
+      producers.emplace_back([&]{
+        for(size_t i = 0; i < tasksPerProducer; i++) {
+          queue.Queue([&done,payload]{ done.fetch_add(1 + payload.words[0], std::memory_order_relaxed); });
+        }
+      });
+    }
+    for(auto & producer : producers) producer.join();
+    queue.SignalQuit();
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(done != producerCount * tasksPerProducer) {
+    printf("  %-6s throughput  %zu producers: FAILED\n", GetQueueName<TQueue>(), producerCount);
+    return;
+  }
+
+  printf("  %-6s throughput  %zu producers: %10.0f ops/s\n", GetQueueName<TQueue>(), producerCount, done / seconds);
+}
+
+// Bursts of burstSize tasks with pauses in between, like a renderer posting
+// per frame: time spent in Queue by the producer, and from Queue until the
+// task ran.
+template<class TQueue> void Latency(size_t burstSize, double pauseMicroseconds) {
+  const size_t bursts = 2000 / burstSize + 200;
+
+  std::vector<double> enqueue;
+  std::vector<double> run;
+  enqueue.reserve(bursts * burstSize);
+  std::vector<BenchClock_t::time_point> queued(bursts * burstSize);
+  std::vector<BenchClock_t::time_point> ran(bursts * burstSize);
+  Payload payload = {};
+  {
+    TQueue queue;
+    for(size_t b = 0; b < bursts; b++) {
+      for(size_t i = 0; i < burstSize; i++) {
+        size_t index = b * burstSize + i;
+        auto before = BenchClock_t::now();
+        queued[index] = before;
+        queue.Queue([&ran,index,payload]{ ran[index + payload.words[0]] = BenchClock_t::now(); });
+        enqueue.push_back(BenchSeconds(before, BenchClock_t::now()) * 1e6);
+      }
+      std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(pauseMicroseconds));
+    }
+    queue.SignalQuit();
+  }
+  for(size_t i = 0; i < queued.size(); i++) run.push_back(BenchSeconds(queued[i], ran[i]) * 1e6);
+
+  printf("  %-6s burst %3zu every %5.0f us: enqueue p50 %7.2f us  p99 %7.2f us  until run p50 %8.1f us  p99 %8.1f us\n",
+    GetQueueName<TQueue>(), burstSize, pauseMicroseconds,
+    BenchPercentile(enqueue, 0.50), BenchPercentile(enqueue, 0.99), BenchPercentile(run, 0.50), BenchPercentile(run, 0.99));
+}
+
+} // namespace
+
+void RunQueueBench(void) {
+  for(size_t producerCount : {1, 2, 4}) {
+    Throughput<CLockedQueue>(producerCount);
+    Throughput<CThreadedQueue>(producerCount);
+  }
+  for(size_t burstSize : {1, 16, 256}) {
+    Latency<CLockedQueue>(burstSize, 1000);
+    Latency<CThreadedQueue>(burstSize, 1000);
+  }
+}
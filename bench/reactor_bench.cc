@@ -0,0 +1,148 @@
+#include "bench.h"
+
+#include "pipe_core.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#ifndef _WIN32
+#include <cstdlib>
+#include <cstring>
+#endif
+
+namespace {
+
+// Threads of this process, -1 where unknown.
+int CountThreads(void) {
+#ifdef _WIN32
+  return -1;
+#else
+  FILE * file = fopen("/proc/self/status", "r");
+  if(nullptr == file) return -1;
+  int count = -1;
+  char line[256];
+  while(fgets(line, sizeof(line), file)) {
+    if(0 == strncmp(line, "Threads:", 8)) {
+      count = atoi(line + 8);
+      break;
+    }
+  }
+  fclose(file);
+  return count;
+#endif
+}
+
+struct BenchToken {
+  bool isRead;
+  size_t pipe;
+};
+
+// Shared by all pipes, collects round trip times as reads complete.
+class CBenchSink {
+ public:
+  void Post(BenchToken && token, bool ok) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(!ok) m_Failed = true;
+    if(token.isRead) {
+      m_Latencies.push_back(BenchSeconds(m_Start, BenchClock_t::now()) * 1e6);
+      ++m_Reads;
+      m_Cv.notify_all();
+    }
+  }
+
+  void Post(BenchToken && token, bool ok, std::string && str) {
+    Post(std::move(token), ok);
+  }
+
+  void Post(BenchToken && token, bool ok, CPipeBuffer && buffer) {
+    Post(std::move(token), ok);
+  }
+
+  void PostFrames(std::vector<std::string> && frames) {
+  }
+
+  void Start(void) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Start = BenchClock_t::now();
+  }
+
+  bool Wait(size_t reads) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [&]{ return m_Failed || reads <= m_Reads; });
+    return !m_Failed;
+  }
+
+  std::vector<double> m_Latencies;
+
+ private:
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  BenchClock_t::time_point m_Start;
+  size_t m_Reads = 0;
+  bool m_Failed = false;
+};
+
+typedef CPipeCore<BenchToken, CBenchSink> BenchPipe_t;
+
+// pipeCount pipes each send a message to themselves and read it back, all at
+// the same time, like many idle pipes that wake up together.
+void RoundTrips(bool bSharedMemory, size_t pipeCount) {
+  const size_t iterations = std::max((size_t)50, 20000 / pipeCount);
+  const char * name = bSharedMemory ? "shm" : "pipe";
+
+  int threadsBefore = CountThreads();
+
+  CBenchSink sink;
+  std::vector<std::unique_ptr<BenchPipe_t>> pipes;
+  for(size_t i = 0; i < pipeCount; i++) {
+    CPipeTransport * transport = bSharedMemory ? CPipeTransport::CreateSharedMemory(64 * 1024) : CPipeTransport::Create();
+    if(nullptr == transport) {
+      printf("  %-4s %4zu pipes: FAILED\n", name, pipeCount);
+      return;
+    }
+    pipes.emplace_back(new BenchPipe_t(transport, sink));
+  }
+  sink.m_Latencies.reserve(iterations * pipeCount);
+
+  std::string message(64, 'x');
+
+  bool bOk = true;
+  int threadsDuring = -1;
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    sink.Start();
+    for(size_t j = 0; j < pipeCount; j++) {
+      pipes[j]->WriteString({false, j}, message);
+      pipes[j]->ReadString({true, j});
+    }
+    bOk = sink.Wait((i + 1) * pipeCount);
+    if(0 == i) threadsDuring = CountThreads();
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  pipes.clear();
+
+  if(!bOk) {
+    printf("  %-4s %4zu pipes: FAILED\n", name, pipeCount);
+    return;
+  }
+
+  double p50 = BenchPercentile(sink.m_Latencies, 0.50);
+  double p99 = BenchPercentile(sink.m_Latencies, 0.99);
+
+  printf("  %-4s %4zu pipes: %+5d threads %12.0f msg/s  p50 %10.1f us  p99 %10.1f us\n", name, pipeCount,
+    0 <= threadsBefore && 0 <= threadsDuring ? threadsDuring - threadsBefore : 0,
+    iterations * pipeCount / seconds, p50, p99);
+}
+
+} // namespace
+
+void RunReactorBench(void) {
+  for(size_t count = 1; count <= 64; count *= 4) {
+    RoundTrips(false, count);
+  }
+  for(size_t count = 1; count <= 64; count *= 4) {
+    RoundTrips(true, count);
+  }
+}
@@ -0,0 +1,130 @@
+// Replays the requests of a pipe capture (AnonymousPipe option capture, see
+// AFXGUI_CAPTURE in main.js) through an AnonymousPipe into a
+// JsonRpc_2_0_Server set up like main.js, with handlers that return right
+// away. Reports throughput as fast as possible and how far handling lags
+// behind the recorded schedule at recorded speed.
+// Usage: node bench/replay.js <serverReadPipe.afxcap> [speed]
+
+const fs = require('fs');
+const advancedfx_gui_native = require('bindings')('advancedfx_gui_native')
+const jsonrpc = require('../modules/jsonrpc.js');
+
+const FlagOut = 1;
+const FlagRaw = 2;
+
+// Layout in addons/advancedfx_gui_native/pipe_capture.h.
+function readCapture(path) {
+  const file = fs.readFileSync(path);
+  if(file.length < 16 || file.toString('latin1', 0, 8) !== 'AFXPCAP1') throw `${path} is not a pipe capture`;
+  let records = [];
+  let offset = 16;
+  while(offset + 13 <= file.length) {
+    const flags = file.readUInt8(offset);
+    const time = file.readBigUInt64LE(offset + 1);
+    const size = file.readUInt32LE(offset + 9);
+    offset += 13;
+    if(file.length < offset + size) break;
+    if(!(flags & FlagOut)) records.push({raw: 0 != (flags & FlagRaw), time: time, data: file.subarray(offset, offset + size)});
+    offset += size;
+  }
+  return records;
+}
+
+function percentile(samples, p) {
+  samples.sort((a, b) => a - b);
+  return samples[Math.min(samples.length - 1, Math.round(p * (samples.length - 1)))];
+}
+
+async function replay(records, speed) {
+  const requestPipe = new advancedfx_gui_native.AnonymousPipe();
+  const replyPipe = new advancedfx_gui_native.AnonymousPipe();
+  replyPipe.startReading(() => {});
+
+  const server = new jsonrpc.JsonRpc_2_0_Server();
+  for(const record of records) {
+    try {
+      const method = JSON.parse(record.data.toString()).method;
+      if(typeof method === 'string' && method !== 'NegotiateEncoding') server.on(method, async () => true);
+    } catch(e) {
+    }
+  }
+  server.setConcurrency(8);
+
+  let handled = [];
+  let done;
+  const allHandled = new Promise((resolve) => { done = resolve; });
+  const requests = records.filter((record) => !record.raw);
+  const count = requests.length;
+
+  const pump = server.streamParsed(
+    (onRequest) => requestPipe.startReading(onRequest, {jsonRpc: true, queueLimit: 64, maxInFlight: 8}),
+    (id, result) => replyPipe.writeJsonRpcResponse(id, result),
+    (id, code, message) => replyPipe.writeJsonRpcError(id, code, message),
+    (encoding) => replyPipe.setEncoding(encoding),
+    (acked) => {
+      requestPipe.ackFrames(acked);
+      const now = process.hrtime.bigint();
+      for(let i = 0; i < acked; i++) handled.push(now);
+      if(count <= handled.length) done();
+    });
+
+  const first = records[0].time;
+  const start = process.hrtime.bigint();
+  let writes = [];
+  let batch = [];
+  for(const record of records) {
+    if(0 < speed) {
+      const due = start + BigInt(Math.round(Number(record.time - first) / speed));
+      const ahead = Number(due - process.hrtime.bigint()) / 1e6;
+      if(1 <= ahead) await new Promise((resolve) => setTimeout(resolve, ahead));
+    }
+    if(record.raw) {
+      if(0 < batch.length) writes.push(requestPipe.writeStrings(batch));
+      batch = [];
+      writes.push(requestPipe.writeArrayBuffer(record.data.buffer.slice(record.data.byteOffset, record.data.byteOffset + record.data.length)));
+    } else {
+      batch.push(record.data.toString());
+    }
+    if(0 < speed || 64 <= batch.length) {
+      if(0 < batch.length) writes.push(requestPipe.writeStrings(batch));
+      batch = [];
+    }
+  }
+  if(0 < batch.length) writes.push(requestPipe.writeStrings(batch));
+  await Promise.all(writes);
+  await allHandled;
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+  await requestPipe.close();
+  await replyPipe.close();
+  await pump.catch(() => {});
+
+  if(0 < speed) {
+    // Requests are handled about in order, compare the n-th handled one with
+    // the n-th due one.
+    let lags = [];
+    for(let i = 0; i < count; i++) {
+      const due = start + BigInt(Math.round(Number(requests[i].time - first) / speed));
+      lags.push(Number(handled[i] - due) / 1000);
+    }
+    console.log(`${speed}x recorded speed: ${count} requests in ${seconds.toFixed(2)} s, handled after due p50 ${percentile(lags, 0.5).toFixed(1)} us  p99 ${percentile(lags, 0.99).toFixed(1)} us`);
+  } else {
+    console.log(`as fast as possible: ${count} requests in ${seconds.toFixed(2)} s, ${Math.round(count / seconds)} requests/sec`);
+  }
+}
+
+async function main() {
+  if(process.argv.length < 3) {
+    console.log('Usage: node bench/replay.js <capture> [speed]');
+    return;
+  }
+  const records = readCapture(process.argv[2]);
+  if(0 == records.length) {
+    console.log('No requests in capture.');
+    return;
+  }
+  await replay(records, 0);
+  await replay(records, parseFloat(process.argv[3] || '1'));
+}
+
+main();
@@ -0,0 +1,237 @@
+#include "bench.h"
+#include "jsonrpc_messages.h"
+
+#include "json_rpc.h"
+#include "pipe_capture.h"
+#include "pipe_core.h"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+
+namespace {
+
+struct BenchToken {
+  bool isRead;
+};
+
+// Parses streamed frames like the addon does before they go to JS and
+// notes when each arrived.
+class CBenchSink {
+ public:
+  void Post(BenchToken && token, bool ok) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    if(!ok) m_Failed = true;
+    if(token.isRead) ++m_Reads;
+    else ++m_Writes;
+    m_Cv.notify_all();
+  }
+
+  void Post(BenchToken && token, bool ok, std::string && str) {
+    Post(std::move(token), ok);
+  }
+
+  void Post(BenchToken && token, bool ok, CPipeBuffer && buffer) {
+    Post(std::move(token), ok);
+  }
+
+  void PostFrames(std::vector<std::string> && frames) {
+    uint64_t now = StatNowNanoseconds();
+    size_t invalid = 0;
+    for(auto & frame : frames) {
+      CJsonRpcRequest request;
+      ParseJsonRpcRequest(frame.data(), frame.size(), request);
+      if(!request.valid) ++invalid;
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Arrivals.insert(m_Arrivals.end(), frames.size(), now);
+      m_Invalid += invalid;
+      m_Reads += frames.size();
+      m_Cv.notify_all();
+    }
+    m_Pipe->AckFrames(frames.size());
+  }
+
+  bool Wait(size_t reads, size_t writes) {
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cv.wait(lock, [&]{ return m_Failed || (reads <= m_Reads && writes <= m_Writes); });
+    return !m_Failed && 0 == m_Invalid;
+  }
+
+  CPipeCore<BenchToken, CBenchSink> * m_Pipe = nullptr;
+  std::vector<uint64_t> m_Arrivals; // StatNowNanoseconds per frame.
+
+ private:
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  size_t m_Reads = 0;
+  size_t m_Writes = 0;
+  size_t m_Invalid = 0;
+  bool m_Failed = false;
+};
+
+typedef CPipeCore<BenchToken, CBenchSink> BenchPipe_t;
+
+std::string TempCapturePath(const char * name) {
+#ifdef _WIN32
+  const char * dir = getenv("TEMP");
+  return std::string(dir ? dir : ".") + "\\" + name;
+#else
+  const char * dir = getenv("TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+// Stands in for a recorded session: requests of the message mix arrive every
+// intervalUs, each gets a response.
+bool SynthesizeCapture(const std::string & path, size_t count, uint64_t intervalUs) {
+  std::vector<std::string> messages = BenchJsonRpcMessageMix();
+  std::string response = "{\"jsonrpc\":\"2.0\",\"result\":true,\"id\":1}";
+
+  CPipeCaptureWriter * capture = CPipeCaptureWriter::Create(path.c_str());
+  if(nullptr == capture) return false;
+  uint64_t start = StatNowNanoseconds();
+  for(size_t i = 0; i < count; i++) {
+    const std::string & message = messages[i % messages.size()];
+    uint64_t time = start + i * intervalUs * 1000;
+    capture->Append(0, time, message.data(), message.size());
+    capture->Append(PipeCaptureFlag_Out, time + 20000, response.data(), response.size());
+  }
+  bool bOk = capture->IsOk();
+  delete capture;
+  return bOk;
+}
+
+// Times of the records that were read, relative to the first one.
+bool ReadInTimes(const std::string & path, std::vector<uint64_t> & outTimes, size_t & outBytes) {
+  CPipeCaptureReader reader;
+  if(!reader.Open(path.c_str())) return false;
+  PipeCaptureRecord record;
+  outBytes = 0;
+  while(reader.Next(record)) {
+    if(record.flags & PipeCaptureFlag_Out) continue;
+    outTimes.push_back(record.time);
+    outBytes += record.data.size();
+  }
+  uint64_t first = outTimes.empty() ? 0 : outTimes.front();
+  for(auto & time : outTimes) time -= first;
+  return !reader.IsTruncated();
+}
+
+// Streams the captured requests through a pipe into the request parser.
+void Replay(const std::string & path, double speed) {
+  std::vector<uint64_t> times;
+  size_t bytes;
+  if(!ReadInTimes(path, times, bytes) || times.empty()) {
+    printf("  replay: FAILED (no requests in capture)\n");
+    return;
+  }
+
+  CPipeTransport * transport = CPipeTransport::Create();
+  if(nullptr == transport) {
+    printf("  replay: FAILED\n");
+    return;
+  }
+  CBenchSink sink;
+  BenchPipe_t pipe(transport, sink);
+  sink.m_Pipe = &pipe;
+  sink.m_Arrivals.reserve(times.size());
+  pipe.StartReading({true}, 64, 32);
+
+  CPipeCaptureReader reader;
+  reader.Open(path.c_str());
+  uint64_t start = StatNowNanoseconds();
+  bool bOk = ReplayPipeCapture(reader, *transport, 0, speed, start) && sink.Wait(times.size(), 0);
+  double seconds = (StatNowNanoseconds() - start) / 1e9;
+  pipe.Shutdown();
+
+  if(!bOk) {
+    printf("  replay: FAILED\n");
+    return;
+  }
+
+  std::vector<double> lateness;
+  lateness.reserve(times.size());
+  for(size_t i = 0; i < times.size(); i++) {
+    uint64_t due = start + (uint64_t)(0 < speed ? times[i] / speed : 0);
+    lateness.push_back(sink.m_Arrivals[i] < due ? 0 : (sink.m_Arrivals[i] - due) / 1000.0);
+  }
+
+  if(0 < speed) {
+    printf("  %4.1fx recorded speed: %8zu requests in %6.2f s, behind schedule p50 %8.1f us  p99 %8.1f us\n",
+      speed, times.size(), seconds, BenchPercentile(lateness, 0.50), BenchPercentile(lateness, 0.99));
+  } else {
+    printf("  as fast as possible:  %8zu requests in %6.2f s %12.0f msg/s %8.1f MB/s\n",
+      times.size(), seconds, times.size() / seconds, bytes / seconds / 1e6);
+  }
+}
+
+// Loopback round trips with and without capturing both directions.
+void CaptureOverhead(const std::string & path, bool bCapture) {
+  const size_t iterations = 100000;
+  const size_t window = 64;
+
+  CPipeTransport * transport = CPipeTransport::Create();
+  if(nullptr == transport) {
+    printf("  capture overhead: FAILED\n");
+    return;
+  }
+  CBenchSink sink;
+  BenchPipe_t pipe(transport, sink);
+  if(bCapture) {
+    CPipeCaptureWriter * capture = CPipeCaptureWriter::Create(path.c_str());
+    if(nullptr == capture) {
+      printf("  capture overhead: FAILED\n");
+      return;
+    }
+    pipe.SetCapture(capture);
+  }
+
+  std::string message = BenchJsonRpcMessageMix()[0];
+
+  bool bOk = true;
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations && bOk; i++) {
+    pipe.WriteString({false}, message);
+    pipe.ReadString({true});
+    if(window <= i) bOk = sink.Wait(i + 1 - window, i + 1 - window);
+  }
+  bOk = bOk && sink.Wait(iterations, iterations);
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+  pipe.Shutdown();
+
+  if(!bOk) {
+    printf("  capture overhead: FAILED\n");
+    return;
+  }
+
+  printf("  capture %-3s: %12.0f msg/s %8.0f ns/msg\n", bCapture ? "on" : "off", iterations / seconds, seconds * 1e9 / iterations);
+}
+
+} // namespace
+
+// AFXGUI_REPLAY=<capture> replays that instead of a synthetic session, e.g.
+// serverReadPipe.afxcap recorded with AFXGUI_CAPTURE (see main.js).
+void RunReplayBench(void) {
+  std::string path;
+  const char * replayPath = getenv("AFXGUI_REPLAY");
+  if(replayPath) {
+    path = replayPath;
+  } else {
+    path = TempCapturePath("advancedfx_gui_bench_replay.afxcap");
+    if(!SynthesizeCapture(path, 20000, 50)) {
+      printf("  synthesize capture: FAILED\n");
+      return;
+    }
+  }
+
+  Replay(path, 0);
+  Replay(path, 1);
+
+  std::string overheadPath = TempCapturePath("advancedfx_gui_bench_overhead.afxcap");
+  CaptureOverhead(overheadPath, false);
+  CaptureOverhead(overheadPath, true);
+  remove(overheadPath.c_str());
+  if(!replayPath) remove(path.c_str());
+}
@@ -0,0 +1,182 @@
+#include "bench.h"
+
+#include "json_rpc.h"
+#include "json_rpc_multiplexer.h"
+#include "pipe_framing.h"
+#include "pipe_transport.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace {
+
+// Stands in for the other process: answers every request after latency, like
+// an async handler would, so responses can be written out of order.
+class CDelayedEchoServer {
+ public:
+  CDelayedEchoServer(CPipeTransport & requests, CPipeTransport & replies)
+  : m_Requests(requests), m_Replies(replies) {
+    m_Reader = std::thread(&CDelayedEchoServer::ReaderThreadHandler, this);
+    m_Writer = std::thread(&CDelayedEchoServer::WriterThreadHandler, this);
+  }
+
+  // Returns once the reader got a Quit request.
+  void Join() {
+    m_Reader.join();
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Quit = true;
+      m_Cv.notify_one();
+    }
+    m_Writer.join();
+  }
+
+ private:
+  struct Reply {
+    BenchClock_t::time_point due;
+    std::string frame;
+    bool operator<(const Reply & rhs) const { return rhs.due < due; }
+  };
+
+  CPipeTransport & m_Requests;
+  CPipeTransport & m_Replies;
+  std::thread m_Reader;
+  std::thread m_Writer;
+  std::mutex m_Lock;
+  std::condition_variable m_Cv;
+  std::priority_queue<Reply> m_Pending;
+  bool m_Quit = false;
+
+  void ReaderThreadHandler() {
+    CPipeFrameReader frameReader(m_Requests);
+    std::string inStr;
+    while(frameReader.ReadFrame(inStr)) {
+      CJsonRpcRequest request;
+      ParseJsonRpcRequest(inStr.data(), inStr.size(), request);
+      if("Quit" == request.method) break;
+      auto latency = std::chrono::microseconds("Slow" == request.method ? 500 : 0);
+      Reply reply{BenchClock_t::now() + latency, std::string()};
+      AppendJsonRpcResult(reply.frame, request.encoding, request.params, &request.id);
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_Pending.push(std::move(reply));
+      m_Cv.notify_one();
+    }
+  }
+
+  void WriterThreadHandler() {
+    std::vector<unsigned char> outBuffer;
+    std::unique_lock<std::mutex> lock(m_Lock);
+    while(true) {
+      if(m_Pending.empty()) {
+        if(m_Quit) break;
+        m_Cv.wait(lock);
+        continue;
+      }
+      if(BenchClock_t::now() < m_Pending.top().due) {
+        m_Cv.wait_until(lock, m_Pending.top().due);
+        continue;
+      }
+      outBuffer.clear();
+      while(!m_Pending.empty() && m_Pending.top().due <= BenchClock_t::now()) {
+        const std::string & frame = m_Pending.top().frame;
+        AppendPipeFrame(outBuffer, frame.data(), (PipeFrameLength_t)frame.size());
+        m_Pending.pop();
+      }
+      lock.unlock();
+      bool bOk = m_Replies.WriteBytes(outBuffer.data(), outBuffer.size());
+      lock.lock();
+      if(!bOk) break;
+    }
+  }
+};
+
+// Every 8th call is slow, the others are answered right away.
+void Calls(size_t maxInFlight) {
+  const size_t iterations = 20000;
+
+  CPipeTransport * requests = CPipeTransport::Create();
+  CPipeTransport * replies = CPipeTransport::Create();
+  CDelayedEchoServer server(*requests, *replies);
+
+  CJsonRpcMultiplexer<BenchClock_t::time_point> multiplexer(maxInFlight);
+  CPipeFrameReader frameReader(*replies);
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+
+  std::vector<std::string> frames;
+  std::vector<BenchClock_t::time_point> written;
+  std::vector<unsigned char> outBuffer;
+  std::string inStr;
+  CJsonValue params;
+  params.type = CJsonValue::Type_Array;
+  params.values.resize(1);
+  params.values[0].type = CJsonValue::Type_Number;
+
+  bool bOk = true;
+  size_t issued = 0;
+  auto start = BenchClock_t::now();
+  while(bOk && latencies.size() < iterations) {
+    // Like JS code that issues all calls up front, the multiplexer holds back
+    // what is over the limit.
+    while(issued < iterations && multiplexer.GetWaiting() < maxInFlight) {
+      uint64_t id = multiplexer.NextId();
+      CJsonValue idValue;
+      idValue.type = CJsonValue::Type_Number;
+      idValue.number = (double)id;
+      params.values[0].number = (double)issued;
+      std::string frame;
+      AppendJsonRpcRequest(frame, JsonRpcEncoding_Json, 0 == issued % 8 ? "Slow" : "Fast", params, &idValue);
+      multiplexer.Call(id, BenchClock_t::now(), std::move(frame));
+      ++issued;
+    }
+
+    frames.clear();
+    multiplexer.TakeSendable(frames, written);
+    if(!frames.empty()) {
+      outBuffer.clear();
+      for(auto & frame : frames) AppendPipeFrame(outBuffer, frame.data(), (PipeFrameLength_t)frame.size());
+      bOk = requests->WriteBytes(outBuffer.data(), outBuffer.size());
+    }
+
+    if(bOk && 0 < multiplexer.GetInFlight()) {
+      bOk = frameReader.ReadFrame(inStr);
+      CJsonRpcResponse response;
+      if(bOk) ParseJsonRpcResponse(inStr.data(), inStr.size(), response);
+      bOk = bOk && response.valid && CJsonValue::Type_Number == response.id.type
+        && multiplexer.Complete((uint64_t)response.id.number, [&latencies](BenchClock_t::time_point && callStart){
+          latencies.push_back(BenchSeconds(callStart, BenchClock_t::now()) * 1e6);
+        });
+    }
+  }
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  outBuffer.clear();
+  std::string quit;
+  AppendJsonRpcRequest(quit, JsonRpcEncoding_Json, "Quit", CJsonValue(), nullptr);
+  AppendPipeFrame(outBuffer, quit.data(), (PipeFrameLength_t)quit.size());
+  requests->WriteBytes(outBuffer.data(), outBuffer.size());
+  server.Join();
+  delete requests;
+  delete replies;
+
+  if(!bOk) {
+    printf("  calls max in flight %3zu: FAILED\n", maxInFlight);
+    return;
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50);
+  double p99 = BenchPercentile(latencies, 0.99);
+
+  printf("  calls max in flight %3zu: %12.0f calls/s  p50 %10.1f us  p99 %10.1f us\n", maxInFlight,
+    iterations / seconds, p50, p99);
+}
+
+} // namespace
+
+void RunRpcBench(void) {
+  for(size_t maxInFlight = 1; maxInFlight <= 64; maxInFlight *= 4) {
+    Calls(maxInFlight);
+  }
+}
@@ -0,0 +1,169 @@
+#include "bench.h"
+
+#include "pipe_framing.h"
+#include "pipe_transport.h"
+
+#include <functional>
+
+#ifdef _WIN32
+#include <thread>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+enum BenchTransport_e {
+  BenchTransport_Pipe,
+  BenchTransport_SharedMemory
+};
+
+const char * GetTransportName(BenchTransport_e kind) {
+  return BenchTransport_Pipe == kind ? "pipe" : "shm";
+}
+
+CPipeTransport * CreateTransport(BenchTransport_e kind) {
+  return BenchTransport_Pipe == kind ? CPipeTransport::Create() : CPipeTransport::CreateSharedMemory(4 * 1024 * 1024);
+}
+
+// Runs peer(requests, replies) in a child process on POSIX, where shared
+// memory rings are attached through their handle like the hook side would,
+// and on a thread elsewhere.
+bool RunWithPeer(BenchTransport_e kind, CPipeTransport * requests, CPipeTransport * replies,
+  const std::function<void(CPipeTransport &, CPipeTransport &)> & peer, const std::function<bool(void)> & local) {
+#ifdef _WIN32
+  std::thread thread([&]{ peer(*requests, *replies); });
+  bool bOk = local();
+  thread.join();
+  return bOk;
+#else
+  pid_t pid = fork();
+  if(pid < 0) return false;
+  if(0 == pid) {
+    if(BenchTransport_SharedMemory == kind) {
+      // Not deleted: that would close the rings for the parent too.
+      requests = CPipeTransport::AttachSharedMemory(dup((int)requests->GetNativeReadHandle()));
+      replies = CPipeTransport::AttachSharedMemory(dup((int)replies->GetNativeWriteHandle()));
+      if(nullptr == requests || nullptr == replies) _exit(1);
+    }
+    peer(*requests, *replies);
+    _exit(0);
+  }
+  bool bOk = local();
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return bOk && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+#endif
+}
+
+void Throughput(BenchTransport_e kind, size_t messageSize) {
+  size_t iterations = BenchIterations(messageSize, 256 * 1024 * 1024, 16, 200000);
+
+  CPipeTransport * requests = CreateTransport(kind);
+  CPipeTransport * replies = CreateTransport(kind);
+
+  std::vector<unsigned char> frame;
+  std::string message(messageSize, 'x');
+  AppendPipeFrame(frame, message.data(), (PipeFrameLength_t)message.size());
+
+  auto start = BenchClock_t::now();
+
+  bool bOk = requests && replies && RunWithPeer(kind, requests, replies, [iterations](CPipeTransport & in, CPipeTransport & out){
+    CPipeFrameReader frameReader(in);
+    std::string inStr;
+    for(size_t i = 0; i < iterations; i++) {
+      if(!frameReader.ReadFrame(inStr)) return;
+    }
+    unsigned char done = 1;
+    out.WriteBytes(&done, 1);
+  }, [&]{
+    for(size_t i = 0; i < iterations; i++) {
+      if(!requests->WriteBytes(frame.data(), frame.size())) return false;
+    }
+    unsigned char done = 0;
+    return replies->ReadBytes(&done, 1) && 1 == done;
+  });
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  delete replies;
+  delete requests;
+
+  if(!bOk) {
+    printf("  %-4s throughput %10s: FAILED\n", GetTransportName(kind), BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  printf("  %-4s throughput %10s: %12.0f msg/s %10.1f MB/s\n", GetTransportName(kind), BenchFormatSize(messageSize).c_str(),
+    iterations / seconds, (double)iterations * messageSize / seconds / 1e6);
+}
+
+void RoundTrip(BenchTransport_e kind, size_t messageSize) {
+  size_t iterations = BenchIterations(messageSize, 64 * 1024 * 1024, 8, 20000);
+
+  CPipeTransport * requests = CreateTransport(kind);
+  CPipeTransport * replies = CreateTransport(kind);
+
+  std::vector<unsigned char> frame;
+  std::string message(messageSize, 'x');
+  AppendPipeFrame(frame, message.data(), (PipeFrameLength_t)message.size());
+
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+
+  auto start = BenchClock_t::now();
+
+  bool bOk = requests && replies && RunWithPeer(kind, requests, replies, [iterations](CPipeTransport & in, CPipeTransport & out){
+    CPipeFrameReader frameReader(in);
+    std::string inStr;
+    std::vector<unsigned char> outBuffer;
+    for(size_t i = 0; i < iterations; i++) {
+      if(!frameReader.ReadFrame(inStr)) return;
+      outBuffer.clear();
+      AppendPipeFrame(outBuffer, inStr.data(), (PipeFrameLength_t)inStr.size());
+      if(!out.WriteBytes(outBuffer.data(), outBuffer.size())) return;
+    }
+  }, [&]{
+    CPipeFrameReader frameReader(*replies);
+    std::string inStr;
+    for(size_t i = 0; i < iterations; i++) {
+      auto requestStart = BenchClock_t::now();
+      if(!requests->WriteBytes(frame.data(), frame.size())) return false;
+      if(!frameReader.ReadFrame(inStr)) return false;
+      latencies.push_back(BenchSeconds(requestStart, BenchClock_t::now()) * 1e6);
+    }
+    return true;
+  });
+
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  delete replies;
+  delete requests;
+
+  if(!bOk) {
+    printf("  %-4s round trip %10s: FAILED\n", GetTransportName(kind), BenchFormatSize(messageSize).c_str());
+    return;
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50);
+  double p99 = BenchPercentile(latencies, 0.99);
+
+  printf("  %-4s round trip %10s: %12.0f msg/s  p50 %10.1f us  p99 %10.1f us\n", GetTransportName(kind), BenchFormatSize(messageSize).c_str(),
+    iterations / seconds, p50, p99);
+}
+
+} // namespace
+
+void RunShmBench(void) {
+  for(BenchTransport_e kind : {BenchTransport_Pipe, BenchTransport_SharedMemory}) {
+    for(size_t size = 16; size <= 1024 * 1024; size *= 16) {
+      Throughput(kind, size);
+    }
+  }
+  for(BenchTransport_e kind : {BenchTransport_Pipe, BenchTransport_SharedMemory}) {
+    for(size_t size = 16; size <= 64 * 1024; size *= 16) {
+      RoundTrip(kind, size);
+    }
+  }
+}
@@ -0,0 +1,142 @@
+#include "bench.h"
+
+#include "texture_upload_queue.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int FrameWidth = 1920;
+const int FrameHeight = 1080;
+
+// Pretends the GPU needs 300 us per copy plus 4 GB/s.
+const double GpuLatencyMicroseconds = 300;
+const double GpuBytesPerMicrosecond = 4000;
+
+// Paints arrive every frameMicroseconds, like an offscreen renderer at a fixed
+// frame rate. Every 16th paint is the full frame, the others a small region.
+void Uploads(size_t stagingCount, double frameMicroseconds) {
+  const size_t iterations = 400;
+
+  CTextureUploader uploader(CTextureDeviceCpu::Create(FrameWidth, FrameHeight, stagingCount, GpuLatencyMicroseconds, GpuBytesPerMicrosecond));
+
+  std::vector<unsigned char> frame((size_t)4 * FrameWidth * FrameHeight, 0x80);
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+  size_t waited = 0;
+  size_t failed = 0;
+
+  auto start = BenchClock_t::now();
+  for(size_t i = 0; i < iterations; i++) {
+    auto due = start + std::chrono::duration_cast<BenchClock_t::duration>(std::chrono::duration<double, std::micro>(i * frameMicroseconds));
+    std::this_thread::sleep_until(due);
+
+    TextureRect rect = 0 == i % 16
+      ? TextureRect{0, 0, FrameWidth, FrameHeight}
+      : TextureRect{(int)(i * 37 % (FrameWidth - 256)), (int)(i * 19 % (FrameHeight - 256)), 256, 256};
+
+    auto uploadStart = BenchClock_t::now();
+    switch(uploader.Upload(rect, frame.data(), (size_t)4 * FrameWidth)) {
+    case TextureUpload_Waited:
+      ++waited;
+      break;
+    case TextureUpload_Failed:
+      ++failed;
+      break;
+    default:
+      break;
+    }
+    latencies.push_back(BenchSeconds(uploadStart, BenchClock_t::now()) * 1e6);
+  }
+
+  static_cast<CTextureDeviceCpu *>(uploader.GetDevice())->GetSharedPixels();
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  if(failed) {
+    printf("  staging %zu every %6.0f us: FAILED\n", stagingCount, frameMicroseconds);
+    return;
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50);
+  double p99 = BenchPercentile(latencies, 0.99);
+
+  printf("  staging %zu every %6.0f us: %8.0f uploads/s  waited %5.1f %%  upload p50 %8.1f us  p99 %8.1f us\n", stagingCount, frameMicroseconds,
+    iterations / seconds, 100.0 * waited / iterations, p50, p99);
+}
+
+struct CountingSink {
+  std::atomic<size_t> done{0};
+  std::atomic<size_t> coalesced{0};
+  std::atomic<size_t> failed{0};
+
+  void Post(int && token, bool ok, std::string && str) {
+    if(!ok) ++failed;
+    else if(str == "coalesced") ++coalesced;
+    ++done;
+  }
+};
+
+// Full frame paints every frameMicroseconds, time spent by the painting thread
+// per paint: uploading itself vs handing the frame to CTextureUploadQueue.
+void FullFrames(int width, int height, double frameMicroseconds, bool bAsync) {
+  const size_t iterations = 120;
+
+  CTextureUploader uploader(CTextureDeviceCpu::Create(width, height, 3, GpuLatencyMicroseconds, GpuBytesPerMicrosecond));
+  CountingSink sink;
+
+  std::vector<unsigned char> frame((size_t)4 * width * height, 0x80);
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+  TextureRect rect{0, 0, width, height};
+  size_t failed = 0;
+
+  {
+    CTextureUploadQueue<int, CountingSink> queue(uploader, sink);
+
+    auto start = BenchClock_t::now();
+    for(size_t i = 0; i < iterations; i++) {
+      auto due = start + std::chrono::duration_cast<BenchClock_t::duration>(std::chrono::duration<double, std::micro>(i * frameMicroseconds));
+      std::this_thread::sleep_until(due);
+
+      auto postStart = BenchClock_t::now();
+      if(bAsync) {
+        queue.Submit((int)i, rect, frame.data(), (size_t)4 * width);
+      } else if(TextureUpload_Failed == uploader.Upload(rect, frame.data(), (size_t)4 * width)) {
+        ++failed;
+      }
+      latencies.push_back(BenchSeconds(postStart, BenchClock_t::now()) * 1e6);
+    }
+
+    queue.WaitIdle();
+  }
+  failed += sink.failed;
+
+  if(failed) {
+    printf("  %4dx%-4d every %6.0f us %-5s: FAILED\n", width, height, frameMicroseconds, bAsync ? "async" : "sync");
+    return;
+  }
+
+  double p50 = BenchPercentile(latencies, 0.50);
+  double p99 = BenchPercentile(latencies, 0.99);
+
+  printf("  %4dx%-4d every %6.0f us %-5s: paint thread p50 %8.1f us  p99 %8.1f us  coalesced %5.1f %%\n", width, height, frameMicroseconds, bAsync ? "async" : "sync",
+    p50, p99, 100.0 * sink.coalesced / iterations);
+}
+
+} // namespace
+
+void RunTextureBench(void) {
+  for(double frameMicroseconds : {0.0, 500.0, 2000.0}) {
+    for(size_t stagingCount = 1; stagingCount <= 4; stagingCount++) {
+      Uploads(stagingCount, frameMicroseconds);
+    }
+  }
+  for(auto size : {std::make_pair(2560, 1440), std::make_pair(3840, 2160)}) {
+    for(double frameMicroseconds : {0.0, 1000000.0 / 60}) {
+      FullFrames(size.first, size.second, frameMicroseconds, false);
+      FullFrames(size.first, size.second, frameMicroseconds, true);
+    }
+  }
+}
@@ -0,0 +1,207 @@
+#include "bench.h"
+
+#include "texture_trace.h"
+#include "texture_uploader.h"
+#include "stats.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// Same pretend GPU as the texture suite.
+const double GpuLatencyMicroseconds = 300;
+const double GpuBytesPerMicrosecond = 4000;
+
+std::string TempTracePath(const char * name) {
+#ifdef _WIN32
+  const char * dir = getenv("TEMP");
+  return std::string(dir ? dir : ".") + "\\" + name;
+#else
+  const char * dir = getenv("TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+void FillRect(std::vector<unsigned char> & frame, int frameWidth, const TextureRect & rect, uint32_t color, uint32_t noise) {
+  for(int y = rect.y; y < rect.y + rect.height; y++) {
+    for(int x = rect.x; x < rect.x + rect.width; x++) {
+      uint32_t pixel = color;
+      if(noise && 0 == ((x * 7 + y * 13) ^ (int)noise) % 5) pixel ^= 0x00ffffff; // Text-like speckles.
+      memcpy(&frame[((size_t)y * frameWidth + x) * 4], &pixel, 4);
+    }
+  }
+}
+
+// Paints like an overlay page: mostly transparent, a static panel, a
+// progress bar that moves every frame, a blinking caret and now and then a
+// repaint of everything. Partial dirty rects are passed cropped, like
+// main.js does.
+bool SynthesizeTrace(const std::string & path, int width, int height, size_t frames, double frameMicroseconds, std::vector<std::vector<unsigned char>> * pExpected) {
+  CTextureTraceWriter * trace = CTextureTraceWriter::Create(path.c_str(), width, height, true);
+  if(nullptr == trace) return false;
+
+  std::vector<unsigned char> frame((size_t)4 * width * height, 0);
+  TextureRect panel{64, 64, 480, 320};
+  TextureRect caret{200, 200, 2, 24};
+  TextureRect bar{64, 400, 480, 16};
+  FillRect(frame, width, panel, 0xc0202020, 1);
+
+  uint64_t start = StatNowNanoseconds();
+  std::vector<unsigned char> crop;
+  for(size_t i = 0; i < frames; i++) {
+    std::vector<TextureRect> dirty;
+    if(0 == i % 120) {
+      dirty.push_back(TextureRect{0, 0, width, height});
+    } else {
+      int progress = (int)(i * 4 % bar.width);
+      FillRect(frame, width, bar, 0xff303030, 0);
+      FillRect(frame, width, TextureRect{bar.x, bar.y, progress, bar.height}, 0xff20a0ff, 0);
+      dirty.push_back(bar);
+      if(0 == i % 30) {
+        FillRect(frame, width, caret, 0 == i % 60 ? 0xffffffff : 0xc0202020, 0);
+        dirty.push_back(caret);
+      }
+    }
+
+    for(const TextureRect & rect : dirty) {
+      if(rect.width == width && rect.height == height) {
+        // Electron hands over the whole frame, nothing to crop.
+        trace->Append(start + (uint64_t)(i * frameMicroseconds * 1000), rect, frame.data(), (size_t)4 * width, false);
+        if(pExpected) pExpected->push_back(frame);
+        continue;
+      }
+      crop.resize((size_t)4 * rect.width * rect.height);
+      for(int y = 0; y < rect.height; y++) {
+        memcpy(&crop[(size_t)y * 4 * rect.width], &frame[(((size_t)rect.y + y) * width + rect.x) * 4], (size_t)4 * rect.width);
+      }
+      trace->Append(start + (uint64_t)(i * frameMicroseconds * 1000), rect, crop.data(), (size_t)4 * rect.width, true);
+      if(pExpected) pExpected->push_back(crop);
+    }
+  }
+
+  bool bOk = trace->IsOk();
+  delete trace;
+  return bOk;
+}
+
+struct LoadedTrace {
+  int width = 0;
+  int height = 0;
+  std::vector<TextureTraceRecord> records;
+  size_t storedBytes = 0;
+};
+
+bool LoadTrace(const std::string & path, LoadedTrace & outTrace) {
+  CTextureTraceReader reader;
+  if(!reader.Open(path.c_str())) return false;
+  outTrace.width = reader.GetWidth();
+  outTrace.height = reader.GetHeight();
+  TextureTraceRecord record;
+  while(reader.Next(record)) {
+    outTrace.storedBytes += record.storedSize;
+    outTrace.records.push_back(std::move(record));
+  }
+  return !reader.IsCorrupt();
+}
+
+// Drives CTextureUploader on the CPU reference device with the recorded
+// updates, as fast as possible (speed 0) or at speed times the recorded
+// pace. The trace is loaded up front so reading it is not measured.
+void Replay(const LoadedTrace & trace, double speed, int tileSize) {
+  CTextureUploader uploader(CTextureDeviceCpu::Create(trace.width, trace.height, 3, GpuLatencyMicroseconds, GpuBytesPerMicrosecond));
+  uploader.SetDamageTracking(tileSize);
+
+  // Full frame updates need a frame to point into.
+  std::vector<unsigned char> canvas;
+  size_t canvasPitch = (size_t)4 * trace.width;
+
+  std::vector<double> latencies;
+  latencies.reserve(trace.records.size());
+  size_t failed = 0;
+  uint64_t firstTime = trace.records.front().time;
+
+  auto start = BenchClock_t::now();
+  for(const TextureTraceRecord & record : trace.records) {
+    if(0 < speed) {
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds((uint64_t)((record.time - firstTime) / speed)));
+    }
+
+    const TextureRect & rect = record.rect;
+    auto uploadStart = BenchClock_t::now();
+    TextureUploadResult_e result;
+    if(record.bFullFrame) {
+      if(canvas.empty()) canvas.resize(canvasPitch * trace.height);
+      for(int y = 0; y < rect.height; y++) {
+        memcpy(&canvas[((size_t)rect.y + y) * canvasPitch + (size_t)4 * rect.x], &record.pixels[(size_t)y * 4 * rect.width], (size_t)4 * rect.width);
+      }
+      result = uploader.Upload(rect, canvas.data(), canvasPitch);
+    } else {
+      result = uploader.Upload(rect, record.pixels.data(), (size_t)4 * rect.width, true);
+    }
+    if(TextureUpload_Failed == result) ++failed;
+    latencies.push_back(BenchSeconds(uploadStart, BenchClock_t::now()) * 1e6);
+  }
+  static_cast<CTextureDeviceCpu *>(uploader.GetDevice())->GetSharedPixels();
+  double seconds = BenchSeconds(start, BenchClock_t::now());
+
+  char name[32];
+  if(0 < speed) snprintf(name, sizeof(name), "%.1fx recorded", speed);
+  else snprintf(name, sizeof(name), "max speed");
+
+  if(failed) {
+    printf("  %-13s tiles %2d: FAILED\n", name, tileSize);
+    return;
+  }
+
+  CTextureStats & stats = uploader.GetStats();
+  size_t frames = trace.records.size();
+  printf("  %-13s tiles %2d: %8.0f frames/s  %9.0f dirty %9.0f uploaded bytes/frame  upload p50 %8.1f us  p99 %8.1f us\n",
+    name, tileSize, frames / seconds, (double)stats.dirtyBytes.Get() / frames, (double)stats.uploadedBytes.Get() / frames,
+    BenchPercentile(latencies, 0.50), BenchPercentile(latencies, 0.99));
+}
+
+} // namespace
+
+// AFXGUI_TEXTURE_TRACE=<trace> replays that instead of a synthetic one, e.g.
+// overlayTexture.afxtrace recorded with AFXGUI_CAPTURE (see main.js).
+void RunTraceBench(void) {
+  std::string path;
+  const char * tracePath = getenv("AFXGUI_TEXTURE_TRACE");
+  std::vector<std::vector<unsigned char>> expected;
+  if(tracePath) {
+    path = tracePath;
+  } else {
+    path = TempTracePath("advancedfx_gui_bench.afxtrace");
+    if(!SynthesizeTrace(path, 1920, 1080, 240, 1000000.0 / 60, &expected)) {
+      printf("  synthesize trace: FAILED\n");
+      return;
+    }
+  }
+
+  LoadedTrace trace;
+  bool bLoaded = LoadTrace(path, trace);
+  if(!tracePath) remove(path.c_str());
+  if(!bLoaded || trace.records.empty()) {
+    printf("  load trace: FAILED\n");
+    return;
+  }
+  if(!tracePath) {
+    bool bSame = expected.size() == trace.records.size();
+    for(size_t i = 0; bSame && i < expected.size(); i++) bSame = expected[i] == trace.records[i].pixels;
+    if(!bSame) {
+      printf("  trace round trip: FAILED\n");
+      return;
+    }
+  }
+
+  size_t rawBytes = 0;
+  for(const TextureTraceRecord & record : trace.records) rawBytes += record.pixels.size();
+  printf("  %zu updates %dx%d: %.0f pixel bytes/update, %.0f stored (%.1f %%)\n", trace.records.size(), trace.width, trace.height,
+    (double)rawBytes / trace.records.size(), (double)trace.storedBytes / trace.records.size(), 100.0 * trace.storedBytes / std::max((size_t)1, rawBytes));
+
+  Replay(trace, 0, 0);
+  Replay(trace, 0, 64);
+  Replay(trace, 1, 0);
+}
@@ -4,12 +4,129 @@
       "target_name": "advancedfx_gui_native",
       "cflags!": [ "-fno-exceptions" ],
       "cflags_cc!": [ "-fno-exceptions" ],
-      "sources": [ "addons/advancedfx_gui_native/addon.cc" ],
+      "sources": [
+        "addons/advancedfx_gui_native/addon.cc",
+        "addons/advancedfx_gui_native/threaded_queue.cc",
+        "addons/advancedfx_gui_native/pipe_reactor.cc",
+        "addons/advancedfx_gui_native/pipe_transport.cc",
+        "addons/advancedfx_gui_native/pipe_transport_shm.cc",
+        "addons/advancedfx_gui_native/pipe_framing.cc",
+        "addons/advancedfx_gui_native/pipe_buffer_pool.cc",
+        "addons/advancedfx_gui_native/pipe_capture.cc",
+        "addons/advancedfx_gui_native/file_writer.cc",
+        "addons/advancedfx_gui_native/json.cc",
+        "addons/advancedfx_gui_native/json_rpc.cc",
+        "addons/advancedfx_gui_native/msgpack.cc",
+        "addons/advancedfx_gui_native/texture_device_cpu.cc",
+        "addons/advancedfx_gui_native/texture_damage.cc",
+        "addons/advancedfx_gui_native/texture_convert.cc",
+        "addons/advancedfx_gui_native/texture_convert_avx2.cc",
+        "addons/advancedfx_gui_native/stats.cc",
+        "addons/advancedfx_gui_native/texture_uploader.cc",
+        "addons/advancedfx_gui_native/texture_trace.cc",
+        "addons/advancedfx_gui_native/texture_pool.cc",
+        "addons/advancedfx_gui_native/texture_frames.cc"
+      ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")"
       ],
       "defines": [ "NAPI_DISABLE_CPP_EXCEPTIONS" ],
-      "libraries": [ "D3D11.lib", "DXGI.lib" ]
+      "conditions": [
+        [ "OS=='win'", {
+          "sources": [ "addons/advancedfx_gui_native/pipe_reactor_iocp.cc", "addons/advancedfx_gui_native/pipe_transport_win32.cc", "addons/advancedfx_gui_native/pipe_transport_shm_win32.cc", "addons/advancedfx_gui_native/texture_frames_win32.cc", "addons/advancedfx_gui_native/texture_device_d3d11.cc" ],
+          "libraries": [ "D3D11.lib", "DXGI.lib" ]
+        }, {
+          "sources": [ "addons/advancedfx_gui_native/pipe_reactor_epoll.cc", "addons/advancedfx_gui_native/pipe_transport_posix.cc", "addons/advancedfx_gui_native/pipe_transport_shm_posix.cc", "addons/advancedfx_gui_native/texture_frames_posix.cc" ],
+          "libraries": [ "-lrt" ]
+        } ]
+      ]
+    },
+    {
+      "target_name": "advancedfx_gui_bench",
+      "type": "executable",
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "sources": [
+        "bench/bench_main.cc",
+        "bench/pipe_bench.cc",
+        "bench/jsonrpc_bench.cc",
+        "bench/rpc_bench.cc",
+        "bench/shm_bench.cc",
+        "bench/texture_bench.cc",
+        "bench/damage_bench.cc",
+        "bench/convert_bench.cc",
+        "bench/queue_bench.cc",
+        "bench/reactor_bench.cc",
+        "bench/backpressure_bench.cc",
+        "bench/replay_bench.cc",
+        "bench/trace_bench.cc",
+        "bench/pool_bench.cc",
+        "bench/frames_bench.cc",
+        "bench/buffers_bench.cc",
+        "addons/advancedfx_gui_native/threaded_queue.cc",
+        "addons/advancedfx_gui_native/pipe_reactor.cc",
+        "addons/advancedfx_gui_native/pipe_transport.cc",
+        "addons/advancedfx_gui_native/pipe_transport_shm.cc",
+        "addons/advancedfx_gui_native/pipe_framing.cc",
+        "addons/advancedfx_gui_native/pipe_buffer_pool.cc",
+        "addons/advancedfx_gui_native/pipe_capture.cc",
+        "addons/advancedfx_gui_native/file_writer.cc",
+        "addons/advancedfx_gui_native/json.cc",
+        "addons/advancedfx_gui_native/json_rpc.cc",
+        "addons/advancedfx_gui_native/msgpack.cc",
+        "addons/advancedfx_gui_native/texture_device_cpu.cc",
+        "addons/advancedfx_gui_native/texture_damage.cc",
+        "addons/advancedfx_gui_native/texture_convert.cc",
+        "addons/advancedfx_gui_native/texture_convert_avx2.cc",
+        "addons/advancedfx_gui_native/stats.cc",
+        "addons/advancedfx_gui_native/texture_uploader.cc",
+        "addons/advancedfx_gui_native/texture_trace.cc",
+        "addons/advancedfx_gui_native/texture_pool.cc",
+        "addons/advancedfx_gui_native/texture_frames.cc"
+      ],
+      "include_dirs": [
+        "addons/advancedfx_gui_native"
+      ],
+      "conditions": [
+        [ "OS=='win'", {
+          "sources": [ "addons/advancedfx_gui_native/pipe_reactor_iocp.cc", "addons/advancedfx_gui_native/pipe_transport_win32.cc", "addons/advancedfx_gui_native/pipe_transport_shm_win32.cc", "addons/advancedfx_gui_native/texture_frames_win32.cc" ]
+        }, {
+          "sources": [ "addons/advancedfx_gui_native/pipe_reactor_epoll.cc", "addons/advancedfx_gui_native/pipe_transport_posix.cc", "addons/advancedfx_gui_native/pipe_transport_shm_posix.cc", "addons/advancedfx_gui_native/texture_frames_posix.cc" ],
+          "libraries": [ "-lpthread", "-lrt" ]
+        } ]
+      ]
+    },
+    {
+      "target_name": "advancedfx_gui_test",
+      "type": "executable",
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "sources": [
+        "test/test_main.cc",
+        "test/frames_test.cc",
+        "test/uploader_test.cc",
+        "test/pool_test.cc",
+        "test/json_test.cc",
+        "test/msgpack_test.cc",
+        "addons/advancedfx_gui_native/texture_device_cpu.cc",
+        "addons/advancedfx_gui_native/texture_damage.cc",
+        "addons/advancedfx_gui_native/texture_convert.cc",
+        "addons/advancedfx_gui_native/texture_convert_avx2.cc",
+        "addons/advancedfx_gui_native/stats.cc",
+        "addons/advancedfx_gui_native/texture_uploader.cc",
+        "addons/advancedfx_gui_native/texture_pool.cc",
+        "addons/advancedfx_gui_native/texture_frames.cc",
+        "addons/advancedfx_gui_native/json.cc",
+        "addons/advancedfx_gui_native/msgpack.cc"
+      ],
+      "include_dirs": [
+        "addons/advancedfx_gui_native"
+      ],
+      "conditions": [
+        [ "OS!='win'", {
+          "libraries": [ "-lpthread" ]
+        } ]
+      ]
     }
   ]
-}
\ No newline at end of file
+}
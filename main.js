@@ -5,6 +5,7 @@ const { type } = require('os');
 const path = require('path')
 const advancedfx_gui_native = require('bindings')('advancedfx_gui_native')
 const jsonrpc = require('./modules/jsonrpc.js');
+const input = require('./modules/input.js');
 
 app.disableHardwareAcceleration()
 
@@ -24,6 +25,7 @@ function createWindow () {
   let overlayWindow;
   let overlayWindowDidFinishLoad = false;
   let overlayTexture;
+  let overlayTexturePromise;
 
   // and load the index.html of the app.
   mainWindow.loadFile('index.html')
@@ -31,10 +33,21 @@ function createWindow () {
   // Open the DevTools.
   // mainWindow.webContents.openDevTools()
 
-  serverWritePipe = new advancedfx_gui_native.AnonymousPipe();
-  serverReadPipe = new advancedfx_gui_native.AnonymousPipe();
-  clientWritePipe = new advancedfx_gui_native.AnonymousPipe();
-  clientReadPipe = new advancedfx_gui_native.AnonymousPipe();
+  // AFXGUI_CAPTURE=<directory> records the traffic of each pipe to
+  // <name>.afxcap there, bench/replay.js plays it back. Overlay paints go to
+  // overlayTexture.afxtrace for the "trace" bench suite.
+  // localEnd is the end used here, AfxHookSource does blocking I/O on the
+  // other one.
+  function pipeOptions(name, localEnd) {
+    let options = {name: name, localEnd: localEnd};
+    if(process.env.AFXGUI_CAPTURE) options.capture = path.join(process.env.AFXGUI_CAPTURE, name + '.afxcap');
+    return options;
+  }
+
+  serverWritePipe = new advancedfx_gui_native.AnonymousPipe(pipeOptions('serverWritePipe', 'write'));
+  serverReadPipe = new advancedfx_gui_native.AnonymousPipe(pipeOptions('serverReadPipe', 'read'));
+  clientWritePipe = new advancedfx_gui_native.AnonymousPipe(pipeOptions('clientWritePipe', 'write'));
+  clientReadPipe = new advancedfx_gui_native.AnonymousPipe(pipeOptions('clientReadPipe', 'read'));
 
   mainWindow.on('closed', function(){
     
@@ -43,6 +56,9 @@ function createWindow () {
   let serverWritePipeReadHandle = serverWritePipe.nativeReadHandleToLong();
   let serverReadPipeWriteHandle = serverReadPipe.nativeWriteHandleToLong();
 
+  // Calls into AfxHookSource, replies are matched by id so they can overlap.
+  let afxClient = new advancedfx_gui_native.JsonRpcClient(clientWritePipe, clientReadPipe, {maxInFlight: 16});
+
   let jsonRpcServer = new jsonrpc.JsonRpc_2_0_Server(async () => { return await serverReadPipe.readString(); }, async(value) => { await serverWritePipe.writeString(value); });
 
   jsonRpcServer.on('GetAfxHookSourceServerReadHandle', async () => {
@@ -51,14 +67,37 @@ function createWindow () {
   jsonRpcServer.on('GetAfxHookSourceServerWriteHandle', async () => {
     return clientReadPipe.nativeWriteHandle();
   });
+  // AFXGUI_TEXTURE_BUFFERS=2..8 makes the overlay texture that many
+  // textures, published through a frame section (see texture_frames.h)
+  // instead of the single texture AfxHookSource reads while it is written.
+  const textureBuffers = parseInt(process.env.AFXGUI_TEXTURE_BUFFERS) || 1;
+
+  // Optional, lets AfxHookSource have textures created before the drawing
+  // window appears, sizes is an Array of {width, height}.
+  jsonRpcServer.on('PrewarmSharedTextures', async (adapterLuid,sizes) => {
+    await advancedfx_gui_native.SharedTexture.prewarm(adapterLuid,sizes,{buffers: textureBuffers});
+  });
   jsonRpcServer.on('DrawingWindowCreated', async (adapterLuid,width,height) => {
-    overlayTexture = new advancedfx_gui_native.SharedTexture(adapterLuid,width,height);
-    clientWritePipe.writeString(JSON.stringify({
-      "jsonrpc": "2.0",
-      "method": "SetSharedTextureHandle",
-      "params": [overlayTexture.getSharedHandle()]
-    }));
-    clientReadPipe.readString();
+    let textureOptions = {damageTracking: true, buffers: textureBuffers, name: 'overlayTexture'};
+    if(process.env.AFXGUI_CAPTURE) {
+      textureOptions.trace = path.join(process.env.AFXGUI_CAPTURE, 'overlayTexture.afxtrace');
+      textureOptions.traceCompress = true;
+    }
+    // Created on a worker thread, paints before it is ready are dropped and
+    // repainted once it is.
+    const texturePromise = advancedfx_gui_native.SharedTexture.createAsync(adapterLuid,width,height,textureOptions);
+    overlayTexturePromise = texturePromise;
+    texturePromise.then((texture) => {
+      if(overlayTexturePromise !== texturePromise) {
+        // The drawing window is gone already.
+        texture.delete();
+        return;
+      }
+      overlayTexture = texture;
+      if(1 < textureBuffers) afxClient.call("SetSharedTextureFrames", [overlayTexture.getFrameSection()]).catch((e) => console.log(e));
+      else afxClient.call("SetSharedTextureHandle", [overlayTexture.getSharedHandle()]).catch((e) => console.log(e));
+      if(overlayWindow) overlayWindow.webContents.invalidate();
+    }).catch((e) => console.log(e));
     overlayWindow = new BrowserWindow({
       "x": 0,
       "y": 0,
@@ -83,43 +122,23 @@ function createWindow () {
     overlayWindow.webContents.on("paint", (event, dirty, image) => {
       console.log("paint");
       if(overlayTexture) {
-
-        /*clientWritePipe.writeString(JSON.stringify({
-          "jsonrpc": "2.0",
-          "method": "LockSharedTexture",
-          "params": []
-        }));*/
-
         console.log(dirty);
 
-        overlayTexture.update(dirty,image.getBitmap());
-
-        /*clientWritePipe.writeString(JSON.stringify({
-          "jsonrpc": "2.0",
-          "method": "UnlockSharedTexture",
-          "params": []
-        }));*/
+        // Only the dirty part crosses over, a full frame if everything is
+        // dirty. toBitmap, because getBitmap's pixels are only valid in this
+        // tick.
+        overlayTexture.updateAsync(dirty,image.crop(dirty).toBitmap()).catch((e) => console.log(e));
       }
     })
     overlayWindow.webContents.on("cursor-changed", (event,type) => {
-      clientWritePipe.writeString(JSON.stringify({
-        "jsonrpc": "2.0",
-        "method": "SetMouseCursor",
-        "params": [type]
-      }));
-      clientReadPipe.readString().then((result)=>{
-      })
-      
+      afxClient.call("SetMouseCursor", [type]).catch((e) => console.log(e));
     })
     overlayWindow.webContents.loadFile("overlay_index.html")
   });
   jsonRpcServer.on('DrawingWindowDestroyed', async() =>{
-    clientWritePipe.writeString(JSON.stringify({
-      "jsonrpc": "2.0",
-      "method": "SetSharedTextureHandle",
-      "params": [advancedfx_gui_native.getInvalidHandleValue()]
-    }));
-    clientReadPipe.readString();
+    if(1 < textureBuffers) afxClient.call("SetSharedTextureFrames", [null]).catch((e) => console.log(e));
+    else afxClient.call("SetSharedTextureHandle", [advancedfx_gui_native.getInvalidHandleValue()]).catch((e) => console.log(e));
+    overlayTexturePromise = null;
     if(overlayWindow) {
       overlayWindowDidFinishLoad = false;
       overlayWindow.destroy();
@@ -131,55 +150,71 @@ function createWindow () {
     }
   });
 
+  // Each call gets its own ack channel, requests run concurrently.
+  let overlayInvokeCount = 0;
   async function overlayRendererInvoke(overlayWindow,channel,...args) {    
+    const ackId = overlayWindow.webContents.id + "-" + (++overlayInvokeCount);
     return await new Promise((resolve,reject)=>{
-      ipcMain.once("advancedfxAck-"+overlayWindow.webContents.id, (event,...args)=>{
+      ipcMain.once("advancedfxAck-"+ackId, (event,...args)=>{
         resolve(args);
       });
-      overlayWindow.webContents.send(channel, overlayWindow.webContents.id, ...args);
+      overlayWindow.webContents.send(channel, ackId, ...args);
     })
   }
 
-  jsonRpcServer.on('SendMouseInputEvent', async(ev)=>{
-    if(overlayWindowDidFinishLoad) {
-      if(overlayWindow.isFocusable() && !overlayWindow.isFocused()) overlayWindow.focus();
-      overlayWindow.webContents.sendInputEvent(ev);
-      console.log("waiting: "+ev.type);
-      result = await overlayRendererInvoke(overlayWindow,"afxEndInput");
-      console.log(result);
-      return result[0];
-    }
-    return false;
-  });
-  jsonRpcServer.on('SendMouseWheelInputEvent', async(ev)=>{
+  const overlay = {
+    sendInputEvent: (ev) => overlayWindow.webContents.sendInputEvent(ev),
+    send: (channel, ...args) => overlayWindow.webContents.send(channel, ...args),
+    invoke: async (channel) => (await overlayRendererInvoke(overlayWindow, channel))[0]
+  };
+
+  function focusOverlay() {
+    if(overlayWindow.isFocusable() && !overlayWindow.isFocused()) overlayWindow.focus();
+  }
+
+  async function sendInputEvent(ev) {
     if(overlayWindowDidFinishLoad) {
-      if(overlayWindow.isFocusable() && !overlayWindow.isFocused()) overlayWindow.focus();
-      if(ev.globalX !== undefined && ev.globalY !== undefined) {
-        // work around electron bug:
-        ev.x -= ev.globalX - ev.x;
-        ev.y -= ev.globalY - ev.y;
-      }
-      overlayWindow.webContents.sendInputEvent(ev);
+      focusOverlay();
       console.log("waiting: "+ev.type);
-      result = await overlayRendererInvoke(overlayWindow,"afxEndInput");
+      result = await input.dispatchInputEvent(overlay, ev);
       console.log(result);
-      return result[0];
+      return result;
     }
     return false;
-  });
-  jsonRpcServer.on('SendKeyboardInputEvent', async(ev)=>{
+  }
+
+  jsonRpcServer.on('SendMouseInputEvent', sendInputEvent);
+  jsonRpcServer.on('SendMouseWheelInputEvent', sendInputEvent);
+  jsonRpcServer.on('SendKeyboardInputEvent', sendInputEvent);
+
+  // SendInputEvents([ev, ...]) hands up to input.MaxInputBatch events (of any
+  // of the kinds above) to the overlay at once, the result has bit i set if
+  // the overlay captured event i.
+  jsonRpcServer.on('SendInputEvents', async(events)=>{
     if(overlayWindowDidFinishLoad) {
-      if(overlayWindow.isFocusable() && !overlayWindow.isFocused()) overlayWindow.focus();
-      overlayWindow.webContents.sendInputEvent(ev);
-      console.log("waiting: "+ev.type);
-      result = await overlayRendererInvoke(overlayWindow,"afxEndInput");
-      console.log(result);
-      return result[0];
+      focusOverlay();
+      return await input.dispatchInputBatch(overlay, events);
     }
-    return false;
+    return 0;
   });
 
-  let pump = jsonRpcServer.pump();
+  // Requests are handled one at a time: overlay_preload.js tracks the
+  // capture state of a single input event, and the window and texture
+  // handlers must not interleave. The next ones wait natively, where a
+  // flood of mouse moves and wheel events collapses into the latest one
+  // instead of piling up.
+  let pump = jsonRpcServer.streamParsed(
+    (onRequest) => serverReadPipe.startReading(onRequest, {
+      jsonRpc: true,
+      queueLimit: 64,
+      queuePolicy: 'coalesce',
+      coalesce: ['SendMouseInputEvent.mouseMove', 'SendMouseWheelInputEvent.mouseWheel'],
+      maxInFlight: 1
+    }),
+    (id, result) => serverWritePipe.writeJsonRpcResponse(id, result),
+    (id, code, message) => serverWritePipe.writeJsonRpcError(id, code, message),
+    (encoding) => serverWritePipe.setEncoding(encoding),
+    (count) => serverReadPipe.ackFrames(count));
 
   const { execFile }= require('child_process');
   execFile('C:\\source\\advancedfx-v3\\build\\Release\\bin\\hlae.exe', [
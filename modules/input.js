@@ -0,0 +1,41 @@
+// Hands input events to the overlay renderer and asks it whether it
+// captured them (overlay_preload.js answers).
+//
+// overlay is {sendInputEvent(ev), send(channel, ...args), invoke(channel)},
+// where invoke sends channel with an id and resolves with the first value
+// the renderer acknowledges with.
+
+// Capture bits of a batch have to fit a 32 bit mask.
+const MaxInputBatch = 32;
+
+function fixInputEvent(ev) {
+    if(ev.type === "mouseWheel" && ev.globalX !== undefined && ev.globalY !== undefined) {
+        // work around electron bug:
+        ev.x -= ev.globalX - ev.x;
+        ev.y -= ev.globalY - ev.y;
+    }
+    return ev;
+}
+
+// One event, one round trip to the renderer. Resolves with true if the
+// overlay captured it.
+async function dispatchInputEvent(overlay, ev) {
+    overlay.sendInputEvent(fixInputEvent(ev));
+    return await overlay.invoke("afxEndInput");
+}
+
+// Several events with one round trip: after each event a one-way mark lets
+// the renderer note whether it captured that event. Resolves with a mask
+// where bit i is set if events[i] was captured.
+async function dispatchInputBatch(overlay, events) {
+    if(!Array.isArray(events) || MaxInputBatch < events.length) {
+        throw `Expected an Array of at most ${MaxInputBatch} input events`;
+    }
+    for(let i = 0; i < events.length; i++) {
+        overlay.sendInputEvent(fixInputEvent(events[i]));
+        overlay.send("afxInputMark", i);
+    }
+    return await overlay.invoke("afxEndInputBatch");
+}
+
+module.exports = { MaxInputBatch, dispatchInputEvent, dispatchInputBatch }
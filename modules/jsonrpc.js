@@ -5,13 +5,132 @@ class JsonRpc_2_0_Server {
         this.fns = {};
         this.fnRead = asyncFnReadString;
         this.fnWrite = asyncFnWriteString;
+        this.concurrency = 1;
     }
 
     on(methodName, asyncFn) {
         this.fns[methodName] = asyncFn;
     }
 
+    // How many requests streamParsed handles at once. Responses carry the
+    // request id, so with more than 1 they can complete out of order; only
+    // for handlers that do not depend on each other's order.
+    setConcurrency(concurrency) {
+        this.concurrency = Math.max(1, concurrency);
+    }
+
     async pump() {
+        while(this.active) {
+            let strRequest = await this.fnRead();
+            await this.handleMessage(strRequest);
+        }
+    }
+
+    // Like pump, but messages are pushed by fnStartReading(onMessage), which
+    // returns a promise that settles when reading ended (e.g. pipe.startReading).
+    // Messages are still handled one after another, one that fails is
+    // logged and answered with an error so the next ones are handled.
+    async stream(fnStartReading) {
+        let self = this;
+        let tail = Promise.resolve();
+
+        await fnStartReading((strRequest) => {
+            if(!self.active) return;
+            tail = tail.then(() => self.handleMessage(strRequest)).catch((e) => {
+                console.error(e);
+                return self.fnWrite(JSON.stringify({
+                    "jsonrpc": "2.0",
+                    "error": {"code": -32603, "message": String(e)},
+                    "id": null
+                })).catch((e) => console.error(e));
+            });
+        });
+
+        await tail;
+    }
+
+    // Like stream, but requests arrive already parsed and validated by the
+    // native pipe: fnStartReading(onRequest) (e.g. pipe.startReading(onRequest,
+    // {jsonRpc: true})) calls onRequest(error, method, params, id), and
+    // responses are serialized natively by fnWriteResponse(id, result) (e.g.
+    // pipe.writeJsonRpcResponse) and fnWriteError(id, code, message).
+    //
+    // If fnSetEncoding (e.g. pipe.setEncoding) is given, the client can
+    // negotiate a binary encoding for the connection with
+    // NegotiateEncoding(["msgpack", "json"]): the first supported entry is
+    // returned (still in the old encoding) and used from then on.
+    //
+    // Up to this.concurrency requests are handled at once, in arrival order.
+    //
+    // If fnAck (e.g. count => pipe.ackFrames(count)) is given, it is called
+    // for every request that was handled, for pipes that only pass on a
+    // limited number at a time (startReading option maxInFlight).
+    async streamParsed(fnStartReading, fnWriteResponse, fnWriteError, fnSetEncoding, fnAck) {
+        let self = this;
+        let running = 0;
+        let waiting = [];
+        let failure;
+        let onIdle;
+
+        const supportedEncodings = fnSetEncoding ? ["msgpack", "json"] : ["json"];
+
+        async function handleParsed(error, method, params, id) {
+            if(error !== undefined) {
+                await fnWriteError(id, error.code, error.message);
+                return;
+            }
+            if(method === "NegotiateEncoding") {
+                let wanted = Array.isArray(params) && Array.isArray(params[0]) ? params[0] : [];
+                let encoding = wanted.find(value => supportedEncodings.includes(value)) || "json";
+                await fnWriteResponse(id, encoding);
+                if(fnSetEncoding) fnSetEncoding(encoding);
+                return;
+            }
+            let fn = self.fns[method];
+            if(fn === undefined) {
+                await fnWriteError(id, -32601, "Method not found");
+                return;
+            }
+            let result;
+            try {
+                result = await fn.apply(null, params);
+            } catch(e) {
+                await fnWriteError(id, -32603, String(e));
+                return;
+            }
+            // An empty frame only tells which request it answers while one
+            // is handled at a time.
+            if(result === undefined && 1 < self.concurrency) {
+                if(id !== undefined) await fnWriteResponse(id, null);
+                return;
+            }
+            await fnWriteResponse(id, result);
+        }
+
+        function run(args) {
+            running++;
+            handleParsed.apply(null, args).catch((e) => {
+                if(failure === undefined) failure = e;
+            }).finally(() => {
+                running--;
+                if(fnAck) fnAck(1);
+                if(0 < waiting.length) run(waiting.shift());
+                else if(0 === running && onIdle) onIdle();
+            });
+        }
+
+        await fnStartReading((error, method, params, id) => {
+            if(!self.active) return;
+            let args = [error, method, params, id];
+            if(running < self.concurrency) run(args);
+            else waiting.push(args);
+        });
+
+        if(0 < running) await new Promise((resolve) => { onIdle = resolve; });
+        if(failure !== undefined) throw failure;
+    }
+
+    async handleMessage(strRequest) {
         let self = this;
 
         async function handleRequest(request) {
@@ -37,15 +156,12 @@ class JsonRpc_2_0_Server {
             return 0 < results.length ? results : undefined;
         }
 
-        while(this.active) {
-            let strRequest = await this.fnRead();
-            console.log(strRequest);
-            let request = JSON.parse(strRequest);
+        console.log(strRequest);
+        let request = JSON.parse(strRequest);
 
-            let result = Array.isArray(request) ? await handleRequests(request) : await handleRequest(request);
+        let result = Array.isArray(request) ? await handleRequests(request) : await handleRequest(request);
 
-            await this.fnWrite(result !== undefined ? JSON.stringify(result) : "");
-        }
+        await this.fnWrite(result !== undefined ? JSON.stringify(result) : "");
     }
 
     quit() {
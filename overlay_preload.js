@@ -2,16 +2,34 @@ const { contextBridge, ipcRenderer } = require('electron')
 
 let domContentLoaded = false;
 let input_captured = false;
+let input_mask = 0; // Of the batch being dispatched (afxInputMark).
 
 document.addEventListener("afxEndInput", (event)=>{
   ipcRenderer.send("advancedfxAck-"+event.detail, input_captured)
 }, {bubble: true});
 
+document.addEventListener("afxInputMark", (event)=>{
+  if(input_captured) input_mask |= 1 << event.detail;
+}, {bubble: true});
+
+document.addEventListener("afxEndInputBatch", (event)=>{
+  ipcRenderer.send("advancedfxAck-"+event.detail, input_mask >>> 0)
+  input_mask = 0;
+}, {bubble: true});
+
 
 ipcRenderer.on('afxEndInput', (event,id)=>{
   document.dispatchEvent(new CustomEvent('afxEndInput', {detail: id}))
 })
 
+ipcRenderer.on('afxInputMark', (event,index)=>{
+  document.dispatchEvent(new CustomEvent('afxInputMark', {detail: index}))
+})
+
+ipcRenderer.on('afxEndInputBatch', (event,id)=>{
+  document.dispatchEvent(new CustomEvent('afxEndInputBatch', {detail: id}))
+})
+
 document.addEventListener("keypress", (event)=>{
   input_captured = true;
 }, {capture: true})
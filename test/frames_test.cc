@@ -0,0 +1,278 @@
+#include "test.h"
+
+#include "texture_frames.h"
+#include "texture_uploader.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int FrameWidth = 256;
+const int FrameHeight = 256;
+const int TileSize = 64;
+const int TilesX = FrameWidth / TileSize;
+const int TileCount = TilesX * (FrameHeight / TileSize);
+const size_t RowPitch = (size_t)4 * FrameWidth;
+
+// Frame i (counting from 1) fills tile (i - 1) % TileCount with TileValue(i)
+// and nothing else, so the frame with sequence i is known without keeping it.
+unsigned char TileValue(uint64_t frame) {
+  return (unsigned char)(1 + (frame - 1) % 255);
+}
+
+TextureRect FrameTile(uint64_t frame) {
+  int tile = (int)((frame - 1) % TileCount);
+  return TextureRect{tile % TilesX * TileSize, tile / TilesX * TileSize, TileSize, TileSize};
+}
+
+void PaintFrame(std::vector<unsigned char> & pixels, uint64_t frame) {
+  TextureRect tile = FrameTile(frame);
+  for(int y = 0; y < tile.height; y++) {
+    memset(pixels.data() + (size_t)(tile.y + y) * RowPitch + (size_t)4 * tile.x, TileValue(frame), (size_t)4 * tile.width);
+  }
+}
+
+bool IsFrame(const unsigned char * pPixels, uint64_t sequence) {
+  for(int tile = 0; tile < TileCount; tile++) {
+    unsigned char value = 0;
+    if((uint64_t)tile < sequence) value = TileValue(sequence - (sequence - 1 - tile) % TileCount);
+    int left = tile % TilesX * TileSize;
+    int top = tile / TilesX * TileSize;
+    for(int y = 0; y < TileSize; y++) {
+      const unsigned char * pRow = pPixels + (size_t)(top + y) * RowPitch + (size_t)4 * left;
+      for(size_t x = 0; x < (size_t)4 * TileSize; x++) {
+        if(value != pRow[x]) return false;
+      }
+    }
+  }
+  return true;
+}
+
+void UploadFrame(CTextureUploader & uploader, std::vector<unsigned char> & pixels, uint64_t frame) {
+  PaintFrame(pixels, frame);
+  TEST_CHECK(TextureUpload_Failed != uploader.Upload(FrameTile(frame), pixels.data(), RowPitch));
+}
+
+// A consumer thread like the game acquires the latest frame, checks it, holds
+// it for holdMicroseconds and checks it again, while frames are uploaded
+// every frameMicroseconds. The producer must never touch a held buffer (torn)
+// and the consumer must never get an older frame than before (stale). With
+// the hold below maxWait the producer must never force a buffer.
+void Concurrent(size_t bufferCount, double frameMicroseconds, double holdMicroseconds) {
+  const uint64_t frames = 200;
+
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 3, 200, 4000, TextureFormat_Bgra8, bufferCount);
+  CTextureUploader uploader(device);
+  alignas(64) unsigned char section[TextureFrameSectionSize];
+  InitTextureFrameHeader(section, device);
+  CTextureFrameHeader * pHeader = reinterpret_cast<CTextureFrameHeader *>(section);
+  uploader.SetFrameSync(pHeader, 1000000);
+
+  std::atomic<bool> quit(false);
+  size_t reads = 0;
+  size_t torn = 0;
+  size_t stale = 0;
+
+  std::thread consumer([&]() {
+    CTextureFrameConsumer frameConsumer(pHeader);
+    uint64_t lastSequence = 0;
+    while(!quit) {
+      size_t buffer;
+      uint64_t sequence;
+      if(frameConsumer.AcquireLatest(buffer, sequence)) {
+        const unsigned char * pPixels = device->GetBufferPixels(buffer);
+        if(!IsFrame(pPixels, sequence)) ++torn;
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(holdMicroseconds));
+        if(!IsFrame(pPixels, sequence)) ++torn;
+        frameConsumer.Release();
+
+        if(sequence < lastSequence) ++stale;
+        lastSequence = sequence;
+        ++reads;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  for(uint64_t frame = 1; frame <= frames; frame++) {
+    UploadFrame(uploader, pixels, frame);
+    std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(frameMicroseconds));
+  }
+
+  quit = true;
+  consumer.join();
+
+  CTextureStats & stats = uploader.GetStats();
+  TEST_CHECK(0 < reads);
+  TEST_CHECK(0 == torn);
+  TEST_CHECK(0 == stale);
+  TEST_CHECK((int64_t)frames == stats.frames.Get());
+  TEST_CHECK(0 == stats.frameForced.Get());
+  if(2 < bufferCount) TEST_CHECK(0 == stats.frameWaits.Get());
+
+  size_t buffer;
+  uint64_t sequence;
+  CTextureFrameConsumer frameConsumer(pHeader);
+  TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(frames == sequence);
+  TEST_CHECK(IsFrame(device->GetSharedPixels(buffer), frames));
+
+  uploader.SetFrameSync(nullptr);
+}
+
+// With 2 buffers and the consumer holding the one that is not the latest the
+// producer gives up after maxWait and takes the held one. It must bring it up
+// to the latest frame first (the stale rects), so what is published is whole.
+void Forced() {
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 3, 200, 4000, TextureFormat_Bgra8, 2);
+  CTextureUploader uploader(device);
+  alignas(64) unsigned char section[TextureFrameSectionSize];
+  InitTextureFrameHeader(section, device);
+  CTextureFrameHeader * pHeader = reinterpret_cast<CTextureFrameHeader *>(section);
+  uploader.SetFrameSync(pHeader, 2000);
+  CTextureStats & stats = uploader.GetStats();
+  CTextureFrameConsumer frameConsumer(pHeader);
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  size_t buffer;
+  uint64_t sequence;
+
+  UploadFrame(uploader, pixels, 1);
+  TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(0 == buffer && 1 == sequence);
+
+  // Buffer 1 gets frame 1's tile from buffer 0, then its own.
+  UploadFrame(uploader, pixels, 2);
+  TEST_CHECK(IsFrame(device->GetSharedPixels(1), 2));
+
+  // Buffer 0 is claimed, buffer 1 the latest.
+  UploadFrame(uploader, pixels, 3);
+  TEST_CHECK(1 == stats.frameForced.Get());
+  TEST_CHECK(0 == stats.frameWaits.Get());
+  TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(0 == buffer && 3 == sequence);
+  TEST_CHECK(IsFrame(device->GetSharedPixels(0), 3));
+  frameConsumer.Release();
+
+  UploadFrame(uploader, pixels, 4);
+  TEST_CHECK(1 == stats.frameForced.Get());
+  TEST_CHECK(0 == stats.frameWaits.Get());
+  TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(1 == buffer && 4 == sequence);
+  TEST_CHECK(IsFrame(device->GetSharedPixels(1), 4));
+
+  uploader.SetFrameSync(nullptr);
+}
+
+// The published buffer misses nothing, the others collect the dirty rects
+// of what they missed, more than 16 collapse into their union.
+void StaleRects() {
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 1, 0, 0, TextureFormat_Bgra8, 3);
+  alignas(64) unsigned char section[TextureFrameSectionSize];
+  InitTextureFrameHeader(section, device);
+  CTextureFrameProducer producer(reinterpret_cast<CTextureFrameHeader *>(section));
+
+  std::vector<TextureRect> dirty;
+  for(int i = 0; i < 10; i++) dirty.push_back(TextureRect{8 * i, 4 * i, 8, 4});
+
+  size_t buffer;
+  TEST_CHECK(TextureFrameBuffer_Free == producer.BeginFrame(0, buffer));
+  TEST_CHECK(0 == buffer);
+  producer.Publish(buffer, dirty);
+  TEST_CHECK(0 == producer.GetLatest());
+  TEST_CHECK(producer.GetStale(0).empty());
+  TEST_CHECK(10 == producer.GetStale(1).size());
+  TEST_CHECK(10 == producer.GetStale(2).size());
+
+  for(TextureRect & rect : dirty) rect.y += 100;
+  TEST_CHECK(TextureFrameBuffer_Free == producer.BeginFrame(0, buffer));
+  TEST_CHECK(1 == buffer);
+  producer.Publish(buffer, dirty);
+  TEST_CHECK(1 == producer.GetLatest());
+  TEST_CHECK(producer.GetStale(1).empty());
+  TEST_CHECK(10 == producer.GetStale(0).size());
+  const std::vector<TextureRect> & collapsed = producer.GetStale(2);
+  TEST_CHECK(1 == collapsed.size());
+  if(1 == collapsed.size()) {
+    TEST_CHECK(0 == collapsed[0].x && 0 == collapsed[0].y);
+    TEST_CHECK(80 == collapsed[0].width && 140 == collapsed[0].height);
+  }
+
+  delete device;
+}
+
+// Frames of many small rects through 3 buffers, so the catch-up copies go
+// through collapsed stale lists, every published frame must be whole.
+void ManyRects() {
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 2, 0, 0, TextureFormat_Bgra8, 3);
+  CTextureUploader uploader(device);
+  alignas(64) unsigned char section[TextureFrameSectionSize];
+  InitTextureFrameHeader(section, device);
+  CTextureFrameHeader * pHeader = reinterpret_cast<CTextureFrameHeader *>(section);
+  uploader.SetFrameSync(pHeader, 0);
+  CTextureFrameConsumer frameConsumer(pHeader);
+
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  uint32_t random = 1;
+  for(int frame = 1; frame <= 30; frame++) {
+    std::vector<TextureRect> rects;
+    for(int i = 0; i < 1 + frame % 24; i++) {
+      random = random * 1664525u + 1013904223u;
+      TextureRect rect{(int)(random >> 8) % (FrameWidth - 16), (int)(random >> 20) % (FrameHeight - 16), 16, 16};
+      for(int y = 0; y < rect.height; y++) {
+        memset(pixels.data() + (size_t)(rect.y + y) * RowPitch + (size_t)4 * rect.x, (unsigned char)(frame * 7 + i), (size_t)4 * rect.width);
+      }
+      rects.push_back(rect);
+    }
+    TEST_CHECK(TextureUpload_FreeSlot == uploader.UploadParts(rects, pixels.data(), RowPitch));
+
+    size_t buffer;
+    uint64_t sequence;
+    TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+    TEST_CHECK((uint64_t)frame == sequence);
+    TEST_CHECK(0 == memcmp(device->GetSharedPixels(buffer), pixels.data(), pixels.size()));
+    frameConsumer.Release();
+  }
+
+  uploader.SetFrameSync(nullptr);
+}
+
+// Once the producer is closed the consumer claims nothing, so the textures
+// can go to someone else.
+void Closed() {
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, 1, 0, 0, TextureFormat_Bgra8, 2);
+  CTextureUploader uploader(device);
+  alignas(64) unsigned char section[TextureFrameSectionSize];
+  InitTextureFrameHeader(section, device);
+  CTextureFrameHeader * pHeader = reinterpret_cast<CTextureFrameHeader *>(section);
+  uploader.SetFrameSync(pHeader, 0);
+  CTextureFrameConsumer frameConsumer(pHeader);
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  size_t buffer;
+  uint64_t sequence;
+
+  UploadFrame(uploader, pixels, 1);
+  TEST_CHECK(frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(0 != pHeader->claimed.load());
+
+  pHeader->closed.store(1);
+  TEST_CHECK(!frameConsumer.AcquireLatest(buffer, sequence));
+  TEST_CHECK(0 == pHeader->claimed.load());
+
+  uploader.SetFrameSync(nullptr);
+}
+
+} // namespace
+
+void RunFramesTest(void) {
+  Concurrent(2, 500, 1500);
+  Concurrent(3, 500, 1500);
+  Concurrent(3, 200, 3000);
+  Forced();
+  StaleRects();
+  ManyRects();
+  Closed();
+}
@@ -0,0 +1,162 @@
+#include "test.h"
+
+#include "json.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace {
+
+bool Parse(const std::string & text, CJsonValue & outValue) {
+  std::string error;
+  bool bOk = ParseJson(text.data(), text.size(), outValue, error);
+  if(bOk != error.empty()) return false;
+  return bOk;
+}
+
+bool Rejects(const std::string & text) {
+  CJsonValue value;
+  std::string error;
+  return !ParseJson(text.data(), text.size(), value, error) && !error.empty();
+}
+
+// The string text parses to, "<failed>" if it does not parse to a string.
+std::string ParseString(const std::string & text) {
+  CJsonValue value;
+  if(!Parse(text, value) || CJsonValue::Type_String != value.type) return "<failed>";
+  return value.string;
+}
+
+double ParseNumber(const std::string & text) {
+  CJsonValue value;
+  if(!Parse(text, value) || CJsonValue::Type_Number != value.type) return NAN;
+  return value.number;
+}
+
+void Escapes() {
+  TEST_CHECK("a\"\\/\b\f\n\r\tb" == ParseString("\"a\\\"\\\\\\/\\b\\f\\n\\r\\tb\""));
+  TEST_CHECK("A\xC3\xA9\xE2\x82\xAC" == ParseString("\"\\u0041\\u00e9\\u20AC\""));
+  TEST_CHECK(std::string("a\0b", 3) == ParseString("\"a\\u0000b\""));
+  // Long enough for the vectorized scan, special characters on both sides
+  // of a 16 byte block.
+  TEST_CHECK("0123456789abcde\"0123456789abcdef\n" == ParseString("\"0123456789abcde\\\"0123456789abcdef\\n\""));
+
+  TEST_CHECK(Rejects("\"\\x\""));
+  TEST_CHECK(Rejects("\"\\u12G4\""));
+  TEST_CHECK(Rejects("\"a\nb\""));
+  TEST_CHECK(Rejects(std::string("\"a\x01", 3) + "\""));
+}
+
+void Surrogates() {
+  // U+1F600 as a pair, upper and lower case hex.
+  TEST_CHECK("\xF0\x9F\x98\x80" == ParseString("\"\\uD83D\\uDE00\""));
+  TEST_CHECK("\xF0\x9F\x98\x80" == ParseString("\"\\ud83d\\ude00\""));
+  // Lone ones have no UTF-8 encoding and become U+FFFD.
+  TEST_CHECK("\xEF\xBF\xBD" == ParseString("\"\\uD83D\""));
+  TEST_CHECK("\xEF\xBF\xBD" "x" == ParseString("\"\\uD83Dx\""));
+  TEST_CHECK("\xEF\xBF\xBD" == ParseString("\"\\uDE00\""));
+  // A high one followed by an escape that is not a low one keeps both.
+  TEST_CHECK("\xEF\xBF\xBD" "A" == ParseString("\"\\uD83D\\u0041\""));
+  TEST_CHECK("\xEF\xBF\xBD" "\n" == ParseString("\"\\uD83D\\n\""));
+  TEST_CHECK("\xEF\xBF\xBD\xEF\xBF\xBD" == ParseString("\"\\uD83D\\uD83D\""));
+  TEST_CHECK(Rejects("\"\\uD83D\\uDE0\""));
+}
+
+void Numbers() {
+  TEST_CHECK(0 == ParseNumber("0"));
+  TEST_CHECK(std::signbit(ParseNumber("-0")));
+  TEST_CHECK(-42 == ParseNumber("-42"));
+  TEST_CHECK(0.1 == ParseNumber("0.1"));
+  TEST_CHECK(-1.5e-3 == ParseNumber("-1.5e-3"));
+  TEST_CHECK(2e10 == ParseNumber("2E+10"));
+  TEST_CHECK(999999999999999.0 == ParseNumber("999999999999999"));
+  TEST_CHECK(9007199254740992.0 == ParseNumber("9007199254740993"));
+  TEST_CHECK(1e300 == ParseNumber("1" + std::string(300, '0')));
+  TEST_CHECK(std::isinf(ParseNumber("1e400")));
+
+  TEST_CHECK(Rejects("-"));
+  TEST_CHECK(Rejects("01"));
+  TEST_CHECK(Rejects("1."));
+  TEST_CHECK(Rejects(".5"));
+  TEST_CHECK(Rejects("1e"));
+  TEST_CHECK(Rejects("1e+"));
+  TEST_CHECK(Rejects("+1"));
+  TEST_CHECK(Rejects("0x10"));
+  TEST_CHECK(Rejects("NaN"));
+  TEST_CHECK(Rejects("[1,]"));
+
+  std::string text;
+  const double numbers[] = {0, -3, 0.1, 1.0 / 3, 1e-300, 123456789.125, -9007199254740991.0, 1e21};
+  for(double number : numbers) {
+    text.clear();
+    AppendJsonNumber(text, number);
+    TEST_CHECK(number == ParseNumber(text));
+  }
+  text.clear();
+  AppendJsonNumber(text, INFINITY);
+  TEST_CHECK("null" == text);
+}
+
+void Depth() {
+  const int maxDepth = 256;
+  CJsonValue value;
+  TEST_CHECK(Parse(std::string(maxDepth, '[') + std::string(maxDepth, ']'), value));
+  TEST_CHECK(Rejects(std::string(maxDepth + 1, '[') + std::string(maxDepth + 1, ']')));
+
+  std::string objects;
+  for(int i = 0; i < maxDepth; i++) objects += "{\"a\":";
+  TEST_CHECK(Parse(objects + "1" + std::string(maxDepth, '}'), value));
+  TEST_CHECK(Rejects(objects + "{}" + std::string(maxDepth, '}')));
+
+  // Far too deep must fail, not run out of stack.
+  TEST_CHECK(Rejects(std::string(1000000, '[')));
+}
+
+void Truncated() {
+  const std::string text = "{\"jsonrpc\":\"2.0\",\"method\":\"m\\u00e9\",\"params\":[1.5e3,true,false,null,{\"k\":[]}],\"id\":7}";
+  CJsonValue value;
+  TEST_CHECK(Parse(text, value));
+  for(size_t length = 0; length < text.size(); length++) {
+    TEST_CHECK(Rejects(text.substr(0, length)));
+  }
+  TEST_CHECK(Rejects("  "));
+  TEST_CHECK(Rejects("tru"));
+  TEST_CHECK(Rejects("nul"));
+  TEST_CHECK(Rejects("\"\\"));
+  TEST_CHECK(Rejects("\"\\u00"));
+  TEST_CHECK(Rejects("1 2"));
+  TEST_CHECK(Rejects("{}}"));
+  TEST_CHECK(Rejects("{1:2}"));
+  TEST_CHECK(Rejects("{\"a\" 1}"));
+}
+
+void RoundTrip() {
+  const std::string text = "{\"a\":[1,-2.5,\"x\\\"y\\u0001\",true,false,null],\"b\":{},\"\\u00e9\":[]}";
+  CJsonValue value;
+  TEST_CHECK(Parse(text, value));
+  std::string out;
+  AppendJson(out, value);
+  TEST_CHECK("{\"a\":[1,-2.5,\"x\\\"y\\u0001\",true,false,null],\"b\":{},\"\xC3\xA9\":[]}" == out);
+
+  CJsonValue again;
+  TEST_CHECK(Parse(out, again));
+  std::string outAgain;
+  AppendJson(outAgain, again);
+  TEST_CHECK(out == outAgain);
+
+  const CJsonValue * a = value.Find("a");
+  TEST_CHECK(a && CJsonValue::Type_Array == a->type && 6 == a->values.size());
+  TEST_CHECK(nullptr == value.Find("c"));
+}
+
+} // namespace
+
+void RunJsonTest(void) {
+  Escapes();
+  Surrogates();
+  Numbers();
+  Depth();
+  Truncated();
+  RoundTrip();
+}
@@ -0,0 +1,186 @@
+#include "test.h"
+
+#include "msgpack.h"
+
+#include <cmath>
+#include <string>
+
+namespace {
+
+bool Rejects(const std::string & data) {
+  CJsonValue value;
+  std::string error;
+  return !ParseMsgPack(data.data(), data.size(), value, error) && !error.empty();
+}
+
+// value as JSON text after a trip through MessagePack, "<failed>" if that
+// does not parse.
+std::string RoundTrip(const CJsonValue & value, std::string * pOutEncoded = nullptr) {
+  std::string encoded;
+  AppendMsgPack(encoded, value);
+  if(pOutEncoded) *pOutEncoded = encoded;
+  CJsonValue decoded;
+  std::string error;
+  if(!ParseMsgPack(encoded.data(), encoded.size(), decoded, error)) return "<failed>";
+  std::string text;
+  AppendJson(text, decoded);
+  return text;
+}
+
+CJsonValue Number(double number) {
+  CJsonValue value;
+  value.type = CJsonValue::Type_Number;
+  value.number = number;
+  return value;
+}
+
+// Every integer size class at its limits, and the type byte it must get.
+void Integers() {
+  const struct {
+    double number;
+    unsigned char type; // 0 for a fixint.
+    size_t size;
+  } cases[] = {
+    {0, 0, 1}, {127, 0, 1}, {128, 0xcc, 2}, {255, 0xcc, 2}, {256, 0xcd, 3}, {65535, 0xcd, 3},
+    {65536, 0xce, 5}, {4294967295.0, 0xce, 5}, {4294967296.0, 0xcf, 9}, {9007199254740991.0, 0xcf, 9},
+    {-1, 0, 1}, {-32, 0, 1}, {-33, 0xd0, 2}, {-128, 0xd0, 2}, {-129, 0xd1, 3}, {-32768, 0xd1, 3},
+    {-32769, 0xd2, 5}, {-2147483648.0, 0xd2, 5}, {-2147483649.0, 0xd3, 9}, {-9007199254740991.0, 0xd3, 9},
+  };
+  for(auto & test : cases) {
+    CJsonValue value = Number(test.number);
+    std::string encoded;
+    std::string expected;
+    AppendJson(expected, value);
+    TEST_CHECK(expected == RoundTrip(value, &encoded));
+    TEST_CHECK(test.size == encoded.size());
+    if(0 != test.type && !encoded.empty()) TEST_CHECK(test.type == (unsigned char)encoded[0]);
+  }
+}
+
+void Floats() {
+  const double numbers[] = {0.5, -0.25, 0.1, 1.0 / 3, 1e300, -1e-300, 9223372036854775808.0};
+  for(double number : numbers) {
+    std::string encoded;
+    AppendMsgPackNumber(encoded, number);
+    CJsonValue decoded;
+    std::string error;
+    TEST_CHECK(ParseMsgPack(encoded.data(), encoded.size(), decoded, error));
+    TEST_CHECK(CJsonValue::Type_Number == decoded.type && number == decoded.number);
+  }
+
+  // Exact as float32 takes 5 bytes, else float64.
+  std::string encoded;
+  AppendMsgPackNumber(encoded, 0.5);
+  TEST_CHECK(5 == encoded.size() && 0xca == (unsigned char)encoded[0]);
+  encoded.clear();
+  AppendMsgPackNumber(encoded, 0.1);
+  TEST_CHECK(9 == encoded.size() && 0xcb == (unsigned char)encoded[0]);
+}
+
+void Strings() {
+  const struct {
+    size_t length;
+    size_t headerSize;
+  } cases[] = {{0, 1}, {31, 1}, {32, 2}, {255, 2}, {256, 3}, {65535, 3}, {65536, 5}};
+  for(auto & test : cases) {
+    std::string str(test.length, 'x');
+    if(0 < test.length) str[0] = '\0';
+    std::string encoded;
+    AppendMsgPackString(encoded, str.data(), str.size());
+    TEST_CHECK(test.headerSize + test.length == encoded.size());
+    CJsonValue decoded;
+    std::string error;
+    TEST_CHECK(ParseMsgPack(encoded.data(), encoded.size(), decoded, error));
+    TEST_CHECK(CJsonValue::Type_String == decoded.type && str == decoded.string);
+  }
+
+  // bin 8 / 16 / 32 decode as strings.
+  CJsonValue decoded;
+  std::string error;
+  const std::string bins[] = {std::string("\xc4\x02hi", 4), std::string("\xc5\x00\x02hi", 5), std::string("\xc6\x00\x00\x00\x02hi", 7)};
+  for(const std::string & bin : bins) {
+    TEST_CHECK(ParseMsgPack(bin.data(), bin.size(), decoded, error));
+    TEST_CHECK(CJsonValue::Type_String == decoded.type && "hi" == decoded.string);
+  }
+}
+
+void Containers() {
+  for(size_t count : {(size_t)0, (size_t)15, (size_t)16, (size_t)65535, (size_t)65536}) {
+    CJsonValue array;
+    array.type = CJsonValue::Type_Array;
+    array.values.resize(count);
+    std::string encoded;
+    AppendMsgPack(encoded, array);
+    CJsonValue decoded;
+    std::string error;
+    TEST_CHECK(ParseMsgPack(encoded.data(), encoded.size(), decoded, error));
+    TEST_CHECK(CJsonValue::Type_Array == decoded.type && count == decoded.values.size());
+
+    CJsonValue map;
+    map.type = CJsonValue::Type_Object;
+    for(size_t i = 0; i < count && i < 20; i++) {
+      map.keys.push_back("k" + std::to_string(i));
+      map.values.push_back(Number((double)i));
+    }
+    std::string expected;
+    AppendJson(expected, map);
+    TEST_CHECK(expected == RoundTrip(map));
+  }
+
+  CJsonValue request;
+  std::string error;
+  const std::string text = "{\"jsonrpc\":\"2.0\",\"method\":\"SendInputEvents\",\"params\":[[{\"type\":\"mouseMove\",\"x\":-12,\"y\":1080.5}],true,false,null,{}],\"id\":70000}";
+  TEST_CHECK(ParseJson(text.data(), text.size(), request, error));
+  TEST_CHECK(text == RoundTrip(request));
+}
+
+void Malformed() {
+  std::string encoded;
+  CJsonValue request;
+  std::string error;
+  const std::string text = "{\"method\":\"m\",\"params\":[300,-70000,0.1,\"" + std::string(40, 's') + "\",[true,null]],\"id\":1}";
+  TEST_CHECK(ParseJson(text.data(), text.size(), request, error));
+  AppendMsgPack(encoded, request);
+
+  // Every truncation, and trailing bytes.
+  for(size_t length = 0; length < encoded.size(); length++) {
+    TEST_CHECK(Rejects(encoded.substr(0, length)));
+  }
+  TEST_CHECK(Rejects(encoded + '\xc0'));
+
+  // Length prefixes larger than what follows must fail before allocating.
+  TEST_CHECK(Rejects(std::string("\xdd\xff\xff\xff\xff\xc0", 6)));
+  TEST_CHECK(Rejects(std::string("\xdc\xff\xff\xc0\xc0", 5)));
+  TEST_CHECK(Rejects(std::string("\xdf\xff\xff\xff\xff\xa1k\xc0", 8)));
+  TEST_CHECK(Rejects(std::string("\xde\x00\x02\xa1k\xc0", 6)));
+  TEST_CHECK(Rejects(std::string("\x9f\xc0", 2)));
+  TEST_CHECK(Rejects(std::string("\xdb\xff\xff\xff\xff" "abc", 8)));
+  TEST_CHECK(Rejects(std::string("\xda\x01\x00" "abc", 6)));
+  TEST_CHECK(Rejects(std::string("\xd9\x05" "abc", 5)));
+  TEST_CHECK(Rejects(std::string("\xc6\x00\x00\x00\x05" "abc", 8)));
+  TEST_CHECK(Rejects(std::string("\xc4\x05" "abc", 5)));
+  TEST_CHECK(Rejects(std::string("\xa5" "abc", 4)));
+
+  // Unsupported types and keys that are not strings.
+  TEST_CHECK(Rejects(std::string("\xc1", 1)));
+  TEST_CHECK(Rejects(std::string("\xd4\x01\x02", 3)));
+  TEST_CHECK(Rejects(std::string("\x81\x01\xc0", 3)));
+
+  // At most 256 levels of nesting, far more must fail without running out
+  // of stack.
+  CJsonValue value;
+  std::string nested(256, '\x91');
+  TEST_CHECK(ParseMsgPack((nested + '\xc0').data(), nested.size() + 1, value, error));
+  TEST_CHECK(Rejects(nested + "\x91\xc0"));
+  TEST_CHECK(Rejects(std::string(1000000, '\x91') + '\xc0'));
+}
+
+} // namespace
+
+void RunMsgPackTest(void) {
+  Integers();
+  Floats();
+  Strings();
+  Containers();
+  Malformed();
+}
@@ -0,0 +1,37 @@
+#include "test.h"
+
+#include "texture_pool.h"
+
+namespace {
+
+// Deleted devices go back to the pool for the next Acquire of the same kind,
+// dropped ones are released.
+void RecycleAndDrop() {
+  CTexturePool pool([](int32_t adapterLuidLo, int32_t adapterLuidHi, std::string & outError) { return CreateTextureAdapterCpu(); });
+  std::string error;
+
+  CTextureDevice * device = pool.Acquire(0, 0, 64, 64, 2, 2, TextureFormat_Bgra8, error);
+  TEST_CHECK(nullptr != device);
+  delete device;
+  TEST_CHECK(1 == pool.GetIdleCount());
+
+  device = pool.Acquire(0, 0, 64, 64, 2, 2, TextureFormat_Bgra8, error);
+  TEST_CHECK(nullptr != device);
+  TEST_CHECK(1 == pool.GetStats().hits.Get());
+  TEST_CHECK(0 == pool.GetIdleCount());
+
+  pool.Drop(device);
+  TEST_CHECK(0 == pool.GetIdleCount());
+  TEST_CHECK(1 == pool.GetStats().dropped.Get());
+
+  device = pool.Acquire(0, 0, 64, 64, 2, 2, TextureFormat_Bgra8, error);
+  TEST_CHECK(nullptr != device);
+  TEST_CHECK(2 == pool.GetStats().misses.Get());
+  delete device;
+}
+
+} // namespace
+
+void RunPoolTest(void) {
+  RecycleAndDrop();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdio>
+
+struct TestSuite {
+  const char * name;
+  void (*run)(void);
+};
+
+// Records a failed check, the test program then exits non-zero.
+void TestFail(const char * file, int line, const char * expr);
+
+#define TEST_CHECK(expr) do { if(!(expr)) TestFail(__FILE__, __LINE__, #expr); } while(0)
+
+void RunFramesTest(void);
+void RunUploaderTest(void);
+void RunPoolTest(void);
+void RunJsonTest(void);
+void RunMsgPackTest(void);
@@ -0,0 +1,47 @@
+// Self-checking tests for the platform neutral parts of
+// advancedfx_gui_native, exits non-zero if a check failed.
+// Usage: advancedfx_gui_test [suite ...]
+
+#include "test.h"
+
+#include <cstring>
+
+static const TestSuite g_Suites[] = {
+  {"frames", &RunFramesTest},
+  {"uploader", &RunUploaderTest},
+  {"pool", &RunPoolTest},
+  {"json", &RunJsonTest},
+  {"msgpack", &RunMsgPackTest},
+};
+
+static size_t g_Failures = 0;
+
+void TestFail(const char * file, int line, const char * expr) {
+  fprintf(stderr, "  %s:%d: check failed: %s\n", file, line, expr);
+  ++g_Failures;
+}
+
+int main(int argc, char ** argv) {
+  bool bRanAny = false;
+  for(const TestSuite & suite : g_Suites) {
+    bool bSelected = argc < 2;
+    for(int i = 1; i < argc; i++) {
+      if(0 == strcmp(argv[i], suite.name)) bSelected = true;
+    }
+    if(!bSelected) continue;
+
+    size_t failures = g_Failures;
+    suite.run();
+    printf("%s %s\n", failures == g_Failures ? "PASS" : "FAIL", suite.name);
+    bRanAny = true;
+  }
+
+  if(!bRanAny) {
+    fprintf(stderr, "Unknown suite. Available:");
+    for(const TestSuite & suite : g_Suites) fprintf(stderr, " %s", suite.name);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  return 0 == g_Failures ? 0 : 1;
+}
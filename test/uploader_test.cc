@@ -0,0 +1,210 @@
+#include "test.h"
+
+#include "texture_uploader.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int FrameWidth = 128;
+const int FrameHeight = 64;
+const size_t RowPitch = (size_t)4 * FrameWidth;
+const size_t StagingCount = 3;
+
+// Pretends each copy takes 100 ms, so a slot stays busy until it is waited
+// for or the test sleeps it off.
+const double LatencyMicroseconds = 100000;
+
+struct MapCall {
+  size_t slot;
+  bool bWait;
+  TextureMapResult_e result;
+};
+
+// Passes everything to a CTextureDeviceCpu with latency, but lets the test
+// keep slots busy on top (as if the GPU finished copies out of order) and
+// records the MapStaging calls.
+class CTestDevice : public CTextureDevice {
+ public:
+  explicit CTestDevice(CTextureDeviceCpu * device)
+  : m_Device(device), m_Held(device->GetStagingCount(), false) {
+  }
+
+  ~CTestDevice() override {
+    delete m_Device;
+  }
+
+  int GetWidth() override { return m_Device->GetWidth(); }
+  int GetHeight() override { return m_Device->GetHeight(); }
+  size_t GetStagingCount() override { return m_Device->GetStagingCount(); }
+  size_t GetBufferCount() override { return m_Device->GetBufferCount(); }
+  TexturePixelFormat_e GetFormat() override { return m_Device->GetFormat(); }
+  int64_t GetSharedHandle(size_t buffer) override { return m_Device->GetSharedHandle(buffer); }
+
+  TextureMapResult_e MapStaging(size_t slot, bool bWait, TextureMapping & outMapping) override {
+    // Waiting on a held slot means waiting for the GPU to be done with it.
+    TextureMapResult_e result = m_Held[slot] && !bWait ? TextureMap_Busy : m_Device->MapStaging(slot, bWait, outMapping);
+    if(bWait) m_Held[slot] = false;
+    m_Calls.push_back(MapCall{slot, bWait, result});
+    return result;
+  }
+
+  void UnmapStaging(size_t slot) override { m_Device->UnmapStaging(slot); }
+  void CopyToShared(size_t slot, const TextureRect & rect, size_t buffer) override { m_Device->CopyToShared(slot, rect, buffer); }
+  void CopyBetweenShared(size_t srcBuffer, size_t dstBuffer, const TextureRect & rect) override { m_Device->CopyBetweenShared(srcBuffer, dstBuffer, rect); }
+  void Flush() override { m_Device->Flush(); }
+  void Finish() override { m_Device->Finish(); }
+
+  CTextureDeviceCpu * m_Device;
+  std::vector<bool> m_Held;
+  std::vector<MapCall> m_Calls;
+};
+
+void Paint(std::vector<unsigned char> & pixels, const TextureRect & rect, unsigned char value) {
+  for(int y = 0; y < rect.height; y++) {
+    memset(pixels.data() + (size_t)(rect.y + y) * RowPitch + (size_t)4 * rect.x, value, (size_t)4 * rect.width);
+  }
+}
+
+void WaitCopies() {
+  std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(2 * LatencyMicroseconds)));
+}
+
+// Without waiting the uploader must try the slots in ring order from the one
+// after the last used, and take the first that is not busy.
+void RingOrder() {
+  CTestDevice * device = new CTestDevice(CTextureDeviceCpu::Create(FrameWidth, FrameHeight, StagingCount, LatencyMicroseconds));
+  CTextureUploader uploader(device);
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  TextureRect full{0, 0, FrameWidth, FrameHeight};
+
+  // Slot 0.
+  Paint(pixels, TextureRect{0, 0, 16, 16}, 1);
+  TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(full, pixels.data(), RowPitch));
+  WaitCopies();
+
+  // Slot 1 is held, 2 is next.
+  device->m_Held[1] = true;
+  device->m_Calls.clear();
+  Paint(pixels, TextureRect{16, 0, 16, 16}, 2);
+  TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(full, pixels.data(), RowPitch));
+  TEST_CHECK(2 == device->m_Calls.size());
+  if(2 == device->m_Calls.size()) {
+    TEST_CHECK(1 == device->m_Calls[0].slot && !device->m_Calls[0].bWait && TextureMap_Busy == device->m_Calls[0].result);
+    TEST_CHECK(2 == device->m_Calls[1].slot && !device->m_Calls[1].bWait && TextureMap_Ok == device->m_Calls[1].result);
+  }
+  WaitCopies();
+
+  // The ring wraps around to 0, skipping nothing.
+  device->m_Calls.clear();
+  Paint(pixels, TextureRect{32, 0, 16, 16}, 3);
+  TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(full, pixels.data(), RowPitch));
+  TEST_CHECK(1 == device->m_Calls.size());
+  if(1 == device->m_Calls.size()) TEST_CHECK(0 == device->m_Calls[0].slot && TextureMap_Ok == device->m_Calls[0].result);
+  WaitCopies();
+
+  // Slot 1 is still held and 0 too, so 1 is skipped again.
+  device->m_Held[0] = true;
+  device->m_Calls.clear();
+  Paint(pixels, TextureRect{48, 0, 16, 16}, 4);
+  TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(full, pixels.data(), RowPitch));
+  TEST_CHECK(2 == device->m_Calls.size());
+  if(2 == device->m_Calls.size()) {
+    TEST_CHECK(1 == device->m_Calls[0].slot && TextureMap_Busy == device->m_Calls[0].result);
+    TEST_CHECK(2 == device->m_Calls[1].slot && TextureMap_Ok == device->m_Calls[1].result);
+  }
+  WaitCopies();
+
+  // Only 2 is free, from 0 on.
+  device->m_Calls.clear();
+  Paint(pixels, TextureRect{64, 0, 16, 16}, 5);
+  TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(full, pixels.data(), RowPitch));
+  TEST_CHECK(3 == device->m_Calls.size());
+  if(3 == device->m_Calls.size()) {
+    TEST_CHECK(0 == device->m_Calls[0].slot && TextureMap_Busy == device->m_Calls[0].result);
+    TEST_CHECK(1 == device->m_Calls[1].slot && TextureMap_Busy == device->m_Calls[1].result);
+    TEST_CHECK(2 == device->m_Calls[2].slot && TextureMap_Ok == device->m_Calls[2].result);
+  }
+  TEST_CHECK(0 == uploader.GetStats().waited.Get());
+  WaitCopies();
+
+  TEST_CHECK(0 == memcmp(device->m_Device->GetSharedPixels(), pixels.data(), pixels.size()));
+}
+
+// TextureUpload_Waited only when no slot is free: with the copies still
+// pending after stagingCount uploads, the next one waits for the oldest.
+void Waited() {
+  CTestDevice * device = new CTestDevice(CTextureDeviceCpu::Create(FrameWidth, FrameHeight, StagingCount, LatencyMicroseconds));
+  CTextureUploader uploader(device);
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+
+  for(size_t i = 0; i < StagingCount; i++) {
+    TextureRect rect{16 * (int)i, 16, 16, 16};
+    Paint(pixels, rect, (unsigned char)(10 + i));
+    TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(rect, pixels.data(), RowPitch));
+  }
+
+  device->m_Calls.clear();
+  TextureRect rect{0, 32, FrameWidth, 16};
+  Paint(pixels, rect, 20);
+  TEST_CHECK(TextureUpload_Waited == uploader.Upload(rect, pixels.data(), RowPitch));
+  TEST_CHECK(StagingCount + 1 == device->m_Calls.size());
+  if(StagingCount + 1 == device->m_Calls.size()) {
+    for(size_t i = 0; i < StagingCount; i++) {
+      TEST_CHECK(i == device->m_Calls[i].slot && !device->m_Calls[i].bWait && TextureMap_Busy == device->m_Calls[i].result);
+    }
+    TEST_CHECK(0 == device->m_Calls[StagingCount].slot && device->m_Calls[StagingCount].bWait);
+    TEST_CHECK(TextureMap_Ok == device->m_Calls[StagingCount].result);
+  }
+  TEST_CHECK(1 == uploader.GetStats().waited.Get());
+
+  // Once the copies are done every slot is free again.
+  WaitCopies();
+  for(size_t i = 0; i < StagingCount; i++) {
+    TextureRect rect{16 * (int)i, 48, 16, 16};
+    Paint(pixels, rect, (unsigned char)(30 + i));
+    TEST_CHECK(TextureUpload_FreeSlot == uploader.Upload(rect, pixels.data(), RowPitch));
+  }
+  TEST_CHECK(1 == uploader.GetStats().waited.Get());
+
+  TEST_CHECK(0 == memcmp(device->m_Device->GetSharedPixels(), pixels.data(), pixels.size()));
+}
+
+// Sub-images and damage tracking through the ring end up as the source.
+void Pixels() {
+  CTextureDeviceCpu * device = CTextureDeviceCpu::Create(FrameWidth, FrameHeight, StagingCount, 500, 4000);
+  CTextureUploader uploader(device);
+  uploader.SetDamageTracking(16);
+  std::vector<unsigned char> pixels(RowPitch * FrameHeight, 0);
+  std::vector<unsigned char> subImage;
+
+  uint32_t random = 7;
+  for(int i = 0; i < 40; i++) {
+    random = random * 1664525u + 1013904223u;
+    TextureRect rect{(int)(random >> 8) % (FrameWidth - 24), (int)(random >> 20) % (FrameHeight - 24), 24, 24};
+    Paint(pixels, rect, (unsigned char)(random >> 24));
+    TextureUploadResult_e result;
+    if(i % 2) {
+      subImage.resize((size_t)4 * rect.width * rect.height);
+      for(int y = 0; y < rect.height; y++) {
+        memcpy(subImage.data() + (size_t)y * 4 * rect.width, pixels.data() + (size_t)(rect.y + y) * RowPitch + (size_t)4 * rect.x, (size_t)4 * rect.width);
+      }
+      result = uploader.Upload(rect, subImage.data(), (size_t)4 * rect.width, true);
+    } else {
+      result = uploader.Upload(rect, pixels.data(), RowPitch);
+    }
+    TEST_CHECK(TextureUpload_Failed != result);
+  }
+
+  TEST_CHECK(0 == memcmp(device->GetSharedPixels(), pixels.data(), pixels.size()));
+}
+
+} // namespace
+
+void RunUploaderTest(void) {
+  RingOrder();
+  Waited();
+  Pixels();
+}